@@ -0,0 +1,274 @@
+/**
+ * @file: access-log.c
+ *
+ * ℹ️ Asynchronous access log: workers hand fixed-size records to a background thread that formats
+ *    them and writes them out, so logging never blocks or slows down request handling.
+ *
+ * 1. Every worker has its own single-producer single-consumer ring. A record is filled in place in the
+ *      ring's next free slot and published with one release store: no lock, no system call, no formatting.
+ * 2. If the ring is full the record is dropped and counted; a worker never waits for the writer.
+ * 3. The writer thread drains all rings, formats the records as text (the request line in Common Log Format,
+ *      followed by the time the request took) into one large buffer and writes it with a single write()
+ *      once the buffer is nearly full or the rings are empty. Drops are reported in the log itself.
+ * 4. When all rings are empty the writer sleeps for ACCESS_LOG_INTERVAL_MS; workers never wake it.
+ */
+#include "access-log.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+/**
+ * @brief Writer-side state while formatting
+ * @param second, date : Cached wall-clock second and its formatted date, since many records share one
+ */
+typedef struct
+{
+    char buf[ACCESS_LOG_BUFFER_SIZE];
+    size_t len;
+    int64_t second;
+    char date[32];
+} LogWriter;
+
+/// @brief Writes the whole buffer out, retrying short writes
+static void flush_writer(AccessLog *log, LogWriter *writer)
+{
+    size_t done = 0;
+    while (done < writer->len)
+    {
+        ssize_t written = write(log->fd, writer->buf + done, writer->len - done);
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("access log: write");
+            break;
+        }
+        done += written;
+    }
+    writer->len = 0;
+}
+
+/// @brief Appends 'text' with quotes, backslashes and control characters escaped as \xHH
+static size_t append_escaped(char *out, const char *text)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t len = 0;
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++)
+    {
+        if (*p == '"' || *p == '\\' || *p < 0x20 || *p >= 0x7f)
+        {
+            out[len++] = '\\';
+            out[len++] = 'x';
+            out[len++] = hex[*p >> 4];
+            out[len++] = hex[*p & 15];
+        }
+        else
+        {
+            out[len++] = *p;
+        }
+    }
+    return len;
+}
+
+/**
+ * @brief Formats one record at the end of the writer's buffer
+ * @details [LOGIC][FORMAT_RECORD]
+ * 1. Turn the monotonic time into wall-clock time; the date is only formatted again when the second changes.
+ * 2. Requests: client address, date, request line, status, bytes and duration in seconds
+ *      (Common Log Format plus one field). Connection events: date, client, descriptor and what happened.
+ */
+static void format_record(AccessLog *log, LogWriter *writer, const AccessLogRecord *record)
+{
+    // {ref}{LOGIC}{FORMAT_RECORD}{1}
+    int64_t wall_ns = (int64_t)record->time_ns + log->clock_offset_ns;
+    if (wall_ns / 1000000000LL != writer->second)
+    {
+        writer->second = wall_ns / 1000000000LL;
+        time_t seconds = writer->second;
+        struct tm tm;
+        gmtime_r(&seconds, &tm);
+        strftime(writer->date, sizeof(writer->date), "%d/%b/%Y:%H:%M:%S +0000", &tm);
+    }
+    char address[INET_ADDRSTRLEN] = "-";
+    if (record->peer_addr)
+    {
+        inet_ntop(AF_INET, &record->peer_addr, address, sizeof(address));
+    }
+
+    // {ref}{LOGIC}{FORMAT_RECORD}{2}
+    char *out = writer->buf + writer->len;
+    if (record->kind == ACCESS_LOG_REQUEST)
+    {
+        char line[4 * (ACCESS_LOG_METHOD_SIZE + ACCESS_LOG_URI_SIZE + ACCESS_LOG_VERSION_SIZE) + 3];
+        size_t line_len = append_escaped(line, record->method[0] ? record->method : "-");
+        line[line_len++] = ' ';
+        line_len += append_escaped(line + line_len, record->uri[0] ? record->uri : "-");
+        line[line_len++] = ' ';
+        line_len += append_escaped(line + line_len, record->version[0] ? record->version : "-");
+        writer->len += sprintf(out, "%s - - [%s] \"%.*s\" %u %llu %.6f\n", address, writer->date, (int)line_len,
+                               line, record->status, (unsigned long long)record->bytes, record->duration_ns / 1e9);
+    }
+    else
+    {
+        writer->len += sprintf(out, "[%s] %s:%u fd %d %s%s\n", writer->date, address, ntohs(record->peer_port),
+                               record->fd, record->kind == ACCESS_LOG_ACCEPT ? "accepted" : "closed: ",
+                               record->kind == ACCESS_LOG_ACCEPT ? "" : record->reason);
+    }
+}
+
+/**
+ * @brief Writer thread: drains the rings until stopped
+ * @details [LOGIC][ACCESS_LOG_WRITER]
+ * 1. For each ring, read the published tail once (acquire), format every record up to it and then hand the
+ *      slots back with one release store of head.
+ * 2. Write the buffer out before it could overflow, and report new drops of each ring.
+ * 3. When nothing was pending, write out what is buffered and sleep.
+ */
+static void *writer_main(void *arg)
+{
+    AccessLog *log = arg;
+    LogWriter *writer = calloc(1, sizeof(LogWriter));
+    const size_t record_max = 4 * (ACCESS_LOG_METHOD_SIZE + ACCESS_LOG_URI_SIZE + ACCESS_LOG_VERSION_SIZE) + 256;
+    if (!writer)
+    {
+        perror("access log");
+        return NULL;
+    }
+    writer->second = -1;
+
+    while (1)
+    {
+        int running = __atomic_load_n(&log->running, __ATOMIC_ACQUIRE);
+        size_t formatted = 0;
+        for (int i = 0; i < log->ring_count; i++)
+        {
+            AccessLogRing *ring = &log->rings[i];
+            // {ref}{LOGIC}{ACCESS_LOG_WRITER}{1}
+            uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+            uint64_t head = ring->head;
+            while (head != tail)
+            {
+                // {ref}{LOGIC}{ACCESS_LOG_WRITER}{2}
+                if (writer->len + record_max > sizeof(writer->buf))
+                {
+                    flush_writer(log, writer);
+                }
+                format_record(log, writer, &ring->records[head & (ACCESS_LOG_RING_SIZE - 1)]);
+                head++;
+                formatted++;
+            }
+            __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+
+            uint64_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+            if (dropped != ring->dropped_reported)
+            {
+                if (writer->len + record_max > sizeof(writer->buf))
+                {
+                    flush_writer(log, writer);
+                }
+                writer->len += sprintf(writer->buf + writer->len, "access log: worker %d dropped %llu records\n", i,
+                                       (unsigned long long)(dropped - ring->dropped_reported));
+                ring->dropped_reported = dropped;
+            }
+        }
+
+        // {ref}{LOGIC}{ACCESS_LOG_WRITER}{3}
+        if (formatted == 0)
+        {
+            flush_writer(log, writer);
+            if (!running)
+            {
+                break;
+            }
+            struct timespec interval = {0, ACCESS_LOG_INTERVAL_MS * 1000000L};
+            nanosleep(&interval, NULL);
+        }
+    }
+    free(writer);
+    return NULL;
+}
+
+/**
+ * @brief Set up one ring per worker and start the writer thread
+ * @param rings : Number of workers
+ * @param fd : Descriptor the log is written to
+ * @return 0 on success, -1 on failure.
+ */
+int access_log_init(AccessLog *log, int rings, int fd)
+{
+    memset(log, 0, sizeof(*log));
+    log->rings = aligned_alloc(ACCESS_LOG_CACHE_LINE, rings * sizeof(AccessLogRing));
+    if (!log->rings)
+    {
+        return -1;
+    }
+    memset(log->rings, 0, rings * sizeof(AccessLogRing));
+    log->ring_count = rings;
+    log->fd = fd;
+
+    struct timespec realtime, monotonic;
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    clock_gettime(CLOCK_MONOTONIC, &monotonic);
+    log->clock_offset_ns = (realtime.tv_sec - monotonic.tv_sec) * 1000000000LL + (realtime.tv_nsec - monotonic.tv_nsec);
+
+    log->running = 1;
+    int err = pthread_create(&log->thread, NULL, writer_main, log);
+    if (err)
+    {
+        free(log->rings);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Stop the writer once it has written every published record, and free the rings
+void access_log_destroy(AccessLog *log)
+{
+    __atomic_store_n(&log->running, 0, __ATOMIC_RELEASE);
+    pthread_join(log->thread, NULL);
+    free(log->rings);
+    log->rings = NULL;
+}
+
+/**
+ * @brief Reserve the next slot of a worker's ring, to be filled in place and published with access_log_commit()
+ * @details The ring only looks full against the cached head; the writer's head is read again only then.
+ * @return The slot, or NULL if the ring is full: the record is dropped and counted.
+ */
+AccessLogRecord *access_log_reserve(AccessLogRing *ring)
+{
+    if (ring->tail - ring->head_cache == ACCESS_LOG_RING_SIZE)
+    {
+        ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (ring->tail - ring->head_cache == ACCESS_LOG_RING_SIZE)
+        {
+            __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+    }
+    return &ring->records[ring->tail & (ACCESS_LOG_RING_SIZE - 1)];
+}
+
+/// @brief Publish the slot returned by access_log_reserve() to the writer
+void access_log_commit(AccessLogRing *ring)
+{
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+/// @brief Copies a string into a record field, truncating it to fit; NULL gives an empty field
+void access_log_copy(char *dst, size_t size, const char *src)
+{
+    size_t len = src ? strnlen(src, size - 1) : 0;
+    if (len)
+    {
+        memcpy(dst, src, len);
+    }
+    dst[len] = '\0';
+}
@@ -0,0 +1,93 @@
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define ACCESS_LOG_RING_SIZE 4096          ///< Records per worker ring (a power of two).
+#define ACCESS_LOG_BUFFER_SIZE (256 * 1024) ///< Formatted text collected before one write().
+#define ACCESS_LOG_INTERVAL_MS 10          ///< How long the writer sleeps when every ring is empty.
+#define ACCESS_LOG_CACHE_LINE 64
+#define ACCESS_LOG_METHOD_SIZE 12
+#define ACCESS_LOG_VERSION_SIZE 12
+#define ACCESS_LOG_URI_SIZE 176            ///< Longer request targets are truncated in the log.
+
+/**
+ * @brief Kinds of access log records
+ */
+typedef enum
+{
+    ACCESS_LOG_REQUEST, ///< A request was answered
+    ACCESS_LOG_ACCEPT,  ///< A connection was accepted
+    ACCESS_LOG_CLOSE    ///< A connection was closed; 'reason' says why
+} AccessLogKind;
+
+/**
+ * @brief One fixed-size log record, filled in place in the ring by a worker and formatted by the writer thread
+ * @param time_ns : CLOCK_MONOTONIC time of the event; the writer turns it into wall-clock time
+ * @param duration_ns : Time the request took to handle
+ * @param bytes : Bytes of response queued
+ * @param peer_addr, peer_port : Client address and port, in network byte order
+ * @param reason : Static string explaining a close
+ * @param method, uri, version : The request line, NUL-terminated and truncated to fit
+ */
+typedef struct
+{
+    uint64_t time_ns;
+    uint64_t duration_ns;
+    uint64_t bytes;
+    uint32_t peer_addr;
+    uint16_t peer_port;
+    uint16_t status;
+    int fd;
+    AccessLogKind kind;
+    const char *reason;
+    char method[ACCESS_LOG_METHOD_SIZE];
+    char version[ACCESS_LOG_VERSION_SIZE];
+    char uri[ACCESS_LOG_URI_SIZE];
+} AccessLogRecord;
+
+/**
+ * @brief Lock-free single-producer single-consumer ring of records between one worker and the writer
+ * @attention The producer owns tail, head_cache and dropped; the consumer owns head. Each side's fields sit
+ *      on cache lines of their own, so the two only exchange a line when one catches up with the other.
+ * @param tail : Next slot the worker fills; published with a release store
+ * @param head_cache : The worker's last view of head, re-read only when the ring looks full
+ * @param dropped : Records the worker could not log because the ring was full
+ * @param head : Next slot the writer formats; published with a release store once formatted
+ */
+typedef struct
+{
+    uint64_t tail __attribute__((aligned(ACCESS_LOG_CACHE_LINE)));
+    uint64_t head_cache;
+    uint64_t dropped;
+    uint64_t head __attribute__((aligned(ACCESS_LOG_CACHE_LINE)));
+    uint64_t dropped_reported;
+    AccessLogRecord records[ACCESS_LOG_RING_SIZE] __attribute__((aligned(ACCESS_LOG_CACHE_LINE)));
+} AccessLogRing;
+
+/**
+ * @brief The rings of all workers and the thread writing them out
+ * @param fd : Where the log goes (a file opened for appending, or standard output)
+ * @param clock_offset_ns : CLOCK_REALTIME minus CLOCK_MONOTONIC at start-up
+ * @param running : Cleared to stop the writer
+ */
+typedef struct
+{
+    AccessLogRing *rings;
+    int ring_count;
+    int fd;
+    int64_t clock_offset_ns;
+    int running;
+    pthread_t thread;
+} AccessLog;
+
+// Access log functions
+int access_log_init(AccessLog *log, int rings, int fd);
+void access_log_destroy(AccessLog *log);
+AccessLogRecord *access_log_reserve(AccessLogRing *ring);
+void access_log_commit(AccessLogRing *ring);
+void access_log_copy(char *dst, size_t size, const char *src);
+
+#endif // ACCESS_LOG_H
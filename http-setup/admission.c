@@ -0,0 +1,77 @@
+/**
+ * @file: admission.c
+ *
+ * ℹ️ Overload control: a worker turns away work it cannot serve in time, instead of taking on everything
+ *      and letting the latency of every client grow with the backlog.
+ *
+ * 1. Two limits apply to each worker: the connections it keeps open, and the requests it has admitted and
+ *      not answered yet. Past either, the client gets a pre-serialized 503 at the cost of one send.
+ * 2. The limits are per worker, a share of the server-wide ones, so the workers keep sharing nothing. The
+ *      server-wide limits hold as long as SO_REUSEPORT's hash spreads connections about evenly. With -p the
+ *      connections follow the CPU that received them (SO_INCOMING_CPU, the steering program), so a worker
+ *      whose CPU takes most of the interrupts fills its share while others stay idle: the limits are then
+ *      the most any one worker takes on, and the server as a whole turns clients away below -m and -q.
+ * 3. The request limit can adapt (AIMD): every ADMISSION_INTERVAL_MS the average latency of the requests
+ *      answered in that window is compared with a target. Above it the limit is cut by a quarter, so a
+ *      backlog drains quickly; below it, and only if the limit was actually reached, it grows by
+ *      ADMISSION_INCREASE. An idle or lightly loaded worker therefore keeps its limit where it is.
+ */
+#include "admission.h"
+#include <string.h>
+
+/**
+ * @brief Sets up a worker's admission control
+ * @param max_connections : Connections the worker keeps open, 0 for no limit
+ * @param max_in_flight : Requests the worker has in flight, 0 for no limit
+ * @param target_ns : Latency target of the adaptive limit, 0 for a fixed limit. The adaptive limit starts at,
+ *      and never exceeds, max_in_flight, or ADMISSION_ADAPTIVE_MAX if that is 0.
+ */
+void admission_init(Admission *admission, int max_connections, int max_in_flight, uint64_t target_ns)
+{
+    memset(admission, 0, sizeof(*admission));
+    admission->max_connections = max_connections;
+    admission->max_limit = max_in_flight;
+    admission->target_ns = target_ns;
+    if (target_ns && !admission->max_limit)
+    {
+        admission->max_limit = ADMISSION_ADAPTIVE_MAX;
+    }
+    admission->limit = admission->max_limit;
+}
+
+/**
+ * @brief Moves the adaptive limit by the latency of the window that just ended, and starts the next one
+ * @details [LOGIC][ADMISSION_ADAPT]
+ * 1. Above the target: multiplicative decrease to three quarters, down to ADMISSION_MIN_LIMIT (or max_limit
+ *      if that is lower).
+ * 2. At or below the target, if the limit was reached in the window: additive increase, up to max_limit.
+ *      A window without answered requests leaves the limit alone.
+ */
+void admission_adapt(Admission *admission)
+{
+    if (admission->target_ns && admission->window_count > 0)
+    {
+        uint64_t average = admission->window_sum_ns / admission->window_count;
+        // {ref}{LOGIC}{ADMISSION_ADAPT}{1}
+        if (average > admission->target_ns)
+        {
+            admission->limit = admission->limit * 3 / 4;
+            if (admission->limit < ADMISSION_MIN_LIMIT)
+            {
+                admission->limit = ADMISSION_MIN_LIMIT < admission->max_limit ? ADMISSION_MIN_LIMIT : admission->max_limit;
+            }
+        }
+        // {ref}{LOGIC}{ADMISSION_ADAPT}{2}
+        else if (admission->window_peak >= admission->limit)
+        {
+            admission->limit += ADMISSION_INCREASE;
+            if (admission->limit > admission->max_limit)
+            {
+                admission->limit = admission->max_limit;
+            }
+        }
+    }
+    admission->window_sum_ns = 0;
+    admission->window_count = 0;
+    admission->window_peak = admission->in_flight;
+}
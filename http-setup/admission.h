@@ -0,0 +1,78 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <stdint.h>
+
+#define ADMISSION_INTERVAL_MS 100     ///< Window over which the adaptive limit measures latency before adjusting.
+#define ADMISSION_MIN_LIMIT 4         ///< The adaptive limit never drops below this many requests per worker.
+#define ADMISSION_ADAPTIVE_MAX 1024   ///< Ceiling of the adaptive limit per worker when no fixed limit is given.
+#define ADMISSION_INCREASE 2          ///< Additive increase per window in which the limit was reached.
+
+/**
+ * @brief One worker's admission control: how many connections and requests it takes on
+ * @attention Owned by one worker; the limits are that worker's share of the server-wide limits.
+ * @param connections, max_connections : Open connections and their limit, 0 for none
+ * @param in_flight : Requests admitted and not answered yet
+ * @param limit : Requests admitted at the same time, 0 for no limit; moved by admission_adapt() if adaptive
+ * @param max_limit : Fixed limit, and the ceiling of the adaptive one
+ * @param target_ns : Latency the adaptive limit aims to keep requests under, 0 to keep the limit fixed
+ * @param window_sum_ns, window_count : Latencies of the requests answered in the current window
+ * @param window_peak : Most requests in flight at the same time in the current window
+ */
+typedef struct
+{
+    int connections;
+    int max_connections;
+    int in_flight;
+    int limit;
+    int max_limit;
+    uint64_t target_ns;
+    uint64_t window_sum_ns;
+    uint64_t window_count;
+    int window_peak;
+} Admission;
+
+/// @brief Takes on a new connection; returns -1 if the worker already has max_connections open
+static inline int admission_open(Admission *admission)
+{
+    if (admission->max_connections && admission->connections >= admission->max_connections)
+    {
+        return -1;
+    }
+    admission->connections++;
+    return 0;
+}
+
+/// @brief Accounts for a closed connection that admission_open() took on
+static inline void admission_close(Admission *admission)
+{
+    admission->connections--;
+}
+
+/// @brief Admits a request; returns -1 if the limit of requests in flight is reached
+static inline int admission_begin(Admission *admission)
+{
+    if (admission->limit && admission->in_flight >= admission->limit)
+    {
+        return -1;
+    }
+    if (++admission->in_flight > admission->window_peak)
+    {
+        admission->window_peak = admission->in_flight;
+    }
+    return 0;
+}
+
+/// @brief Accounts for an admitted request that was answered after 'latency_ns'
+static inline void admission_end(Admission *admission, uint64_t latency_ns)
+{
+    admission->in_flight--;
+    admission->window_sum_ns += latency_ns;
+    admission->window_count++;
+}
+
+// Admission functions
+void admission_init(Admission *admission, int max_connections, int max_in_flight, uint64_t target_ns);
+void admission_adapt(Admission *admission);
+
+#endif // ADMISSION_H
@@ -0,0 +1,124 @@
+/**
+ * @file: arena.c
+ *
+ * ℹ️ A bump ("arena") allocator for short-lived per-request data.
+ *
+ * 1. Allocating is a pointer increment inside the current block; a new block is only malloc'd
+ *      when the current one is full.
+ * 2. Nothing is freed individually. arena_reset() releases everything at once after a response
+ *      has been queued, so per-request data can never leak.
+ * 3. After a reset that found several blocks, they are merged into a single block of their combined
+ *      size, so a connection settles on one block and stops calling malloc() at all.
+ */
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+/// @brief Allocates a block with room for at least 'size' bytes
+static ArenaBlock *new_block(size_t size)
+{
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + size);
+    if (block)
+    {
+        block->next = NULL;
+        block->size = size;
+        block->used = 0;
+    }
+    return block;
+}
+
+/// @brief Initialize an empty arena; the first block is allocated on first use
+void arena_init(Arena *arena)
+{
+    arena->head = NULL;
+    arena->total = 0;
+}
+
+/**
+ * @brief Allocate 'size' bytes aligned to ARENA_ALIGNMENT
+ * @details [LOGIC][ARENA_ALLOC]
+ * 1. Round the request up to the alignment.
+ * 2. Serve it from the current block if it fits.
+ * 3. Otherwise chain a new block at least twice the size of the current one.
+ * @return The memory, or NULL on allocation failure.
+ */
+void *arena_alloc(Arena *arena, size_t size)
+{
+    // {ref}{LOGIC}{ARENA_ALLOC}{1}
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+    // {ref}{LOGIC}{ARENA_ALLOC}{2}
+    ArenaBlock *block = arena->head;
+    if (!block || block->size - block->used < size)
+    {
+        // {ref}{LOGIC}{ARENA_ALLOC}{3}
+        size_t block_size = block ? block->size * 2 : ARENA_INITIAL_SIZE;
+        while (block_size < size)
+        {
+            block_size *= 2;
+        }
+        block = new_block(block_size);
+        if (!block)
+        {
+            return NULL;
+        }
+        block->next = arena->head;
+        arena->head = block;
+        arena->total += block_size;
+    }
+    void *memory = block->data + block->used;
+    block->used += size;
+    return memory;
+}
+
+/// @brief Copy a NUL-terminated string into the arena
+char *arena_strdup(Arena *arena, const char *string)
+{
+    size_t len = strlen(string) + 1;
+    char *copy = arena_alloc(arena, len);
+    if (copy)
+    {
+        memcpy(copy, string, len);
+    }
+    return copy;
+}
+
+/**
+ * @brief Release every allocation made since the last reset
+ * @details [LOGIC][ARENA_RESET]
+ * 1. With a single block, just rewind it.
+ * 2. With several blocks, free them all and replace them by one block of their combined size.
+ */
+void arena_reset(Arena *arena)
+{
+    ArenaBlock *block = arena->head;
+    if (!block)
+    {
+        return;
+    }
+    // {ref}{LOGIC}{ARENA_RESET}{1}
+    if (!block->next)
+    {
+        block->used = 0;
+        return;
+    }
+    // {ref}{LOGIC}{ARENA_RESET}{2}
+    size_t total = arena->total;
+    arena_destroy(arena);
+    arena->head = new_block(total);
+    arena->total = arena->head ? total : 0;
+}
+
+/// @brief Free all memory held by the arena
+void arena_destroy(Arena *arena)
+{
+    ArenaBlock *block = arena->head;
+    while (block)
+    {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+    arena->total = 0;
+}
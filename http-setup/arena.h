@@ -0,0 +1,38 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_INITIAL_SIZE 1024 ///< Size of an arena's first block.
+#define ARENA_ALIGNMENT 8       ///< Every allocation is aligned to this many bytes.
+
+/**
+ * @brief One contiguous block of arena memory
+ */
+typedef struct ArenaBlock
+{
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+    char data[];
+} ArenaBlock;
+
+/**
+ * @brief Bump allocator whose allocations are all released at once by arena_reset()
+ * @param head : Block currently allocated from; older, full blocks follow through next
+ * @param total : Combined size of all blocks, used to size the single block kept after a reset
+ */
+typedef struct
+{
+    ArenaBlock *head;
+    size_t total;
+} Arena;
+
+// Arena functions
+void arena_init(Arena *arena);
+void *arena_alloc(Arena *arena, size_t size);
+char *arena_strdup(Arena *arena, const char *string);
+void arena_reset(Arena *arena);
+void arena_destroy(Arena *arena);
+
+#endif // ARENA_H
@@ -0,0 +1,5 @@
+// Reports the round trip of a request to the embedded health page.
+const started = performance.now();
+fetch("/health.html", { cache: "no-store" }).then(() => {
+    document.body.insertAdjacentText("beforeend", " " + Math.round(performance.now() - started) + " ms");
+});
@@ -0,0 +1,296 @@
+/**
+ * backend-bench V1.0📔
+ * @file: backend-bench.c
+ *
+ * ℹ️ Benchmark of the two event-loop backends of http-server: epoll with readiness events against
+ *    io_uring with completions (-u), both with a single worker on the same CPU budget.
+ *
+ * 1. A temporary document root with a ~1 KB index.html is created, so both runs serve the same
+ *      small, cached response.
+ * 2. For each backend the server binary is started with `-w 1 [-u]`, its output discarded, and driven by
+ *      a closed-loop client: N keep-alive connections on one epoll instance, each sending its next
+ *      request as soon as the previous response is complete.
+ * 3. Results are reported as requests per second and the server's CPU time (user + system, read from
+ *      /proc/<pid>/stat) per request; the second number is where saved system calls show up.
+ *
+ * Build and run (after building http-server):
+ *      gcc -O2 backend-bench.c -o backend-bench && ./backend-bench [server] [seconds] [connections]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define PORT 8080 ///< Same port as http-server.c.
+#define DEFAULT_SECONDS 5
+#define DEFAULT_CONNECTIONS 64
+#define MAX_CONNECTIONS 1024
+#define BODY_SIZE 1024
+#define RESPONSE_BUFFER 8192
+
+static const char request[] = "GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+/**
+ * @brief One client connection and the progress of its current response
+ * @param received : Bytes of the current response received so far
+ * @param expected : Full length of the response, 0 until its head is complete
+ */
+typedef struct
+{
+    int fd;
+    size_t received;
+    size_t expected;
+    char buf[RESPONSE_BUFFER];
+} Client;
+
+/// @brief Monotonic clock in nanoseconds
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief CPU time a process has used so far
+ * @return Clock ticks of user plus system time, -1 if /proc cannot be read.
+ */
+static long process_cpu_ticks(pid_t pid)
+{
+    char path[64], stat[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        return -1;
+    }
+    size_t len = fread(stat, 1, sizeof(stat) - 1, file);
+    fclose(file);
+    stat[len] = '\0';
+
+    // Fields 14 and 15 (utime, stime) follow the command name, which may itself contain spaces.
+    char *p = strrchr(stat, ')');
+    unsigned long utime, stime;
+    if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)
+    {
+        return -1;
+    }
+    return (long)(utime + stime);
+}
+
+/**
+ * @brief Starts the server and waits until it accepts connections
+ * @return The server's pid, -1 if it did not come up.
+ */
+static pid_t start_server(const char *server, int io_uring, const char *root)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        if (io_uring)
+        {
+            execl(server, server, "-w", "1", "-u", root, (char *)NULL);
+        }
+        else
+        {
+            execl(server, server, "-w", "1", root, (char *)NULL);
+        }
+        _exit(127);
+    }
+
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(PORT)};
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    for (int attempt = 0; attempt < 100; attempt++)
+    {
+        usleep(50000);
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        int up = connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        close(fd);
+        if (up)
+        {
+            return pid;
+        }
+        if (waitpid(pid, NULL, WNOHANG) == pid)
+        {
+            return -1;
+        }
+    }
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+/**
+ * @brief Handles data on one client connection; sends the next request once a response is complete
+ * @return Number of responses completed, -1 on a connection error.
+ */
+static int client_read(Client *client)
+{
+    int completed = 0;
+    while (1)
+    {
+        ssize_t n = recv(client->fd, client->buf + client->received, sizeof(client->buf) - client->received, 0);
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return completed;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        client->received += n;
+
+        while (1)
+        {
+            if (!client->expected)
+            {
+                client->buf[client->received < sizeof(client->buf) ? client->received : sizeof(client->buf) - 1] = '\0';
+                char *end = strstr(client->buf, "\r\n\r\n");
+                char *length = strstr(client->buf, "Content-Length: ");
+                if (!end || !length)
+                {
+                    break;
+                }
+                client->expected = (end + 4 - client->buf) + strtoul(length + 16, NULL, 10);
+            }
+            if (client->received < client->expected)
+            {
+                break;
+            }
+            memmove(client->buf, client->buf + client->expected, client->received - client->expected);
+            client->received -= client->expected;
+            client->expected = 0;
+            completed++;
+            if (send(client->fd, request, sizeof(request) - 1, MSG_NOSIGNAL) == -1)
+            {
+                return -1;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Drives the running server with a closed loop of keep-alive connections
+ * @return Number of responses received in the measured interval.
+ */
+static long drive(int connections, double seconds)
+{
+    static Client clients[MAX_CONNECTIONS];
+    int epoll_fd = epoll_create1(0);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(PORT)};
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    for (int i = 0; i < connections; i++)
+    {
+        int one = 1;
+        clients[i] = (Client){.fd = socket(AF_INET, SOCK_STREAM, 0)};
+        if (connect(clients[i].fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+        {
+            perror("connect");
+            exit(EXIT_FAILURE);
+        }
+        setsockopt(clients[i].fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(clients[i].fd, F_SETFL, O_NONBLOCK);
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLET, .data.ptr = &clients[i]};
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, clients[i].fd, &ev);
+        send(clients[i].fd, request, sizeof(request) - 1, MSG_NOSIGNAL);
+    }
+
+    long responses = 0;
+    double deadline = now_ns() + seconds * 1e9;
+    struct epoll_event events[MAX_CONNECTIONS];
+    while (now_ns() < deadline)
+    {
+        int n = epoll_wait(epoll_fd, events, MAX_CONNECTIONS, 100);
+        for (int i = 0; i < n; i++)
+        {
+            int completed = client_read(events[i].data.ptr);
+            if (completed == -1)
+            {
+                fprintf(stderr, "connection failed\n");
+                exit(EXIT_FAILURE);
+            }
+            responses += completed;
+        }
+    }
+
+    for (int i = 0; i < connections; i++)
+    {
+        close(clients[i].fd);
+    }
+    close(epoll_fd);
+    return responses;
+}
+
+/**
+ * @brief Benchmarks both backends and prints a table
+ * @param argc Number of command-line arguments.
+ * @param argv Optional server binary (default ./http-server), seconds per backend and number of connections.
+ */
+int main(int argc, char *argv[])
+{
+    const char *server = argc > 1 ? argv[1] : "./http-server";
+    double seconds = argc > 2 ? atof(argv[2]) : DEFAULT_SECONDS;
+    int connections = argc > 3 ? atoi(argv[3]) : DEFAULT_CONNECTIONS;
+    if (connections < 1 || connections > MAX_CONNECTIONS)
+    {
+        fprintf(stderr, "connections must be between 1 and %d\n", MAX_CONNECTIONS);
+        return EXIT_FAILURE;
+    }
+
+    char root[] = "/tmp/backend-bench-XXXXXX", index_path[64];
+    if (!mkdtemp(root))
+    {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    snprintf(index_path, sizeof(index_path), "%s/index.html", root);
+    FILE *index = fopen(index_path, "w");
+    for (int i = 0; i < BODY_SIZE; i++)
+    {
+        fputc(i % 64 == 63 ? '\n' : 'a' + i % 26, index);
+    }
+    fclose(index);
+
+    printf("%d connections, %.1f s per backend, 1 worker\n", connections, seconds);
+    printf("%-10s %14s %16s\n", "backend", "requests/s", "server us/req");
+    const char *names[] = {"epoll", "io_uring"};
+    long ticks_per_second = sysconf(_SC_CLK_TCK);
+    for (int io_uring = 0; io_uring < 2; io_uring++)
+    {
+        pid_t pid = start_server(server, io_uring, root);
+        if (pid == -1)
+        {
+            fprintf(stderr, "%s: server did not start\n", names[io_uring]);
+            continue;
+        }
+        long cpu_start = process_cpu_ticks(pid);
+        double start = now_ns();
+        long responses = drive(connections, seconds);
+        double elapsed = (now_ns() - start) / 1e9;
+        long cpu_used = process_cpu_ticks(pid) - cpu_start;
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+
+        printf("%-10s %14.0f %16.2f\n", names[io_uring], responses / elapsed,
+               responses ? cpu_used * 1e6 / ticks_per_second / responses : 0.0);
+    }
+
+    unlink(index_path);
+    rmdir(root);
+    return EXIT_SUCCESS;
+}
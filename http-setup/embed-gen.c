@@ -0,0 +1,293 @@
+/**
+ * @file: embed-gen.c
+ *
+ * embed-gen V1.0📔
+ *
+ * ℹ️ Generates embedded-assets.c: the files of an assets directory compiled into the server as const
+ *    arrays, each with its responses already serialized.
+ *
+ * 1. Every regular file below the directory becomes an asset served at '/' plus its relative path.
+ *      Hidden files are skipped; files and directories are visited in name order, so the output is
+ *      reproducible.
+ * 2. An asset is one block laid out like a response cache entry: the 304 head, the 200 head with
+ *      Content-Type, Content-Length and ETag, the blank line and the body. The ETag is derived from the
+ *      body's length and FNV-1a hash like the response cache does, so a file gets the same tag either way.
+ * 3. At request time the server only picks the right slices of the block: no file system access, no
+ *      formatting, and nothing to load at startup.
+ *
+ * Usage: ./embed-gen assets > embedded-assets.c
+ */
+#include <dirent.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#define MAX_ASSETS 256            ///< Files one assets directory may hold.
+#define MAX_ASSET_SIZE (1 << 20)  ///< Largest file embedded; the set is meant for small, fixed assets.
+#define LINE_WIDTH 96             ///< Width after which a string literal is continued on the next line.
+
+/**
+ * @brief An asset found in the directory
+ * @param path : Request path, '/' plus the path below the directory
+ * @param file : Path of the file to read
+ */
+typedef struct
+{
+    char path[PATH_MAX];
+    char file[PATH_MAX];
+} Asset;
+
+static Asset assets[MAX_ASSETS];
+static int asset_count = 0;
+
+/// @brief Content type of a file by its extension; must match content_type_for_path() in http-server.c
+static const char *content_type_for_path(const char *path)
+{
+    static const struct
+    {
+        const char *extension;
+        const char *content_type;
+    } types[] = {
+        {".html", "text/html"},
+        {".htm", "text/html"},
+        {".css", "text/css"},
+        {".js", "application/javascript"},
+        {".json", "application/json"},
+        {".txt", "text/plain"},
+        {".png", "image/png"},
+        {".jpg", "image/jpeg"},
+        {".jpeg", "image/jpeg"},
+        {".gif", "image/gif"},
+        {".svg", "image/svg+xml"},
+        {".ico", "image/x-icon"},
+        {".pdf", "application/pdf"},
+        {".mp4", "video/mp4"},
+        {".woff2", "font/woff2"},
+    };
+    const char *extension = strrchr(path, '.');
+    if (extension && !strchr(extension, '/'))
+    {
+        for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+        {
+            if (strcasecmp(extension, types[i].extension) == 0)
+            {
+                return types[i].content_type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+/// @brief FNV-1a hash of 'len' bytes; must match hash_bytes() in response-cache.c
+static uint64_t hash_bytes(const char *data, size_t len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/// @brief Skips hidden entries, and with them "." and ".."
+static int visible(const struct dirent *entry)
+{
+    return entry->d_name[0] != '.';
+}
+
+/**
+ * @brief Collects the regular files below a directory, in name order
+ * @param dir : Directory to read
+ * @param prefix : Request path of the directory, without a trailing '/'
+ */
+static void collect(const char *dir, const char *prefix)
+{
+    struct dirent **entries;
+    int count = scandir(dir, &entries, visible, alphasort);
+    if (count == -1)
+    {
+        perror(dir);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        char file[PATH_MAX], path[PATH_MAX];
+        struct stat st;
+        if (snprintf(file, sizeof(file), "%s/%s", dir, entries[i]->d_name) >= (int)sizeof(file) ||
+            snprintf(path, sizeof(path), "%s/%s", prefix, entries[i]->d_name) >= (int)sizeof(path) ||
+            stat(file, &st) == -1)
+        {
+            fprintf(stderr, "cannot embed %s/%s\n", dir, entries[i]->d_name);
+            exit(EXIT_FAILURE);
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            collect(file, path);
+        }
+        else if (S_ISREG(st.st_mode))
+        {
+            if (asset_count == MAX_ASSETS || st.st_size > MAX_ASSET_SIZE)
+            {
+                fprintf(stderr, "%s: more than %d assets, or larger than %d bytes\n", file, MAX_ASSETS, MAX_ASSET_SIZE);
+                exit(EXIT_FAILURE);
+            }
+            strcpy(assets[asset_count].file, file);
+            strcpy(assets[asset_count].path, path);
+            asset_count++;
+        }
+        free(entries[i]);
+    }
+    free(entries);
+}
+
+/**
+ * @brief Prints bytes as the continuation of a C string literal, breaking it into lines
+ * @details Printable characters are written as they are, '"', '\\' and '?' (trigraphs) escaped; everything
+ *      else as a three-digit octal escape, which cannot swallow a digit that follows it. A line also
+ *      ends after every newline in the data, so text assets stay readable.
+ * @param column : Current output column, updated; 0 before the literal is opened, -1 once a line is due to end
+ */
+static void print_literal(const char *data, size_t len, int *column)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = data[i];
+        if (*column <= 0)
+        {
+            fputs(*column ? "\"\n    \"" : "    \"", stdout);
+            *column = 5;
+        }
+        if (c == '"' || c == '\\' || c == '?')
+        {
+            *column += printf("\\%c", c);
+        }
+        else if (c == '\r')
+        {
+            *column += printf("\\r");
+        }
+        else if (c == '\n')
+        {
+            *column += printf("\\n");
+        }
+        else if (c >= 0x20 && c < 0x7f)
+        {
+            putchar(c);
+            (*column)++;
+        }
+        else
+        {
+            *column += printf("\\%03o", c);
+        }
+        if (c == '\n' || *column >= LINE_WIDTH)
+        {
+            *column = -1;
+        }
+    }
+}
+
+/// @brief Prints a NUL-terminated string as one C string literal
+static void print_string(const char *s)
+{
+    putchar('"');
+    for (; *s; s++)
+    {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\' || c == '?')
+        {
+            printf("\\%c", c);
+        }
+        else if (c >= 0x20 && c < 0x7f)
+        {
+            putchar(c);
+        }
+        else
+        {
+            printf("\\%03o", c);
+        }
+    }
+    putchar('"');
+}
+
+/**
+ * @brief Reads an asset and prints its block and the lengths of its parts
+ * @details [LOGIC][EMBED_ASSET]
+ * 1. Read the whole file and derive its ETag.
+ * 2. Serialize the 304 head, then the 200 head and the blank line, as the server would.
+ * 3. Print the heads and the body as one array.
+ */
+static void print_asset(int index, size_t *lengths, char *etag, size_t etag_size)
+{
+    // {ref}{LOGIC}{EMBED_ASSET}{1}
+    FILE *file = fopen(assets[index].file, "rb");
+    if (!file)
+    {
+        perror(assets[index].file);
+        exit(EXIT_FAILURE);
+    }
+    char *body = malloc(MAX_ASSET_SIZE + 1);
+    size_t body_len = body ? fread(body, 1, MAX_ASSET_SIZE + 1, file) : 0;
+    if (!body || ferror(file) || body_len > MAX_ASSET_SIZE)
+    {
+        fprintf(stderr, "cannot read %s\n", assets[index].file);
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+    snprintf(etag, etag_size, "\"%zx-%016llx\"", body_len, (unsigned long long)hash_bytes(body, body_len));
+
+    // {ref}{LOGIC}{EMBED_ASSET}{2}
+    char heads[1024];
+    int not_modified_len = snprintf(heads, sizeof(heads), "HTTP/1.1 304 Not Modified\r\nETag: %s\r\n", etag);
+    int head_len = snprintf(heads + not_modified_len, sizeof(heads) - not_modified_len,
+                            "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\nETag: %s\r\n",
+                            content_type_for_path(assets[index].path), body_len, etag);
+    strcat(heads, "\r\n");
+
+    // {ref}{LOGIC}{EMBED_ASSET}{3}
+    printf("// %s\nstatic const char asset_%d[] =\n", assets[index].path, index);
+    int column = 0;
+    print_literal(heads, not_modified_len + head_len + 2, &column);
+    print_literal(body, body_len, &column);
+    printf("\";\n\n");
+    lengths[0] = not_modified_len;
+    lengths[1] = head_len;
+    lengths[2] = body_len;
+    free(body);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s assets_dir > embedded-assets.c\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    collect(argv[1], "");
+
+    printf("// Generated by embed-gen.c from %s; do not edit.\n\n#include \"embedded.h\"\n\n", argv[1]);
+    size_t lengths[MAX_ASSETS][3];
+    static char etags[MAX_ASSETS][48];
+    for (int i = 0; i < asset_count; i++)
+    {
+        print_asset(i, lengths[i], etags[i], sizeof(etags[i]));
+    }
+    printf("const EmbeddedAsset embedded_assets[] = {\n");
+    for (int i = 0; i < asset_count; i++)
+    {
+        printf("    {");
+        print_string(assets[i].path);
+        printf(", ");
+        print_string(etags[i]);
+        printf(", asset_%d, %zu, %zu, %zu},\n", i, lengths[i][0], lengths[i][1], lengths[i][2]);
+    }
+    if (asset_count == 0)
+    {
+        printf("    {0},\n");
+    }
+    printf("};\n\nconst int embedded_asset_count = %d;\n", asset_count);
+    return 0;
+}
@@ -0,0 +1,52 @@
+// Generated by embed-gen.c from assets; do not edit.
+
+#include "embedded.h"
+
+// /favicon.svg
+static const char asset_0[] =
+    "HTTP/1.1 304 Not Modified\r\n"
+    "ETag: \"6c-65c12ad8ab94cd5e\"\r\n"
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: image/svg+xml\r\n"
+    "Content-Length: 108\r\n"
+    "ETag: \"6c-65c12ad8ab94cd5e\"\r\n"
+    "\r\n"
+    "<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"0 0 16 16\"><circle cx=\"8\" cy=\"8\" r"
+    "=\"7\" fill=\"#2a7\"/></svg>\n";
+
+// /health.html
+static const char asset_1[] =
+    "HTTP/1.1 304 Not Modified\r\n"
+    "ETag: \"9b-8c83e924ac896496\"\r\n"
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/html\r\n"
+    "Content-Length: 155\r\n"
+    "ETag: \"9b-8c83e924ac896496\"\r\n"
+    "\r\n"
+    "<!DOCTYPE html>\n"
+    "<html><head><title>OK</title><link rel=\"icon\" href=\"/favicon.svg\"></head>\n"
+    "<body><p>OK</p><script src=\"/js/ping.js\"></script></body></html>\n";
+
+// /js/ping.js
+static const char asset_2[] =
+    "HTTP/1.1 304 Not Modified\r\n"
+    "ETag: \"10f-4c03027454f7ab43\"\r\n"
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: application/javascript\r\n"
+    "Content-Length: 271\r\n"
+    "ETag: \"10f-4c03027454f7ab43\"\r\n"
+    "\r\n"
+    "// Reports the round trip of a request to the embedded health page.\n"
+    "const started = performance.now();\n"
+    "fetch(\"/health.html\", { cache: \"no-store\" }).then(() => {\n"
+    "    document.body.insertAdjacentText(\"beforeend\", \" \" + Math.round(performance.now() - "
+    "started) + \" ms\");\n"
+    "});\n";
+
+const EmbeddedAsset embedded_assets[] = {
+    {"/favicon.svg", "\"6c-65c12ad8ab94cd5e\"", asset_0, 56, 96, 108},
+    {"/health.html", "\"9b-8c83e924ac896496\"", asset_1, 56, 92, 155},
+    {"/js/ping.js", "\"10f-4c03027454f7ab43\"", asset_2, 57, 106, 271},
+};
+
+const int embedded_asset_count = 3;
@@ -0,0 +1,29 @@
+#ifndef EMBEDDED_H
+#define EMBEDDED_H
+
+#include <stddef.h>
+
+/**
+ * @brief A file compiled into the server, with its responses serialized at build time
+ * @param path : Request path the asset is served at: '/' and its path below the assets directory
+ * @param etag : Strong entity tag of the body, with its quotes
+ * @param data : "304 head | 200 head | CRLF | body" in one block, laid out like a response cache entry
+ * @param not_modified_len : Length of the 304 status line and ETag header at the start of data
+ * @param head_len : Length of the 200 status line and headers that follow, without the final CRLF
+ * @param body_len : Length of the body after the final CRLF
+ */
+typedef struct
+{
+    const char *path;
+    const char *etag;
+    const char *data;
+    size_t not_modified_len;
+    size_t head_len;
+    size_t body_len;
+} EmbeddedAsset;
+
+// Embedded assets, generated by embed-gen into embedded-assets.c
+extern const EmbeddedAsset embedded_assets[];
+extern const int embedded_asset_count;
+
+#endif // EMBEDDED_H
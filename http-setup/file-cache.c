@@ -0,0 +1,243 @@
+/**
+ * @file: file-cache.c
+ *
+ * ℹ️ An LRU cache of open file descriptors and their fstat() results for the static file handler.
+ *
+ * 1. A hit returns the already open descriptor, so serving a popular file costs no open() and no stat().
+ * 2. Entries are re-validated at most once every FILE_CACHE_REVALIDATE_SECONDS: if the file's
+ *      mtime, size or inode changed, the stale descriptor is dropped and the file is reopened.
+ * 3. The validators of a response, ETag and Last-Modified, are formatted once when the file is opened;
+ *      every response that serves the entry copies them from there.
+ * 4. Entries are reference counted. A response queued with sendfile() keeps its descriptor
+ *      alive even if the entry is evicted or invalidated before the response is written.
+ */
+#include "file-cache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+/// @brief FNV-1a hash of a path
+static size_t hash_path(const char *path)
+{
+    size_t hash = 14695981039346656037ULL;
+    while (*path)
+    {
+        hash ^= (unsigned char)*path++;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/// @brief Closes and frees an entry once nobody references it
+static void free_entry(CachedFile *file)
+{
+    close(file->fd);
+    free(file->path);
+    free(file);
+}
+
+/// @brief Formats the ETag, "<size>-<mtime in ns>" in hex and quoted, and the Last-Modified date of an entry
+static void format_validators(CachedFile *file)
+{
+    char *p = file->etag;
+    *p++ = '"';
+    p = http_format_hex(p, (uint64_t)file->st.st_size, 1);
+    *p++ = '-';
+    p = http_format_hex(p, (uint64_t)file->st.st_mtim.tv_sec * 1000000000ULL + file->st.st_mtim.tv_nsec, 1);
+    *p++ = '"';
+    *p = '\0';
+    *http_format_date(file->last_modified, file->st.st_mtime) = '\0';
+}
+
+/// @brief Unlinks an entry from the LRU list
+static void lru_unlink(FileCache *cache, CachedFile *file)
+{
+    if (file->lru_prev)
+    {
+        file->lru_prev->lru_next = file->lru_next;
+    }
+    else
+    {
+        cache->lru_head = file->lru_next;
+    }
+    if (file->lru_next)
+    {
+        file->lru_next->lru_prev = file->lru_prev;
+    }
+    else
+    {
+        cache->lru_tail = file->lru_prev;
+    }
+    file->lru_prev = file->lru_next = NULL;
+}
+
+/// @brief Inserts an entry at the most recently used end of the LRU list
+static void lru_push_front(FileCache *cache, CachedFile *file)
+{
+    file->lru_prev = NULL;
+    file->lru_next = cache->lru_head;
+    if (cache->lru_head)
+    {
+        cache->lru_head->lru_prev = file;
+    }
+    cache->lru_head = file;
+    if (!cache->lru_tail)
+    {
+        cache->lru_tail = file;
+    }
+}
+
+/**
+ * @brief Removes an entry from the cache
+ * @attention The descriptor is only closed if no queued response still holds a reference.
+ */
+static void remove_entry(FileCache *cache, CachedFile *file)
+{
+    CachedFile **link = &cache->buckets[hash_path(file->path) % cache->bucket_count];
+    while (*link != file)
+    {
+        link = &(*link)->hash_next;
+    }
+    *link = file->hash_next;
+    lru_unlink(cache, file);
+    cache->count--;
+    file->cached = 0;
+    if (file->refcount == 0)
+    {
+        free_entry(file);
+    }
+}
+
+/**
+ * @brief Initialize a file cache
+ * @param capacity : Maximum number of open files to keep
+ * @return 0 on success, -1 on allocation failure.
+ */
+int file_cache_init(FileCache *cache, int capacity)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache->capacity = capacity;
+    cache->bucket_count = (size_t)capacity * 2;
+    cache->buckets = calloc(cache->bucket_count, sizeof(CachedFile *));
+    return cache->buckets ? 0 : -1;
+}
+
+/// @brief Drop every cached entry and release the hash table
+void file_cache_destroy(FileCache *cache)
+{
+    while (cache->lru_head)
+    {
+        remove_entry(cache, cache->lru_head);
+    }
+    free(cache->buckets);
+    cache->buckets = NULL;
+}
+
+/**
+ * @brief Look up a regular file, opening it on a miss
+ * @details [LOGIC][FILE_CACHE_ACQUIRE]
+ * 1. Find the entry for the path. If its last check is older than FILE_CACHE_REVALIDATE_SECONDS,
+ *      stat() the path and drop the entry if the file was modified, replaced or removed.
+ * 2. On a hit, move the entry to the front of the LRU list.
+ * 3. On a miss, open and fstat() the file. Only regular files are cached; a directory
+ *      fails with EISDIR so the caller can try its index file. Format the validators of its responses.
+ * 4. Evict the least recently used entry when the cache is full, then insert the new one.
+ * 5. Take a reference for the caller, who must hand it back with file_cache_release().
+ * @return The cached file, or NULL with errno set.
+ */
+CachedFile *file_cache_acquire(FileCache *cache, const char *path)
+{
+    time_t now = time(NULL);
+    size_t bucket = hash_path(path) % cache->bucket_count;
+
+    // {ref}{LOGIC}{FILE_CACHE_ACQUIRE}{1}
+    CachedFile *file = cache->buckets[bucket];
+    while (file && strcmp(file->path, path) != 0)
+    {
+        file = file->hash_next;
+    }
+
+    if (file && now - file->checked_at >= FILE_CACHE_REVALIDATE_SECONDS)
+    {
+        struct stat st;
+        if (stat(path, &st) == -1 || st.st_mtime != file->st.st_mtime ||
+            st.st_size != file->st.st_size || st.st_ino != file->st.st_ino ||
+            st.st_dev != file->st.st_dev)
+        {
+            remove_entry(cache, file);
+            file = NULL;
+        }
+        else
+        {
+            file->checked_at = now;
+        }
+    }
+
+    if (file)
+    {
+        // {ref}{LOGIC}{FILE_CACHE_ACQUIRE}{2}
+        lru_unlink(cache, file);
+        lru_push_front(cache, file);
+    }
+    else
+    {
+        // {ref}{LOGIC}{FILE_CACHE_ACQUIRE}{3}
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+        {
+            return NULL;
+        }
+        file = calloc(1, sizeof(CachedFile));
+        if (!file || fstat(fd, &file->st) == -1 || !(file->path = strdup(path)))
+        {
+            int saved_errno = file ? errno : ENOMEM;
+            close(fd);
+            free(file);
+            errno = saved_errno;
+            return NULL;
+        }
+        if (!S_ISREG(file->st.st_mode))
+        {
+            close(fd);
+            free(file->path);
+            free(file);
+            errno = EISDIR;
+            return NULL;
+        }
+        file->fd = fd;
+        format_validators(file);
+        file->checked_at = now;
+        file->cached = 1;
+
+        // {ref}{LOGIC}{FILE_CACHE_ACQUIRE}{4}
+        if (cache->count >= cache->capacity)
+        {
+            remove_entry(cache, cache->lru_tail);
+        }
+        file->hash_next = cache->buckets[bucket];
+        cache->buckets[bucket] = file;
+        lru_push_front(cache, file);
+        cache->count++;
+    }
+
+    // {ref}{LOGIC}{FILE_CACHE_ACQUIRE}{5}
+    file->refcount++;
+    return file;
+}
+
+/// @brief Take another reference to a file the caller already holds one to
+void file_cache_retain(CachedFile *file)
+{
+    file->refcount++;
+}
+
+/// @brief Give back a reference taken by file_cache_acquire() or file_cache_retain()
+void file_cache_release(CachedFile *file)
+{
+    if (--file->refcount == 0 && !file->cached)
+    {
+        free_entry(file);
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+#include <time.h>
+#include "http-head.h"
+
+#define FILE_CACHE_CAPACITY 256          ///< Maximum number of open files kept in the cache.
+#define FILE_CACHE_REVALIDATE_SECONDS 1  ///< How long a cached stat() result is trusted.
+#define FILE_ETAG_SIZE 40                ///< Room for the entity tag of a file, with its quotes and a NUL.
+
+/**
+ * @brief An open file shared by every response that serves it
+ * @param path : Filesystem path the entry was opened from (hash key)
+ * @param fd : Read-only descriptor, used with sendfile() and explicit offsets so it can be shared
+ * @param st : fstat() result taken when the file was opened
+ * @param etag : Strong entity tag from the file's size and modification time in nanoseconds
+ * @param last_modified : The modification time as an HTTP date
+ * @param checked_at : Last time the path was re-checked for a newer mtime
+ * @param refcount : Number of queued responses still using the fd
+ * @param cached : Non-zero while the entry is reachable from the cache
+ */
+typedef struct CachedFile
+{
+    char *path;
+    int fd;
+    struct stat st;
+    char etag[FILE_ETAG_SIZE];
+    char last_modified[HTTP_DATE_SIZE];
+    time_t checked_at;
+    int refcount;
+    int cached;
+    struct CachedFile *hash_next;
+    struct CachedFile *lru_prev;
+    struct CachedFile *lru_next;
+} CachedFile;
+
+/**
+ * @brief LRU cache of open file descriptors keyed by path
+ * @param buckets : Hash table of entries, chained through hash_next
+ * @param lru_head : Most recently used entry
+ * @param lru_tail : Least recently used entry, evicted first
+ */
+typedef struct
+{
+    CachedFile **buckets;
+    size_t bucket_count;
+    CachedFile *lru_head;
+    CachedFile *lru_tail;
+    int count;
+    int capacity;
+} FileCache;
+
+// File cache functions
+int file_cache_init(FileCache *cache, int capacity);
+void file_cache_destroy(FileCache *cache);
+CachedFile *file_cache_acquire(FileCache *cache, const char *path);
+void file_cache_retain(CachedFile *file);
+void file_cache_release(CachedFile *file);
+
+#endif // FILE_CACHE_H
@@ -0,0 +1,251 @@
+/**
+ * @file: http-body.c
+ *
+ * ℹ️ Incremental decoding of request bodies (RFC 9112 sections 6 and 7.1).
+ *
+ * 1. A body is framed either by Content-Length or by the chunked transfer coding: a sequence of
+ *      "<hex size>[;ext]\r\n<data>\r\n" chunks ended by a zero-size chunk and optional trailer lines.
+ * 2. The decoder is a byte-driven state machine that keeps its state between calls, so a chunk-size
+ *      line or a chunk split across reads needs no buffering: every byte handed in is consumed, and
+ *      chunk data is passed to the sink straight out of the receive buffer.
+ * 3. Only framing lines are inspected byte by byte; chunk data is handed over in one piece per read.
+ */
+#include "http-body.h"
+
+/**
+ * @brief Decoder states
+ */
+enum
+{
+    BODY_LENGTH,      ///< Content-Length body, 'remaining' bytes left.
+    CHUNK_SIZE_START, ///< Expecting the first hex digit of a chunk size.
+    CHUNK_SIZE,       ///< Inside the hex chunk size.
+    CHUNK_EXT,        ///< Skipping a chunk extension until the end of the line.
+    CHUNK_SIZE_LF,    ///< Saw '\r' after the size line, expecting '\n'.
+    CHUNK_DATA,       ///< Inside chunk data, 'remaining' bytes left.
+    CHUNK_DATA_CR,    ///< Expecting the CRLF after chunk data.
+    CHUNK_DATA_LF,    ///< Saw '\r' after chunk data, expecting '\n'.
+    TRAILER_START,    ///< At the start of a trailer line or the final empty line.
+    TRAILER_LINE,     ///< Inside a trailer field, which is skipped.
+    TRAILER_END_LF,   ///< Saw '\r' at the start of a line, expecting the final '\n'.
+    BODY_DONE
+};
+
+/// @brief Value of a hex digit, or -1
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/// @brief Prepare to decode a body of exactly 'content_length' bytes
+void http_body_init_length(HttpBodyDecoder *decoder, uint64_t content_length)
+{
+    decoder->state = content_length ? BODY_LENGTH : BODY_DONE;
+    decoder->remaining = content_length;
+    decoder->line_length = 0;
+}
+
+/// @brief Prepare to decode a chunked body
+void http_body_init_chunked(HttpBodyDecoder *decoder)
+{
+    decoder->state = CHUNK_SIZE_START;
+    decoder->remaining = 0;
+    decoder->line_length = 0;
+}
+
+/// @brief The size line ended: a zero size starts the trailer section, anything else the chunk data
+static void end_size_line(HttpBodyDecoder *decoder)
+{
+    decoder->line_length = 0;
+    decoder->state = decoder->remaining ? CHUNK_DATA : TRAILER_START;
+}
+
+/**
+ * @brief Decode as much of 'buf' as belongs to the body
+ * @param buf Bytes received after the headers (or after the part of the body decoded before).
+ * @param len Number of bytes in buf.
+ * @param consumed Set to the number of bytes of buf that belonged to the body.
+ * @param sink Receives the decoded body data.
+ * @param context Passed to sink.
+ * @details [LOGIC][BODY_DECODE]
+ * 1. Content-Length: pass up to 'remaining' bytes to the sink.
+ * 2. Chunk size: hex digits, guarded against overflow, optionally followed by an extension that is
+ *      skipped, then CRLF. A bare LF is accepted as a line end as well.
+ * 3. Chunk data is passed to the sink in one piece and must be followed by CRLF.
+ * 4. After the zero-size chunk, trailer fields are skipped up to the empty line that ends the body.
+ * @return See HttpBodyResult; on HTTP_BODY_DONE, bytes after 'consumed' start the next request.
+ */
+HttpBodyResult http_body_decode(HttpBodyDecoder *decoder, const char *buf, size_t len, size_t *consumed,
+                                HttpBodySink sink, void *context)
+{
+    size_t i = 0;
+    HttpBodyResult result = HTTP_BODY_INCOMPLETE;
+
+    while (i < len && decoder->state != BODY_DONE && result == HTTP_BODY_INCOMPLETE)
+    {
+        char c = buf[i];
+        switch (decoder->state)
+        {
+        // {ref}{LOGIC}{BODY_DECODE}{1,3}
+        case BODY_LENGTH:
+        case CHUNK_DATA:
+        {
+            size_t length = len - i < decoder->remaining ? len - i : (size_t)decoder->remaining;
+            if (sink(context, buf + i, length) == -1)
+            {
+                result = HTTP_BODY_ABORTED;
+            }
+            i += length;
+            decoder->remaining -= length;
+            if (decoder->remaining == 0)
+            {
+                decoder->state = decoder->state == BODY_LENGTH ? BODY_DONE : CHUNK_DATA_CR;
+            }
+            continue;
+        }
+
+        // {ref}{LOGIC}{BODY_DECODE}{2}
+        case CHUNK_SIZE_START:
+        case CHUNK_SIZE:
+        {
+            int digit = hex_value(c);
+            if (digit >= 0)
+            {
+                if (decoder->remaining > (UINT64_MAX >> 4))
+                {
+                    result = HTTP_BODY_ERROR;
+                    break;
+                }
+                decoder->remaining = (decoder->remaining << 4) | digit;
+                decoder->state = CHUNK_SIZE;
+            }
+            else if (decoder->state == CHUNK_SIZE_START)
+            {
+                result = HTTP_BODY_ERROR;
+            }
+            else if (c == ';' || c == ' ' || c == '\t')
+            {
+                decoder->state = CHUNK_EXT;
+            }
+            else if (c == '\r')
+            {
+                decoder->state = CHUNK_SIZE_LF;
+            }
+            else if (c == '\n')
+            {
+                end_size_line(decoder);
+            }
+            else
+            {
+                result = HTTP_BODY_ERROR;
+            }
+            break;
+        }
+
+        case CHUNK_EXT:
+            if (c == '\r')
+            {
+                decoder->state = CHUNK_SIZE_LF;
+            }
+            else if (c == '\n')
+            {
+                end_size_line(decoder);
+            }
+            else if (++decoder->line_length > HTTP_BODY_MAX_LINE)
+            {
+                result = HTTP_BODY_ERROR;
+            }
+            break;
+
+        case CHUNK_SIZE_LF:
+            if (c != '\n')
+            {
+                result = HTTP_BODY_ERROR;
+                break;
+            }
+            end_size_line(decoder);
+            break;
+
+        case CHUNK_DATA_CR:
+            if (c == '\r')
+            {
+                decoder->state = CHUNK_DATA_LF;
+            }
+            else if (c == '\n')
+            {
+                decoder->state = CHUNK_SIZE_START;
+            }
+            else
+            {
+                result = HTTP_BODY_ERROR;
+            }
+            break;
+
+        case CHUNK_DATA_LF:
+            if (c != '\n')
+            {
+                result = HTTP_BODY_ERROR;
+                break;
+            }
+            decoder->state = CHUNK_SIZE_START;
+            break;
+
+        // {ref}{LOGIC}{BODY_DECODE}{4}
+        case TRAILER_START:
+            if (c == '\r')
+            {
+                decoder->state = TRAILER_END_LF;
+            }
+            else if (c == '\n')
+            {
+                decoder->state = BODY_DONE;
+            }
+            else
+            {
+                decoder->state = TRAILER_LINE;
+            }
+            break;
+
+        case TRAILER_LINE:
+            // The limit covers the whole trailer section, not each line
+            if (++decoder->line_length > HTTP_BODY_MAX_LINE)
+            {
+                result = HTTP_BODY_ERROR;
+            }
+            else if (c == '\n')
+            {
+                decoder->state = TRAILER_START;
+            }
+            break;
+
+        case TRAILER_END_LF:
+            if (c != '\n')
+            {
+                result = HTTP_BODY_ERROR;
+                break;
+            }
+            decoder->state = BODY_DONE;
+            break;
+        }
+        i++;
+    }
+
+    *consumed = i;
+    if (result == HTTP_BODY_INCOMPLETE && decoder->state == BODY_DONE)
+    {
+        result = HTTP_BODY_DONE;
+    }
+    return result;
+}
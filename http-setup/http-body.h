@@ -0,0 +1,45 @@
+#ifndef HTTP_BODY_H
+#define HTTP_BODY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HTTP_BODY_MAX_LINE 4096 ///< Longest chunk-size line (with extensions) or trailer line accepted.
+
+/**
+ * @brief Receives a piece of decoded body
+ * @return 0 to continue, -1 to abort the request.
+ */
+typedef int (*HttpBodySink)(void *context, const char *data, size_t length);
+
+/**
+ * @brief Result of a call to http_body_decode()
+ */
+typedef enum
+{
+    HTTP_BODY_INCOMPLETE, ///< All input was consumed and more body is expected.
+    HTTP_BODY_DONE,       ///< The body ended; bytes after it belong to the next request.
+    HTTP_BODY_ERROR,      ///< Malformed chunked framing.
+    HTTP_BODY_ABORTED     ///< The sink returned -1.
+} HttpBodyResult;
+
+/**
+ * @brief Incremental decoder for a request body framed by Content-Length or chunked transfer coding
+ * @param state : Position in the chunked grammar, or the Content-Length state (internal)
+ * @param remaining : Bytes left in the current chunk, or in the whole Content-Length body
+ * @param line_length : Bytes seen in the current chunk extension or trailer line
+ */
+typedef struct
+{
+    int state;
+    uint64_t remaining;
+    size_t line_length;
+} HttpBodyDecoder;
+
+// Body decoder functions
+void http_body_init_length(HttpBodyDecoder *decoder, uint64_t content_length);
+void http_body_init_chunked(HttpBodyDecoder *decoder);
+HttpBodyResult http_body_decode(HttpBodyDecoder *decoder, const char *buf, size_t len, size_t *consumed,
+                                HttpBodySink sink, void *context);
+
+#endif // HTTP_BODY_H
@@ -0,0 +1,180 @@
+/**
+ * @file: http-head.c
+ *
+ * ℹ️ Pieces of response heads that do not have to be formatted per response.
+ *
+ * 1. Status lines are rendered at compile time into a table indexed by status code, so a head starts
+ *      with one memcpy of a known length instead of a printf of the code and reason.
+ * 2. HTTP/1.1 requires a Date header (RFC 9110 section 6.6.1), but its value only changes once a second.
+ *      Each worker keeps the formatted line and redoes it when the wall clock moved to the next second;
+ *      the line has a fixed length, so it is copied like a constant.
+ * 3. Numbers such as Content-Length, the hex of entity tags and the dates of Last-Modified are written with
+ *      small digit loops and tables rather than printf and strftime.
+ */
+#include "http-head.h"
+#include <string.h>
+
+#define HTTP_STATUS_CODES 600 ///< Status codes 100-599 index the table directly.
+
+/// @brief A table entry of the status line "HTTP/1.1 <line>\r\n"
+#define STATUS_LINE(line) {"HTTP/1.1 " line "\r\n", sizeof("HTTP/1.1 " line "\r\n") - 1}
+
+/// @brief Status lines of the codes the server and its handlers use, with the reason phrases of RFC 9110
+static const HttpStatusLine status_lines[HTTP_STATUS_CODES] = {
+    [100] = STATUS_LINE("100 Continue"),
+    [101] = STATUS_LINE("101 Switching Protocols"),
+    [200] = STATUS_LINE("200 OK"),
+    [201] = STATUS_LINE("201 Created"),
+    [202] = STATUS_LINE("202 Accepted"),
+    [204] = STATUS_LINE("204 No Content"),
+    [206] = STATUS_LINE("206 Partial Content"),
+    [301] = STATUS_LINE("301 Moved Permanently"),
+    [302] = STATUS_LINE("302 Found"),
+    [303] = STATUS_LINE("303 See Other"),
+    [304] = STATUS_LINE("304 Not Modified"),
+    [307] = STATUS_LINE("307 Temporary Redirect"),
+    [308] = STATUS_LINE("308 Permanent Redirect"),
+    [400] = STATUS_LINE("400 Bad Request"),
+    [401] = STATUS_LINE("401 Unauthorized"),
+    [403] = STATUS_LINE("403 Forbidden"),
+    [404] = STATUS_LINE("404 Not Found"),
+    [405] = STATUS_LINE("405 Method Not Allowed"),
+    [408] = STATUS_LINE("408 Request Timeout"),
+    [409] = STATUS_LINE("409 Conflict"),
+    [411] = STATUS_LINE("411 Length Required"),
+    [413] = STATUS_LINE("413 Content Too Large"),
+    [414] = STATUS_LINE("414 URI Too Long"),
+    [415] = STATUS_LINE("415 Unsupported Media Type"),
+    [416] = STATUS_LINE("416 Range Not Satisfiable"),
+    [417] = STATUS_LINE("417 Expectation Failed"),
+    [429] = STATUS_LINE("429 Too Many Requests"),
+    [431] = STATUS_LINE("431 Request Header Fields Too Large"),
+    [500] = STATUS_LINE("500 Internal Server Error"),
+    [501] = STATUS_LINE("501 Not Implemented"),
+    [502] = STATUS_LINE("502 Bad Gateway"),
+    [503] = STATUS_LINE("503 Service Unavailable"),
+    [504] = STATUS_LINE("504 Gateway Timeout"),
+    [505] = STATUS_LINE("505 HTTP Version Not Supported"),
+};
+
+/**
+ * @brief Looks up the pre-rendered status line of a code
+ * @return The line, or NULL for a code the table does not have; the caller then renders it itself.
+ */
+const HttpStatusLine *http_status_line(int status_code)
+{
+    if (status_code < 0 || status_code >= HTTP_STATUS_CODES || !status_lines[status_code].text)
+    {
+        return NULL;
+    }
+    return &status_lines[status_code];
+}
+
+/// @brief Writes a value in two digits
+static char *two_digits(char *out, int value)
+{
+    out[0] = '0' + value / 10;
+    out[1] = '0' + value % 10;
+    return out + 2;
+}
+
+/**
+ * @brief Writes a time as an IMF-fixdate, "Sun, 06 Nov 1994 08:49:37 GMT", without a terminating NUL
+ * @details [LOGIC][FORMAT_DATE]
+ * 1. Break the time down in UTC.
+ * 2. Write the fixed-width fields. Day and month names come from tables rather than strftime(), so the
+ *      result does not depend on the locale.
+ * @param out : Room for HTTP_DATE_LEN characters
+ * @return The end of the date written.
+ */
+char *http_format_date(char *out, time_t time)
+{
+    static const char days[7][4] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+    static const char months[12][4] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                       "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    // {ref}{LOGIC}{FORMAT_DATE}{1}
+    struct tm tm;
+    gmtime_r(&time, &tm);
+
+    // {ref}{LOGIC}{FORMAT_DATE}{2}
+    char *p = out;
+    memcpy(p, days[tm.tm_wday], 3);
+    p += 3;
+    *p++ = ',';
+    *p++ = ' ';
+    p = two_digits(p, tm.tm_mday);
+    *p++ = ' ';
+    memcpy(p, months[tm.tm_mon], 3);
+    p += 3;
+    *p++ = ' ';
+    int year = tm.tm_year + 1900;
+    p = two_digits(p, year / 100 % 100);
+    p = two_digits(p, year % 100);
+    *p++ = ' ';
+    p = two_digits(p, tm.tm_hour);
+    *p++ = ':';
+    p = two_digits(p, tm.tm_min);
+    *p++ = ':';
+    p = two_digits(p, tm.tm_sec);
+    memcpy(p, " GMT", 4);
+    return p + 4;
+}
+
+/**
+ * @brief Formats the Date line of a new second
+ * @details The line is "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n\r\n" (`http_format_date`).
+ */
+void http_date_refresh(HttpDateCache *cache, time_t now)
+{
+    char *p = cache->line;
+    memcpy(p, "Date: ", 6);
+    p = http_format_date(p + 6, now);
+    memcpy(p, "\r\n\r\n", 5);
+    cache->second = now;
+}
+
+/**
+ * @brief Writes a value in decimal, without a terminating NUL
+ * @param out : Room for HTTP_DECIMAL_SIZE characters
+ * @return The end of the digits written.
+ */
+char *http_format_decimal(char *out, uint64_t value)
+{
+    char digits[HTTP_DECIMAL_SIZE];
+    int n = 0;
+    do
+    {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    while (n > 0)
+    {
+        *out++ = digits[--n];
+    }
+    return out;
+}
+
+/**
+ * @brief Writes a value in lowercase hex, without a terminating NUL
+ * @param out : Room for HTTP_HEX_SIZE characters
+ * @param min_digits : Digits to write at least, padded with zeros
+ * @return The end of the digits written.
+ */
+char *http_format_hex(char *out, uint64_t value, int min_digits)
+{
+    static const char hex[] = "0123456789abcdef";
+    int n = 1;
+    while (n < HTTP_HEX_SIZE && value >> (4 * n))
+    {
+        n++;
+    }
+    if (n < min_digits)
+    {
+        n = min_digits;
+    }
+    for (int i = n - 1; i >= 0; i--)
+    {
+        *out++ = hex[(value >> (4 * i)) & 0xf];
+    }
+    return out;
+}
@@ -0,0 +1,58 @@
+#ifndef HTTP_HEAD_H
+#define HTTP_HEAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define HTTP_DATE_LEN 29       ///< Length of an IMF-fixdate such as "Sun, 06 Nov 1994 08:49:37 GMT"; it never varies.
+#define HTTP_DATE_SIZE 32      ///< Room for an IMF-fixdate and its NUL.
+#define HTTP_DATE_LINE_LEN 37  ///< Length of "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n".
+#define HTTP_DATE_LINE_SIZE 40 ///< Room for the Date line, the CRLF that may end a head after it, and a NUL.
+#define HTTP_DECIMAL_SIZE 20   ///< Digits of the largest 64-bit value.
+#define HTTP_HEX_SIZE 16       ///< Hex digits of the largest 64-bit value.
+
+/**
+ * @brief A status line rendered at compile time, "HTTP/1.1 <code> <reason>\r\n"
+ */
+typedef struct
+{
+    const char *text;
+    size_t len;
+} HttpStatusLine;
+
+/**
+ * @brief The Date line of one worker, formatted at most once a second
+ * @attention The line is rewritten in place when the second changes: responses copy it, never point to it.
+ * @param second : Wall-clock second the line shows
+ * @param line : "Date: <IMF-fixdate>\r\n\r\n"
+ */
+typedef struct
+{
+    time_t second;
+    char line[HTTP_DATE_LINE_SIZE];
+} HttpDateCache;
+
+// HTTP head functions
+const HttpStatusLine *http_status_line(int status_code);
+void http_date_refresh(HttpDateCache *cache, time_t now);
+char *http_format_date(char *out, time_t time);
+char *http_format_decimal(char *out, uint64_t value);
+char *http_format_hex(char *out, uint64_t value, int min_digits);
+
+/**
+ * @brief The current Date line, followed by a CRLF that a head may end with
+ * @details Reading the coarse wall clock is all a request costs; the line is only formatted again when
+ *      the second changed.
+ */
+static inline const char *http_date_line(HttpDateCache *cache)
+{
+    time_t now = time(NULL);
+    if (now != cache->second)
+    {
+        http_date_refresh(cache, now);
+    }
+    return cache->line;
+}
+
+#endif // HTTP_HEAD_H
@@ -0,0 +1,1002 @@
+/**
+ * http-load V1.0📔
+ * @file: http-load.c
+ *
+ * ℹ️ Load generator for http-server, grown out of http-client.c: instead of one request it keeps
+ *    many persistent connections busy and reports the latency distribution of the responses.
+ *
+ * 1. N connections are opened up front and spread over M threads. Each thread drives its share of the
+ *      connections with its own epoll instance and keeps its own statistics, so threads never contend.
+ * 2. Every connection is keep-alive and may have up to 'depth' requests in flight (HTTP pipelining).
+ *      Responses are framed by Content-Length or the chunked coding (decoded with http-body.c), so they
+ *      can be matched to the requests in order.
+ * 3. Closed loop (default): a connection sends its next request as soon as a response arrives; this
+ *      measures the highest throughput the server sustains.
+ * 4. Open loop (-r rate): requests are scheduled at a constant total rate, whether or not the server
+ *      keeps up. Latency is measured from the time a request was scheduled to be sent, not from when it
+ *      could be sent: a stalled server then shows up in the latency of every request it held back, instead of
+ *      silently lowering the request rate (coordinated omission). The uncorrected service time is
+ *      reported next to it.
+ * 5. Latencies go into log-linear histograms with 128 linear buckets per power of two (under 1% error),
+ *      merged after the run into percentiles from p50 to p99.99, printed as text or JSON (-j).
+ * 6. Only loopback addresses are accepted: the tool is meant to qualify a server build on the machine
+ *      it runs on, never to send load across a network.
+ *
+ * Build and run:
+ *      gcc -O2 -pthread http-load.c http-body.c -o http-load
+ *      ./http-load [-c connections] [-t threads] [-d seconds] [-p depth] [-r rate] [-m method] [-b body] [-C] [-j] [url]
+ */
+#define _GNU_SOURCE // epoll_pwait2(), memmem()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "http-body.h"
+
+#define PORT 8080                 ///< Same default port as http-server.c.
+#define BUFFER_SIZE 1024          ///< Largest request, as in http-client.c.
+#define RECV_BUFFER_SIZE (16 * 1024) ///< Receive buffer of a connection; a response head must fit in it.
+#define MAX_EVENTS 256
+#define MAX_DEPTH 1024            ///< Upper bound on the pipelining depth.
+#define DEFAULT_CONNECTIONS 64
+#define DEFAULT_THREADS 2
+#define DEFAULT_SECONDS 10
+#define HIST_SUB_BITS 7           ///< 128 linear buckets per power of two.
+#define HIST_MAX_SHIFT 40         ///< Latencies are capped at 2^40 ns (~18 minutes).
+#define HIST_BUCKETS ((HIST_MAX_SHIFT - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+#define MAX_WAIT_NS 10000000      ///< Longest sleep of a thread, so it notices the end of the run.
+
+/**
+ * @brief Log-linear latency histogram in nanoseconds
+ * @param buckets : Values below 2^(HIST_SUB_BITS+1) ns are counted exactly, larger ones in buckets
+ *      1/128 of their power of two wide
+ */
+typedef struct
+{
+    uint64_t buckets[HIST_BUCKETS];
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+} Histogram;
+
+/**
+ * @brief Framing of the response body being received
+ */
+typedef enum
+{
+    BODY_FRAMED,  ///< Content-Length or chunked, decoded by the HttpBodyDecoder
+    BODY_TO_CLOSE ///< Neither: the body ends when the server closes the connection
+} BodyMode;
+
+/**
+ * @brief One connection to the server and the requests in flight on it
+ * @param buf, len : Received bytes not yet consumed
+ * @param in_body : Set once the head of the current response was parsed
+ * @param status : Status code of the current response
+ * @param server_closes : The current response carried 'Connection: close'
+ * @param intended, sent : Per request in flight, oldest at 'oldest': when it was scheduled and when it was
+ *      handed to the socket. Both are the same in closed loop.
+ * @param in_flight : Requests sent or waiting in 'unsent' that have no response yet
+ * @param unsent : Bytes of queued requests not yet accepted by the socket
+ * @param next_send : Open loop: when the next request is due
+ */
+typedef struct
+{
+    int fd;
+    char buf[RECV_BUFFER_SIZE];
+    size_t len;
+    int in_body;
+    int status;
+    int server_closes;
+    BodyMode body_mode;
+    HttpBodyDecoder body;
+    uint64_t *intended;
+    uint64_t *sent;
+    int oldest;
+    int in_flight;
+    size_t unsent;
+    uint64_t next_send;
+} LoadConnection;
+
+/**
+ * @brief A thread driving a share of the connections, with its own statistics
+ * @param latency : Response time from the scheduled send; the coordinated-omission corrected
+ *      latency in open loop
+ * @param service : Response time from the actual send
+ * @param status_classes : Responses by status class, 1xx to 5xx
+ */
+typedef struct
+{
+    pthread_t thread;
+    LoadConnection *connections;
+    int connection_count;
+    int epoll_fd;
+    Histogram latency;
+    Histogram service;
+    uint64_t responses;
+    uint64_t bytes;
+    uint64_t status_classes[6];
+    uint64_t connect_errors;
+    uint64_t read_errors;
+    uint64_t write_errors;
+    uint64_t parse_errors;
+} LoadThread;
+
+/**
+ * @brief The run's settings, shared read-only by all threads
+ */
+typedef struct
+{
+    struct sockaddr_in addr;
+    char url[256];
+    int connections;
+    int threads;
+    double seconds;
+    int depth;
+    double rate;
+    int close_each;
+    int json;
+    char request[BUFFER_SIZE * 2];
+    size_t request_len;
+    char *pipeline; ///< 'depth' copies of the request back to back, so any run of queued requests is contiguous
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint64_t interval_ns; ///< Open loop: time between two requests of one connection
+} LoadConfig;
+
+static LoadConfig config;
+
+/// @brief Monotonic clock in nanoseconds
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/// @brief Bucket of a value: exact below 2^(HIST_SUB_BITS+1), then its power of two and 7 bits below the top one
+static int hist_bucket(uint64_t value)
+{
+    if (value >= (1ULL << HIST_MAX_SHIFT))
+    {
+        value = (1ULL << HIST_MAX_SHIFT) - 1;
+    }
+    int top = 63 - __builtin_clzll(value | 1);
+    if (top <= HIST_SUB_BITS)
+    {
+        return (int)value;
+    }
+    int shift = top - HIST_SUB_BITS;
+    return (shift << HIST_SUB_BITS) + (int)(value >> shift);
+}
+
+/// @brief Highest value that falls into a bucket
+static uint64_t hist_bucket_value(int bucket)
+{
+    if (bucket < (2 << HIST_SUB_BITS))
+    {
+        return bucket;
+    }
+    int shift = (bucket >> HIST_SUB_BITS) - 1;
+    uint64_t sub = (bucket & ((1 << HIST_SUB_BITS) - 1)) + (1 << HIST_SUB_BITS);
+    return ((sub + 1) << shift) - 1;
+}
+
+static void hist_record(Histogram *histogram, uint64_t value)
+{
+    histogram->buckets[hist_bucket(value)]++;
+    if (histogram->count == 0 || value < histogram->min)
+    {
+        histogram->min = value;
+    }
+    if (value > histogram->max)
+    {
+        histogram->max = value;
+    }
+    histogram->count++;
+    histogram->sum += value;
+}
+
+static void hist_merge(Histogram *into, const Histogram *from)
+{
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        into->buckets[i] += from->buckets[i];
+    }
+    if (from->count && (into->count == 0 || from->min < into->min))
+    {
+        into->min = from->min;
+    }
+    if (from->max > into->max)
+    {
+        into->max = from->max;
+    }
+    into->count += from->count;
+    into->sum += from->sum;
+}
+
+/// @brief Smallest recorded value that at least 'percentile' percent of the values do not exceed
+static uint64_t hist_percentile(const Histogram *histogram, double percentile)
+{
+    if (histogram->count == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percentile / 100.0 * histogram->count + 0.5);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += histogram->buckets[i];
+        if (seen >= rank)
+        {
+            uint64_t value = hist_bucket_value(i);
+            return value > histogram->max ? histogram->max : value;
+        }
+    }
+    return histogram->max;
+}
+
+/**
+ * @brief Parses an http:// URL of a loopback address
+ * @details [LOGIC][PARSE_URL]
+ * 1. Accept "http://host[:port][/path]"; "localhost" stands for 127.0.0.1.
+ * 2. Refuse any address outside 127.0.0.0/8.
+ * @return 0 on success, -1 if the URL is invalid or not on loopback.
+ */
+static int parse_url(const char *url, struct sockaddr_in *addr, char *host, size_t host_size, char *path,
+                     size_t path_size)
+{
+    // {ref}{LOGIC}{PARSE_URL}{1}
+    if (strncmp(url, "http://", 7) != 0)
+    {
+        return -1;
+    }
+    const char *authority = url + 7;
+    size_t authority_len = strcspn(authority, "/");
+    const char *colon = memchr(authority, ':', authority_len);
+    size_t host_len = colon ? (size_t)(colon - authority) : authority_len;
+    if (host_len == 0 || host_len >= host_size)
+    {
+        return -1;
+    }
+    memcpy(host, authority, host_len);
+    host[host_len] = '\0';
+    int port = colon ? atoi(colon + 1) : 80;
+    snprintf(path, path_size, "%s", authority[authority_len] ? authority + authority_len : "/");
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+    if (port <= 0 || port > 65535 ||
+        inet_pton(AF_INET, strcmp(host, "localhost") == 0 ? "127.0.0.1" : host, &addr->sin_addr) != 1)
+    {
+        return -1;
+    }
+    // {ref}{LOGIC}{PARSE_URL}{2}
+    if ((ntohl(addr->sin_addr.s_addr) >> 24) != 127)
+    {
+        fprintf(stderr, "%s is not a loopback address; http-load only runs against this machine\n", host);
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief Opens a connection to the server and registers it with the thread's epoll instance
+static int open_connection(LoadThread *thread, LoadConnection *conn)
+{
+    int one = 1;
+    conn->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (conn->fd == -1 || connect(conn->fd, (struct sockaddr *)&config.addr, sizeof(config.addr)) == -1)
+    {
+        if (conn->fd != -1)
+        {
+            close(conn->fd);
+        }
+        conn->fd = -1;
+        thread->connect_errors++;
+        return -1;
+    }
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(conn->fd, F_SETFL, O_NONBLOCK);
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLET, .data.ptr = conn};
+    epoll_ctl(thread->epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev);
+    conn->len = 0;
+    conn->in_body = 0;
+    conn->oldest = 0;
+    conn->in_flight = 0;
+    conn->unsent = 0;
+    return 0;
+}
+
+/// @brief Closes a connection; requests still in flight on it count as read errors
+static void close_load_connection(LoadThread *thread, LoadConnection *conn)
+{
+    if (conn->fd != -1)
+    {
+        close(conn->fd);
+        conn->fd = -1;
+    }
+    if (now_ns() < config.end_ns)
+    {
+        thread->read_errors += conn->in_flight;
+    }
+    conn->in_flight = 0;
+    conn->unsent = 0;
+}
+
+/**
+ * @brief Writes as much of the queued requests as the socket accepts
+ * @return 0 on success, -1 on a write error.
+ */
+static int flush_requests(LoadThread *thread, LoadConnection *conn)
+{
+    while (conn->unsent > 0)
+    {
+        size_t offset = (config.request_len - conn->unsent % config.request_len) % config.request_len;
+        size_t len = config.depth * config.request_len - offset;
+        if (len > conn->unsent)
+        {
+            len = conn->unsent;
+        }
+        ssize_t written = send(conn->fd, config.pipeline + offset, len, MSG_NOSIGNAL);
+        if (written == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return 0;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            thread->write_errors++;
+            return -1;
+        }
+        conn->unsent -= written;
+    }
+    return 0;
+}
+
+/// @brief Queues one request scheduled for 'intended', sent at 'now'
+static void queue_request(LoadConnection *conn, uint64_t intended, uint64_t now)
+{
+    int slot = (conn->oldest + conn->in_flight) % config.depth;
+    conn->intended[slot] = intended;
+    conn->sent[slot] = now;
+    conn->in_flight++;
+    conn->unsent += config.request_len;
+}
+
+/**
+ * @brief Queues the requests a connection may send now
+ * @details [LOGIC][SCHEDULE_REQUESTS]
+ * 1. Nothing once the run is over, and never more than 'depth' requests in flight.
+ * 2. Closed loop: fill the pipeline.
+ * 3. Open loop: queue every request whose scheduled time has come. A request that is due while the
+ *      pipeline is full keeps its scheduled time, so the wait counts towards its latency.
+ * 4. Send what was queued.
+ * @return -1 on a write error.
+ */
+static int schedule_requests(LoadThread *thread, LoadConnection *conn, uint64_t now)
+{
+    // {ref}{LOGIC}{SCHEDULE_REQUESTS}{1}
+    int limit = config.close_each ? 1 : config.depth;
+    while (now < config.end_ns && conn->in_flight < limit)
+    {
+        if (config.rate <= 0)
+        {
+            // {ref}{LOGIC}{SCHEDULE_REQUESTS}{2}
+            queue_request(conn, now, now);
+        }
+        else if (conn->next_send <= now)
+        {
+            // {ref}{LOGIC}{SCHEDULE_REQUESTS}{3}
+            queue_request(conn, conn->next_send, now);
+            conn->next_send += config.interval_ns;
+        }
+        else
+        {
+            break;
+        }
+    }
+    // {ref}{LOGIC}{SCHEDULE_REQUESTS}{4}
+    return flush_requests(thread, conn);
+}
+
+/// @brief Body sink that only drops the bytes; only the framing matters
+static int discard_body(void *context, const char *data, size_t length)
+{
+    (void)context;
+    (void)data;
+    (void)length;
+    return 0;
+}
+
+/**
+ * @brief Parses a response head at the start of the receive buffer
+ * @details [LOGIC][PARSE_RESPONSE_HEAD]
+ * 1. Wait until the blank line that ends the head has arrived.
+ * 2. Take the status code from the status line, and the framing from Content-Length and Transfer-Encoding.
+ *      1xx, 204 and 304 responses have no body; a response with no framing ends when the connection closes.
+ * 3. Drop the head from the buffer.
+ * @return 1 if a head was parsed, 0 if more input is needed, -1 on a malformed head.
+ */
+static int parse_response_head(LoadConnection *conn)
+{
+    // {ref}{LOGIC}{PARSE_RESPONSE_HEAD}{1}
+    char *end = memmem(conn->buf, conn->len, "\r\n\r\n", 4);
+    if (!end)
+    {
+        return conn->len == sizeof(conn->buf) ? -1 : 0;
+    }
+    *end = '\0';
+
+    // {ref}{LOGIC}{PARSE_RESPONSE_HEAD}{2}
+    if (sscanf(conn->buf, "HTTP/%*d.%*d %d", &conn->status) != 1)
+    {
+        return -1;
+    }
+    int chunked = 0;
+    long long content_length = -1;
+    conn->server_closes = 0;
+    for (char *line = strstr(conn->buf, "\r\n"); line; line = strstr(line, "\r\n"))
+    {
+        line += 2;
+        if (strncasecmp(line, "Content-Length:", 15) == 0)
+        {
+            content_length = strtoll(line + 15, NULL, 10);
+        }
+        else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0)
+        {
+            chunked = strcasestr(line, "chunked") != NULL;
+        }
+        else if (strncasecmp(line, "Connection:", 11) == 0)
+        {
+            conn->server_closes = strcasestr(line, "close") != NULL;
+        }
+    }
+    conn->body_mode = BODY_FRAMED;
+    if (conn->status < 200 || conn->status == 204 || conn->status == 304)
+    {
+        http_body_init_length(&conn->body, 0);
+    }
+    else if (chunked)
+    {
+        http_body_init_chunked(&conn->body);
+    }
+    else if (content_length >= 0)
+    {
+        http_body_init_length(&conn->body, content_length);
+    }
+    else
+    {
+        conn->body_mode = BODY_TO_CLOSE;
+    }
+
+    // {ref}{LOGIC}{PARSE_RESPONSE_HEAD}{3}
+    size_t head_len = end + 4 - conn->buf;
+    memmove(conn->buf, conn->buf + head_len, conn->len - head_len);
+    conn->len -= head_len;
+    return 1;
+}
+
+/**
+ * @brief Accounts for a complete response: matches it to the oldest request in flight
+ * @details [LOGIC][COMPLETE_RESPONSE]
+ * 1. Interim 1xx responses only precede the real one.
+ * 2. Responses completing after the end of the run are not counted.
+ * 3. Record the latency from the scheduled send and the service time from the actual send.
+ */
+static void complete_response(LoadThread *thread, LoadConnection *conn, uint64_t now)
+{
+    // {ref}{LOGIC}{COMPLETE_RESPONSE}{1}
+    if (conn->status < 200)
+    {
+        return;
+    }
+    int slot = conn->oldest;
+    conn->oldest = (conn->oldest + 1) % config.depth;
+    conn->in_flight--;
+
+    // {ref}{LOGIC}{COMPLETE_RESPONSE}{2}
+    if (now >= config.end_ns)
+    {
+        return;
+    }
+    // {ref}{LOGIC}{COMPLETE_RESPONSE}{3}
+    hist_record(&thread->latency, now - conn->intended[slot]);
+    hist_record(&thread->service, now - conn->sent[slot]);
+    thread->responses++;
+    thread->status_classes[conn->status / 100 <= 5 ? conn->status / 100 : 0]++;
+}
+
+/**
+ * @brief Reads from a connection and consumes every complete response
+ * @details [LOGIC][READ_RESPONSES]
+ * 1. Read until the socket is drained (the socket is edge-triggered).
+ * 2. Parse heads and decode bodies; each complete response frees a pipeline slot.
+ * 3. A response that asked to close the connection, or every response with -C, ends the connection:
+ *      it is reopened for the next request while the run lasts.
+ * 4. End of stream completes a body that runs to the close, and otherwise fails the requests in flight.
+ * @return -1 if the connection was closed.
+ */
+static int read_responses(LoadThread *thread, LoadConnection *conn, uint64_t now)
+{
+    while (1)
+    {
+        // {ref}{LOGIC}{READ_RESPONSES}{1}
+        ssize_t n = recv(conn->fd, conn->buf + conn->len, sizeof(conn->buf) - conn->len, 0);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return 0;
+        }
+        if (n <= 0)
+        {
+            // {ref}{LOGIC}{READ_RESPONSES}{4}
+            if (n == 0 && conn->in_body && conn->body_mode == BODY_TO_CLOSE)
+            {
+                complete_response(thread, conn, now);
+            }
+            else if (n == -1)
+            {
+                thread->read_errors++;
+            }
+            close_load_connection(thread, conn);
+            return -1;
+        }
+        thread->bytes += n;
+        conn->len += n;
+
+        // {ref}{LOGIC}{READ_RESPONSES}{2}
+        while (conn->len > 0 || conn->in_body)
+        {
+            if (!conn->in_body)
+            {
+                int parsed = parse_response_head(conn);
+                if (parsed == 0)
+                {
+                    break;
+                }
+                if (parsed == -1 || conn->in_flight == 0)
+                {
+                    thread->parse_errors++;
+                    close_load_connection(thread, conn);
+                    return -1;
+                }
+                conn->in_body = 1;
+            }
+            if (conn->body_mode == BODY_TO_CLOSE)
+            {
+                conn->len = 0;
+                break;
+            }
+            size_t consumed;
+            HttpBodyResult result = http_body_decode(&conn->body, conn->buf, conn->len, &consumed, discard_body, NULL);
+            memmove(conn->buf, conn->buf + consumed, conn->len - consumed);
+            conn->len -= consumed;
+            if (result == HTTP_BODY_INCOMPLETE)
+            {
+                break;
+            }
+            if (result != HTTP_BODY_DONE)
+            {
+                thread->parse_errors++;
+                close_load_connection(thread, conn);
+                return -1;
+            }
+            conn->in_body = 0;
+            complete_response(thread, conn, now);
+
+            // {ref}{LOGIC}{READ_RESPONSES}{3}
+            if (conn->status >= 200 && (conn->server_closes || config.close_each))
+            {
+                close_load_connection(thread, conn);
+                return -1;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Thread body: drives the thread's connections until the end of the run
+ * @details [LOGIC][LOAD_THREAD]
+ * 1. Reopen connections that were closed, then let every connection queue what it may send now.
+ * 2. Sleep until a socket is ready or the next open-loop request is due, with microsecond precision
+ *      (epoll_pwait2), since a late wake-up would be measured as server latency.
+ * 3. Read the responses and continue the writes the sockets have room for.
+ */
+static void *load_thread_main(void *arg)
+{
+    LoadThread *thread = arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (1)
+    {
+        uint64_t now = now_ns();
+        if (now >= config.end_ns)
+        {
+            break;
+        }
+
+        // {ref}{LOGIC}{LOAD_THREAD}{1}
+        uint64_t wake = now + MAX_WAIT_NS;
+        for (int i = 0; i < thread->connection_count; i++)
+        {
+            LoadConnection *conn = &thread->connections[i];
+            if (conn->fd == -1 && open_connection(thread, conn) == -1)
+            {
+                continue;
+            }
+            if (schedule_requests(thread, conn, now) == -1)
+            {
+                close_load_connection(thread, conn);
+                continue;
+            }
+            if (config.rate > 0 && conn->in_flight < config.depth && conn->next_send < wake)
+            {
+                wake = conn->next_send;
+            }
+        }
+
+        // {ref}{LOGIC}{LOAD_THREAD}{2}
+        uint64_t wait = wake > now ? wake - now : 0;
+        struct timespec timeout = {.tv_sec = wait / 1000000000ULL, .tv_nsec = wait % 1000000000ULL};
+        int n = epoll_pwait2(thread->epoll_fd, events, MAX_EVENTS, &timeout, NULL);
+        if (n == -1 && errno != EINTR)
+        {
+            perror("epoll_pwait2");
+            break;
+        }
+
+        // {ref}{LOGIC}{LOAD_THREAD}{3}
+        now = now_ns();
+        for (int i = 0; i < n; i++)
+        {
+            LoadConnection *conn = events[i].data.ptr;
+            if (conn->fd == -1)
+            {
+                continue;
+            }
+            if (read_responses(thread, conn, now) == -1)
+            {
+                continue;
+            }
+            if (flush_requests(thread, conn) == -1)
+            {
+                close_load_connection(thread, conn);
+            }
+        }
+    }
+
+    for (int i = 0; i < thread->connection_count; i++)
+    {
+        if (thread->connections[i].fd != -1)
+        {
+            close(thread->connections[i].fd);
+        }
+    }
+    close(thread->epoll_fd);
+    return NULL;
+}
+
+/// @brief Prints a histogram's percentiles in microseconds as text
+static void print_histogram_text(const char *title, const Histogram *histogram)
+{
+    static const double percentiles[] = {50, 75, 90, 99, 99.9, 99.99};
+    printf("  %s\n", title);
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++)
+    {
+        printf("    p%-7g %12.1f us\n", percentiles[i], hist_percentile(histogram, percentiles[i]) / 1e3);
+    }
+    printf("    %-8s %12.1f us\n    %-8s %12.1f us\n", "max", histogram->max / 1e3, "mean",
+           histogram->count ? histogram->sum / histogram->count / 1e3 : 0.0);
+}
+
+/// @brief Prints a histogram's percentiles in microseconds as a JSON object
+static void print_histogram_json(const char *name, const Histogram *histogram)
+{
+    printf("  \"%s\": {\"min\": %.1f, \"mean\": %.1f, \"p50\": %.1f, \"p75\": %.1f, \"p90\": %.1f, "
+           "\"p99\": %.1f, \"p99.9\": %.1f, \"p99.99\": %.1f, \"max\": %.1f}",
+           name, histogram->min / 1e3, histogram->count ? histogram->sum / histogram->count / 1e3 : 0.0,
+           hist_percentile(histogram, 50) / 1e3, hist_percentile(histogram, 75) / 1e3,
+           hist_percentile(histogram, 90) / 1e3, hist_percentile(histogram, 99) / 1e3,
+           hist_percentile(histogram, 99.9) / 1e3, hist_percentile(histogram, 99.99) / 1e3,
+           histogram->max / 1e3);
+}
+
+/**
+ * @brief Merges the threads' statistics and prints the report
+ * @details In closed loop every request is sent when it is scheduled, so only one latency distribution is printed.
+ */
+static void report(LoadThread *threads)
+{
+    static LoadThread total;
+    for (int t = 0; t < config.threads; t++)
+    {
+        hist_merge(&total.latency, &threads[t].latency);
+        hist_merge(&total.service, &threads[t].service);
+        total.responses += threads[t].responses;
+        total.bytes += threads[t].bytes;
+        for (int c = 0; c < 6; c++)
+        {
+            total.status_classes[c] += threads[t].status_classes[c];
+        }
+        total.connect_errors += threads[t].connect_errors;
+        total.read_errors += threads[t].read_errors;
+        total.write_errors += threads[t].write_errors;
+        total.parse_errors += threads[t].parse_errors;
+    }
+    double rps = total.responses / config.seconds;
+    const char *mode = config.rate > 0 ? "open" : "closed";
+
+    if (config.json)
+    {
+        printf("{\n  \"url\": \"%s\", \"threads\": %d, \"connections\": %d, \"depth\": %d, \"mode\": \"%s\", "
+               "\"rate\": %.0f, \"seconds\": %.2f,\n",
+               config.url, config.threads, config.connections, config.depth, mode, config.rate, config.seconds);
+        printf("  \"requests\": %llu, \"requests_per_second\": %.1f, \"bytes\": %llu,\n",
+               (unsigned long long)total.responses, rps, (unsigned long long)total.bytes);
+        printf("  \"status\": {\"1xx\": %llu, \"2xx\": %llu, \"3xx\": %llu, \"4xx\": %llu, \"5xx\": %llu},\n",
+               (unsigned long long)total.status_classes[1], (unsigned long long)total.status_classes[2],
+               (unsigned long long)total.status_classes[3], (unsigned long long)total.status_classes[4],
+               (unsigned long long)total.status_classes[5]);
+        printf("  \"errors\": {\"connect\": %llu, \"read\": %llu, \"write\": %llu, \"parse\": %llu},\n",
+               (unsigned long long)total.connect_errors, (unsigned long long)total.read_errors,
+               (unsigned long long)total.write_errors, (unsigned long long)total.parse_errors);
+        print_histogram_json("latency_us", &total.latency);
+        printf(",\n");
+        print_histogram_json("service_time_us", &total.service);
+        printf("\n}\n");
+        return;
+    }
+
+    printf("%.2f s @ %s\n", config.seconds, config.url);
+    printf("  %d threads, %d connections, pipeline depth %d, %s loop", config.threads, config.connections,
+           config.depth, mode);
+    if (config.rate > 0)
+    {
+        printf(" at %.0f requests/s", config.rate);
+    }
+    printf("%s\n", config.close_each ? ", new connection per request" : "");
+    printf("  %llu requests, %.1f requests/s, %.1f MB read\n", (unsigned long long)total.responses, rps,
+           total.bytes / 1e6);
+    printf("  status 2xx %llu, 3xx %llu, 4xx %llu, 5xx %llu\n", (unsigned long long)total.status_classes[2],
+           (unsigned long long)total.status_classes[3], (unsigned long long)total.status_classes[4],
+           (unsigned long long)total.status_classes[5]);
+    printf("  errors: connect %llu, read %llu, write %llu, parse %llu\n", (unsigned long long)total.connect_errors,
+           (unsigned long long)total.read_errors, (unsigned long long)total.write_errors,
+           (unsigned long long)total.parse_errors);
+    if (config.rate > 0)
+    {
+        print_histogram_text("Latency (from scheduled send, corrected for coordinated omission)", &total.latency);
+        print_histogram_text("Service time (from actual send, uncorrected)", &total.service);
+    }
+    else
+    {
+        print_histogram_text("Latency", &total.latency);
+    }
+}
+
+/**
+ * @brief Parses the command line, opens the connections, runs the threads and prints the report
+ * @param argc Number of command-line arguments.
+ * @param argv Usage: http-load [-c connections] [-t threads] [-d seconds] [-p depth] [-r rate] [-m method]
+ *      [-b body] [-C] [-j] [url]
+ *      -c  connections, spread over the threads (default DEFAULT_CONNECTIONS)
+ *      -t  threads (default DEFAULT_THREADS, at most one per connection)
+ *      -d  duration of the run in seconds (default DEFAULT_SECONDS)
+ *      -p  requests in flight per connection (pipelining depth, default 1)
+ *      -r  open loop at this total rate in requests per second (default: closed loop)
+ *      -m  GET (default) or POST; -b sets the POST body
+ *      -C  close the connection after every response instead of keeping it alive
+ *      -j  print the report as JSON
+ *      url defaults to http://127.0.0.1:8080/ and must be a loopback address.
+ * @details [LOGIC][LOAD_MAIN]
+ * 1. Parse the options and the URL.
+ * 2. Build the request once, as http-client.c does, and repeat it 'depth' times for pipelined sends.
+ * 3. Give every thread its share of the connections and open them before the clock starts.
+ * 4. Open loop: spread the connections' first requests evenly over one interval, so the total rate is
+ *      smooth from the start.
+ * 5. Run the threads, then report.
+ * @return 0 on success, 1 on invalid arguments or if no connection could be opened.
+ */
+int main(int argc, char *argv[])
+{
+    const char *method = "GET";
+    const char *body = "";
+    int opt;
+
+    // {ref}{LOGIC}{LOAD_MAIN}{1}
+    config.connections = DEFAULT_CONNECTIONS;
+    config.threads = DEFAULT_THREADS;
+    config.seconds = DEFAULT_SECONDS;
+    config.depth = 1;
+    while ((opt = getopt(argc, argv, "c:t:d:p:r:m:b:Cj")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            config.connections = atoi(optarg);
+            break;
+        case 't':
+            config.threads = atoi(optarg);
+            break;
+        case 'd':
+            config.seconds = atof(optarg);
+            break;
+        case 'p':
+            config.depth = atoi(optarg);
+            break;
+        case 'r':
+            config.rate = atof(optarg);
+            break;
+        case 'm':
+            method = optarg;
+            break;
+        case 'b':
+            body = optarg;
+            break;
+        case 'C':
+            config.close_each = 1;
+            break;
+        case 'j':
+            config.json = 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-c connections] [-t threads] [-d seconds] [-p depth] [-r rate] "
+                            "[-m method] [-b body] [-C] [-j] [url]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc)
+    {
+        snprintf(config.url, sizeof(config.url), "%s", argv[optind]);
+    }
+    else
+    {
+        snprintf(config.url, sizeof(config.url), "http://127.0.0.1:%d/", PORT);
+    }
+    char host[64], path[BUFFER_SIZE / 2];
+    if (parse_url(config.url, &config.addr, host, sizeof(host), path, sizeof(path)) == -1)
+    {
+        fprintf(stderr, "Invalid URL %s: expected http://127.x.x.x[:port][/path]\n", config.url);
+        return 1;
+    }
+    if (config.connections < 1 || config.seconds <= 0 || config.depth < 1 || config.depth > MAX_DEPTH)
+    {
+        fprintf(stderr, "connections and seconds must be positive, depth between 1 and %d\n", MAX_DEPTH);
+        return 1;
+    }
+    if (config.threads < 1 || config.threads > config.connections)
+    {
+        config.threads = config.threads < 1 ? 1 : config.connections;
+    }
+
+    // {ref}{LOGIC}{LOAD_MAIN}{2}
+    int port = ntohs(config.addr.sin_port);
+    int request_len;
+    if (strcmp(method, "GET") == 0)
+    {
+        request_len = snprintf(config.request, sizeof(config.request),
+                               "GET %s HTTP/1.1\r\n"
+                               "Host: %s:%d\r\n"
+                               "%s"
+                               "\r\n",
+                               path, host, port, config.close_each ? "Connection: close\r\n" : "");
+    }
+    else if (strcmp(method, "POST") == 0)
+    {
+        request_len = snprintf(config.request, sizeof(config.request),
+                               "POST %s HTTP/1.1\r\n"
+                               "Host: %s:%d\r\n"
+                               "%s"
+                               "Content-Type: application/x-www-form-urlencoded\r\n"
+                               "Content-Length: %zu\r\n"
+                               "\r\n"
+                               "%s",
+                               path, host, port, config.close_each ? "Connection: close\r\n" : "", strlen(body), body);
+    }
+    else
+    {
+        fprintf(stderr, "Unsupported method: %s\n", method);
+        return 1;
+    }
+    if (request_len >= (int)sizeof(config.request))
+    {
+        fprintf(stderr, "Request too large\n");
+        return 1;
+    }
+    config.request_len = request_len;
+    config.pipeline = malloc(config.depth * config.request_len);
+    LoadThread *threads = calloc(config.threads, sizeof(LoadThread));
+    LoadConnection *connections = calloc(config.connections, sizeof(LoadConnection));
+    uint64_t *slots = calloc((size_t)config.connections * config.depth * 2, sizeof(uint64_t));
+    if (!config.pipeline || !threads || !connections || !slots)
+    {
+        perror("malloc");
+        return 1;
+    }
+    for (int i = 0; i < config.connections; i++)
+    {
+        connections[i].intended = slots + (size_t)i * config.depth * 2;
+        connections[i].sent = connections[i].intended + config.depth;
+    }
+    for (int i = 0; i < config.depth; i++)
+    {
+        memcpy(config.pipeline + i * config.request_len, config.request, config.request_len);
+    }
+
+    // {ref}{LOGIC}{LOAD_MAIN}{3}
+    int opened = 0;
+    for (int t = 0, first = 0; t < config.threads; t++)
+    {
+        LoadThread *thread = &threads[t];
+        thread->connection_count = config.connections / config.threads + (t < config.connections % config.threads);
+        thread->connections = &connections[first];
+        thread->epoll_fd = epoll_create1(0);
+        first += thread->connection_count;
+        for (int i = 0; i < thread->connection_count; i++)
+        {
+            opened += open_connection(thread, &thread->connections[i]) == 0;
+        }
+    }
+    if (opened == 0)
+    {
+        fprintf(stderr, "Could not connect to %s\n", config.url);
+        return 1;
+    }
+
+    // {ref}{LOGIC}{LOAD_MAIN}{4}
+    config.start_ns = now_ns();
+    config.end_ns = config.start_ns + (uint64_t)(config.seconds * 1e9);
+    if (config.rate > 0)
+    {
+        config.interval_ns = (uint64_t)(config.connections * 1e9 / config.rate);
+        for (int i = 0; i < config.connections; i++)
+        {
+            connections[i].next_send = config.start_ns + config.interval_ns * i / config.connections;
+        }
+    }
+
+    // {ref}{LOGIC}{LOAD_MAIN}{5}
+    for (int t = 0; t < config.threads; t++)
+    {
+        int err = pthread_create(&threads[t].thread, NULL, load_thread_main, &threads[t]);
+        if (err)
+        {
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            return 1;
+        }
+    }
+    for (int t = 0; t < config.threads; t++)
+    {
+        pthread_join(threads[t].thread, NULL);
+    }
+    report(threads);
+
+    free(slots);
+    free(connections);
+    free(threads);
+    free(config.pipeline);
+    return 0;
+}
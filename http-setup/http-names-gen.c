@@ -0,0 +1,130 @@
+/**
+ * @file: http-names-gen.c
+ *
+ * http-names-gen V1.0📔
+ *
+ * ℹ️ Generates http-names-table.h: perfect hash tables mapping the request methods and header names the
+ *    server knows to their enum IDs in http-names.h.
+ *
+ * 1. A name is reduced to a 32-bit key of its first byte, last byte and length (letters folded to lower
+ *      case), and hashed with one multiplication: (key * seed) >> (32 - bits).
+ * 2. For each list the generator looks for the smallest table, then the first seed, for which no two
+ *      names share a slot, and prints the seed and the table as C.
+ * 3. A lookup then costs one multiplication and at most one comparison against the name in its slot.
+ *
+ * Usage: ./http-names-gen > http-names-table.h
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_BITS 10        ///< Largest table tried: 1024 slots.
+#define MAX_SEED_TRIES 1000000
+
+/// @brief Methods in the order of HttpMethod, from HTTP_METHOD_GET on
+static const char *methods[] = {"GET", "HEAD", "POST", "PUT", "DELETE", "CONNECT", "OPTIONS", "TRACE", "PATCH"};
+
+/// @brief Header names in the order of HttpHeaderId
+static const char *headers[] = {
+    "Host", "Connection", "Content-Length", "Content-Type", "Transfer-Encoding", "Expect", "If-None-Match",
+    "If-Modified-Since", "If-Range", "Range", "Accept", "Accept-Encoding", "User-Agent", "Referer", "Cookie",
+    "Authorization", "Cache-Control", "Upgrade", "Keep-Alive", "TE", "X-Forwarded-For",
+};
+
+/// @brief Hash key of a name; must match name_key() in http-names.c
+static uint32_t name_key(const char *name, size_t len)
+{
+    return (uint32_t)(name[0] | 0x20) | (uint32_t)(name[len - 1] | 0x20) << 8 | (uint32_t)len << 16;
+}
+
+/// @brief Slot of a key in a table of 2^bits slots
+static uint32_t slot_of(uint32_t key, uint32_t seed, int bits)
+{
+    return (key * seed) >> (32 - bits);
+}
+
+/**
+ * @brief Find the smallest collision-free table for a list of names
+ * @details [LOGIC][FIND_HASH]
+ * 1. Start with the smallest power of two that holds every name.
+ * 2. Try odd seeds from a fixed pseudo-random sequence, so the output is reproducible.
+ * 3. If no seed separates all names, double the table.
+ * @return 0 on success with *seed and *bits set, -1 if even the largest table failed.
+ */
+static int find_hash(const char **names, int count, uint32_t *seed, int *bits)
+{
+    // {ref}{LOGIC}{FIND_HASH}{1}
+    int b = 1;
+    while ((1 << b) < count)
+    {
+        b++;
+    }
+    for (; b <= MAX_BITS; b++)
+    {
+        // {ref}{LOGIC}{FIND_HASH}{2}
+        uint32_t candidate = 0x9E3779B9u;
+        for (int attempt = 0; attempt < MAX_SEED_TRIES; attempt++)
+        {
+            candidate = candidate * 1664525u + 1013904223u;
+            uint32_t s = candidate | 1;
+            unsigned char used[1 << MAX_BITS] = {0};
+            int ok = 1;
+            for (int i = 0; i < count && ok; i++)
+            {
+                uint32_t slot = slot_of(name_key(names[i], strlen(names[i])), s, b);
+                ok = !used[slot];
+                used[slot] = 1;
+            }
+            if (ok)
+            {
+                *seed = s;
+                *bits = b;
+                return 0;
+            }
+        }
+        // {ref}{LOGIC}{FIND_HASH}{3}
+    }
+    return -1;
+}
+
+/// @brief Enum constant of a name: prefix plus the name in upper case with '-' as '_'
+static void print_enum(const char *prefix, const char *name)
+{
+    printf("%s", prefix);
+    for (const char *p = name; *p; p++)
+    {
+        putchar(*p == '-' ? '_' : (*p >= 'a' && *p <= 'z' ? *p - 32 : *p));
+    }
+}
+
+/// @brief Prints the seed, size and slots of one table
+static void print_table(const char *macro, const char *table, const char *prefix, const char **names, int count)
+{
+    uint32_t seed;
+    int bits;
+    if (find_hash(names, count, &seed, &bits) == -1)
+    {
+        fprintf(stderr, "no perfect hash found for %s\n", table);
+        exit(EXIT_FAILURE);
+    }
+    printf("#define %s_SEED 0x%08xu\n#define %s_BITS %d\n\n", macro, seed, macro, bits);
+    printf("static const NameEntry %s[1 << %s_BITS] = {\n", table, macro);
+    for (int i = 0; i < count; i++)
+    {
+        size_t len = strlen(names[i]);
+        printf("    [%u] = {\"%s\", %zu, ", slot_of(name_key(names[i], len), seed, bits), names[i], len);
+        print_enum(prefix, names[i]);
+        printf("},\n");
+    }
+    printf("};\n");
+}
+
+int main(void)
+{
+    printf("// Generated by http-names-gen.c; do not edit.\n\n");
+    print_table("METHOD_HASH", "method_table", "HTTP_METHOD_", methods, sizeof(methods) / sizeof(methods[0]));
+    printf("\n");
+    print_table("HEADER_HASH", "header_table", "HTTP_HEADER_", headers, sizeof(headers) / sizeof(headers[0]));
+    return 0;
+}
@@ -0,0 +1,43 @@
+// Generated by http-names-gen.c; do not edit.
+
+#define METHOD_HASH_SEED 0x42d0d7c5u
+#define METHOD_HASH_BITS 4
+
+static const NameEntry method_table[1 << METHOD_HASH_BITS] = {
+    [0] = {"GET", 3, HTTP_METHOD_GET},
+    [1] = {"HEAD", 4, HTTP_METHOD_HEAD},
+    [3] = {"POST", 4, HTTP_METHOD_POST},
+    [6] = {"PUT", 3, HTTP_METHOD_PUT},
+    [8] = {"DELETE", 6, HTTP_METHOD_DELETE},
+    [5] = {"CONNECT", 7, HTTP_METHOD_CONNECT},
+    [10] = {"OPTIONS", 7, HTTP_METHOD_OPTIONS},
+    [14] = {"TRACE", 5, HTTP_METHOD_TRACE},
+    [4] = {"PATCH", 5, HTTP_METHOD_PATCH},
+};
+
+#define HEADER_HASH_SEED 0xa8f4f45du
+#define HEADER_HASH_BITS 5
+
+static const NameEntry header_table[1 << HEADER_HASH_BITS] = {
+    [14] = {"Host", 4, HTTP_HEADER_HOST},
+    [4] = {"Connection", 10, HTTP_HEADER_CONNECTION},
+    [6] = {"Content-Length", 14, HTTP_HEADER_CONTENT_LENGTH},
+    [13] = {"Content-Type", 12, HTTP_HEADER_CONTENT_TYPE},
+    [10] = {"Transfer-Encoding", 17, HTTP_HEADER_TRANSFER_ENCODING},
+    [12] = {"Expect", 6, HTTP_HEADER_EXPECT},
+    [7] = {"If-None-Match", 13, HTTP_HEADER_IF_NONE_MATCH},
+    [5] = {"If-Modified-Since", 17, HTTP_HEADER_IF_MODIFIED_SINCE},
+    [18] = {"If-Range", 8, HTTP_HEADER_IF_RANGE},
+    [20] = {"Range", 5, HTTP_HEADER_RANGE},
+    [23] = {"Accept", 6, HTTP_HEADER_ACCEPT},
+    [28] = {"Accept-Encoding", 15, HTTP_HEADER_ACCEPT_ENCODING},
+    [24] = {"User-Agent", 10, HTTP_HEADER_USER_AGENT},
+    [0] = {"Referer", 7, HTTP_HEADER_REFERER},
+    [22] = {"Cookie", 6, HTTP_HEADER_COOKIE},
+    [21] = {"Authorization", 13, HTTP_HEADER_AUTHORIZATION},
+    [2] = {"Cache-Control", 13, HTTP_HEADER_CACHE_CONTROL},
+    [17] = {"Upgrade", 7, HTTP_HEADER_UPGRADE},
+    [25] = {"Keep-Alive", 10, HTTP_HEADER_KEEP_ALIVE},
+    [3] = {"TE", 2, HTTP_HEADER_TE},
+    [19] = {"X-Forwarded-For", 15, HTTP_HEADER_X_FORWARDED_FOR},
+};
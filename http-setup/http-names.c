@@ -0,0 +1,67 @@
+/**
+ * @file: http-names.c
+ *
+ * ℹ️ Maps request methods and header names to enum IDs with perfect hash tables generated by http-names-gen.c.
+ *
+ * 1. The parser classifies every method and header name once, when the request head is complete; handlers
+ *      then compare IDs and index header slots instead of comparing strings.
+ * 2. A name is hashed from its first byte, last byte and length with one multiplication. Every known name has
+ *      a slot of its own, so a lookup compares the name against at most one candidate.
+ * 3. Methods are case-sensitive (RFC 9110 section 9.1); header names are not (RFC 9110 section 5.1).
+ *
+ * To add a name, add it to http-names.h and to the matching list in http-names-gen.c, then regenerate the
+ * tables: ./http-names-gen > http-names-table.h
+ */
+#include "http-names.h"
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+/**
+ * @brief One slot of a generated table
+ * @param length : Length of name; 0 for an empty slot, which no lookup matches
+ */
+typedef struct
+{
+    const char *name;
+    uint8_t length;
+    uint8_t id;
+} NameEntry;
+
+#include "http-names-table.h"
+
+/// @brief Hash key of a name: first and last byte folded to lower case, and the length
+static inline uint32_t name_key(const char *name, size_t len)
+{
+    return (uint32_t)(name[0] | 0x20) | (uint32_t)(name[len - 1] | 0x20) << 8 | (uint32_t)len << 16;
+}
+
+/// @brief Classifies a request method; anything not in the table is HTTP_METHOD_UNKNOWN
+HttpMethod http_method_lookup(const char *name, size_t len)
+{
+    if (len == 0)
+    {
+        return HTTP_METHOD_UNKNOWN;
+    }
+    const NameEntry *entry = &method_table[(name_key(name, len) * METHOD_HASH_SEED) >> (32 - METHOD_HASH_BITS)];
+    if (entry->length == len && memcmp(entry->name, name, len) == 0)
+    {
+        return entry->id;
+    }
+    return HTTP_METHOD_UNKNOWN;
+}
+
+/// @brief Classifies a header name (case-insensitive); anything not in the table is HTTP_HEADER_UNKNOWN
+HttpHeaderId http_header_lookup(const char *name, size_t len)
+{
+    if (len == 0)
+    {
+        return HTTP_HEADER_UNKNOWN;
+    }
+    const NameEntry *entry = &header_table[(name_key(name, len) * HEADER_HASH_SEED) >> (32 - HEADER_HASH_BITS)];
+    if (entry->length == len && strncasecmp(entry->name, name, len) == 0)
+    {
+        return entry->id;
+    }
+    return HTTP_HEADER_UNKNOWN;
+}
@@ -0,0 +1,60 @@
+#ifndef HTTP_NAMES_H
+#define HTTP_NAMES_H
+
+#include <stddef.h>
+
+/**
+ * @brief Request methods known to the server
+ * @attention Names and order must match the method list in http-names-gen.c.
+ */
+typedef enum
+{
+    HTTP_METHOD_UNKNOWN,
+    HTTP_METHOD_GET,
+    HTTP_METHOD_HEAD,
+    HTTP_METHOD_POST,
+    HTTP_METHOD_PUT,
+    HTTP_METHOD_DELETE,
+    HTTP_METHOD_CONNECT,
+    HTTP_METHOD_OPTIONS,
+    HTTP_METHOD_TRACE,
+    HTTP_METHOD_PATCH,
+    HTTP_METHOD_COUNT
+} HttpMethod;
+
+/**
+ * @brief Request headers the server looks up; each has a slot in HttpRequest.header_slots
+ * @attention Names and order must match the header list in http-names-gen.c.
+ */
+typedef enum
+{
+    HTTP_HEADER_HOST,
+    HTTP_HEADER_CONNECTION,
+    HTTP_HEADER_CONTENT_LENGTH,
+    HTTP_HEADER_CONTENT_TYPE,
+    HTTP_HEADER_TRANSFER_ENCODING,
+    HTTP_HEADER_EXPECT,
+    HTTP_HEADER_IF_NONE_MATCH,
+    HTTP_HEADER_IF_MODIFIED_SINCE,
+    HTTP_HEADER_IF_RANGE,
+    HTTP_HEADER_RANGE,
+    HTTP_HEADER_ACCEPT,
+    HTTP_HEADER_ACCEPT_ENCODING,
+    HTTP_HEADER_USER_AGENT,
+    HTTP_HEADER_REFERER,
+    HTTP_HEADER_COOKIE,
+    HTTP_HEADER_AUTHORIZATION,
+    HTTP_HEADER_CACHE_CONTROL,
+    HTTP_HEADER_UPGRADE,
+    HTTP_HEADER_KEEP_ALIVE,
+    HTTP_HEADER_TE,
+    HTTP_HEADER_X_FORWARDED_FOR,
+    HTTP_HEADER_COUNT,
+    HTTP_HEADER_UNKNOWN = HTTP_HEADER_COUNT
+} HttpHeaderId;
+
+// Name lookup functions
+HttpMethod http_method_lookup(const char *name, size_t len);
+HttpHeaderId http_header_lookup(const char *name, size_t len);
+
+#endif // HTTP_NAMES_H
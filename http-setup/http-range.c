@@ -0,0 +1,176 @@
+/**
+ * @file: http-range.c
+ *
+ * ℹ️ Parses the Range request header (RFC 9110 section 14.2) into byte ranges of a body of known size.
+ *
+ * 1. Only the 'bytes' unit exists. A range is 'first-last', 'first-' (to the end) or '-suffix' (the last
+ *      bytes); ranges are separated by commas with optional whitespace.
+ * 2. A header that does not parse is ignored rather than rejected, as RFC 9110 asks, and so is one with more
+ *      than HTTP_RANGE_MAX ranges: the client simply gets the whole body.
+ * 3. Ranges are clipped to the body, sorted, and overlapping or adjacent ones are merged (RFC 9110 section
+ *      15.3.7.2 allows this), so a request cannot make the server send the same bytes many times over.
+ */
+#include "http-range.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <strings.h>
+
+/**
+ * @brief Parses a run of digits; returns a pointer past them, or NULL if there are none
+ * @details Values too large for 64 bits saturate: they lie past the end of any body either way.
+ */
+static const char *parse_position(const char *p, uint64_t *value)
+{
+    if (!isdigit((unsigned char)*p))
+    {
+        return NULL;
+    }
+    uint64_t v = 0;
+    while (isdigit((unsigned char)*p))
+    {
+        unsigned digit = *p++ - '0';
+        v = v > (UINT64_MAX - digit) / 10 ? UINT64_MAX : v * 10 + digit;
+    }
+    *value = v;
+    return p;
+}
+
+/// @brief Orders ranges by start
+static int compare_ranges(const void *a, const void *b)
+{
+    const HttpRange *x = a, *y = b;
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+/**
+ * @brief Parses a Range header value against a body of 'size' bytes
+ * @param ranges : Receives up to HTTP_RANGE_MAX satisfiable ranges, sorted and merged
+ * @param count : Receives the number of ranges
+ * @details [LOGIC][RANGE_PARSE]
+ * 1. Require the 'bytes=' unit (case-insensitive).
+ * 2. Parse each range spec. A 'first-last' with last before first makes the header invalid.
+ * 3. Clip to the body: a range starting at or past the end, or an empty suffix, is unsatisfiable and skipped;
+ *      a last position past the end, or a suffix longer than the body, is cut back to it.
+ * 4. Sort the satisfiable ranges and merge those that overlap or touch.
+ * @return Whether to answer 206, 416, or ignore the header.
+ */
+HttpRangeResult http_range_parse(const char *value, uint64_t size, HttpRange *ranges, int *count)
+{
+    *count = 0;
+    // {ref}{LOGIC}{RANGE_PARSE}{1}
+    if (!value || strncasecmp(value, "bytes=", 6) != 0)
+    {
+        return HTTP_RANGE_IGNORE;
+    }
+    const char *p = value + 6;
+    int specs = 0;
+    while (1)
+    {
+        while (*p == ' ' || *p == '\t')
+        {
+            p++;
+        }
+        if (*p == ',')
+        {
+            p++;
+            continue;
+        }
+        if (*p == '\0')
+        {
+            break;
+        }
+        if (++specs > HTTP_RANGE_MAX)
+        {
+            return HTTP_RANGE_IGNORE;
+        }
+
+        // {ref}{LOGIC}{RANGE_PARSE}{2}
+        uint64_t first = 0, last = UINT64_MAX, suffix = 0;
+        int is_suffix = *p == '-';
+        if (is_suffix)
+        {
+            p = parse_position(p + 1, &suffix);
+        }
+        else
+        {
+            p = parse_position(p, &first);
+            if (p && *p == '-')
+            {
+                p++;
+                if (isdigit((unsigned char)*p))
+                {
+                    p = parse_position(p, &last);
+                    if (p && last < first)
+                    {
+                        return HTTP_RANGE_IGNORE;
+                    }
+                }
+            }
+            else
+            {
+                p = NULL;
+            }
+        }
+        while (p && (*p == ' ' || *p == '\t'))
+        {
+            p++;
+        }
+        if (!p || (*p != ',' && *p != '\0'))
+        {
+            return HTTP_RANGE_IGNORE;
+        }
+
+        // {ref}{LOGIC}{RANGE_PARSE}{3}
+        if (is_suffix)
+        {
+            if (suffix == 0 || size == 0)
+            {
+                continue;
+            }
+            first = suffix < size ? size - suffix : 0;
+            last = size - 1;
+        }
+        else if (first >= size)
+        {
+            continue;
+        }
+        else if (last >= size)
+        {
+            last = size - 1;
+        }
+        ranges[*count].start = first;
+        ranges[*count].length = last - first + 1;
+        (*count)++;
+    }
+    if (specs == 0)
+    {
+        return HTTP_RANGE_IGNORE;
+    }
+    if (*count == 0)
+    {
+        return HTTP_RANGE_UNSATISFIABLE;
+    }
+
+    // {ref}{LOGIC}{RANGE_PARSE}{4}
+    qsort(ranges, *count, sizeof(HttpRange), compare_ranges);
+    int merged = 0;
+    for (int i = 1; i < *count; i++)
+    {
+        HttpRange *previous = &ranges[merged];
+        uint64_t end = previous->start + previous->length;
+        if (ranges[i].start <= end)
+        {
+            uint64_t range_end = ranges[i].start + ranges[i].length;
+            if (range_end > end)
+            {
+                previous->length = range_end - previous->start;
+            }
+        }
+        else
+        {
+            ranges[++merged] = ranges[i];
+        }
+    }
+    *count = merged + 1;
+    return HTTP_RANGE_SATISFIABLE;
+}
@@ -0,0 +1,30 @@
+#ifndef HTTP_RANGE_H
+#define HTTP_RANGE_H
+
+#include <stdint.h>
+
+#define HTTP_RANGE_MAX 16 ///< Ranges served in one response; a request asking for more gets the whole file.
+
+/**
+ * @brief A satisfiable byte range, clipped to the size of the representation
+ */
+typedef struct
+{
+    uint64_t start;
+    uint64_t length;
+} HttpRange;
+
+/**
+ * @brief Result of http_range_parse()
+ */
+typedef enum
+{
+    HTTP_RANGE_IGNORE,       ///< Not a valid 'bytes' range set, or too many ranges: answer 200 with the whole body.
+    HTTP_RANGE_SATISFIABLE,  ///< At least one range overlaps the body: answer 206.
+    HTTP_RANGE_UNSATISFIABLE ///< A valid range set, but none overlaps the body: answer 416.
+} HttpRangeResult;
+
+// Range functions
+HttpRangeResult http_range_parse(const char *value, uint64_t size, HttpRange *ranges, int *count);
+
+#endif // HTTP_RANGE_H
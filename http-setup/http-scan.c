@@ -0,0 +1,353 @@
+/**
+ * @file: http-scan.c
+ *
+ * ℹ️ A vectorized scanner that splits an HTTP request head into spans in a single pass.
+ *
+ * 1. Only three bytes matter for the structure of a request head: '\n' ends a line, ' ' separates the
+ *      request-line tokens, and ':' ends a header name. The scanner loads 32 (AVX2) or 16 (SSE4.2) bytes
+ *      at a time, turns them into a bitmask of those delimiters and feeds only the set bits to a small
+ *      state machine. Runs of ordinary bytes (long URIs, cookies, user agents) cost one compare per block.
+ * 2. The instruction set is picked once at start-up with __builtin_cpu_supports(), and the SIMD
+ *      functions are compiled with target attributes, so the binary still runs on CPUs without them.
+ *      A scalar lookup-table loop handles the tail of the buffer and older CPUs.
+ * 3. The state machine keeps its position between calls, so a request head that arrives in several
+ *      reads is scanned exactly once, starting where the previous call stopped.
+ */
+#include "http-scan.h"
+#include <stdint.h>
+#include <immintrin.h>
+
+/**
+ * @brief States of the request-head grammar
+ */
+enum
+{
+    SCAN_METHOD,       ///< Before the first space of the request line.
+    SCAN_URI,          ///< Between the first and second space.
+    SCAN_VERSION,      ///< After the second space, until the end of the line.
+    SCAN_HEADER_NAME,  ///< At the start of a header line, before its ':'.
+    SCAN_HEADER_VALUE, ///< After the ':', until the end of the line.
+    SCAN_DONE,
+    SCAN_ERROR
+};
+
+/// @brief Non-zero for the bytes the state machine needs to see
+static const unsigned char delimiter_table[256] = {['\n'] = 1, [' '] = 1, [':'] = 1};
+
+/// @brief Backend selected by http_scan_select_backend() or http_scan_set_backend()
+static HttpScanBackend scan_backend = HTTP_SCAN_SCALAR;
+
+/// @brief Tells whether the line starting at 'start' and ending with the '\n' at 'newline' is empty
+static inline int is_empty_line(const char *buf, size_t start, size_t newline)
+{
+    return newline == start || (newline == start + 1 && buf[start] == '\r');
+}
+
+/**
+ * @brief Advances the state machine over one delimiter byte
+ * @param scanner The scanner.
+ * @param buf The receive buffer.
+ * @param i Offset of a '\n', ' ' or ':' byte.
+ * @details [LOGIC][SCAN_STEP]
+ * 1. Request line: the first space ends the method, the second the URI, the end of line the version.
+ *      Empty lines before the request line are skipped (RFC 9112 section 2.2).
+ * 2. Header name: the first ':' ends it. Whitespace in a name, including an obs-fold continuation
+ *      line, is rejected (RFC 9112 section 5).
+ * 3. Header value: only the end of line matters; the value is trimmed of surrounding whitespace.
+ * 4. An empty line where a header name is expected ends the head.
+ * @return Non-zero once the scanner reached SCAN_DONE or SCAN_ERROR.
+ */
+static inline int scan_step(HttpScanner *scanner, const char *buf, size_t i)
+{
+    char c = buf[i];
+    switch (scanner->state)
+    {
+    // {ref}{LOGIC}{SCAN_STEP}{1}
+    case SCAN_METHOD:
+        if (c == '\n')
+        {
+            if (!is_empty_line(buf, scanner->line_start, i))
+            {
+                scanner->state = SCAN_ERROR;
+                return 1;
+            }
+            scanner->line_start = i + 1;
+        }
+        else if (c == ' ')
+        {
+            if (i == scanner->line_start)
+            {
+                scanner->state = SCAN_ERROR;
+                return 1;
+            }
+            scanner->method.offset = scanner->line_start;
+            scanner->method.length = i - scanner->line_start;
+            scanner->token_start = i + 1;
+            scanner->state = SCAN_URI;
+        }
+        return 0;
+
+    case SCAN_URI:
+        if (c == ':')
+        {
+            return 0;
+        }
+        if (c == '\n' || i == scanner->token_start)
+        {
+            scanner->state = SCAN_ERROR;
+            return 1;
+        }
+        scanner->uri.offset = scanner->token_start;
+        scanner->uri.length = i - scanner->token_start;
+        scanner->token_start = i + 1;
+        scanner->state = SCAN_VERSION;
+        return 0;
+
+    case SCAN_VERSION:
+        if (c != '\n')
+        {
+            scanner->state = SCAN_ERROR;
+            return 1;
+        }
+        else
+        {
+            size_t end = i;
+            if (end > scanner->token_start && buf[end - 1] == '\r')
+            {
+                end--;
+            }
+            if (end == scanner->token_start)
+            {
+                scanner->state = SCAN_ERROR;
+                return 1;
+            }
+            scanner->version.offset = scanner->token_start;
+            scanner->version.length = end - scanner->token_start;
+            scanner->line_start = i + 1;
+            scanner->state = SCAN_HEADER_NAME;
+        }
+        return 0;
+
+    // {ref}{LOGIC}{SCAN_STEP}{2,4}
+    case SCAN_HEADER_NAME:
+        if (c == '\n' && is_empty_line(buf, scanner->line_start, i))
+        {
+            scanner->end = i + 1;
+            scanner->state = SCAN_DONE;
+            return 1;
+        }
+        if (c != ':' || i == scanner->line_start || scanner->header_count >= scanner->max_headers)
+        {
+            scanner->state = SCAN_ERROR;
+            return 1;
+        }
+        scanner->headers[scanner->header_count].key.offset = scanner->line_start;
+        scanner->headers[scanner->header_count].key.length = i - scanner->line_start;
+        scanner->token_start = i + 1;
+        scanner->state = SCAN_HEADER_VALUE;
+        return 0;
+
+    // {ref}{LOGIC}{SCAN_STEP}{3}
+    case SCAN_HEADER_VALUE:
+        if (c == '\n')
+        {
+            size_t start = scanner->token_start;
+            size_t end = i;
+            while (start < end && (buf[start] == ' ' || buf[start] == '\t'))
+            {
+                start++;
+            }
+            while (end > start && (buf[end - 1] == ' ' || buf[end - 1] == '\t' || buf[end - 1] == '\r'))
+            {
+                end--;
+            }
+            scanner->headers[scanner->header_count].value.offset = start;
+            scanner->headers[scanner->header_count].value.length = end - start;
+            scanner->header_count++;
+            scanner->line_start = i + 1;
+            scanner->state = SCAN_HEADER_NAME;
+        }
+        return 0;
+
+    default:
+        return 1;
+    }
+}
+
+/// @brief Maps the internal state to the public result
+static HttpScanResult scan_result(const HttpScanner *scanner)
+{
+    if (scanner->state == SCAN_DONE)
+    {
+        return HTTP_SCAN_DONE;
+    }
+    return scanner->state == SCAN_ERROR ? HTTP_SCAN_ERROR : HTTP_SCAN_INCOMPLETE;
+}
+
+/// @brief Byte-at-a-time scan through the delimiter table
+static HttpScanResult scan_scalar(HttpScanner *scanner, const char *buf, size_t len)
+{
+    for (size_t i = scanner->pos; i < len; i++)
+    {
+        if (delimiter_table[(unsigned char)buf[i]] && scan_step(scanner, buf, i))
+        {
+            scanner->pos = i + 1;
+            return scan_result(scanner);
+        }
+    }
+    scanner->pos = len;
+    return HTTP_SCAN_INCOMPLETE;
+}
+
+/**
+ * @brief 16-byte scan: PCMPESTRM in "equal any" mode compares every byte of the block against
+ *      the three delimiters at once and returns the matches as a bitmask
+ */
+__attribute__((target("sse4.2"))) static HttpScanResult scan_sse42(HttpScanner *scanner, const char *buf, size_t len)
+{
+    const __m128i delimiters = _mm_setr_epi8('\n', ' ', ':', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    size_t i = scanner->pos;
+    while (i + 16 <= len)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)(buf + i));
+        __m128i matches = _mm_cmpestrm(delimiters, 3, block, 16,
+                                       _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK);
+        uint32_t mask = (uint32_t)_mm_cvtsi128_si32(matches);
+        while (mask)
+        {
+            size_t at = i + __builtin_ctz(mask);
+            if (scan_step(scanner, buf, at))
+            {
+                scanner->pos = at + 1;
+                return scan_result(scanner);
+            }
+            mask &= mask - 1;
+        }
+        i += 16;
+    }
+    scanner->pos = i;
+    return scan_scalar(scanner, buf, len);
+}
+
+/**
+ * @brief 32-byte scan: three byte-wise compares OR'ed together and collapsed with VPMOVMSKB
+ */
+__attribute__((target("avx2"))) static HttpScanResult scan_avx2(HttpScanner *scanner, const char *buf, size_t len)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i colon = _mm256_set1_epi8(':');
+    size_t i = scanner->pos;
+    while (i + 32 <= len)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(buf + i));
+        __m256i matches = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, newline),
+                                                          _mm256_cmpeq_epi8(block, space)),
+                                          _mm256_cmpeq_epi8(block, colon));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(matches);
+        while (mask)
+        {
+            size_t at = i + __builtin_ctz(mask);
+            if (scan_step(scanner, buf, at))
+            {
+                scanner->pos = at + 1;
+                return scan_result(scanner);
+            }
+            mask &= mask - 1;
+        }
+        i += 32;
+    }
+    scanner->pos = i;
+    _mm256_zeroupper(); // the tail call below would otherwise leave the upper YMM halves dirty
+    return scan_scalar(scanner, buf, len);
+}
+
+/// @brief Pick the widest instruction set the CPU supports; call once at start-up
+void http_scan_select_backend(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        scan_backend = HTTP_SCAN_AVX2;
+    }
+    else if (__builtin_cpu_supports("sse4.2"))
+    {
+        scan_backend = HTTP_SCAN_SSE42;
+    }
+    else
+    {
+        scan_backend = HTTP_SCAN_SCALAR;
+    }
+}
+
+/**
+ * @brief Force a backend, e.g. to compare them in a benchmark
+ * @return 0 on success, -1 if the CPU does not support it.
+ */
+int http_scan_set_backend(HttpScanBackend backend)
+{
+    __builtin_cpu_init();
+    if ((backend == HTTP_SCAN_AVX2 && !__builtin_cpu_supports("avx2")) ||
+        (backend == HTTP_SCAN_SSE42 && !__builtin_cpu_supports("sse4.2")))
+    {
+        return -1;
+    }
+    scan_backend = backend;
+    return 0;
+}
+
+/// @brief Name of the backend in use
+const char *http_scan_backend_name(void)
+{
+    switch (scan_backend)
+    {
+    case HTTP_SCAN_AVX2:
+        return "avx2";
+    case HTTP_SCAN_SSE42:
+        return "sse4.2";
+    default:
+        return "scalar";
+    }
+}
+
+/**
+ * @brief Prepare a scanner for a request head starting at offset 0 of the buffer
+ * @param headers Array that receives the header spans.
+ * @param max_headers Capacity of headers; more headers make the scan fail.
+ */
+void http_scan_init(HttpScanner *scanner, HeaderView *headers, int max_headers)
+{
+    scanner->state = SCAN_METHOD;
+    scanner->pos = 0;
+    scanner->line_start = 0;
+    scanner->token_start = 0;
+    scanner->headers = headers;
+    scanner->max_headers = max_headers;
+    scanner->header_count = 0;
+    scanner->end = 0;
+}
+
+/**
+ * @brief Scan the bytes received since the previous call
+ * @param buf The receive buffer, holding the request head from offset 0.
+ * @param len Number of valid bytes in buf.
+ * @return HTTP_SCAN_DONE once the blank line after the headers has been seen; the spans and
+ *      'end' are then valid. HTTP_SCAN_INCOMPLETE if more input is needed, HTTP_SCAN_ERROR if
+ *      the head is malformed or has more than max_headers headers.
+ */
+HttpScanResult http_scan(HttpScanner *scanner, const char *buf, size_t len)
+{
+    if (scanner->state == SCAN_DONE || scanner->state == SCAN_ERROR)
+    {
+        return scan_result(scanner);
+    }
+    switch (scan_backend)
+    {
+    case HTTP_SCAN_AVX2:
+        return scan_avx2(scanner, buf, len);
+    case HTTP_SCAN_SSE42:
+        return scan_sse42(scanner, buf, len);
+    default:
+        return scan_scalar(scanner, buf, len);
+    }
+}
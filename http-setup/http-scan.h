@@ -0,0 +1,79 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+#include <stddef.h>
+
+/**
+ * @brief A run of bytes inside a connection's receive buffer, stored as an offset so it
+ *      stays valid when the buffer is reallocated while a request is still being parsed
+ */
+typedef struct
+{
+    size_t offset;
+    size_t length;
+} Span;
+
+/**
+ * @brief A request header as views into the receive buffer; nothing is copied.
+ */
+typedef struct
+{
+    Span key;
+    Span value;
+} HeaderView;
+
+/**
+ * @brief Result of a call to http_scan()
+ */
+typedef enum
+{
+    HTTP_SCAN_INCOMPLETE, ///< More input is needed; call again once it has arrived.
+    HTTP_SCAN_DONE,       ///< The request line and all headers have been scanned.
+    HTTP_SCAN_ERROR       ///< The input is not a valid HTTP/1.x request head.
+} HttpScanResult;
+
+/**
+ * @brief Instruction set used by the scanner
+ */
+typedef enum
+{
+    HTTP_SCAN_SCALAR, ///< One byte at a time through a lookup table.
+    HTTP_SCAN_SSE42,  ///< 16 bytes at a time with PCMPESTRM.
+    HTTP_SCAN_AVX2    ///< 32 bytes at a time with VPCMPEQB.
+} HttpScanBackend;
+
+/**
+ * @brief Resumable scanner for a request line and its headers
+ * @param state : Position in the request grammar (internal)
+ * @param pos : Next byte to examine; scanning resumes here when more input arrives
+ * @param line_start : Offset of the line being scanned
+ * @param token_start : Offset of the request-line token or header value being scanned
+ * @param method, uri, version : Spans of the request-line tokens
+ * @param headers : Caller-provided array the header spans are written to
+ * @param max_headers : Capacity of headers
+ * @param header_count : Number of headers found so far
+ * @param end : Offset just past the blank line that ends the headers (valid once done)
+ */
+typedef struct
+{
+    int state;
+    size_t pos;
+    size_t line_start;
+    size_t token_start;
+    Span method;
+    Span uri;
+    Span version;
+    HeaderView *headers;
+    int max_headers;
+    int header_count;
+    size_t end;
+} HttpScanner;
+
+// Scanner functions
+void http_scan_select_backend(void);
+int http_scan_set_backend(HttpScanBackend backend);
+const char *http_scan_backend_name(void);
+void http_scan_init(HttpScanner *scanner, HeaderView *headers, int max_headers);
+HttpScanResult http_scan(HttpScanner *scanner, const char *buf, size_t len);
+
+#endif // HTTP_SCAN_H
@@ -16,12 +16,71 @@
  * 4. The socket created earlier is added to the epoll instance, so that it can notiy
  *      when the socket is ready to accept a new connection.
  * 5. The program then enters an infinite ♾️ event loop, where it waits for a new connection
- *      and handles the connection upon coming.
+ *      and handles the connection upon coming. One such loop runs per worker thread: each worker owns
+ *      a listening socket bound with SO_REUSEPORT, an epoll instance and a connection table, so the
+ *      workers share nothing and the load spreads over all cores.
  * 6. The connected client is also added to epoll instance, so that epoll can notify
  *      about read events coming from the client.
  * 7. The program expects messages adhering to HTTP protocol.
+ *      Each connection keeps its partial input and parser state, so requests split across
+ *      several TCP segments are parsed incrementally. Request bodies, framed by Content-Length or
+ *      the chunked transfer coding, are streamed to the handler as they arrive and never buffered whole.
+ *      Responses can be streamed the same way: a producer callback is asked for the next chunk whenever
+ *      the socket has room, and the output is sent with 'Transfer-Encoding: chunked'.
+ *      The method and the known header names are classified once by generated perfect hashes
+ *      (http-names.c), and each request keeps a slot per known header, so handlers look headers up in O(1).
+ *      Requests are routed by method and path pattern through a radix tree (router.c), which also captures
+ *      ':name' and '*name' path parameters.
+ *      Static files honour Range requests: one range is answered with a 206 carrying just those bytes, several
+ *      with multipart/byteranges, and If-Range falls back to the whole file once it has changed. The bytes
+ *      come from the response cache or from the file with sendfile() at the requested offsets.
+ * 8. Small static files are answered from a response cache shared by the workers: the complete response is
+ *      serialized once, with a strong ETag, and queued straight from the cached bytes. A request whose
+ *      If-None-Match carries that ETag, or whose If-Modified-Since repeats the Last-Modified, gets a
+ *      pre-serialized 304 instead. Files sent with sendfile() are validated by the same rule, against the
+ *      validators the file cache formatted for them.
+ * 9. Instead of epoll, the workers can run on io_uring (-u): one multishot accept per listening socket,
+ *      a multishot recv per connection filling buffers from a provided-buffer ring, and responses written
+ *      by chains of linked sendmsg operations. Everything a pass of the event loop prepares is submitted
+ *      with the same io_uring_enter() that waits for the next completions. Handlers are the same for both.
+ * 10. Every connection carries timers on a per-worker timer wheel: a client must send a complete request
+ *      within REQUEST_TIMEOUT_MS, may stay idle between requests for KEEP_ALIVE_TIMEOUT_MS, and must accept
+ *      queued output within WRITE_STALL_TIMEOUT_MS. Clients that trickle bytes (slowloris) or stop reading
+ *      are closed instead of holding a file descriptor forever.
+ * 11. Each worker counts connections, requests by method and status, bytes and parse errors, and records
+ *      parse, handle and send latencies in histograms of its own, written without locks or shared atomics.
+ *      GET /metrics sums the workers on demand and answers in the Prometheus text format.
+ * 12. Requests and connection events are logged asynchronously: a worker fills a fixed-size record in its own
+ *      lock-free ring, and a background thread formats the records and writes them out in large batches
+ *      (standard output, or the file given with -a). A full ring drops records instead of blocking.
+ * 13. With -P the server also works as a reverse proxy: requests below a path prefix are forwarded to a group
+ *      of backend servers (upstream.c), balanced by fewest outstanding requests over pooled keep-alive
+ *      connections. Bodies move between the sockets with splice() through a pipe, never copied to user space;
+ *      only the heads are parsed. Servers that fail are taken out of rotation until a health probe succeeds.
+ * 14. Slow handlers (e.g. GET /checksum, which hashes a whole file) run on a bounded thread pool shared by the
+ *      workers (offload.c, -o), so one of them no longer holds up every other connection of its worker. A
+ *      finished job comes back through a lock-free queue and an eventfd the worker waits on with the sockets.
+ *      When the pool is full the request is answered 503 with Retry-After instead of queued without bound.
+ * 15. Admission control (admission.c) keeps an overloaded server serving the clients it admitted: past the
+ *      connection limit (-m) or the limit of requests in flight (-q) a client gets a pre-serialized 503 with
+ *      Retry-After, sent with one call. With -A the request limit adapts (AIMD) to the measured latency.
+ * 16. The files of assets/ are compiled into the binary (embed-gen.c generates embedded-assets.c), each with
+ *      its 200 and 304 heads serialized at build time. They are answered from static memory with one writev,
+ *      without touching the file system or formatting anything.
+ * 17. Response heads are assembled with memcpy, never printf (http-head.c): status lines come pre-rendered from
+ *      a table, every response carries a Date header that each worker formats only once a second, and the
+ *      ETag and Last-Modified of a file are formatted once, when the file cache opens it. Range, proxy and
+ *      error heads are copied together the same way.
+ * 18. Clients are rate limited by address (rate-limit.c, -R and -r): token buckets in a fixed open-addressing
+ *      table per worker, refilled lazily from timestamps and bounded by clock eviction. A client over its
+ *      rate gets a pre-serialized 429 with Retry-After, checked before its connection or request costs more.
+ * 19. With -C the server speaks HTTPS (tls.c): OpenSSL runs the handshake, then hands the session keys to the
+ *      kernel (kTLS, TCP_ULP "tls"). The socket then takes plain bytes and the kernel encrypts them, so
+ *      responses keep going out with sendmsg() and static files with zero-copy sendfile(). A kernel without
+ *      kTLS falls back to SSL_write().
  *
  */
+#define _GNU_SOURCE // pthread_setaffinity_np(), CPU_SET(), splice(), memmem()
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/epoll.h>
@@ -30,20 +89,82 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
 #include <errno.h>
 #include <time.h>
 #include <sys/sysinfo.h>
 #include <sys/utsname.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <poll.h>
+#include <stdint.h>
+#include <linux/filter.h>
+#include "file-cache.h"
+#include "response-cache.h"
+#include "arena.h"
+#include "http-scan.h"
+#include "http-body.h"
+#include "timer-wheel.h"
+#include "uring.h"
+#include "metrics.h"
+#include "access-log.h"
+#include "http-names.h"
+#include "router.h"
+#include "http-range.h"
+#include "upstream.h"
+#include "offload.h"
+#include "admission.h"
+#include "embedded.h"
+#include "http-head.h"
+#include "rate-limit.h"
+#include "tls.h"
 
-#define MAX_CLIENTS 10     ///< Maximum number of clients allowed.
+#define MAX_EVENTS 256     ///< Maximum number of events returned by one epoll_wait() call.
 #define MAX_HEADERS 20     ///< Maximum number of headers allowed.
 #define PORT 8080          ///< port 8080 will be sued to run the server.
 #define MESSAGE_INTERVAL 5 ///< 5 Seconds is the message interval.
 #define BUFFER_SIZE 4096   ///< Buffer limit for data to be sent.
+#define READ_BUFFER_INITIAL 4096    ///< Initial size of a connection's receive buffer.
+#define MAX_REQUEST_SIZE (64 * 1024) ///< Upper bound on a buffered request line + headers; bodies are streamed.
+#define MAX_IOV_BATCH 64             ///< Output segments handed to a single writev() call.
+#define OUTPUT_HIGH_WATERMARK (256 * 1024) ///< Queued output at which we stop reading from the client.
+#define OUTPUT_LOW_WATERMARK (64 * 1024)   ///< Queued output below which reading resumes.
+#define STREAM_CHUNK_SIZE (16 * 1024)      ///< Largest chunk a response producer is asked for.
+#define STREAM_CHUNKS_PER_PASS 16          ///< Chunks produced for one connection before others get a turn.
+#define CHUNK_PREFIX_SIZE 18               ///< Room for a chunk-size line: 16 hex digits and CRLF.
+#define LISTING_ENTRY_MAX 2560             ///< Room one directory listing entry may need (255-byte name, escaped twice).
+#define TIMER_TICK_MS 100                  ///< Resolution of the connection timeouts.
+#define REQUEST_TIMEOUT_MS 10000           ///< Time allowed to receive a complete request, counted from its first byte.
+#define KEEP_ALIVE_TIMEOUT_MS 5000         ///< Time an idle persistent connection is kept open between requests.
+#define BODY_TIMEOUT_MS 10000              ///< Time allowed between two reads while a request body streams in.
+#define WRITE_STALL_TIMEOUT_MS 30000       ///< Time queued output may wait without the client accepting any of it.
+#define RESPONSE_CACHE_SIZE_MB 64          ///< Default size of the response cache; -c overrides it.
+#define RANGE_HEAD_SIZE 512                ///< Room for the head of a 206 or 416 response.
+#define RANGE_PART_SIZE 256                ///< Room for the boundary and headers of one multipart/byteranges part.
+#define PROXY_HEAD_SIZE (16 * 1024)        ///< Longest response head accepted from an upstream server.
+#define PROXY_SPLICE_SIZE (64 * 1024)      ///< Most bytes one splice() call moves, the default capacity of a pipe.
+#define PROXY_TIMEOUT_MS 30000             ///< Time an exchange with an upstream server may make no progress.
+#define PROXY_MAX_ATTEMPTS 3               ///< Links a request is tried on before the client gets a 502.
+#define PROXY_MAX_GROUPS 8                 ///< Upstream groups that can be given with -P.
+#define CHECKSUM_READ_SIZE (64 * 1024)     ///< Bytes the checksum handler reads from a file at a time.
+#define URING_ENTRIES 1024                 ///< Submission queue size of a worker's io_uring.
+#define URING_BUFFER_COUNT 256             ///< Provided receive buffers per worker (a power of two).
+#define URING_BUFFER_SIZE (16 * 1024)      ///< Size of a provided receive buffer.
+#define URING_SEND_LINKS 4                 ///< sendmsg operations linked into one chain, each with up to MAX_IOV_BATCH segments.
+#define URING_OP_MASK 7                    ///< Low bits of an io_uring user_data holding the UringOp.
 
 /**
- * @brief Header structure for HTTP request headers
+ * @brief Header structure for HTTP response headers
  */
 typedef struct
 {
@@ -53,19 +174,54 @@ typedef struct
 
 /**
  * @brief HTTP Request structure
+ * @param method, uri, version : Request-line tokens, NUL-terminated in place in the receive buffer
+ * @param method_id : The method, classified once by its perfect hash
+ * @param version_minor : 1 for HTTP/1.1, 0 for HTTP/1.0, -1 for any other version
+ * @param header_slots : For each known header, 1 + its index in headers, or 0 if the request lacks it;
+ *      the first occurrence wins. See request_header().
+ * @param route, match : Outcome of routing the request once its headers are complete; match holds the
+ *      Endpoint and the path parameters, as spans of uri
+ * @param base : Receive buffer the header spans point into; valid while the request is handled.
+ *      Header keys and values are also NUL-terminated in place once the headers are complete.
+ * @param has_body : Non-zero if the request carries a body (Content-Length > 0 or chunked)
+ * @param on_body : Set by the handler before the body arrives; receives the body piece by piece.
+ *      When NULL, the body is read and discarded.
+ * @param body_context : Passed to on_body
  */
 typedef struct
 {
-    char method[10];
-    char uri[256];
-    char version[10];
-    Header headers[MAX_HEADERS];
+    char *method;
+    char *uri;
+    char *version;
+    HttpMethod method_id;
+    int version_minor;
+    const char *base;
+    HeaderView headers[MAX_HEADERS];
     int header_count;
-    char *body;
+    uint8_t header_slots[HTTP_HEADER_COUNT];
+    RouteResult route;
+    RouteMatch match;
+    int has_body;
+    HttpBodySink on_body;
+    void *body_context;
 } HttpRequest;
 
+/**
+ * @brief Produces the next piece of a streamed response body
+ * @param context The handler's state, e.g. allocated from the connection's arena.
+ * @param buf Where to write the data; NULL when the connection closed before the stream ended,
+ *      so the producer can release what it holds.
+ * @param size Room in buf.
+ * @return Bytes written (1..size), 0 at the end of the body, -1 on an error, which closes the connection.
+ */
+typedef ssize_t (*ResponseProducer)(void *context, char *buf, size_t size);
+
 /**
  * @brief HTTP response structure
+ * @param arena : Per-connection arena that response header copies are allocated from;
+ *      reset once the response has been serialized, or once a streamed response has ended
+ * @param producer : When set, the body is streamed from this callback instead of 'body' or 'file'
+ * @param producer_context : Passed to producer
  */
 typedef struct
 {
@@ -74,8 +230,426 @@ typedef struct
     Header headers[MAX_HEADERS];
     int header_count;
     char *body;
+    CachedFile *file; ///< When set, the body is this file's content, sent with sendfile()
+    Arena *arena;
+    ResponseProducer producer;
+    void *producer_context;
 } HttpResponse;
 
+/**
+ * @brief What a route serves
+ * @param prepare : Called once the headers are complete, before the body arrives, e.g. to install a body sink; may be NULL
+ * @param handle : Fills in the response once the request is complete
+ * @param cacheable : Non-zero if requests may be answered from, and responses added to, the response cache
+ * @param offload : Non-zero if handle is slow and runs on the handler pool, off the event loop. It must not use
+ *      the worker's state (file cache, metrics, timers), and such an endpoint cannot be cacheable.
+ * @param upstreams : For a reverse-proxy route, the group requests are forwarded to; prepare and handle are unused
+ * @param asset : For an embedded asset, its serialized responses; prepare and handle are unused
+ */
+typedef struct
+{
+    void (*prepare)(HttpRequest *request, Arena *arena);
+    void (*handle)(HttpRequest *request, HttpResponse *response);
+    int cacheable;
+    int offload;
+    UpstreamGroup *upstreams;
+    const EmbeddedAsset *asset;
+} Endpoint;
+
+/**
+ * @brief State of a directory listing while it streams out
+ * @param dir : The open directory
+ * @param uri : Request path of the directory, ending in '/'
+ * @param stage : 0 before the page header is written, 1 while listing entries, 2 once the footer is out
+ */
+typedef struct
+{
+    DIR *dir;
+    char *uri;
+    int stage;
+} DirectoryListing;
+
+/**
+ * @brief State of a POST request while its body streams in
+ * @param bytes : Body bytes received so far
+ */
+typedef struct
+{
+    size_t bytes;
+} PostUpload;
+
+/**
+ * @brief The representation a Range request selects bytes from
+ * @param cached, file : Exactly one is set: the bytes are the cached body at 'data', or the file's content
+ * @param size : Length of the whole representation
+ * @param etag, last_modified : Validators sent with it, which If-Range is compared against
+ */
+typedef struct
+{
+    CachedResponse *cached;
+    CachedFile *file;
+    const char *data;
+    uint64_t size;
+    const char *content_type;
+    const char *etag;
+    const char *last_modified;
+} RangeSource;
+
+/**
+ * @brief States of the incremental request parser
+ */
+typedef enum
+{
+    PARSE_HEADERS,      ///< Scanning the request line and headers until the blank line.
+    PARSE_HEAD_DONE,    ///< Headers done; the handler picks the body sink before decoding starts.
+    PARSE_BODY,         ///< Streaming the body to the handler until its framing says it ended.
+    PARSE_DONE,         ///< A complete request is available in 'request'.
+    PARSE_ERROR         ///< The input is not a valid HTTP request.
+} ParseState;
+
+/**
+ * @brief Which deadline the connection's read timer currently enforces
+ */
+typedef enum
+{
+    READ_TIMEOUT_NONE,       ///< Not armed: output is pending, or the connection no longer reads.
+    READ_TIMEOUT_REQUEST,    ///< A request head has been started (or the connection is new) and must complete.
+    READ_TIMEOUT_BODY,       ///< A request body is streaming in; restarted whenever some of it arrives.
+    READ_TIMEOUT_KEEP_ALIVE  ///< Idle between requests.
+} ReadTimeout;
+
+/**
+ * @brief Kind of an io_uring operation; kept in the low bits of its user_data, next to the Connection pointer
+ */
+typedef enum
+{
+    URING_OP_ACCEPT = 1, ///< Multishot accept on the worker's listening socket.
+    URING_OP_RECV,       ///< Multishot recv of a connection.
+    URING_OP_SEND,       ///< One sendmsg of a connection's linked chain.
+    URING_OP_POLL,       ///< POLLOUT poll of a connection waiting to continue a file segment.
+    URING_OP_CANCEL,     ///< Cancellation request; its completion carries nothing of interest.
+    URING_OP_OFFLOAD     ///< POLLIN poll of the worker's handler job completion eventfd.
+} UringOp;
+
+/**
+ * @brief Message headers and iovecs of the sendmsg operations a connection has in flight on io_uring;
+ *      the kernel reads them while the operations run, so they live outside the stack
+ */
+typedef struct
+{
+    struct msghdr msg[URING_SEND_LINKS];
+    struct iovec iov[URING_SEND_LINKS][MAX_IOV_BATCH];
+} UringSendBatch;
+
+/**
+ * @brief A piece of serialized response waiting to be written
+ * @param data : Start of the bytes not sent yet (memory segments)
+ * @param len : Number of bytes left to send
+ * @param owned : malloc'd block holding data, freed once written; NULL if the segment does not own its bytes
+ * @param cached : Response cache entry data points into; the reference is dropped once written
+ * @param file : For file segments, the cached file sent with sendfile(); NULL for memory segments
+ * @param offset : For file segments, the file offset of the next byte to send
+ */
+typedef struct
+{
+    char *data;
+    size_t len;
+    char *owned;
+    CachedResponse *cached;
+    CachedFile *file;
+    off_t offset;
+} OutSegment;
+
+/**
+ * @brief Per-connection state kept across edge-triggered wakeups
+ * @param fd : File Descriptor associated with the client
+ * @param peer_addr, peer_port : Client address and port in network byte order, for the access log
+ * @param in_buf : Growable buffer holding received bytes not yet consumed by a request
+ * @param in_len : Number of valid bytes in in_buf
+ * @param in_cap : Allocated size of in_buf
+ * @param scanner : Resumable request-head scanner; remembers where the previous read stopped
+ * @param body_start : Offset of the first body byte once the headers are complete. Decoded body bytes are
+ *      dropped from the buffer, so the body part of in_buf only holds what arrived since the last read.
+ * @param body : Decoder for the body framing
+ * @param body_progress : Set when body bytes were decoded since the body timer was last restarted
+ * @param error_status : Status to answer a PARSE_ERROR with (0 means 400)
+ * @param state : Current parser state
+ * @param request : The request being assembled
+ * @param arena : Scratch memory for the request being handled, reset after each response
+ * @param keep_alive : Non-zero while the connection may serve further requests
+ * @param closing : Set once no more requests will be read; the connection closes when 'out' drains
+ * @param read_paused : Set while queued output is above OUTPUT_HIGH_WATERMARK
+ * @param events : epoll events the socket is currently registered for
+ * @param out : Queue of response segments not yet accepted by the kernel, oldest at out_head
+ * @param out_head : Index of the first unsent segment in out
+ * @param out_count : One past the last queued segment in out
+ * @param out_cap : Allocated number of segments in out
+ * @param out_bytes : Total number of unsent bytes in the queue
+ * @param producer : Producer of the response being streamed, NULL if none; further requests wait until it ends
+ * @param producer_context : Passed to producer
+ * @param stream_chunked : Non-zero if the streamed body is sent chunked; otherwise it ends when the connection closes
+ * @param proxy : Request being forwarded to an upstream server, NULL if none; further requests wait until it ends
+ * @param job : Request whose handler runs on the handler pool, NULL if none; the loop leaves the request and
+ *      the arena alone until it is back, and further requests wait
+ * @param read_timeout : Deadline the read timer is armed for
+ * @param read_timer : Request / keep-alive timeout
+ * @param write_timer : Write-stall timeout, armed while output is queued
+ * @param uring_ops : io_uring operations in flight; a closed connection is freed once they all completed
+ * @param recv_armed : A multishot recv is in flight (io_uring)
+ * @param recv_cancelling : Its cancellation has been requested, since reading paused
+ * @param sends : Linked sendmsg operations in flight (io_uring), described in send_batch
+ * @param send_failed : One of them failed; the connection is closed once the others completed
+ * @param poll_armed : A POLLOUT poll is in flight, to continue a file segment once the socket has room
+ * @param closed : Closed while io_uring operations or a handler job were still in flight
+ * @param send_batch : Message headers and iovecs of the sends in flight, allocated on first use
+ * @param parse_ns : Time spent scanning the current request head so far, over all reads
+ * @param send_started_ns : When the queued output started waiting to be written, 0 while the queue is empty
+ * @param admitted_ns : When admission control admitted the current request, 0 if it holds no admission
+ * @param tls : TLS session of the connection, NULL when serving plain HTTP
+ * @param tls_state : Progress of its handshake; nothing is read or written for HTTP before it is done
+ * @param ktls_send : The kernel encrypts what is written to the socket (kTLS), so output is sent as on a plain
+ *      connection; otherwise it goes through OpenSSL
+ */
+typedef struct
+{
+    int fd;
+    uint32_t peer_addr;
+    uint16_t peer_port;
+    char *in_buf;
+    size_t in_len;
+    size_t in_cap;
+    HttpScanner scanner;
+    size_t body_start;
+    HttpBodyDecoder body;
+    int body_progress;
+    int error_status;
+    ParseState state;
+    HttpRequest request;
+    Arena arena;
+    int keep_alive;
+    int closing;
+    int read_paused;
+    uint32_t events;
+    OutSegment *out;
+    int out_head;
+    int out_count;
+    int out_cap;
+    size_t out_bytes;
+    ResponseProducer producer;
+    void *producer_context;
+    int stream_chunked;
+    struct ProxyExchange *proxy;
+    struct HandlerJob *job;
+    ReadTimeout read_timeout;
+    TimerNode read_timer;
+    TimerNode write_timer;
+    int uring_ops;
+    int recv_armed;
+    int recv_cancelling;
+    int sends;
+    int send_failed;
+    int poll_armed;
+    int closed;
+    UringSendBatch *send_batch;
+    uint64_t parse_ns;
+    uint64_t send_started_ns;
+    uint64_t admitted_ns;
+    SSL *tls;
+    TlsHandshake tls_state;
+    int ktls_send;
+} Connection;
+
+/**
+ * @brief A request whose handler runs on the handler pool
+ * @param job : Pool bookkeeping; first, so the pool's OffloadJob pointer is also the HandlerJob
+ * @param conn : The connection; the job lives in its arena
+ * @param request_buf : The receive buffer the request's strings point into, taken over from the connection
+ * @param response : Filled in by the handler on a pool thread, queued by the loop once the job is back
+ * @param started_ns : When the request was complete, for the handle time and the access log
+ */
+typedef struct HandlerJob
+{
+    OffloadJob job;
+    Connection *conn;
+    char *request_buf;
+    HttpResponse response;
+    uint64_t started_ns;
+} HandlerJob;
+
+/**
+ * @brief Progress of a request forwarded to an upstream server
+ */
+typedef enum
+{
+    PROXY_CONNECT,       ///< Picking a server and taking a link to it.
+    PROXY_SEND_HEAD,     ///< Writing the request head, and the body bytes that arrived with it, to the server.
+    PROXY_SEND_BODY,     ///< Splicing the rest of the request body from the client, through the pipe, to the server.
+    PROXY_RESPONSE_HEAD, ///< Peeking at the server's socket until the response head is complete.
+    PROXY_RESPONSE_BODY, ///< Splicing the response body, or a run of chunks, from the server through the pipe to the client.
+    PROXY_CHUNK_LINE     ///< Peeking at the next chunk-size line of a chunked response body.
+} ProxyState;
+
+/**
+ * @brief A request forwarded to an upstream server; lives in the client connection's arena
+ * @param client : The connection the request arrived on
+ * @param pool : This worker's servers of the route's upstream group
+ * @param upstream, link : Server picked and the link to it; upstream is NULL while no link is held
+ * @param reused : The link came from the pool, so the server may have closed it just before we wrote to it
+ * @param attempts : Links the request has been tried on
+ * @param excluded : Servers a new link failed on, skipped when the request is retried
+ * @param head, head_len, head_sent : malloc'd request head for the server, followed by the body bytes that
+ *      arrived with the client's head
+ * @param body_length, body_left : Request body bytes that were still in the client's socket, and are still there
+ * @param pipe_bytes : Bytes spliced into the link's pipe and not yet out of it
+ * @param status : Status code of the response, 0 until its head has been queued
+ * @param response_left : Bytes of the response body, or of the current run of chunks, still to splice
+ * @param chunked : The response body is chunked; it is forwarded as is, chunk-size lines and all
+ * @param until_close : The response body ends when the server closes the connection
+ * @param server_keep_alive : The server keeps the connection open after the response
+ * @param response_bytes : Bytes of response forwarded to the client, for the access log
+ * @param started_ns : When the request head was complete, on the metrics clock
+ * @param timer : Fires when the exchange made no progress for PROXY_TIMEOUT_MS
+ */
+typedef struct ProxyExchange
+{
+    Connection *client;
+    UpstreamPool *pool;
+    Upstream *upstream;
+    UpstreamLink link;
+    int reused;
+    int attempts;
+    unsigned excluded;
+    ProxyState state;
+    char *head;
+    size_t head_len;
+    size_t head_sent;
+    uint64_t body_length;
+    uint64_t body_left;
+    size_t pipe_bytes;
+    int status;
+    uint64_t response_left;
+    int chunked;
+    int until_close;
+    int server_keep_alive;
+    size_t response_bytes;
+    uint64_t started_ns;
+    TimerNode timer;
+} ProxyExchange;
+
+/**
+ * @brief Outcome of splice_through()
+ */
+typedef enum
+{
+    SPLICE_BLOCKED,    ///< Waiting for a socket: no more input yet, or no room for output.
+    SPLICE_DONE,       ///< Everything asked for went through and the pipe is empty.
+    SPLICE_EOF,        ///< The input ended early.
+    SPLICE_READ_ERROR, ///< Reading the input failed.
+    SPLICE_WRITE_ERROR ///< Writing the output failed.
+} SpliceResult;
+
+/**
+ * @brief A worker thread running its own event loop
+ * @param id : Index of the worker, also its position in the SO_REUSEPORT group
+ * @param cpu : CPU the worker is pinned to, or -1 if it is not pinned
+ * @param server_fd : The worker's own listening socket
+ * @param epoll_fd : The worker's own epoll instance
+ * @param thread : Thread running worker_main()
+ */
+typedef struct
+{
+    int id;
+    int cpu;
+    int server_fd;
+    int epoll_fd;
+    pthread_t thread;
+} Worker;
+
+/// @brief Connections indexed by their socket File Descriptor; each worker thread has its own table.
+__thread Connection **connections = NULL;
+/// @brief Number of slots allocated in this worker's connections table.
+__thread int connections_size = 0;
+/// @brief Open file descriptors of recently served static files, one cache per worker.
+__thread FileCache file_cache;
+/// @brief Connection timeouts of this worker.
+__thread TimerWheel timers;
+/// @brief This worker's io_uring when the workers run on io_uring (-u); NULL on epoll.
+__thread Uring *uring = NULL;
+/// @brief This worker's block of worker_metrics.
+__thread WorkerMetrics *metrics = NULL;
+/// @brief This worker's ring of the access log.
+__thread AccessLogRing *log_ring = NULL;
+/// @brief Serialized responses of small static files, shared by all workers.
+ResponseCache response_cache;
+/// @brief Counters and histograms of every worker, indexed by worker id; summed by GET /metrics.
+WorkerMetrics *worker_metrics = NULL;
+/// @brief Number of blocks in worker_metrics.
+int worker_metrics_count = 0;
+/// @brief Access log written by a background thread from one ring per worker.
+AccessLog access_log;
+/// @brief Non-zero if the workers run on io_uring instead of epoll (-u).
+int use_io_uring = 0;
+/// @brief Directory served by the GET handler; can be overridden on the command line.
+const char *document_root = "www";
+/// @brief Non-zero if directories without an index.html are answered with a generated listing (-l).
+int directory_listings = 0;
+/// @brief Routes from method and path to Endpoint; built in main() and only read by the workers.
+Router router;
+/// @brief Exchanges indexed by the socket of their upstream link; each worker thread has its own table.
+__thread ProxyExchange **proxies = NULL;
+/// @brief Number of slots allocated in this worker's proxies table.
+__thread int proxies_size = 0;
+/// @brief This worker's state of every upstream group, in the order of upstream_groups.
+__thread UpstreamPool *upstream_pools = NULL;
+/// @brief Runs the health checks and idle-link expiry of this worker's upstream pools.
+__thread TimerNode upstream_check_timer;
+/// @brief Upstream groups given with -P; reverse-proxy routes forward to them.
+UpstreamGroup upstream_groups[PROXY_MAX_GROUPS];
+/// @brief Number of groups in upstream_groups.
+int upstream_group_count = 0;
+/// @brief Threads running the handlers of offload endpoints, shared by all workers.
+OffloadPool handler_pool;
+/// @brief Handler jobs of this worker that the pool finished, signalled through its eventfd.
+__thread OffloadQueue handler_completions;
+/// @brief Connections each worker keeps open (-m, divided among the workers), 0 for no limit.
+int worker_max_connections = 0;
+/// @brief Requests each worker has in flight (-q, divided among the workers), 0 for no limit.
+int worker_max_in_flight = 0;
+/// @brief Latency target of the adaptive request limit (-A), 0 to keep it fixed.
+uint64_t admission_target_ns = 0;
+/// @brief This worker's connection and request limits.
+__thread Admission admission;
+/// @brief Adjusts this worker's adaptive request limit every ADMISSION_INTERVAL_MS.
+__thread TimerNode admission_timer;
+/// @brief Date line of this worker's responses, formatted once a second
+__thread HttpDateCache date_cache;
+/// @brief Connections one client may open per second (-R), 0 for no limit. Address steering sends all of a
+///      client's connections to one worker, which applies the whole rate.
+unsigned worker_connection_rate = 0;
+/// @brief Requests one client may send per second (-r), 0 for no limit; applied like the connection rate.
+unsigned worker_request_rate = 0;
+/// @brief This worker's token buckets per client address.
+__thread RateLimiter rate_limiter;
+/// @brief TLS context shared by the workers (-C, -K), NULL to serve plain HTTP.
+SSL_CTX *tls_context = NULL;
+
+/// @brief Answer of admission control, serialized once: a client turned away gets it with a single send.
+static const char overload_response[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                        "Content-Type: text/plain\r\n"
+                                        "Retry-After: 1\r\n"
+                                        "Connection: close\r\n"
+                                        "Content-Length: 20\r\n"
+                                        "\r\n"
+                                        "Service Unavailable\n";
+/// @brief Answer of the rate limiter to a client over its rate, serialized once like overload_response.
+static const char rate_limited_response[] = "HTTP/1.1 429 Too Many Requests\r\n"
+                                            "Content-Type: text/plain\r\n"
+                                            "Retry-After: 1\r\n"
+                                            "Connection: close\r\n"
+                                            "Content-Length: 18\r\n"
+                                            "\r\n"
+                                            "Too Many Requests\n";
+
 /**
  * @brief Helper function to to set a socket to non-blocking mode.
  * @param socket_fd: File Descriptor of corresponding socket
@@ -145,16 +719,328 @@ void create_epoll(int *epoll_fd, int server_fd, struct epoll_event *ev)
     }
 }
 
+/**
+ * @brief This function allocates the connection state for a newly accepted client
+ * @param client_fd File descriptor of the accepted client
+ * @details [LOGIC][CONNECTION_CREATE]
+ * 1. Grow the fd-indexed connections table if client_fd does not fit.
+ * 2. Allocate the Connection and its initial receive buffer.
+ * 3. Start the parser at the request line.
+ * @return Pointer to the new connection, or NULL on allocation failure.
+ */
+Connection *create_connection(int client_fd)
+{
+    // {ref}{LOGIC}{CONNECTION_CREATE}{1}
+    if (client_fd >= connections_size)
+    {
+        int new_size = connections_size ? connections_size : 64;
+        while (new_size <= client_fd)
+        {
+            new_size *= 2;
+        }
+        Connection **grown = realloc(connections, new_size * sizeof(Connection *));
+        if (!grown)
+        {
+            return NULL;
+        }
+        memset(grown + connections_size, 0, (new_size - connections_size) * sizeof(Connection *));
+        connections = grown;
+        connections_size = new_size;
+    }
+
+    // {ref}{LOGIC}{CONNECTION_CREATE}{2,3}
+    Connection *conn = calloc(1, sizeof(Connection));
+    if (!conn)
+    {
+        return NULL;
+    }
+    conn->in_buf = malloc(READ_BUFFER_INITIAL);
+    if (!conn->in_buf)
+    {
+        free(conn);
+        return NULL;
+    }
+    conn->fd = client_fd;
+    conn->in_cap = READ_BUFFER_INITIAL;
+    conn->state = PARSE_HEADERS;
+    http_scan_init(&conn->scanner, conn->request.headers, MAX_HEADERS);
+    conn->keep_alive = 1;
+    arena_init(&conn->arena);
+    connections[client_fd] = conn;
+    return conn;
+}
+
+/**
+ * @brief Logs an accepted or closed connection.
+ * @param reason Why the connection was closed; a static string, since the record is formatted later.
+ */
+void log_connection(Connection *conn, AccessLogKind kind, const char *reason)
+{
+    AccessLogRecord *record = access_log_reserve(log_ring);
+    if (!record)
+    {
+        return;
+    }
+    record->kind = kind;
+    record->time_ns = metrics_now_ns();
+    record->peer_addr = conn->peer_addr;
+    record->peer_port = conn->peer_port;
+    record->fd = conn->fd;
+    record->reason = reason;
+    access_log_commit(log_ring);
+}
+
+/**
+ * @brief Logs an answered request: its request line, status, response size and handling time.
+ * @param bytes Bytes of response queued for it.
+ * @param started, now When handling began and ended, on the metrics clock.
+ */
+void log_request(Connection *conn, int status_code, size_t bytes, uint64_t started, uint64_t now)
+{
+    AccessLogRecord *record = access_log_reserve(log_ring);
+    if (!record)
+    {
+        return;
+    }
+    record->kind = ACCESS_LOG_REQUEST;
+    record->time_ns = now;
+    record->duration_ns = now - started;
+    record->bytes = bytes;
+    record->peer_addr = conn->peer_addr;
+    record->peer_port = conn->peer_port;
+    record->status = status_code;
+    record->fd = conn->fd;
+    access_log_copy(record->method, sizeof(record->method), conn->request.method);
+    access_log_copy(record->uri, sizeof(record->uri), conn->request.uri);
+    access_log_copy(record->version, sizeof(record->version), conn->request.version);
+    access_log_commit(log_ring);
+}
+
+/**
+ * @brief Releases whatever an output segment owns: a malloc'd buffer, a response cache entry or a file cache reference.
+ */
+void release_segment(OutSegment *segment)
+{
+    free(segment->owned);
+    if (segment->cached)
+    {
+        response_cache_release(segment->cached);
+    }
+    if (segment->file)
+    {
+        file_cache_release(segment->file);
+    }
+}
+
+/**
+ * @brief Frees a closed connection's output queue and the connection itself.
+ * @attention On io_uring the socket is only closed here, once no operation uses it any more, so its
+ *      descriptor number cannot be reused by a new connection while completions for the old one are due.
+ */
+void release_connection(Connection *conn)
+{
+    for (int i = conn->out_head; i < conn->out_count; i++)
+    {
+        release_segment(&conn->out[i]);
+    }
+    free(conn->out);
+    free(conn->send_batch);
+    if (uring)
+    {
+        close(conn->fd);
+    }
+    free(conn);
+}
+
+/**
+ * @brief Ends an exchange's use of its upstream link.
+ * @param reusable Non-zero if the link may go back to the pool; it is closed otherwise, and so is a link
+ *      whose pipe still holds bytes.
+ * @details The link no longer dispatches events to the exchange, and its server has one request less outstanding.
+ */
+void release_proxy_link(ProxyExchange *proxy, int reusable)
+{
+    proxies[proxy->link.fd] = NULL;
+    proxy->upstream->outstanding--;
+    upstream_release(proxy->upstream, &proxy->link, reusable && proxy->pipe_bytes == 0, timers.now_ms);
+    proxy->upstream = NULL;
+}
+
+/**
+ * @brief Detaches a connection from the request it forwards: releases the link and the request head
+ *      and stops the exchange's timer. The exchange itself lives in the connection's arena.
+ */
+void release_proxy(Connection *conn, int reusable)
+{
+    ProxyExchange *proxy = conn->proxy;
+    if (proxy->upstream)
+    {
+        release_proxy_link(proxy, reusable);
+    }
+    timer_wheel_cancel(&timers, &proxy->timer);
+    free(proxy->head);
+    conn->proxy = NULL;
+}
+
+/**
+ * @brief Gives back the admission the connection's current request holds, and reports its latency to the
+ *      adaptive limit. Does nothing if the request holds none.
+ * @param now When the request was answered, or given up on.
+ */
+void end_admission(Connection *conn, uint64_t now)
+{
+    if (conn->admitted_ns)
+    {
+        admission_end(&admission, now - conn->admitted_ns);
+        conn->admitted_ns = 0;
+    }
+}
+
+/**
+ * @brief This function tears down a client connection
+ * @param epoll_fd File descriptor corresponding to epoll instance
+ * @param conn Connection to close
+ * @details [LOGIC][CONNECTION_CLOSE]
+ * 1. Remove the socket from the epoll instance and close it, after ending its TLS session. On io_uring, shut
+ *      the socket down and cancel what is in flight on it instead: the kernel may still use the socket, the
+ *      send iovecs and the output queue until those operations complete.
+ * 2. Stop the connection's timers, let an unfinished response producer release its state, and drop
+ *      an unfinished exchange with an upstream server together with its link. Give back the admissions of the
+ *      connection and of an unanswered request, and count the connection as closed.
+ * 3. Release the buffered input and the arena, and clear the slot in the connections table. While a handler
+ *      job runs, the arena and the connection stay until it is back (`finish_handler_jobs`).
+ * 4. Release the unsent response segments and the connection, or leave that to the completion of
+ *      the last io_uring operation in flight (`release_connection`).
+ */
+void close_connection(int epoll_fd, Connection *conn)
+{
+    // {ref}{LOGIC}{CONNECTION_CLOSE}{1}
+    if (uring)
+    {
+        shutdown(conn->fd, SHUT_RDWR);
+        struct io_uring_sqe *sqe = conn->uring_ops ? uring_get_sqe(uring) : NULL;
+        if (sqe)
+        {
+            uring_prep_cancel_fd(sqe, conn->fd);
+            sqe->user_data = URING_OP_CANCEL;
+        }
+    }
+    else
+    {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+        if (conn->tls)
+        {
+            tls_session_close(conn->tls);
+            conn->tls = NULL;
+        }
+        close(conn->fd);
+    }
+    // {ref}{LOGIC}{CONNECTION_CLOSE}{2}
+    timer_wheel_cancel(&timers, &conn->read_timer);
+    timer_wheel_cancel(&timers, &conn->write_timer);
+    if (conn->producer)
+    {
+        conn->producer(conn->producer_context, NULL, 0);
+        conn->producer = NULL;
+    }
+    if (conn->proxy)
+    {
+        release_proxy(conn, 0);
+    }
+    if (conn->admitted_ns)
+    {
+        end_admission(conn, metrics_now_ns());
+    }
+    admission_close(&admission);
+    metrics_add(&metrics->connections_closed, 1);
+    // {ref}{LOGIC}{CONNECTION_CLOSE}{3}
+    if (!conn->job)
+    {
+        arena_destroy(&conn->arena);
+    }
+    connections[conn->fd] = NULL;
+    free(conn->in_buf);
+    conn->in_buf = NULL;
+    // {ref}{LOGIC}{CONNECTION_CLOSE}{4}
+    if (conn->uring_ops > 0 || conn->job)
+    {
+        conn->closed = 1;
+        return;
+    }
+    release_connection(conn);
+}
+
+/**
+ * @brief Timer wheel callback: the connection missed a deadline and is closed.
+ * @param timer The read or write timer of the connection.
+ * @param arg Pointer to the worker's epoll file descriptor.
+ */
+void on_connection_timeout(TimerNode *timer, void *arg)
+{
+    Connection *conn = timer->data;
+    const char *reason = "request timeout";
+    if (timer == &conn->write_timer)
+    {
+        reason = "write stall timeout";
+    }
+    else if (conn->read_timeout == READ_TIMEOUT_KEEP_ALIVE)
+    {
+        reason = "keep-alive idle timeout";
+    }
+    else if (conn->read_timeout == READ_TIMEOUT_BODY)
+    {
+        reason = "request body timeout";
+    }
+    log_connection(conn, ACCESS_LOG_CLOSE, reason);
+    close_connection(*(int *)arg, conn);
+}
+
+/**
+ * @brief Turns away a connection the worker has no room for, or whose client is over its connection rate:
+ *      answers 503 or 429 right away and closes it.
+ * @param client_fd The accepted socket, blocking or not.
+ * @param status_code 503 at the connection limit, 429 from the rate limiter.
+ * @details Whatever the client already sent is read first: closing a socket with unread data resets the
+ *      connection, and the client might lose the answer. Neither call waits. A TLS client expects a
+ *      handshake, not a plain answer, so it only sees the connection close.
+ */
+void shed_connection(int client_fd, int status_code)
+{
+    char discard[BUFFER_SIZE];
+    recv(client_fd, discard, sizeof(discard), MSG_DONTWAIT);
+    if (status_code == 429)
+    {
+        if (!tls_context)
+        {
+            send(client_fd, rate_limited_response, sizeof(rate_limited_response) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+        }
+        metrics_add(&metrics->connections_limited, 1);
+    }
+    else
+    {
+        if (!tls_context)
+        {
+            send(client_fd, overload_response, sizeof(overload_response) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+        }
+        metrics_add(&metrics->connections_shed, 1);
+    }
+    close(client_fd);
+}
+
 /**
  * @brief This function handles incoming connection from clients
  * @param epoll_fd File descriptor corresponding to epoll instance
  * @param server_fd File descriptor corresponding to server socket
  * @param ev A pointer to struct epoll_event
  * @details [LOGIC][HANDLE_CONNECTION]
- * 1. Use accept() system call to accept client connection
+ * 1. Use accept() system call to accept client connection. If its client opens connections faster than
+ *      its rate allows (`rate_limit_connection`), or at the worker's connection limit, turn it away
+ *      (`shed_connection`) and go on with the next one.
  * 2. Make the socket corresponding to new connection as non-blocking
- * 3. Add the client socket to epoll instance' to get notified about events
- * 4. Add the client in the clients array
+ * 3. Create the per-connection state used by the incremental parser and, with TLS, the session whose
+ *      handshake the first readable event starts.
+ * 4. Add the client socket to epoll instance' to get notified about events
+ * 5. Start the request timeout: the first request has to arrive within REQUEST_TIMEOUT_MS.
  */
 void handle_new_connection(int epoll_fd, int server_fd, struct epoll_event *ev)
 {
@@ -177,26 +1063,67 @@ void handle_new_connection(int epoll_fd, int server_fd, struct epoll_event *ev)
                 exit(EXIT_FAILURE);
             }
         }
+        if (rate_limit_connection(&rate_limiter, client_addr.sin_addr.s_addr, metrics_now_ns()) == -1)
+        {
+            shed_connection(client_fd, 429);
+            continue;
+        }
+        if (admission_open(&admission) == -1)
+        {
+            shed_connection(client_fd, 503);
+            continue;
+        }
 
         // Make the client socket non-blocking
         if (make_socket_non_blocking(client_fd) == -1)
         {
             perror("make_socket_non_blocking: client_fd");
+            admission_close(&admission);
+            close(client_fd);
+            continue;
+        }
+
+        Connection *conn = create_connection(client_fd);
+        if (!conn)
+        {
+            perror("create_connection");
+            admission_close(&admission);
             close(client_fd);
             continue;
         }
+        metrics_add(&metrics->connections_accepted, 1);
+        conn->peer_addr = client_addr.sin_addr.s_addr;
+        conn->peer_port = client_addr.sin_port;
+        if (tls_context)
+        {
+            conn->tls = tls_session_create(tls_context, client_fd);
+            conn->tls_state = TLS_HANDSHAKE_WANT_READ;
+            if (!conn->tls)
+            {
+                perror("tls_session_create");
+                close_connection(epoll_fd, conn);
+                continue;
+            }
+        }
 
         // Add the new client socket to epoll
         ev->events = EPOLLIN | EPOLLET; // Edge-triggered mode
         ev->data.fd = client_fd;
+        conn->events = ev->events;
 
         if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, ev) == -1)
         {
             perror("epoll_ctl: client_fd");
-            close(client_fd);
+            close_connection(epoll_fd, conn);
             continue;
-        }        
-        printf("Accepted new connection: FD %d\n", client_fd);
+        }
+
+        // {ref}{LOGIC}{HANDLE_CONNECTION}{5}
+        timer_init(&conn->read_timer, on_connection_timeout, conn);
+        timer_init(&conn->write_timer, on_connection_timeout, conn);
+        conn->read_timeout = READ_TIMEOUT_REQUEST;
+        timer_wheel_schedule(&timers, &conn->read_timer, REQUEST_TIMEOUT_MS);
+        log_connection(conn, ACCESS_LOG_ACCEPT, NULL);
     }
 }
 
@@ -207,214 +1134,3719 @@ void handle_new_connection(int epoll_fd, int server_fd, struct epoll_event *ev)
  * @param value
  * @details [LOGIC][ADD_RESPONSE_HEADER]
  * 1. Check if header count does not exceed maximum headers
- * 2. Add KEY/VALUE to respective parameters of HttpResponse
+ * 2. Copy KEY/VALUE into the connection's arena, so callers may pass temporary buffers,
+ *      and add them to respective parameters of HttpResponse
  */
 void add_response_header(HttpResponse *response, const char *key, const char *value)
 {
     if (response->header_count < MAX_HEADERS)
     {
-        response->headers[response->header_count].key = strdup(key);
-        response->headers[response->header_count].value = strdup(value);
-        response->header_count++;
+        Header *header = &response->headers[response->header_count];
+        header->key = arena_strdup(response->arena, key);
+        header->value = arena_strdup(response->arena, value);
+        if (header->key && header->value)
+        {
+            response->header_count++;
+        }
     }
 }
 /**
- * @brief This function parses the HTTP request text coming from client
+ * @brief Looks up a known request header through its slot, without comparing names
+ * @return The NUL-terminated header value inside the receive buffer, or NULL if the header is absent.
  */
-void parse_request_line(char *line, HttpRequest *request)
+static inline const char *request_header(const HttpRequest *request, HttpHeaderId id)
 {
-    sscanf(line, "%s %s %s", request->method, request->uri, request->version);
+    int slot = request->header_slots[id];
+    return slot ? request->base + request->headers[slot - 1].value.offset : NULL;
 }
 
-void parse_header(char *line, Header *header)
+/// @brief Counter slot of a request's method in the metrics; a request that never got that far counts as OTHER
+static inline MetricsMethod request_metrics_method(const HttpRequest *request)
 {
-    char *colon = strchr(line, ':');
-    if (colon)
+    switch (request->method_id)
     {
-        *colon = '\0';
-        header->key = strdup(line);
-        header->value = strdup(colon + 2); // +2 to skip ': '
+    case HTTP_METHOD_GET:
+        return METRICS_METHOD_GET;
+    case HTTP_METHOD_POST:
+        return METRICS_METHOD_POST;
+    default:
+        return METRICS_METHOD_OTHER;
+    }
+}
+
+/// @brief Minor version of an HTTP/1.0 or HTTP/1.1 request line, -1 for any other version
+static int version_minor(const char *version, size_t len)
+{
+    if (len == 8 && memcmp(version, "HTTP/1.", 7) == 0 && (version[7] == '0' || version[7] == '1'))
+    {
+        return version[7] - '0';
     }
+    return -1;
 }
 
 /**
- * @brief This function parses a HTTP request and
- * breaks down the raw request data into its component parts: the request line, headers, and body.
- * @param buffer The received text from the client read during 'handle_read_operation'.
- * @param request Pointer to the HttpRequest body/structure.
- * @details [LOGIC][PARSE_REQUEST]
- * 1. Split the buffer at the first occurrence of "\r\n"
- * (carriage return followed by line feed, which separates lines in HTTP). It returns first line of HTTP request.
- * 2. Parse the above parsed line into method, URI, and HTTP version, and store them in the HttpRequest structure.
- * 3. Continue reading subsequent lines and check if line is not empty.
- * 4. For each non emepty lines, we check the following:
- *      i.      MAX_HEADERS count has not exceeded
- *      ii.     Parse and extract header line into 'headers' array of HttpRequest structure.
- *      iii.    Keep incrementing header count to extract all headers
- * 5. After processing all headers, parse the remaining part of the buffer, which is the request body.
- * 6. Store the request body in HttpRequest structure's request parameter.
- *
+ * @brief Checks whether a comma-separated header value (e.g. 'Connection') lists a token
+ * @return 1 if the token is present (case-insensitive), 0 otherwise.
  */
-void parse_request(char *buffer, HttpRequest *request)
+int header_has_token(const char *value, const char *token)
 {
-    // {ref}{LOGIC}{PARSE_REQUEST}{1,2}
-    char *line = strtok(buffer, "\r\n");
-    parse_request_line(line, request);
-
-    request->header_count = 0;
-    // {ref}{LOGIC}{PARSE_REQUEST}{3,4}
-    while ((line = strtok(NULL, "\r\n")) && *line)
+    size_t token_len = strlen(token);
+    while (value && *value)
     {
-        if (request->header_count < MAX_HEADERS)
+        value += strspn(value, " \t,");
+        size_t len = strcspn(value, ",");
+        while (len > 0 && (value[len - 1] == ' ' || value[len - 1] == '\t'))
         {
-            parse_header(line, &request->headers[request->header_count++]);
+            len--;
         }
+        if (len == token_len && strncasecmp(value, token, len) == 0)
+        {
+            return 1;
+        }
+        value += strcspn(value, ",");
     }
-    // {ref}{LOGIC}{PARSE_REQUEST}{5,6}
-    request->body = strtok(NULL, "");
+    return 0;
 }
 
 /**
- * @brief Handles the processing of an HTTP GET request by constructing an appropriate response.
- * @param request Pointer to the parsed HttpRequest structure containing the details of the incoming GET request.
- * @param response Pointer to the HttpResponse structure where the response data will be populated.
- * @details [LOGIC][HANDLE_GET_REQUEST]
- * 1. Set the response status code to 200, indicating a successful request.
- * 2. Set the response status text to "OK".
- * 3. Add a "Content-Type" header with a value of "text/html" to the response.
- * 4. Set the body of the response to a simple HTML message.
+ * @brief Decides whether the connection stays open after answering this request
+ * @details [LOGIC][KEEP_ALIVE]
+ * 1. An explicit 'Connection: close' always ends the connection.
+ * 2. HTTP/1.1 connections are persistent by default.
+ * 3. HTTP/1.0 connections are persistent only with 'Connection: keep-alive'.
  */
-void handle_get_request(HttpRequest *request, HttpResponse *response)
+int request_wants_keep_alive(const HttpRequest *request)
 {
-    response->status_code = 200;
-    response->status_text = "OK";
-    add_response_header(response, "Content-Type", "text/html");
-    response->body = "<html><body><h1>Hello from GET!</h1></body></html>";
+    const char *connection = request_header(request, HTTP_HEADER_CONNECTION);
+    // {ref}{LOGIC}{KEEP_ALIVE}{1}
+    if (header_has_token(connection, "close"))
+    {
+        return 0;
+    }
+    // {ref}{LOGIC}{KEEP_ALIVE}{2,3}
+    if (request->version_minor == 1)
+    {
+        return 1;
+    }
+    return header_has_token(connection, "keep-alive");
 }
 
 /**
- * @brief Handles the processing of an HTTP POST request by constructing an appropriate response.
- * @param request Pointer to the parsed HttpRequest structure containing the details of the incoming POST request.
- * @param response Pointer to the HttpResponse structure where the response data will be populated.
- * @details [LOGIC][HANDLE_POST_REQUEST]
- * 1. Set the response status code to 200, indicating a successful request.
- * 2. Set the response status text to "OK".
- * 3. Add a "Content-Type" header with a value of "text/plain" to the response.
- * 4. Set the body of the response to acknowledge receipt of the POST request.
+ * @brief Returns a span's bytes as a NUL-terminated string by terminating it in place.
+ * @attention The byte after every span produced by the scanner is a delimiter, '\r' or trailing
+ *      whitespace, so overwriting it loses nothing.
  */
-void handle_post_request(HttpRequest *request, HttpResponse *response)
+static char *terminate_span(char *base, Span span)
 {
-    response->status_code = 200;
-    response->status_text = "OK";
-    add_response_header(response, "Content-Type", "text/plain");
-    response->body = "Received POST request";
+    base[span.offset + span.length] = '\0';
+    return base + span.offset;
 }
 
-/**
- * @brief Sends the constructed HTTP response to the client over the specified socket file descriptor.
- * @param client_fd The file descriptor for the client's socket connection.
- * @param response Pointer to the HttpResponse structure containing the status, headers, and body to be sent.
- * @details [LOGIC][SEND_RESPONSE]
- * 1. Use `snprintf` to format the response status line with the HTTP version, status code, and status text.
- * 2. Loop through the headers in the response structure and append each header (key-value pairs) to the response buffer.
- * 3. Append a blank line (`\r\n`) to separate headers from the body.
- * 4. If the response contains a body, append it to the buffer.
- * 5. Send the complete response buffer to the client using the `send` system call.
- */
-void send_response(int client_fd, HttpResponse *response)
+/// @brief Copies 'len' bytes to 'out' and returns the end of the copy
+static inline char *append_bytes(char *out, const char *data, size_t len)
 {
-    char buffer[BUFFER_SIZE];
-    int len = snprintf(buffer, BUFFER_SIZE, "HTTP/1.1 %d %s\r\n",
-                       response->status_code, response->status_text);
-
-    for (int i = 0; i < response->header_count; i++)
-    {
-        len += snprintf(buffer + len, BUFFER_SIZE - len, "%s: %s\r\n",
-                        response->headers[i].key, response->headers[i].value);
-    }
+    memcpy(out, data, len);
+    return out + len;
+}
 
-    len += snprintf(buffer + len, BUFFER_SIZE - len, "\r\n");
+/// @brief Copies a NUL-terminated string to 'out', without the NUL, and returns the end of the copy
+static inline char *append_string(char *out, const char *text)
+{
+    return append_bytes(out, text, strlen(text));
+}
 
-    if (response->body)
+/// @brief Body sink for requests whose handler does not read the body
+static int discard_body(void *context, const char *data, size_t length)
+{
+    (void)context;
+    (void)data;
+    (void)length;
+    return 0;
+}
+
+/**
+ * @brief This function incrementally parses the HTTP request buffered on a connection and
+ * breaks down the raw request data into its component parts: the request line, headers, and body.
+ * @param conn The connection whose 'in_buf' holds the bytes read so far by 'handle_read_operation'.
+ * @details [LOGIC][PARSE_REQUEST]
+ * 1. Hand the buffer to the SIMD scanner (`http_scan`). It resumes at the first byte it has not
+ *      examined yet, so a request split across several reads is never re-scanned from the start,
+ *      and produces the method, URI, version and header spans in that single pass.
+ * 2. Until the blank line after the headers has arrived, wait for more input.
+ * 3. Once the head is complete, NUL-terminate the request-line tokens and the header keys and
+ *      values in place, so handlers can use them as C strings without copying. Classify the method,
+ *      the version and every header name once, filling the slots of the known headers, so nothing
+ *      after the parser compares them as strings again. A slot keeps the first of repeated fields, so the
+ *      framing fields may not repeat: Content-Length only with the same value every time, Transfer-Encoding
+ *      not at all. Otherwise the request is rejected with 400, since a server or proxy that took another of
+ *      the values would see a different body (RFC 9112 section 6.3).
+ * 4. Work out the body framing (RFC 9112 section 6.3): 'Transfer-Encoding: chunked', otherwise
+ *      'Content-Length', otherwise no body. A request with both is rejected, since the two framings
+ *      could disagree about where the next request starts; other transfer codings are answered with 501.
+ * 5. Stop in PARSE_HEAD_DONE, so the handler can choose where the body goes before any of it is decoded.
+ * 6. In PARSE_BODY, decode the body bytes that have arrived and pass them to the handler's `on_body`.
+ *      Decoded bytes are dropped from the buffer right away: only the head stays buffered, so an upload
+ *      of any size needs no more memory than the head plus one read.
+ * 7. Once the framing says the body ended, the request is complete.
+ * @return The parser state after consuming the available input.
+ */
+ParseState parse_request(Connection *conn)
+{
+    HttpRequest *request = &conn->request;
+    // The buffer may have been reallocated since the last call; spans are offsets, so only the base moves.
+    request->base = conn->in_buf;
+
+    if (conn->state == PARSE_HEADERS)
+    {
+        // {ref}{LOGIC}{PARSE_REQUEST}{1,2}
+        HttpScanResult result = http_scan(&conn->scanner, conn->in_buf, conn->in_len);
+        if (result == HTTP_SCAN_INCOMPLETE)
+        {
+            return conn->state;
+        }
+        if (result == HTTP_SCAN_ERROR)
+        {
+            return conn->state = PARSE_ERROR;
+        }
+
+        // {ref}{LOGIC}{PARSE_REQUEST}{3}
+        request->method = terminate_span(conn->in_buf, conn->scanner.method);
+        request->uri = terminate_span(conn->in_buf, conn->scanner.uri);
+        request->version = terminate_span(conn->in_buf, conn->scanner.version);
+        request->method_id = http_method_lookup(request->method, conn->scanner.method.length);
+        request->version_minor = version_minor(request->version, conn->scanner.version.length);
+        request->header_count = conn->scanner.header_count;
+        for (int i = 0; i < request->header_count; i++)
+        {
+            const char *key = terminate_span(conn->in_buf, request->headers[i].key);
+            terminate_span(conn->in_buf, request->headers[i].value);
+            HttpHeaderId id = http_header_lookup(key, request->headers[i].key.length);
+            if (id == HTTP_HEADER_UNKNOWN)
+            {
+                continue;
+            }
+            if (!request->header_slots[id])
+            {
+                request->header_slots[id] = i + 1;
+            }
+            else if (id == HTTP_HEADER_TRANSFER_ENCODING ||
+                     (id == HTTP_HEADER_CONTENT_LENGTH &&
+                      strcmp(request_header(request, id), conn->in_buf + request->headers[i].value.offset) != 0))
+            {
+                return conn->state = PARSE_ERROR;
+            }
+        }
+
+        // {ref}{LOGIC}{PARSE_REQUEST}{4}
+        const char *transfer_encoding = request_header(request, HTTP_HEADER_TRANSFER_ENCODING);
+        const char *length = request_header(request, HTTP_HEADER_CONTENT_LENGTH);
+        if (transfer_encoding)
+        {
+            if (length)
+            {
+                return conn->state = PARSE_ERROR;
+            }
+            if (strcasecmp(transfer_encoding, "chunked") != 0)
+            {
+                conn->error_status = 501;
+                return conn->state = PARSE_ERROR;
+            }
+            http_body_init_chunked(&conn->body);
+            request->has_body = 1;
+        }
+        else
+        {
+            char *end = NULL;
+            errno = 0;
+            unsigned long long content_length = length ? strtoull(length, &end, 10) : 0;
+            if (length && (!isdigit((unsigned char)*length) || *end != '\0' || errno == ERANGE))
+            {
+                return conn->state = PARSE_ERROR;
+            }
+            http_body_init_length(&conn->body, content_length);
+            request->has_body = content_length > 0;
+        }
+
+        // {ref}{LOGIC}{PARSE_REQUEST}{5}
+        conn->body_start = conn->scanner.end;
+        return conn->state = PARSE_HEAD_DONE;
+    }
+
+    if (conn->state == PARSE_BODY)
+    {
+        // {ref}{LOGIC}{PARSE_REQUEST}{6}
+        size_t consumed;
+        HttpBodyResult result = http_body_decode(&conn->body, conn->in_buf + conn->body_start,
+                                                 conn->in_len - conn->body_start, &consumed,
+                                                 request->on_body ? request->on_body : discard_body,
+                                                 request->body_context);
+        if (consumed > 0)
+        {
+            memmove(conn->in_buf + conn->body_start, conn->in_buf + conn->body_start + consumed,
+                    conn->in_len - conn->body_start - consumed);
+            conn->in_len -= consumed;
+            conn->in_buf[conn->in_len] = '\0';
+            conn->body_progress = 1;
+        }
+
+        // {ref}{LOGIC}{PARSE_REQUEST}{7}
+        if (result == HTTP_BODY_DONE)
+        {
+            conn->state = PARSE_DONE;
+        }
+        else if (result == HTTP_BODY_ERROR)
+        {
+            conn->state = PARSE_ERROR;
+        }
+        else if (result == HTTP_BODY_ABORTED)
+        {
+            conn->error_status = 500;
+            conn->state = PARSE_ERROR;
+        }
+    }
+    return conn->state;
+}
+
+/**
+ * @brief Maps a file name extension to the Content-Type it is served with.
+ */
+const char *content_type_for_path(const char *path)
+{
+    static const struct
+    {
+        const char *extension;
+        const char *content_type;
+    } types[] = {
+        {".html", "text/html"},
+        {".htm", "text/html"},
+        {".css", "text/css"},
+        {".js", "application/javascript"},
+        {".json", "application/json"},
+        {".txt", "text/plain"},
+        {".png", "image/png"},
+        {".jpg", "image/jpeg"},
+        {".jpeg", "image/jpeg"},
+        {".gif", "image/gif"},
+        {".svg", "image/svg+xml"},
+        {".ico", "image/x-icon"},
+        {".pdf", "application/pdf"},
+        {".mp4", "video/mp4"},
+        {".woff2", "font/woff2"},
+    };
+    const char *extension = strrchr(path, '.');
+    if (extension && !strchr(extension, '/'))
+    {
+        for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+        {
+            if (strcasecmp(extension, types[i].extension) == 0)
+            {
+                return types[i].content_type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+/**
+ * @brief Translates a request URI into a path below the document root.
+ * @param uri The request target, e.g. "/docs/a%20b.html?x=1".
+ * @param path Output buffer for the filesystem path.
+ * @param path_size Size of the output buffer.
+ * @details [LOGIC][RESOLVE_PATH]
+ * 1. Only origin-form targets starting with '/' are accepted; the query string is ignored.
+ * 2. Percent-escapes are decoded, rejecting malformed escapes and encoded NUL bytes.
+ * 3. Any ".." path segment is rejected so requests cannot escape the document root.
+ * @return 0 on success, -1 if the URI cannot be mapped to a file.
+ */
+int resolve_request_path(const char *uri, char *path, size_t path_size)
+{
+    // {ref}{LOGIC}{RESOLVE_PATH}{1}
+    if (uri[0] != '/')
+    {
+        return -1;
+    }
+    size_t len = strlen(document_root);
+    if (len >= path_size)
+    {
+        return -1;
+    }
+    memcpy(path, document_root, len);
+    char *segment = path + len;
+
+    // {ref}{LOGIC}{RESOLVE_PATH}{2}
+    for (const char *cursor = uri; *cursor && *cursor != '?' && *cursor != '#'; cursor++)
+    {
+        char c = *cursor;
+        if (c == '%')
+        {
+            unsigned int decoded;
+            if (!isxdigit((unsigned char)cursor[1]) || !isxdigit((unsigned char)cursor[2]) ||
+                sscanf(cursor + 1, "%2x", &decoded) != 1 || decoded == 0)
+            {
+                return -1;
+            }
+            c = (char)decoded;
+            cursor += 2;
+        }
+        if (len + 1 >= path_size)
+        {
+            return -1;
+        }
+        if (c == '/')
+        {
+            segment = path + len + 1;
+        }
+        path[len++] = c;
+        path[len] = '\0';
+
+        // {ref}{LOGIC}{RESOLVE_PATH}{3}
+        if (strcmp(segment, "..") == 0 && (cursor[1] == '/' || cursor[1] == '\0' || cursor[1] == '?' || cursor[1] == '#'))
+        {
+            return -1;
+        }
+    }
+    path[len] = '\0';
+    return 0;
+}
+
+/// @brief Appends 'text' to buf at 'len'; the caller made sure it fits
+static size_t append_text(char *buf, size_t len, const char *text)
+{
+    size_t text_len = strlen(text);
+    memcpy(buf + len, text, text_len);
+    return len + text_len;
+}
+
+/// @brief Appends 'text' HTML-escaped, stopping before the first character that would pass 'limit'
+static size_t append_html(char *buf, size_t len, size_t limit, const char *text)
+{
+    for (; *text; text++)
+    {
+        char plain[2] = {*text, '\0'};
+        const char *escaped = plain;
+        switch (*text)
+        {
+        case '&':
+            escaped = "&amp;";
+            break;
+        case '<':
+            escaped = "&lt;";
+            break;
+        case '>':
+            escaped = "&gt;";
+            break;
+        case '"':
+            escaped = "&quot;";
+            break;
+        case '\'':
+            escaped = "&#39;";
+            break;
+        }
+        size_t escaped_len = strlen(escaped);
+        if (len + escaped_len > limit)
+        {
+            break;
+        }
+        memcpy(buf + len, escaped, escaped_len);
+        len += escaped_len;
+    }
+    return len;
+}
+
+/// @brief Appends 'text' percent-encoded; only RFC 3986 unreserved characters are kept as they are
+static size_t append_uri_encoded(char *buf, size_t len, const char *text)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    for (; *text; text++)
+    {
+        unsigned char c = *text;
+        if (isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~')
+        {
+            buf[len++] = c;
+        }
+        else
+        {
+            buf[len++] = '%';
+            buf[len++] = hex[c >> 4];
+            buf[len++] = hex[c & 15];
+        }
+    }
+    return len;
+}
+
+/**
+ * @brief Response producer of a directory listing: an HTML page with one link per entry.
+ * @param context The DirectoryListing.
+ * @details [LOGIC][DIRECTORY_LISTING]
+ * 1. The first call writes the page header, with a link to the parent unless this is the root.
+ * 2. Entries are read from the directory only as far as they fit into this call's buffer, so a
+ *      directory of any size is listed with one buffer of memory; they appear in readdir() order.
+ *      Names are HTML-escaped in the text and percent-encoded in the link; directories get a '/'.
+ * 3. After the last entry, write the page footer and close the directory. The next call ends the body.
+ * 4. Called without a buffer, the connection went away: close the directory.
+ */
+ssize_t produce_directory_listing(void *context, char *buf, size_t size)
+{
+    DirectoryListing *listing = context;
+    size_t len = 0;
+
+    // {ref}{LOGIC}{DIRECTORY_LISTING}{4}
+    if (!buf)
+    {
+        if (listing->dir)
+        {
+            closedir(listing->dir);
+            listing->dir = NULL;
+        }
+        return 0;
+    }
+
+    // {ref}{LOGIC}{DIRECTORY_LISTING}{1}
+    if (listing->stage == 0)
+    {
+        len = append_text(buf, len, "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>Index of ");
+        len = append_html(buf, len, size / 4, listing->uri);
+        len = append_text(buf, len, "</title></head>\n<body><h1>Index of ");
+        len = append_html(buf, len, size / 2, listing->uri);
+        len = append_text(buf, len, "</h1>\n<ul>\n");
+        if (strcmp(listing->uri, "/") != 0)
+        {
+            len = append_text(buf, len, "<li><a href=\"../\">../</a></li>\n");
+        }
+        listing->stage = 1;
+    }
+
+    // {ref}{LOGIC}{DIRECTORY_LISTING}{2}
+    while (listing->stage == 1 && size - len >= LISTING_ENTRY_MAX)
+    {
+        errno = 0;
+        struct dirent *entry = readdir(listing->dir);
+        if (!entry)
+        {
+            if (errno)
+            {
+                perror("readdir");
+                return -1;
+            }
+            listing->stage = 2;
+            break;
+        }
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+        const char *suffix = entry->d_type == DT_DIR ? "/" : "";
+        len = append_text(buf, len, "<li><a href=\"");
+        len = append_uri_encoded(buf, len, entry->d_name);
+        len = append_text(buf, len, suffix);
+        len = append_text(buf, len, "\">");
+        len = append_html(buf, len, size, entry->d_name);
+        len = append_text(buf, len, suffix);
+        len = append_text(buf, len, "</a></li>\n");
+    }
+
+    // {ref}{LOGIC}{DIRECTORY_LISTING}{3}
+    static const char footer[] = "</ul>\n</body></html>\n";
+    if (listing->stage == 2 && size - len >= sizeof(footer))
+    {
+        len = append_text(buf, len, footer);
+        closedir(listing->dir);
+        listing->dir = NULL;
+        listing->stage = 3;
+    }
+    return len;
+}
+
+/**
+ * @brief Answers a GET for a directory that has no index.html with a streamed listing of its entries.
+ * @param request The GET request; its URI names the directory.
+ * @param response The response to fill in.
+ * @param path The directory below the document root.
+ * @details [LOGIC][HANDLE_DIRECTORY_LISTING]
+ * 1. Links in the listing are relative to the directory, so a URI without a trailing '/' is first
+ *      redirected to the same URI with one (301).
+ * 2. Open the directory; an unreadable one is answered with 404 like a missing file.
+ * 3. Keep the listing state and a copy of the URI in the connection's arena, which is not reset
+ *      while the response streams, and attach `produce_directory_listing` as the body.
+ */
+void handle_directory_listing(HttpRequest *request, HttpResponse *response, const char *path)
+{
+    size_t uri_len = strcspn(request->uri, "?#");
+
+    // {ref}{LOGIC}{HANDLE_DIRECTORY_LISTING}{1}
+    if (request->uri[uri_len - 1] != '/')
+    {
+        char *location = arena_alloc(response->arena, strlen(request->uri) + 2);
+        if (location)
+        {
+            memcpy(location, request->uri, uri_len);
+            location[uri_len] = '/';
+            strcpy(location + uri_len + 1, request->uri + uri_len);
+            add_response_header(response, "Location", location);
+        }
+        response->status_code = 301;
+        response->status_text = "Moved Permanently";
+        add_response_header(response, "Content-Type", "text/plain");
+        response->body = "Moved Permanently";
+        return;
+    }
+
+    // {ref}{LOGIC}{HANDLE_DIRECTORY_LISTING}{2}
+    DIR *dir = opendir(path);
+    if (!dir)
+    {
+        response->status_code = 404;
+        response->status_text = "Not Found";
+        add_response_header(response, "Content-Type", "text/plain");
+        response->body = "Not Found";
+        return;
+    }
+
+    // {ref}{LOGIC}{HANDLE_DIRECTORY_LISTING}{3}
+    DirectoryListing *listing = arena_alloc(response->arena, sizeof(DirectoryListing));
+    char *uri = arena_alloc(response->arena, uri_len + 1);
+    if (!listing || !uri)
+    {
+        closedir(dir);
+        response->status_code = 500;
+        response->status_text = "Internal Server Error";
+        add_response_header(response, "Content-Type", "text/plain");
+        response->body = "Internal Server Error";
+        return;
+    }
+    memcpy(uri, request->uri, uri_len);
+    uri[uri_len] = '\0';
+    listing->dir = dir;
+    listing->uri = uri;
+    listing->stage = 0;
+
+    response->status_code = 200;
+    response->status_text = "OK";
+    add_response_header(response, "Content-Type", "text/html; charset=utf-8");
+    response->producer = produce_directory_listing;
+    response->producer_context = listing;
+}
+
+/**
+ * @brief Handles the processing of an HTTP GET request by serving a file below the document root.
+ * @param request Pointer to the parsed HttpRequest structure containing the details of the incoming GET request.
+ * @param response Pointer to the HttpResponse structure where the response data will be populated.
+ * @details [LOGIC][HANDLE_GET_REQUEST]
+ * 1. Map the URI to a path below `document_root`; reject paths that try to escape it with 400.
+ * 2. Look the file up in the open-file cache, which avoids an open() and stat() per hit.
+ * 3. A directory is served through its "index.html".
+ * 4. A directory without one is answered with a generated listing, if listings are enabled (-l).
+ * 5. A missing or unreadable file is answered with 404.
+ * 6. Otherwise answer 200 with the Content-Type for the file's extension and attach the cached file
+ *      as the body; its bytes go from the page cache to the socket with `sendfile`, never through user space.
+ *      Announce byte ranges, with the validators a later If-Range can name; the file cache formatted them
+ *      when it opened the file.
+ */
+void handle_get_request(HttpRequest *request, HttpResponse *response)
+{
+    char path[PATH_MAX];
+
+    // {ref}{LOGIC}{HANDLE_GET_REQUEST}{1}
+    if (resolve_request_path(request->uri, path, sizeof(path) - sizeof("/index.html")) == -1)
+    {
+        response->status_code = 400;
+        response->status_text = "Bad Request";
+        add_response_header(response, "Content-Type", "text/plain");
+        response->body = "Invalid path";
+        return;
+    }
+
+    // {ref}{LOGIC}{HANDLE_GET_REQUEST}{2}
+    CachedFile *file = file_cache_acquire(&file_cache, path);
+    if (!file && errno == EISDIR)
+    {
+        // {ref}{LOGIC}{HANDLE_GET_REQUEST}{3}
+        size_t directory_len = strlen(path);
+        strcat(path, path[directory_len - 1] == '/' ? "index.html" : "/index.html");
+        file = file_cache_acquire(&file_cache, path);
+
+        // {ref}{LOGIC}{HANDLE_GET_REQUEST}{4}
+        if (!file && errno == ENOENT && directory_listings)
+        {
+            path[directory_len] = '\0';
+            handle_directory_listing(request, response, path);
+            return;
+        }
+    }
+
+    if (!file)
+    {
+        // {ref}{LOGIC}{HANDLE_GET_REQUEST}{5}
+        response->status_code = 404;
+        response->status_text = "Not Found";
+        add_response_header(response, "Content-Type", "text/plain");
+        response->body = "Not Found";
+        return;
+    }
+
+    // {ref}{LOGIC}{HANDLE_GET_REQUEST}{6}
+    response->status_code = 200;
+    response->status_text = "OK";
+    add_response_header(response, "Content-Type", content_type_for_path(path));
+    add_response_header(response, "ETag", file->etag);
+    add_response_header(response, "Last-Modified", file->last_modified);
+    add_response_header(response, "Accept-Ranges", "bytes");
+    response->file = file;
+}
+
+/**
+ * @brief Body sink of POST requests: consumes the body as it streams in, one piece per read.
+ * @param context The request's PostUpload.
+ * @return 0 to keep receiving.
+ */
+int post_body_received(void *context, const char *data, size_t length)
+{
+    (void)data;
+    PostUpload *upload = context;
+    upload->bytes += length;
+    return 0;
+}
+
+/**
+ * @brief Prepares a POST request before its body arrives by installing the body sink.
+ * @param request The request whose headers are complete.
+ * @param arena Per-connection arena; the upload state lives there until the response is queued.
+ */
+void begin_post_request(HttpRequest *request, Arena *arena)
+{
+    PostUpload *upload = arena_alloc(arena, sizeof(PostUpload));
+    if (upload)
+    {
+        upload->bytes = 0;
+        request->on_body = post_body_received;
+        request->body_context = upload;
+    }
+}
+
+/**
+ * @brief Handles the processing of an HTTP POST request by constructing an appropriate response.
+ * @param request Pointer to the parsed HttpRequest structure containing the details of the incoming POST request.
+ * @param response Pointer to the HttpResponse structure where the response data will be populated.
+ * @details [LOGIC][HANDLE_POST_REQUEST]
+ * 1. Set the response status code to 200, indicating a successful request.
+ * 2. Set the response status text to "OK".
+ * 3. Add a "Content-Type" header with a value of "text/plain" to the response.
+ * 4. Set the body of the response to acknowledge receipt of the POST request and the size of its body,
+ *      which `post_body_received` counted while it streamed in.
+ */
+void handle_post_request(HttpRequest *request, HttpResponse *response)
+{
+    PostUpload *upload = request->body_context;
+    response->status_code = 200;
+    response->status_text = "OK";
+    add_response_header(response, "Content-Type", "text/plain");
+
+    // {ref}{LOGIC}{HANDLE_POST_REQUEST}{4}
+    char *body = arena_alloc(response->arena, 64);
+    if (body && upload)
+    {
+        snprintf(body, 64, "Received POST request: %zu bytes", upload->bytes);
+        response->body = body;
+    }
+    else
+    {
+        response->body = "Received POST request";
+    }
+}
+
+/**
+ * @brief Updates a CRC-32 (IEEE 802.3, as used by gzip and zip) with more data.
+ * @details Bit by bit, without a lookup table, so the pool threads share no state. It is slow, which is
+ *      fine for the handler using it: that one runs off the event loop.
+ */
+static uint32_t crc32_update(uint32_t crc, const unsigned char *data, size_t len)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+/**
+ * @brief Answers GET /checksum/<path> with the CRC-32 and size of a file below the document root.
+ * @param request The request; the 'path' parameter names the file.
+ * @param response The response to fill; the text is built in its arena.
+ * @details [LOGIC][HANDLE_CHECKSUM_REQUEST]
+ * 1. Resolve the path like a static file; only regular files are checksummed.
+ * 2. Read the whole file and checksum it. This is the kind of work that must not run on an event loop:
+ *      the endpoint is an offload endpoint, so it runs on the handler pool and reads the file directly
+ *      rather than through the worker's file cache.
+ */
+void handle_checksum_request(HttpRequest *request, HttpResponse *response)
+{
+    // {ref}{LOGIC}{HANDLE_CHECKSUM_REQUEST}{1}
+    const Span *name = router_param(&request->match, "path");
+    char path[PATH_MAX];
+    if (!name || resolve_request_path(request->uri + name->offset - 1, path, sizeof(path)) == -1)
+    {
+        response->status_code = 400;
+        response->status_text = "Bad Request";
+        add_response_header(response, "Content-Type", "text/plain");
+        response->body = "Invalid path";
+        return;
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        response->status_code = 404;
+        response->status_text = "Not Found";
+        add_response_header(response, "Content-Type", "text/plain");
+        response->body = "Not Found";
+        return;
+    }
+
+    // {ref}{LOGIC}{HANDLE_CHECKSUM_REQUEST}{2}
+    unsigned char *buf = malloc(CHECKSUM_READ_SIZE);
+    uint32_t crc = 0;
+    uint64_t size = 0;
+    ssize_t len = -1;
+    while (buf && (len = read(fd, buf, CHECKSUM_READ_SIZE)) != 0)
+    {
+        if (len == -1 && errno != EINTR)
+        {
+            break;
+        }
+        if (len > 0)
+        {
+            crc = crc32_update(crc, buf, len);
+            size += len;
+        }
+    }
+    free(buf);
+    close(fd);
+    char *body = len == 0 ? arena_alloc(response->arena, 64) : NULL;
+    if (!body)
+    {
+        response->status_code = 500;
+        response->status_text = "Internal Server Error";
+        add_response_header(response, "Content-Type", "text/plain");
+        response->body = "Internal Server Error";
+        return;
+    }
+    snprintf(body, 64, "crc32 %08x size %llu\n", crc, (unsigned long long)size);
+    response->status_code = 200;
+    response->status_text = "OK";
+    add_response_header(response, "Content-Type", "text/plain");
+    response->body = body;
+}
+
+/**
+ * @brief Answers GET /metrics with the metrics of all workers in the Prometheus text format.
+ * @param request The request; unused.
+ * @param response The response to fill; the text is built in its arena.
+ * @details [LOGIC][HANDLE_METRICS_REQUEST]
+ * 1. Sum the blocks of all workers. The workers keep recording meanwhile; each value is read whole,
+ *      so the totals are a consistent enough snapshot for monitoring.
+ * 2. Measure the text first, then render it into an arena buffer of exactly that size.
+ */
+void handle_metrics_request(HttpRequest *request, HttpResponse *response)
+{
+    (void)request;
+    // {ref}{LOGIC}{HANDLE_METRICS_REQUEST}{1}
+    WorkerMetrics *total = malloc(sizeof(WorkerMetrics));
+    char *body = NULL;
+    if (total)
+    {
+        metrics_aggregate(worker_metrics, worker_metrics_count, total);
+
+        // {ref}{LOGIC}{HANDLE_METRICS_REQUEST}{2}
+        size_t len = metrics_render(total, NULL, 0);
+        body = arena_alloc(response->arena, len + 1);
+        if (body)
+        {
+            metrics_render(total, body, len + 1);
+        }
+        free(total);
+    }
+    if (!body)
+    {
+        response->status_code = 500;
+        response->status_text = "Internal Server Error";
+        add_response_header(response, "Content-Type", "text/plain");
+        response->body = "Internal Server Error";
+        return;
+    }
+    response->status_code = 200;
+    response->status_text = "OK";
+    add_response_header(response, "Content-Type", "text/plain; version=0.0.4");
+    response->body = body;
+}
+
+/**
+ * @brief Registers the server's routes before the workers start.
+ * @details GET /metrics is answered by `handle_metrics_request`; the literal path takes precedence over
+ *      '*path'. GET /checksum/<path> runs `handle_checksum_request` on the handler pool. Any other GET serves a file below the document root through the response cache, and a POST
+ *      to any path has its body counted as it streams in and acknowledged.
+ *      Every embedded asset is a literal GET route of its own, so it takes precedence over the files below
+ *      the document root, and over an upstream group's prefix.
+ *      Every upstream group forwards its prefix, and any path below it, for every method but CONNECT;
+ *      a group for the prefix "/" takes the place of the file and POST routes.
+ * @return 0 on success, -1 on allocation failure or if two groups share a prefix.
+ */
+int register_routes(void)
+{
+    static const struct
+    {
+        HttpMethod method;
+        const char *pattern;
+        Endpoint endpoint;
+    } routes[] = {
+        {HTTP_METHOD_GET, "/metrics", {NULL, handle_metrics_request, 0, 0, NULL, NULL}},
+        {HTTP_METHOD_GET, "/checksum/*path", {NULL, handle_checksum_request, 0, 1, NULL, NULL}},
+        {HTTP_METHOD_GET, "/*path", {NULL, handle_get_request, 1, 0, NULL, NULL}},
+        {HTTP_METHOD_POST, "/*path", {begin_post_request, handle_post_request, 0, 0, NULL, NULL}},
+    };
+
+    static Endpoint proxy_endpoints[PROXY_MAX_GROUPS];
+    static Endpoint *asset_endpoints;
+
+    router_init(&router);
+    asset_endpoints = calloc(embedded_asset_count ? embedded_asset_count : 1, sizeof(Endpoint));
+    if (!asset_endpoints)
+    {
+        return -1;
+    }
+    for (int i = 0; i < embedded_asset_count; i++)
+    {
+        asset_endpoints[i].asset = &embedded_assets[i];
+        if (router_add(&router, HTTP_METHOD_GET, embedded_assets[i].path, &asset_endpoints[i]) == -1)
+        {
+            return -1;
+        }
+    }
+    int proxy_root = 0;
+    for (int i = 0; i < upstream_group_count; i++)
+    {
+        proxy_endpoints[i].upstreams = &upstream_groups[i];
+        const char *prefix = upstream_groups[i].prefix;
+        char pattern[PATH_MAX];
+        snprintf(pattern, sizeof(pattern), "%s/*path", prefix);
+        proxy_root |= prefix[0] == '\0';
+        for (HttpMethod method = HTTP_METHOD_GET; method <= HTTP_METHOD_PATCH; method++)
+        {
+            if (method == HTTP_METHOD_CONNECT)
+            {
+                continue;
+            }
+            if (router_add(&router, method, pattern, &proxy_endpoints[i]) == -1 ||
+                (prefix[0] && router_add(&router, method, prefix, &proxy_endpoints[i]) == -1))
+            {
+                return -1;
+            }
+        }
+    }
+    for (size_t i = 0; i < sizeof(routes) / sizeof(routes[0]); i++)
+    {
+        if (proxy_root && strcmp(routes[i].pattern, "/*path") == 0)
+        {
+            continue;
+        }
+        if (router_add(&router, routes[i].method, routes[i].pattern, (void *)&routes[i].endpoint) == -1)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Reserves a slot at the tail of the connection's output queue.
+ * @details [LOGIC][QUEUE_SEGMENT]
+ * 1. If the array is full, first slide the unsent segments down over the ones already written.
+ * 2. If it is still full, double its capacity.
+ * @return The zeroed slot, or NULL on allocation failure.
+ */
+OutSegment *append_segment(Connection *conn)
+{
+    if (conn->out_count == conn->out_cap)
+    {
+        // {ref}{LOGIC}{QUEUE_SEGMENT}{1}
+        if (conn->out_head > 0)
+        {
+            memmove(conn->out, conn->out + conn->out_head,
+                    (conn->out_count - conn->out_head) * sizeof(OutSegment));
+            conn->out_count -= conn->out_head;
+            conn->out_head = 0;
+        }
+        // {ref}{LOGIC}{QUEUE_SEGMENT}{2}
+        if (conn->out_count == conn->out_cap)
+        {
+            int new_cap = conn->out_cap ? conn->out_cap * 2 : 16;
+            OutSegment *grown = realloc(conn->out, new_cap * sizeof(OutSegment));
+            if (!grown)
+            {
+                return NULL;
+            }
+            conn->out = grown;
+            conn->out_cap = new_cap;
+        }
+    }
+    OutSegment *segment = &conn->out[conn->out_count++];
+    memset(segment, 0, sizeof(*segment));
+    return segment;
+}
+
+/**
+ * @brief Appends a memory segment to the connection's output queue.
+ * @param owned The malloc'd block containing data, freed once the segment is written; NULL for
+ *      data that outlives the connection (string literals).
+ * @return 0 on success, -1 on allocation failure (an owned block is freed).
+ */
+int queue_segment(Connection *conn, char *data, size_t len, char *owned)
+{
+    OutSegment *segment = append_segment(conn);
+    if (!segment)
+    {
+        free(owned);
+        return -1;
+    }
+    segment->data = data;
+    segment->len = len;
+    segment->owned = owned;
+    conn->out_bytes += len;
+    return 0;
+}
+
+/**
+ * @brief Appends bytes of a response cache entry to the connection's output queue.
+ * @param cached The entry data points into; the segment takes over the caller's reference, also on
+ *      failure. NULL for a segment that shares an entry with a segment queued after it.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int queue_cached_segment(Connection *conn, char *data, size_t len, CachedResponse *cached)
+{
+    OutSegment *segment = append_segment(conn);
+    if (!segment)
+    {
+        if (cached)
+        {
+            response_cache_release(cached);
+        }
+        return -1;
+    }
+    segment->data = data;
+    segment->len = len;
+    segment->cached = cached;
+    conn->out_bytes += len;
+    return 0;
+}
+
+/**
+ * @brief Appends a byte range of a cached file to the connection's output queue.
+ * @attention Takes over the caller's file cache reference, also on failure.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int queue_file_segment(Connection *conn, CachedFile *file, off_t offset, size_t len)
+{
+    OutSegment *segment = append_segment(conn);
+    if (!segment)
+    {
+        file_cache_release(file);
+        return -1;
+    }
+    segment->file = file;
+    segment->offset = offset;
+    segment->len = len;
+    conn->out_bytes += len;
+    return 0;
+}
+
+/**
+ * @brief Drops 'written' bytes of memory segments from the front of the output queue.
+ * @details Fully written segments are released; a partially written one is advanced past the bytes sent.
+ */
+void consume_output(Connection *conn, size_t written)
+{
+    conn->out_bytes -= written;
+    while (conn->out_head < conn->out_count && written >= conn->out[conn->out_head].len)
+    {
+        OutSegment *segment = &conn->out[conn->out_head];
+        written -= segment->len;
+        release_segment(segment);
+        conn->out_head++;
+    }
+    if (written > 0)
+    {
+        conn->out[conn->out_head].data += written;
+        conn->out[conn->out_head].len -= written;
+    }
+}
+
+/**
+ * @brief Hands the memory segments at the front of the output queue to io_uring as linked sendmsg operations.
+ * @details [LOGIC][SUBMIT_SENDS]
+ * 1. Describe up to URING_SEND_LINKS batches of at most MAX_IOV_BATCH segments, up to the next file segment,
+ *      in the connection's send_batch.
+ * 2. Link the operations, so the kernel runs them in order; MSG_WAITALL makes each one send all of its bytes
+ *      before the next starts, retrying internally while the socket is full. Room for the whole chain is made
+ *      first, since a chain cannot span two submissions.
+ * 3. Keep the write-stall timer armed while the chain runs.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int submit_sends(Connection *conn)
+{
+    if (!conn->send_batch && !(conn->send_batch = malloc(sizeof(UringSendBatch))))
+    {
+        return -1;
+    }
+    if (uring_sq_space(uring) < URING_SEND_LINKS)
+    {
+        uring_submit(uring);
+    }
+
+    int i = conn->out_head;
+    while (conn->sends < URING_SEND_LINKS && i < conn->out_count && !conn->out[i].file)
+    {
+        // {ref}{LOGIC}{SUBMIT_SENDS}{1}
+        struct msghdr *msg = &conn->send_batch->msg[conn->sends];
+        struct iovec *iov = conn->send_batch->iov[conn->sends];
+        memset(msg, 0, sizeof(*msg));
+        msg->msg_iov = iov;
+        while (i < conn->out_count && !conn->out[i].file && msg->msg_iovlen < MAX_IOV_BATCH)
+        {
+            iov[msg->msg_iovlen].iov_base = conn->out[i].data;
+            iov[msg->msg_iovlen].iov_len = conn->out[i].len;
+            msg->msg_iovlen++;
+            i++;
+        }
+
+        // {ref}{LOGIC}{SUBMIT_SENDS}{2}
+        struct io_uring_sqe *sqe = uring_get_sqe(uring);
+        if (!sqe)
+        {
+            break;
+        }
+        int more = i < conn->out_count;
+        uring_prep_sendmsg(sqe, conn->fd, msg, MSG_NOSIGNAL | MSG_WAITALL | (more ? MSG_MORE : 0));
+        if (more && !conn->out[i].file && conn->sends + 1 < URING_SEND_LINKS)
+        {
+            sqe->flags |= IOSQE_IO_LINK;
+        }
+        sqe->user_data = (uintptr_t)conn | URING_OP_SEND;
+        conn->sends++;
+        conn->uring_ops++;
+    }
+
+    // {ref}{LOGIC}{SUBMIT_SENDS}{3}
+    if (!timer_pending(&conn->write_timer))
+    {
+        timer_wheel_schedule(&timers, &conn->write_timer, WRITE_STALL_TIMEOUT_MS);
+    }
+    return conn->sends ? 0 : -1;
+}
+
+/**
+ * @brief Asks io_uring to report when the socket has room again, to continue a file segment.
+ * @return 0 on success, -1 if the submission queue is full.
+ */
+int arm_write_poll(Connection *conn)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(uring);
+    if (!sqe)
+    {
+        return -1;
+    }
+    uring_prep_poll(sqe, conn->fd, POLLOUT);
+    sqe->user_data = (uintptr_t)conn | URING_OP_POLL;
+    conn->poll_armed = 1;
+    conn->uring_ops++;
+    return 0;
+}
+
+/**
+ * @brief Writes the front of the output queue through OpenSSL, for a TLS connection the kernel does not encrypt.
+ * @param head The oldest segment of the queue.
+ * @details Up to TLS_RECORD_SIZE bytes become one record: the memory segments up to the next file segment, or
+ *      the next bytes of a file segment read with `pread`. After EAGAIN the queue is unchanged, so the retry
+ *      OpenSSL requires gathers the same bytes again.
+ * @return Like `sendmsg`. A file segment's offset is advanced by the bytes written.
+ */
+ssize_t write_tls_output(Connection *conn, OutSegment *head)
+{
+    char record[TLS_RECORD_SIZE];
+    size_t len = 0;
+    if (head->file)
+    {
+        ssize_t n = pread(head->file->fd, record, head->len < sizeof(record) ? head->len : sizeof(record), head->offset);
+        if (n <= 0)
+        {
+            // The file shrank underneath us; the promised Content-Length cannot be met.
+            fprintf(stderr, "pread: %s truncated\n", head->file->path);
+            errno = EIO;
+            return -1;
+        }
+        len = n;
+    }
+    else
+    {
+        for (int i = conn->out_head; i < conn->out_count && !conn->out[i].file && len < sizeof(record); i++)
+        {
+            size_t n = conn->out[i].len < sizeof(record) - len ? conn->out[i].len : sizeof(record) - len;
+            memcpy(record + len, conn->out[i].data, n);
+            len += n;
+        }
+    }
+    ssize_t written = tls_write(conn->tls, record, len);
+    if (written > 0 && head->file)
+    {
+        head->offset += written;
+    }
+    return written;
+}
+
+/**
+ * @brief Writes as much of the connection's output queue as the kernel accepts.
+ * @param conn The connection whose queue should be flushed.
+ * @details [LOGIC][FLUSH_OUTPUT]
+ * 1. If the oldest segment is a file, send it with `sendfile` from its current offset:
+ *      the file data moves from the page cache to the socket without a copy through user space.
+ * 2. Otherwise build an iovec array over the memory segments up to the next file segment
+ *      (at most MAX_IOV_BATCH) and hand them to the kernel in one `sendmsg`. MSG_MORE is set when a
+ *      file follows, so the response headers and the start of the file share a packet.
+ * 3. Retry on EINTR. EAGAIN means the socket send buffer is full: stop, the caller will wait for EPOLLOUT.
+ * 4. Drop the segments that were written completely and trim a partially written one,
+ *      so a short write never loses or repeats bytes. Count the bytes sent.
+ * 5. While output stays queued, keep the write-stall timer armed and restart it whenever the client
+ *      accepted some bytes; a client that stops reading is closed after WRITE_STALL_TIMEOUT_MS.
+ *      Stop the timer once the queue is empty.
+ * 6. On io_uring, memory segments are not written here: `submit_sends` hands them to the kernel as a chain
+ *      of sendmsg operations, and nothing more is sent until that chain completed. A file segment is still
+ *      sent with `sendfile`, which io_uring has no operation for; when the socket is full, a POLLOUT poll
+ *      takes the place of EPOLLOUT.
+ * 7. Once the queue is empty and no response streams or is proxied, record how long the output waited to be written.
+ * 8. A TLS connection whose kernel encrypts its records (kTLS) is written exactly like a plain one, `sendfile`
+ *      included. Without kTLS the queue goes through OpenSSL instead, one record at a time (`write_tls_output`).
+ * @return 0 if the connection is still usable, -1 on a write error.
+ */
+int flush_output(Connection *conn)
+{
+    int progress = 0;
+    // {ref}{LOGIC}{FLUSH_OUTPUT}{6}
+    if (uring && (conn->sends || conn->poll_armed))
+    {
+        return 0;
+    }
+    while (conn->out_head < conn->out_count)
+    {
+        OutSegment *head = &conn->out[conn->out_head];
+        ssize_t written;
+
+        if (conn->tls && !conn->ktls_send)
+        {
+            // {ref}{LOGIC}{FLUSH_OUTPUT}{8}
+            written = write_tls_output(conn, head);
+        }
+        else if (head->file)
+        {
+            // {ref}{LOGIC}{FLUSH_OUTPUT}{1}
+            written = sendfile(conn->fd, head->file->fd, &head->offset, head->len);
+            if (written == 0)
+            {
+                // The file shrank underneath us; the promised Content-Length cannot be met.
+                fprintf(stderr, "sendfile: %s truncated\n", head->file->path);
+                return -1;
+            }
+        }
+        else if (uring)
+        {
+            // {ref}{LOGIC}{FLUSH_OUTPUT}{6}
+            return submit_sends(conn);
+        }
+        else
+        {
+            // {ref}{LOGIC}{FLUSH_OUTPUT}{2}
+            struct iovec iov[MAX_IOV_BATCH];
+            struct msghdr msg = {0};
+            int i = conn->out_head;
+            while (i < conn->out_count && !conn->out[i].file && msg.msg_iovlen < MAX_IOV_BATCH)
+            {
+                iov[msg.msg_iovlen].iov_base = conn->out[i].data;
+                iov[msg.msg_iovlen].iov_len = conn->out[i].len;
+                msg.msg_iovlen++;
+                i++;
+            }
+            msg.msg_iov = iov;
+            written = sendmsg(conn->fd, &msg, MSG_NOSIGNAL | (i < conn->out_count ? MSG_MORE : 0));
+        }
+
+        // {ref}{LOGIC}{FLUSH_OUTPUT}{3}
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                // {ref}{LOGIC}{FLUSH_OUTPUT}{5}
+                if (progress || !timer_pending(&conn->write_timer))
+                {
+                    timer_wheel_schedule(&timers, &conn->write_timer, WRITE_STALL_TIMEOUT_MS);
+                }
+                return uring ? arm_write_poll(conn) : 0;
+            }
+            perror(conn->tls && !conn->ktls_send ? "SSL_write" : head->file ? "sendfile" : "sendmsg");
+            return -1;
+        }
+
+        // {ref}{LOGIC}{FLUSH_OUTPUT}{4}
+        progress = 1;
+        metrics_add(&metrics->bytes_out, written);
+        if (head->file)
+        {
+            // sendfile() (or write_tls_output()) already advanced head->offset
+            conn->out_bytes -= written;
+            head->len -= written;
+            if (head->len == 0)
+            {
+                release_segment(head);
+                conn->out_head++;
+            }
+            continue;
+        }
+        consume_output(conn, written);
+    }
+    conn->out_head = 0;
+    conn->out_count = 0;
+    timer_wheel_cancel(&timers, &conn->write_timer);
+    // {ref}{LOGIC}{FLUSH_OUTPUT}{7}
+    if (conn->send_started_ns && !conn->producer && !conn->proxy)
+    {
+        metrics_record(&metrics->histograms[METRICS_SEND], metrics_now_ns() - conn->send_started_ns);
+        conn->send_started_ns = 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief Arms the read timer for whatever the connection is waiting for.
+ * @details [LOGIC][READ_TIMER]
+ * 1. Nothing while a response is still being written or streamed, or the connection no longer reads:
+ *      the write-stall timer covers those.
+ * 2. The body timeout while a body streams in, restarted whenever some of it arrived: a large upload
+ *      may take as long as it needs, as long as it keeps moving.
+ * 3. The request timeout while a request head is partly buffered, and on a new connection.
+ * 4. The keep-alive timeout once the previous response is out and nothing new has arrived.
+ * 5. Otherwise the timer is only rescheduled when its purpose changes, so a client trickling a request
+ *      head byte by byte never pushes its deadline back.
+ */
+void update_read_timer(Connection *conn)
+{
+    ReadTimeout wanted;
+    // {ref}{LOGIC}{READ_TIMER}{1,2,3,4}
+    if (conn->closing || conn->read_paused || conn->producer || (conn->out_bytes > 0 && conn->state != PARSE_BODY))
+    {
+        wanted = READ_TIMEOUT_NONE;
+    }
+    else if (conn->state == PARSE_BODY)
+    {
+        wanted = READ_TIMEOUT_BODY;
+    }
+    else if (conn->in_len > 0 || conn->read_timeout == READ_TIMEOUT_REQUEST)
+    {
+        wanted = READ_TIMEOUT_REQUEST;
+    }
+    else
+    {
+        wanted = READ_TIMEOUT_KEEP_ALIVE;
+    }
+
+    // {ref}{LOGIC}{READ_TIMER}{5}
+    if (wanted == conn->read_timeout && !(wanted == READ_TIMEOUT_BODY && conn->body_progress))
+    {
+        return;
+    }
+    conn->read_timeout = wanted;
+    conn->body_progress = 0;
+    if (wanted == READ_TIMEOUT_NONE)
+    {
+        timer_wheel_cancel(&timers, &conn->read_timer);
+    }
+    else if (wanted == READ_TIMEOUT_BODY)
+    {
+        timer_wheel_schedule(&timers, &conn->read_timer, BODY_TIMEOUT_MS);
+    }
+    else
+    {
+        timer_wheel_schedule(&timers, &conn->read_timer,
+                             wanted == READ_TIMEOUT_REQUEST ? REQUEST_TIMEOUT_MS : KEEP_ALIVE_TIMEOUT_MS);
+    }
+}
+
+/**
+ * @brief Ends a streamed response once its producer has nothing more to give.
+ * @details [LOGIC][END_STREAM]
+ * 1. A chunked body ends with the zero-size chunk; a close-delimited one ends when the connection closes.
+ * 2. Forget the producer and reset the arena, which held its state.
+ * 3. Requests pipelined behind the stream were held back with reading paused: force `update_connection`
+ *      to re-arm the socket, so EPOLLOUT is reported again and `handle_write_operation` resumes reading.
+ */
+void end_stream(Connection *conn)
+{
+    // {ref}{LOGIC}{END_STREAM}{1}
+    if (conn->stream_chunked)
+    {
+        static char last_chunk[] = "0\r\n\r\n";
+        if (queue_segment(conn, last_chunk, sizeof(last_chunk) - 1, NULL) == -1)
+        {
+            conn->closing = 1;
+        }
+    }
+    // {ref}{LOGIC}{END_STREAM}{2}
+    conn->producer = NULL;
+    conn->producer_context = NULL;
+    arena_reset(&conn->arena);
+    // {ref}{LOGIC}{END_STREAM}{3}
+    conn->events = 0;
+}
+
+/**
+ * @brief Feeds a streamed response from its producer while the socket accepts data.
+ * @param conn A connection with an active producer.
+ * @details [LOGIC][PUMP_STREAM]
+ * 1. Ask the producer for the next chunk only once everything produced before has been sent, so a
+ *      stream holds at most one chunk in memory however large the body is and however slow the client.
+ * 2. Frame the chunk in place: the hex size line is written right in front of the data, in space kept
+ *      free for it, and CRLF after it, so the chunk goes out in one segment without another copy.
+ * 3. Send it right away; if the socket fills up, EPOLLOUT brings us back here.
+ * 4. When the producer is done, end the stream and send its end.
+ * 5. After STREAM_CHUNKS_PER_PASS chunks, yield to the other connections of this worker. The socket
+ *      is re-armed, so epoll reports it writable again on the next pass and the stream continues.
+ * @return 0 if the connection is still usable, -1 on a producer or write error.
+ */
+int pump_stream(Connection *conn)
+{
+    for (int produced = 0; conn->producer && conn->out_bytes == 0; produced++)
+    {
+        // {ref}{LOGIC}{PUMP_STREAM}{5}
+        if (produced == STREAM_CHUNKS_PER_PASS)
+        {
+            conn->events = 0;
+            return 0;
+        }
+
+        // {ref}{LOGIC}{PUMP_STREAM}{1}
+        char *block = malloc(CHUNK_PREFIX_SIZE + STREAM_CHUNK_SIZE + 2);
+        if (!block)
+        {
+            return -1;
+        }
+        char *data = block + CHUNK_PREFIX_SIZE;
+        ssize_t produced_len = conn->producer(conn->producer_context, data, STREAM_CHUNK_SIZE);
+        if (produced_len <= 0)
+        {
+            free(block);
+            if (produced_len == -1)
+            {
+                return -1;
+            }
+            // {ref}{LOGIC}{PUMP_STREAM}{4}
+            end_stream(conn);
+            return flush_output(conn);
+        }
+
+        // {ref}{LOGIC}{PUMP_STREAM}{2}
+        char *start = data;
+        size_t len = produced_len;
+        if (conn->stream_chunked)
+        {
+            static const char hex[] = "0123456789abcdef";
+            *--start = '\n';
+            *--start = '\r';
+            for (size_t size = len; size > 0; size >>= 4)
+            {
+                *--start = hex[size & 15];
+            }
+            data[len] = '\r';
+            data[len + 1] = '\n';
+            len += (data - start) + 2;
+        }
+
+        // {ref}{LOGIC}{PUMP_STREAM}{3}
+        if (queue_segment(conn, start, len, block) == -1 || flush_output(conn) == -1)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Starts or cancels the connection's multishot recv on io_uring, depending on whether reading is allowed.
+ * @details A completed recv cannot be left in the socket the way an unread epoll event can, so the recv
+ *      is cancelled as soon as reading pauses; data it delivers until the cancellation is buffered.
+ */
+void update_recv(Connection *conn)
+{
+    int wanted = !conn->closing && !conn->read_paused;
+    if (wanted == conn->recv_armed || (!wanted && conn->recv_cancelling))
+    {
+        return;
+    }
+    struct io_uring_sqe *sqe = uring_get_sqe(uring);
+    if (!sqe)
+    {
+        return; // Retried on the next completion of this connection
+    }
+    if (wanted)
+    {
+        uring_prep_recv_multishot(sqe, conn->fd);
+        sqe->user_data = (uintptr_t)conn | URING_OP_RECV;
+        conn->recv_armed = 1;
+        conn->uring_ops++;
+    }
+    else
+    {
+        uring_prep_cancel(sqe, (uintptr_t)conn | URING_OP_RECV);
+        sqe->user_data = URING_OP_CANCEL;
+        conn->recv_cancelling = 1;
+    }
+}
+
+/**
+ * @brief Makes sure the proxies table has a slot for a link's socket, growing it like the connections table.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int reserve_proxy_slot(int fd)
+{
+    if (fd < proxies_size)
+    {
+        return 0;
+    }
+    int new_size = proxies_size ? proxies_size : 64;
+    while (new_size <= fd)
+    {
+        new_size *= 2;
+    }
+    ProxyExchange **grown = realloc(proxies, new_size * sizeof(ProxyExchange *));
+    if (!grown)
+    {
+        return -1;
+    }
+    memset(grown + proxies_size, 0, (new_size - proxies_size) * sizeof(ProxyExchange *));
+    proxies = grown;
+    proxies_size = new_size;
+    return 0;
+}
+
+/**
+ * @brief Drops an answered request from the connection, so that the next one can be parsed.
+ * @details The request head is removed from the front of the buffer; its body was already dropped while it
+ *      was decoded or spliced. The arena is reset unless a streamed response keeps its state there (then
+ *      `end_stream` resets it), the parser starts over and the request timeout is stopped: the next request
+ *      gets a deadline of its own. A request that ends the connection marks it closing.
+ */
+void reset_request(Connection *conn)
+{
+    size_t consumed = conn->body_start;
+    memmove(conn->in_buf, conn->in_buf + consumed, conn->in_len - consumed);
+    conn->in_len -= consumed;
+    conn->in_buf[conn->in_len] = '\0';
+
+    if (!conn->producer)
+    {
+        arena_reset(&conn->arena);
+    }
+    memset(&conn->request, 0, sizeof(conn->request));
+    http_scan_init(&conn->scanner, conn->request.headers, MAX_HEADERS);
+    conn->body_start = 0;
+    conn->state = PARSE_HEADERS;
+    conn->read_timeout = READ_TIMEOUT_NONE;
+    timer_wheel_cancel(&timers, &conn->read_timer);
+
+    if (!conn->keep_alive)
+    {
+        conn->closing = 1;
+    }
+}
+
+/**
+ * @brief Moves bytes from one socket to another through the pipe of an exchange's link, so they never
+ *      reach user space.
+ * @param left Bytes still to take from in_fd; decreased by what entered the pipe.
+ * @param moved Increased by the bytes written to out_fd.
+ * @details Splices into the pipe while bytes are left and out of it while it holds any, until neither
+ *      side makes progress. A splice into a full pipe fails with EAGAIN like one from an empty socket;
+ *      either way the pipe then holds bytes, so the output side is tried as well.
+ */
+SpliceResult splice_through(ProxyExchange *proxy, int in_fd, int out_fd, uint64_t *left, uint64_t *moved)
+{
+    while (1)
+    {
+        int progress = 0;
+        if (*left > 0)
+        {
+            ssize_t spliced = splice(in_fd, NULL, proxy->link.pipe[1], NULL,
+                                     *left < PROXY_SPLICE_SIZE ? *left : PROXY_SPLICE_SIZE,
+                                     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (spliced > 0)
+            {
+                *left -= spliced;
+                proxy->pipe_bytes += spliced;
+                progress = 1;
+            }
+            else if (spliced == 0)
+            {
+                return SPLICE_EOF;
+            }
+            else if (errno != EAGAIN && errno != EINTR)
+            {
+                return SPLICE_READ_ERROR;
+            }
+        }
+        if (proxy->pipe_bytes > 0)
+        {
+            ssize_t spliced = splice(proxy->link.pipe[0], NULL, out_fd, NULL, proxy->pipe_bytes,
+                                     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (spliced > 0)
+            {
+                proxy->pipe_bytes -= spliced;
+                *moved += spliced;
+                progress = 1;
+            }
+            else if (spliced == -1 && errno != EAGAIN && errno != EINTR)
+            {
+                return SPLICE_WRITE_ERROR;
+            }
+        }
+        if (*left == 0 && proxy->pipe_bytes == 0)
+        {
+            return SPLICE_DONE;
+        }
+        if (!progress)
+        {
+            return SPLICE_BLOCKED;
+        }
+    }
+}
+
+/**
+ * @brief Ends a proxied request: counts and logs it, releases its link and moves on to the next request.
+ * @param reusable Non-zero if the link goes back to the pool.
+ * @details Like `end_stream`, the socket is re-armed, so EPOLLOUT lets `handle_write_operation` resume
+ *      reading and serve the requests pipelined behind this one.
+ */
+void end_proxy(Connection *conn, int reusable)
+{
+    ProxyExchange *proxy = conn->proxy;
+    uint64_t now = metrics_now_ns();
+    metrics_count_request(metrics, request_metrics_method(&conn->request), proxy->status);
+    log_request(conn, proxy->status, proxy->response_bytes, proxy->started_ns, now);
+    release_proxy(conn, reusable);
+    end_admission(conn, now);
+    reset_request(conn);
+    conn->events = 0;
+}
+
+/**
+ * @brief Gives up on a proxied request and closes the connection once the queued output is sent.
+ * @param status_code Answer for the client (502, 503 or 504) if the response has not started; once it
+ *      has, the client only sees the connection close before the promised body is complete.
+ */
+void abort_proxy(Connection *conn, int status_code)
+{
+    ProxyExchange *proxy = conn->proxy;
+    if (!proxy->status)
+    {
+        const char *reason = status_code == 503   ? "Service Unavailable"
+                             : status_code == 504 ? "Gateway Timeout"
+                                                  : "Bad Gateway";
+        const HttpStatusLine *status = http_status_line(status_code);
+        char *text = malloc(BUFFER_SIZE);
+        if (text)
+        {
+            char *p = append_bytes(text, status->text, status->len);
+            p = append_string(p, "Content-Type: text/plain\r\nContent-Length: ");
+            p = http_format_decimal(p, strlen(reason));
+            p = append_bytes(p, "\r\n", 2);
+            p = append_bytes(p, http_date_line(&date_cache), HTTP_DATE_LINE_LEN);
+            p = append_string(p, "Connection: close\r\n\r\n");
+            p = append_string(p, reason);
+            size_t len = p - text;
+            if (queue_segment(conn, text, len, text) == 0)
+            {
+                proxy->response_bytes = len;
+            }
+        }
+        proxy->status = status_code;
+        if (!conn->send_started_ns)
+        {
+            conn->send_started_ns = metrics_now_ns();
+        }
+    }
+    conn->keep_alive = 0;
+    end_proxy(conn, 0);
+}
+
+/**
+ * @brief Handles a link that failed: retries the request on another link when that is safe, otherwise gives up.
+ * @details [LOGIC][FAIL_PROXY]
+ * 1. A new link that failed counts against its server, which a retry skips. A pooled link may simply have
+ *      been closed by the server just before we wrote to it, which says nothing about the server.
+ * 2. Retry only while the whole request is still at hand, i.e. no body bytes were spliced out of the
+ *      client's socket, and only if the server cannot have acted on it: nothing was written yet, or the link
+ *      was pooled and the method is idempotent. `pump_proxy` gives up after PROXY_MAX_ATTEMPTS links.
+ * 3. Otherwise answer 502, or close the connection if the response has started.
+ */
+void fail_proxy(Connection *conn)
+{
+    ProxyExchange *proxy = conn->proxy;
+    // {ref}{LOGIC}{FAIL_PROXY}{1}
+    if (!proxy->reused)
+    {
+        upstream_report(proxy->upstream, 0);
+        proxy->excluded |= 1u << (proxy->upstream - proxy->pool->upstreams);
+    }
+
+    // {ref}{LOGIC}{FAIL_PROXY}{2}
+    HttpMethod method = conn->request.method_id;
+    int idempotent = method == HTTP_METHOD_GET || method == HTTP_METHOD_HEAD || method == HTTP_METHOD_PUT ||
+                     method == HTTP_METHOD_DELETE || method == HTTP_METHOD_OPTIONS || method == HTTP_METHOD_TRACE;
+    int whole_request = proxy->state == PROXY_SEND_HEAD ||
+                        (proxy->state == PROXY_RESPONSE_HEAD && proxy->body_length == 0);
+    if (whole_request && (proxy->head_sent == 0 || (proxy->reused && idempotent)))
+    {
+        release_proxy_link(proxy, 0);
+        proxy->head_sent = 0;
+        proxy->state = PROXY_CONNECT;
+        return;
+    }
+
+    // {ref}{LOGIC}{FAIL_PROXY}{3}
+    abort_proxy(conn, 502);
+}
+
+/// @brief Whether two field values are equal, apart from the whitespace that may trail them
+static int field_values_equal(const char *a, const char *b)
+{
+    size_t a_len = strlen(a), b_len = strlen(b);
+    while (a_len > 0 && (a[a_len - 1] == ' ' || a[a_len - 1] == '\t'))
+    {
+        a_len--;
+    }
+    while (b_len > 0 && (b[b_len - 1] == ' ' || b[b_len - 1] == '\t'))
+    {
+        b_len--;
+    }
+    return a_len == b_len && memcmp(a, b, a_len) == 0;
+}
+
+/**
+ * @brief Parses the response head of the server and queues the head the client gets.
+ * @param head The head, up to and including its blank line, NUL-terminated; its lines are terminated in place.
+ * @details [LOGIC][PROXY_RESPONSE]
+ * 1. Check the status line. An interim 1xx response is dropped; the final response follows it.
+ *      101 cannot happen, since Upgrade is not forwarded.
+ * 2. Work out the body framing (RFC 9112 section 6.3): none for HEAD requests and 204 or 304 responses,
+ *      otherwise chunked, otherwise Content-Length, otherwise until the server closes the connection.
+ *      HTTP/1.0 clients are forwarded as HTTP/1.0, so a chunked answer to them is malformed. Repeated
+ *      Content-Length fields must all carry the same value; a server that sends two lengths gets the client
+ *      a 502, since the client could frame the body by either.
+ * 3. Copy the headers except the hop-by-hop ones: Connection, Keep-Alive, Proxy-Connection, Upgrade, TE
+ *      and those the server's Connection header names. Everything else, Transfer-Encoding included, is
+ *      passed on unchanged, except a Content-Length next to a chunked body: the chunks frame it.
+ * 4. The client connection persists as dispatch_request decides, unless the body ends with the server's
+ *      connection: then it can only reach the client the same way. Say so in a Connection header.
+ * 5. The link can be pooled afterwards if the body is framed and the server keeps the connection open.
+ * @return 0 on success, -1 if the head is malformed or on allocation failure.
+ */
+int queue_proxy_response(Connection *conn, ProxyExchange *proxy, char *head, size_t len)
+{
+    HttpRequest *request = &conn->request;
+
+    // {ref}{LOGIC}{PROXY_RESPONSE}{1}
+    if (len < 16 || memcmp(head, "HTTP/1.", 7) != 0 || (head[7] != '0' && head[7] != '1') || head[8] != ' ' ||
+        !isdigit((unsigned char)head[9]) || !isdigit((unsigned char)head[10]) ||
+        !isdigit((unsigned char)head[11]) || (head[12] != ' ' && head[12] != '\r'))
+    {
+        return -1;
+    }
+    int status = atoi(head + 9);
+    if (status < 100 || status == 101)
+    {
+        return -1;
+    }
+    if (status < 200)
+    {
+        return 0;
+    }
+    char *status_end = strstr(head, "\r\n");
+    *status_end = '\0';
+    const char *connection = NULL, *content_length = NULL, *transfer_encoding = NULL;
+    for (char *line = status_end + 2; *line != '\r'; line += strlen(line) + 2)
+    {
+        *strstr(line, "\r\n") = '\0';
+        char *colon = strchr(line, ':');
+        if (!colon || colon == line)
+        {
+            return -1;
+        }
+        const char *value = colon + 1 + strspn(colon + 1, " \t");
+        HttpHeaderId id = http_header_lookup(line, colon - line);
+        if (id == HTTP_HEADER_CONNECTION && !connection)
+        {
+            connection = value;
+        }
+        else if (id == HTTP_HEADER_CONTENT_LENGTH)
+        {
+            if (content_length && !field_values_equal(content_length, value))
+            {
+                return -1;
+            }
+            content_length = value;
+        }
+        else if (id == HTTP_HEADER_TRANSFER_ENCODING && !transfer_encoding)
+        {
+            transfer_encoding = value;
+        }
+    }
+
+    // {ref}{LOGIC}{PROXY_RESPONSE}{2}
+    proxy->chunked = 0;
+    proxy->until_close = 0;
+    proxy->response_left = 0;
+    if (request->method_id == HTTP_METHOD_HEAD || status == 204 || status == 304)
+    {
+        proxy->response_left = 0;
+    }
+    else if (transfer_encoding)
+    {
+        if (!header_has_token(transfer_encoding, "chunked") || request->version_minor == 0)
+        {
+            return -1;
+        }
+        proxy->chunked = 1;
+    }
+    else if (content_length)
+    {
+        char *end;
+        errno = 0;
+        proxy->response_left = strtoull(content_length, &end, 10);
+        if (!isdigit((unsigned char)*content_length) || errno == ERANGE || end[strspn(end, " \t")] != '\0')
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        proxy->until_close = 1;
+        proxy->response_left = UINT64_MAX;
+    }
+
+    // {ref}{LOGIC}{PROXY_RESPONSE}{3}
+    char *out = malloc(len + 32);
+    if (!out)
+    {
+        return -1;
+    }
+    size_t n = strlen(head);
+    memcpy(out, "HTTP/1.1", 8);
+    memcpy(out + 8, head + 8, n - 8);
+    memcpy(out + n, "\r\n", 2);
+    n += 2;
+    for (char *line = status_end + 2; *line != '\r'; line += strlen(line) + 2)
+    {
+        char *colon = strchr(line, ':');
+        HttpHeaderId id = http_header_lookup(line, colon - line);
+        *colon = '\0';
+        int hop_by_hop = id == HTTP_HEADER_CONNECTION || id == HTTP_HEADER_KEEP_ALIVE || id == HTTP_HEADER_UPGRADE ||
+                         id == HTTP_HEADER_TE || strcasecmp(line, "Proxy-Connection") == 0 ||
+                         header_has_token(connection, line);
+        *colon = ':';
+        if (!hop_by_hop && !(id == HTTP_HEADER_CONTENT_LENGTH && proxy->chunked))
+        {
+            size_t line_len = strlen(line);
+            memcpy(out + n, line, line_len);
+            memcpy(out + n + line_len, "\r\n", 2);
+            n += line_len + 2;
+        }
+    }
+
+    // {ref}{LOGIC}{PROXY_RESPONSE}{4}
+    conn->keep_alive = request_wants_keep_alive(request) && !proxy->until_close;
+    const char *connection_line = !conn->keep_alive             ? "Connection: close\r\n"
+                                  : request->version_minor == 0 ? "Connection: keep-alive\r\n"
+                                                                : "";
+    n = append_bytes(append_string(out + n, connection_line), "\r\n", 2) - out;
+
+    // {ref}{LOGIC}{PROXY_RESPONSE}{5}
+    proxy->server_keep_alive = !proxy->until_close && !header_has_token(connection, "close") &&
+                               (head[7] == '1' || header_has_token(connection, "keep-alive"));
+
+    if (queue_segment(conn, out, n, out) == -1)
+    {
+        return -1;
+    }
+    proxy->status = status;
+    proxy->response_bytes += n;
+    proxy->state = proxy->chunked ? PROXY_CHUNK_LINE : PROXY_RESPONSE_BODY;
+    uint64_t now = metrics_now_ns();
+    metrics_record(&metrics->histograms[METRICS_HANDLE], now - proxy->started_ns);
+    if (!conn->send_started_ns)
+    {
+        conn->send_started_ns = now;
+    }
+    return 0;
+}
+
+/**
+ * @brief Moves a proxied request along as far as the sockets allow.
+ * @param epoll_fd The worker's epoll instance, which new links are registered with.
+ * @param conn A connection with an exchange in progress.
+ * @details [LOGIC][PUMP_PROXY]
+ * 1. Pick the healthy server with the fewest outstanding requests and take a pooled link to it, or open a
+ *      new one and register it edge-triggered for reading and writing; it stays registered while pooled, so
+ *      a reused link costs no epoll_ctl(). With no healthy server the client gets a 503, and a 502 once
+ *      PROXY_MAX_ATTEMPTS links failed.
+ * 2. Write the request head and the body bytes that came with it. On a new link the first write also tells
+ *      whether the connection is up yet.
+ * 3. Splice the rest of the request body from the client's socket through the pipe to the server.
+ * 4. Peek at the server's socket until the response head is complete, then read exactly the head, so the
+ *      body stays in the socket for splice(). Queue the head the client gets (`queue_proxy_response`).
+ * 5. Once the head is out, splice the response body through the pipe to the client. A chunked body goes one
+ *      chunk at a time, size line and CRLF included; only the size line is peeked at, to learn where the
+ *      chunk ends. The last chunk reaches up to the blank line after its trailers.
+ * 6. When the response is complete, the server counts as healthy and the link goes back to the pool if
+ *      the server keeps it open.
+ * Every step runs until a socket would block; an event on either socket brings us back. Any progress
+ * restarts the exchange's timeout. A link that fails is handled by `fail_proxy`.
+ * @return 0 if the connection is still usable, -1 if the client went away and it must be closed.
+ */
+int pump_proxy(int epoll_fd, Connection *conn)
+{
+    ProxyExchange *proxy = conn->proxy;
+    char buf[PROXY_HEAD_SIZE];
+    while (conn->proxy)
+    {
+        if (proxy->state == PROXY_CONNECT)
+        {
+            // {ref}{LOGIC}{PUMP_PROXY}{1}
+            Upstream *upstream =
+                proxy->attempts < PROXY_MAX_ATTEMPTS ? upstream_pick(proxy->pool, proxy->excluded) : NULL;
+            if (!upstream)
+            {
+                abort_proxy(conn, proxy->attempts ? 502 : 503);
+                return 0;
+            }
+            proxy->attempts++;
+            int reused = upstream_acquire(upstream, &proxy->link);
+            if (reused != -1 && reserve_proxy_slot(proxy->link.fd) == -1)
+            {
+                upstream_release(upstream, &proxy->link, 0, 0);
+                reused = -1;
+            }
+            if (reused == 0)
+            {
+                struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+                                         .data.fd = proxy->link.fd};
+                if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, proxy->link.fd, &ev) == -1)
+                {
+                    upstream_release(upstream, &proxy->link, 0, 0);
+                    reused = -1;
+                }
+            }
+            if (reused == -1)
+            {
+                upstream_report(upstream, 0);
+                proxy->excluded |= 1u << (upstream - proxy->pool->upstreams);
+                continue;
+            }
+            proxies[proxy->link.fd] = proxy;
+            upstream->outstanding++;
+            proxy->upstream = upstream;
+            proxy->reused = reused;
+            proxy->state = PROXY_SEND_HEAD;
+        }
+        else if (proxy->state == PROXY_SEND_HEAD)
+        {
+            // {ref}{LOGIC}{PUMP_PROXY}{2}
+            ssize_t written = send(proxy->link.fd, proxy->head + proxy->head_sent, proxy->head_len - proxy->head_sent,
+                                   MSG_NOSIGNAL);
+            if (written == -1)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    return 0;
+                }
+                if (errno != EINTR)
+                {
+                    fail_proxy(conn);
+                }
+                continue;
+            }
+            proxy->head_sent += written;
+            timer_wheel_schedule(&timers, &proxy->timer, PROXY_TIMEOUT_MS);
+            if (proxy->head_sent == proxy->head_len)
+            {
+                proxy->state = proxy->body_left > 0 ? PROXY_SEND_BODY : PROXY_RESPONSE_HEAD;
+            }
+        }
+        else if (proxy->state == PROXY_SEND_BODY)
+        {
+            // {ref}{LOGIC}{PUMP_PROXY}{3}
+            uint64_t left = proxy->body_left, moved = 0;
+            SpliceResult result = splice_through(proxy, conn->fd, proxy->link.fd, &proxy->body_left, &moved);
+            metrics_add(&metrics->bytes_in, left - proxy->body_left);
+            if (moved || left != proxy->body_left)
+            {
+                timer_wheel_schedule(&timers, &proxy->timer, PROXY_TIMEOUT_MS);
+            }
+            if (result == SPLICE_BLOCKED)
+            {
+                return 0;
+            }
+            if (result == SPLICE_EOF || result == SPLICE_READ_ERROR)
+            {
+                log_connection(conn, ACCESS_LOG_CLOSE, "client disconnected");
+                return -1;
+            }
+            if (result == SPLICE_WRITE_ERROR)
+            {
+                fail_proxy(conn);
+                continue;
+            }
+            proxy->state = PROXY_RESPONSE_HEAD;
+        }
+        else if (proxy->state == PROXY_RESPONSE_HEAD || proxy->state == PROXY_CHUNK_LINE)
+        {
+            // {ref}{LOGIC}{PUMP_PROXY}{4,5}
+            ssize_t len = recv(proxy->link.fd, buf, sizeof(buf) - 1, MSG_PEEK);
+            if (len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                return 0;
+            }
+            if (len <= 0)
+            {
+                if (len == 0 || errno != EINTR)
+                {
+                    fail_proxy(conn);
+                }
+                continue;
+            }
+            buf[len] = '\0';
+            char *end = memmem(buf, len, proxy->state == PROXY_CHUNK_LINE ? "\r\n" : "\r\n\r\n",
+                               proxy->state == PROXY_CHUNK_LINE ? 2 : 4);
+            if (end && proxy->state == PROXY_CHUNK_LINE)
+            {
+                char *size_end;
+                errno = 0;
+                unsigned long long size = strtoull(buf, &size_end, 16);
+                if (!isxdigit((unsigned char)buf[0]) || errno == ERANGE || size > UINT64_MAX / 2 ||
+                    !strchr("; \t\r", *size_end))
+                {
+                    fail_proxy(conn);
+                    continue;
+                }
+                if (size > 0)
+                {
+                    proxy->response_left = (end + 2 - buf) + size + 2;
+                    proxy->state = PROXY_RESPONSE_BODY;
+                    continue;
+                }
+                // The last chunk: its line, the trailers and the blank line after them
+                end = memmem(end, len - (end - buf), "\r\n\r\n", 4);
+                if (end)
+                {
+                    proxy->response_left = end + 4 - buf;
+                    proxy->chunked = 0;
+                    proxy->state = PROXY_RESPONSE_BODY;
+                    continue;
+                }
+            }
+            if (!end)
+            {
+                if (len == sizeof(buf) - 1)
+                {
+                    fail_proxy(conn);
+                    continue;
+                }
+                return 0; // Incomplete; the rest arrives with the next edge
+            }
+            size_t head_len = end + 4 - buf;
+            if (recv(proxy->link.fd, buf, head_len, 0) != (ssize_t)head_len)
+            {
+                fail_proxy(conn);
+                continue;
+            }
+            buf[head_len] = '\0';
+            timer_wheel_schedule(&timers, &proxy->timer, PROXY_TIMEOUT_MS);
+            if (queue_proxy_response(conn, proxy, buf, head_len) == -1)
+            {
+                abort_proxy(conn, 502);
+            }
+        }
+        else
+        {
+            // {ref}{LOGIC}{PUMP_PROXY}{5}
+            if (conn->out_bytes > 0)
+            {
+                if (flush_output(conn) == -1)
+                {
+                    return -1;
+                }
+                if (conn->out_bytes > 0)
+                {
+                    return 0;
+                }
+            }
+            uint64_t left = proxy->response_left, moved = 0;
+            SpliceResult result = splice_through(proxy, proxy->link.fd, conn->fd, &proxy->response_left, &moved);
+            proxy->response_bytes += moved;
+            metrics_add(&metrics->bytes_out, moved);
+            if (moved || left != proxy->response_left)
+            {
+                timer_wheel_schedule(&timers, &proxy->timer, PROXY_TIMEOUT_MS);
+            }
+            if (result == SPLICE_BLOCKED)
+            {
+                return 0;
+            }
+            if (result == SPLICE_EOF && proxy->until_close)
+            {
+                proxy->response_left = 0; // The body ended; drain the pipe
+                continue;
+            }
+            if (result == SPLICE_EOF || result == SPLICE_READ_ERROR)
+            {
+                fail_proxy(conn);
+                continue;
+            }
+            if (result == SPLICE_WRITE_ERROR)
+            {
+                log_connection(conn, ACCESS_LOG_CLOSE, "client disconnected");
+                return -1;
+            }
+            if (proxy->chunked)
+            {
+                proxy->state = PROXY_CHUNK_LINE;
+                continue;
+            }
+            // {ref}{LOGIC}{PUMP_PROXY}{6}
+            upstream_report(proxy->upstream, 1);
+            end_proxy(conn, proxy->server_keep_alive);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Brings the connection's epoll registration in line with its state after an I/O pass.
+ * @param epoll_fd The file descriptor for the epoll instance.
+ * @param conn The connection to update.
+ * @details [LOGIC][UPDATE_CONNECTION]
+ * 1. Flush the output queue, then let a streamed response produce more (`pump_stream`) or a proxied request
+ *      move along (`pump_proxy`); events on the upstream link end up here as well.
+ * 2. A connection that is closing and has nothing left to send or stream is closed.
+ * 3. Ask for EPOLLIN only while reading is allowed or a request body may be spliced to an upstream server,
+ *      and EPOLLOUT while output is queued, a response streams or reading is paused: the next EPOLLOUT is what
+ *      lets `handle_write_operation` resume a paused reader. A TLS handshake waiting to write asks for EPOLLOUT too.
+ *      On io_uring, keep a multishot recv in flight exactly while reading is allowed (`update_recv`).
+ * 4. Re-arm the read timer for the connection's new state.
+ * @return 0 if the connection is still open, -1 if it was closed.
+ */
+int update_connection(int epoll_fd, Connection *conn)
+{
+    // {ref}{LOGIC}{UPDATE_CONNECTION}{1,2}
+    if (flush_output(conn) == -1 || (conn->producer && pump_stream(conn) == -1) ||
+        (conn->proxy && pump_proxy(epoll_fd, conn) == -1) ||
+        (conn->closing && conn->out_bytes == 0 && !conn->producer))
+    {
+        close_connection(epoll_fd, conn);
+        return -1;
+    }
+
+    // {ref}{LOGIC}{UPDATE_CONNECTION}{3}
+    if (uring)
+    {
+        update_recv(conn);
+        update_read_timer(conn);
+        return 0;
+    }
+    uint32_t events = EPOLLET;
+    if (!conn->closing && (!conn->read_paused || conn->proxy))
+    {
+        events |= EPOLLIN;
+    }
+    if (conn->out_bytes > 0 || conn->producer || conn->read_paused || conn->tls_state == TLS_HANDSHAKE_WANT_WRITE)
+    {
+        events |= EPOLLOUT;
+    }
+    if (events != conn->events)
+    {
+        struct epoll_event ev = {.events = events, .data.fd = conn->fd};
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) == -1)
+        {
+            perror("epoll_ctl: EPOLL_CTL_MOD");
+            close_connection(epoll_fd, conn);
+            return -1;
+        }
+        conn->events = events;
+    }
+    // {ref}{LOGIC}{UPDATE_CONNECTION}{4}
+    update_read_timer(conn);
+    return 0;
+}
+
+/**
+ * @brief Timer wheel callback: a proxied request made no progress for PROXY_TIMEOUT_MS.
+ * @param timer The exchange's timer.
+ * @param arg Pointer to the worker's epoll file descriptor.
+ * @details A server that never answered counts as failed; the client gets a 504 and the connection closes.
+ */
+void on_proxy_timeout(TimerNode *timer, void *arg)
+{
+    ProxyExchange *proxy = timer->data;
+    Connection *conn = proxy->client;
+    if (proxy->upstream && !proxy->status)
+    {
+        upstream_report(proxy->upstream, 0);
+    }
+    log_connection(conn, ACCESS_LOG_CLOSE, "upstream timeout");
+    abort_proxy(conn, 504);
+    update_connection(*(int *)arg, conn);
+}
+
+/// @brief Timer wheel callback: expires idle upstream links and runs the health probes, every UPSTREAM_CHECK_INTERVAL_MS
+void on_upstream_check(TimerNode *timer, void *arg)
+{
+    (void)arg;
+    for (int i = 0; i < upstream_group_count; i++)
+    {
+        upstream_check(&upstream_pools[i], timers.now_ms);
+    }
+    timer_wheel_schedule(&timers, timer, UPSTREAM_CHECK_INTERVAL_MS);
+}
+
+/// @brief Timer wheel callback: adjusts the worker's adaptive request limit, every ADMISSION_INTERVAL_MS
+void on_admission_adapt(TimerNode *timer, void *arg)
+{
+    (void)arg;
+    admission_adapt(&admission);
+    timer_wheel_schedule(&timers, timer, ADMISSION_INTERVAL_MS);
+}
+
+/**
+ * @brief Serializes the constructed HTTP response and queues it on the connection.
+ * @param conn The client connection the response belongs to.
+ * @param response Pointer to the HttpResponse structure containing the status, headers, and body to be sent.
+ * @details [LOGIC][QUEUE_RESPONSE]
+ * 1. Measure the head: the pre-rendered status line of the code (`http_status_line`), or one built from the
+ *      status text for a code the table lacks, every header, the worker's Date line and the length or
+ *      framing header. One buffer then holds the head and a copy of the body. Nothing is formatted with
+ *      printf: every piece is copied with a known length.
+ * 2. Copy the status line, then every header (key-value pairs), then the Date line.
+ * 3. Always send 'Content-Length' so the client can find the end of the body on a persistent connection,
+ *      except in a 304, which has no body and whose length would be taken for the representation's.
+ *      For a file body this is the size recorded by the file cache. A streamed body has no length known
+ *      up front: it is sent with 'Transfer-Encoding: chunked', or for an HTTP/1.0 client until the
+ *      connection closes.
+ * 4. Append a blank line (`\r\n`) to separate headers from the body.
+ * 5. Queue the header block together with a copy of the body, so a handler may build the body in the
+ *      connection's arena, or followed by the file as its own segment. Nothing is sent here: every response
+ *      produced during one event-loop pass is written together by `flush_output`.
+ * 6. For a streamed body, hand the producer to the connection; `pump_stream` calls it once the headers are out.
+ */
+void queue_response(Connection *conn, HttpResponse *response)
+{
+    static const char chunked[] = "Transfer-Encoding: chunked\r\n";
+    static const char content_length[] = "Content-Length: ";
+    size_t body_len = response->file ? (size_t)response->file->st.st_size
+                                     : response->body ? strlen(response->body) : 0;
+
+    // {ref}{LOGIC}{QUEUE_RESPONSE}{1}
+    const HttpStatusLine *status = http_status_line(response->status_code);
+    size_t status_text_len = status ? 0 : strlen(response->status_text);
+    size_t head_len = status ? status->len : sizeof("HTTP/1.1  \r\n") - 1 + HTTP_DECIMAL_SIZE + status_text_len;
+    size_t key_len[MAX_HEADERS], value_len[MAX_HEADERS];
+    for (int i = 0; i < response->header_count; i++)
+    {
+        key_len[i] = strlen(response->headers[i].key);
+        value_len[i] = strlen(response->headers[i].value);
+        head_len += key_len[i] + value_len[i] + 4;
+    }
+    head_len += HTTP_DATE_LINE_LEN + sizeof(content_length) - 1 + HTTP_DECIMAL_SIZE + 4;
+    size_t copy_len = response->file ? 0 : body_len;
+    char *buffer = malloc(head_len + copy_len);
+    if (!buffer)
+    {
+        goto failed;
+    }
+
+    // {ref}{LOGIC}{QUEUE_RESPONSE}{2}
+    char *p = buffer;
+    if (status)
+    {
+        p = append_bytes(p, status->text, status->len);
+    }
+    else
+    {
+        p = append_bytes(p, "HTTP/1.1 ", 9);
+        p = http_format_decimal(p, response->status_code);
+        *p++ = ' ';
+        p = append_bytes(p, response->status_text, status_text_len);
+        p = append_bytes(p, "\r\n", 2);
+    }
+    for (int i = 0; i < response->header_count; i++)
+    {
+        p = append_bytes(p, response->headers[i].key, key_len[i]);
+        p = append_bytes(p, ": ", 2);
+        p = append_bytes(p, response->headers[i].value, value_len[i]);
+        p = append_bytes(p, "\r\n", 2);
+    }
+    p = append_bytes(p, http_date_line(&date_cache), HTTP_DATE_LINE_LEN);
+
+    // {ref}{LOGIC}{QUEUE_RESPONSE}{3,4}
+    if (response->producer && conn->stream_chunked)
+    {
+        p = append_bytes(p, chunked, sizeof(chunked) - 1);
+    }
+    else if (!response->producer && response->status_code != 304)
+    {
+        p = append_bytes(p, content_length, sizeof(content_length) - 1);
+        p = http_format_decimal(p, body_len);
+        p = append_bytes(p, "\r\n", 2);
+    }
+    p = append_bytes(p, "\r\n", 2);
+
+    // {ref}{LOGIC}{QUEUE_RESPONSE}{5}
+    if (copy_len)
+    {
+        p = append_bytes(p, response->body, copy_len);
+    }
+    if (queue_segment(conn, buffer, p - buffer, buffer) == -1)
+    {
+        goto failed;
+    }
+    if (response->file)
+    {
+        if (body_len == 0)
+        {
+            file_cache_release(response->file);
+        }
+        else if (queue_file_segment(conn, response->file, 0, body_len) == -1)
+        {
+            conn->keep_alive = 0;
+        }
+    }
+    // {ref}{LOGIC}{QUEUE_RESPONSE}{6}
+    if (response->producer)
+    {
+        conn->producer = response->producer;
+        conn->producer_context = response->producer_context;
+    }
+    return;
+
+failed:
+    if (response->file)
+    {
+        file_cache_release(response->file);
+    }
+    if (response->producer)
+    {
+        response->producer(response->producer_context, NULL, 0);
+    }
+    conn->keep_alive = 0;
+}
+
+/// @brief Queues bytes of a range source, with a reference of their own to the cached body or file
+int queue_source_range(Connection *conn, RangeSource *source, const HttpRange *range)
+{
+    if (source->file)
+    {
+        file_cache_retain(source->file);
+        return queue_file_segment(conn, source->file, range->start, range->length);
+    }
+    response_cache_retain(source->cached);
+    return queue_cached_segment(conn, (char *)source->data + range->start, range->length, source->cached);
+}
+
+/// @brief Writes "Content-Range: bytes <first>-<last>/<size>" and its CRLF
+static char *append_content_range(char *out, const HttpRange *range, uint64_t size)
+{
+    out = append_string(out, "Content-Range: bytes ");
+    out = http_format_decimal(out, range->start);
+    *out++ = '-';
+    out = http_format_decimal(out, range->start + range->length - 1);
+    *out++ = '/';
+    out = http_format_decimal(out, size);
+    return append_bytes(out, "\r\n", 2);
+}
+
+/// @brief Writes the ETag and Last-Modified lines of a range source
+static char *append_validators(char *out, const RangeSource *source)
+{
+    out = append_bytes(append_string(append_string(out, "ETag: "), source->etag), "\r\n", 2);
+    return append_bytes(append_string(append_string(out, "Last-Modified: "), source->last_modified), "\r\n", 2);
+}
+
+/// @brief Ends a range response head: a copy of the Date line, the 'Connection' header if any and the blank line
+static char *append_range_head_end(char *out, const char *date, const char *connection)
+{
+    out = append_bytes(out, date, HTTP_DATE_LINE_LEN);
+    return append_bytes(append_string(out, connection), "\r\n", 2);
+}
+
+/**
+ * @brief Answers a Range request with the selected bytes of a file or cached body (RFC 9110 section 14).
+ * @param source The representation; the caller's reference is handed over whenever a response is queued.
+ * @details [LOGIC][QUEUE_RANGE_RESPONSE]
+ * 1. Without a Range header there is nothing to do. With If-Range, serve ranges only if it names the current
+ *      representation: an entity tag must equal its ETag exactly (a strong comparison), a date its Last-Modified.
+ * 2. Parse the ranges against the size. A header that does not parse, or asks for too many ranges, is ignored.
+ * 3. If no range overlaps the representation, answer 416 with its size in Content-Range.
+ * 4. One range: a 206 head with Content-Range, then the bytes. File bytes go out with sendfile() from the
+ *      range's offset; cached bytes are queued from the cache entry without copying.
+ * 5. Several ranges: a multipart/byteranges body in which every part has its own boundary line, Content-Type
+ *      and Content-Range ahead of its bytes. The heads are formatted first, so Content-Length is known.
+ * 6. All text goes into one buffer that the segments point into; the segment queued last owns it, since
+ *      segments are released in order. It is copied together like any other head, without printf, and
+ *      holds its own copy of the Date line.
+ * @return 416 or 206 once a response is queued, 0 if the request gets the whole representation instead.
+ */
+int queue_range_response(Connection *conn, HttpRequest *request, RangeSource *source)
+{
+    // {ref}{LOGIC}{QUEUE_RANGE_RESPONSE}{1}
+    const char *range = request_header(request, HTTP_HEADER_RANGE);
+    const char *if_range = request_header(request, HTTP_HEADER_IF_RANGE);
+    if (!range || (if_range && strcmp(if_range, *if_range == '"' ? source->etag : source->last_modified) != 0))
+    {
+        return 0;
+    }
+
+    // {ref}{LOGIC}{QUEUE_RANGE_RESPONSE}{2}
+    HttpRange ranges[HTTP_RANGE_MAX];
+    int count;
+    HttpRangeResult result = http_range_parse(range, source->size, ranges, &count);
+    if (result == HTTP_RANGE_IGNORE)
+    {
+        return 0;
+    }
+    const char *connection = !conn->keep_alive              ? "Connection: close\r\n"
+                             : request->version_minor == 0 ? "Connection: keep-alive\r\n"
+                                                           : "";
+    const char *date = http_date_line(&date_cache);
+    char *text = malloc(RANGE_HEAD_SIZE + (count + 1) * RANGE_PART_SIZE);
+    int status = result == HTTP_RANGE_UNSATISFIABLE ? 416 : 206;
+    const HttpStatusLine *status_line = http_status_line(status);
+    int queued = 0, failed = !text;
+
+    if (!failed && status == 416)
+    {
+        // {ref}{LOGIC}{QUEUE_RANGE_RESPONSE}{3}
+        char *p = append_bytes(text, status_line->text, status_line->len);
+        p = append_string(p, "Content-Range: bytes */");
+        p = http_format_decimal(p, source->size);
+        p = append_string(p, "\r\nContent-Length: 0\r\n");
+        p = append_range_head_end(p, date, connection);
+        failed = queue_segment(conn, text, p - text, NULL) == -1;
+        queued += !failed;
+    }
+    else if (!failed && count == 1)
+    {
+        // {ref}{LOGIC}{QUEUE_RANGE_RESPONSE}{4}
+        char *p = append_bytes(text, status_line->text, status_line->len);
+        p = append_bytes(append_string(append_string(p, "Content-Type: "), source->content_type), "\r\n", 2);
+        p = append_content_range(p, &ranges[0], source->size);
+        p = append_string(p, "Content-Length: ");
+        p = http_format_decimal(p, ranges[0].length);
+        p = append_bytes(p, "\r\n", 2);
+        p = append_validators(p, source);
+        p = append_range_head_end(p, date, connection);
+        failed = queue_segment(conn, text, p - text, NULL) == -1;
+        queued += !failed;
+        failed = failed || queue_source_range(conn, source, &ranges[0]) == -1;
+        queued += !failed;
+    }
+    else if (!failed)
+    {
+        // {ref}{LOGIC}{QUEUE_RANGE_RESPONSE}{5}
+        char boundary[HTTP_HEX_SIZE + 1];
+        *http_format_hex(boundary, metrics_now_ns() * 0x9E3779B97F4A7C15ULL, HTTP_HEX_SIZE) = '\0';
+        char *parts = text + RANGE_HEAD_SIZE;
+        int part_len[HTTP_RANGE_MAX + 1];
+        char *p = parts;
+        uint64_t content_length = 0;
+        for (int i = 0; i < count; i++)
+        {
+            char *part = p;
+            p = append_string(append_string(p, "\r\n--"), boundary);
+            p = append_string(append_string(p, "\r\nContent-Type: "), source->content_type);
+            p = append_bytes(p, "\r\n", 2);
+            p = append_bytes(append_content_range(p, &ranges[i], source->size), "\r\n", 2);
+            part_len[i] = p - part;
+            content_length += part_len[i] + ranges[i].length;
+        }
+        char *closing = p;
+        p = append_string(append_string(append_string(p, "\r\n--"), boundary), "--\r\n");
+        part_len[count] = p - closing;
+        content_length += part_len[count];
+
+        p = append_bytes(text, status_line->text, status_line->len);
+        p = append_string(append_string(p, "Content-Type: multipart/byteranges; boundary="), boundary);
+        p = append_string(p, "\r\nContent-Length: ");
+        p = http_format_decimal(p, content_length);
+        p = append_bytes(p, "\r\n", 2);
+        p = append_validators(p, source);
+        p = append_range_head_end(p, date, connection);
+        failed = queue_segment(conn, text, p - text, NULL) == -1;
+        queued += !failed;
+        for (int i = 0; i <= count && !failed; i++)
+        {
+            failed = queue_segment(conn, parts, part_len[i], NULL) == -1;
+            queued += !failed;
+            parts += part_len[i];
+            if (!failed && i < count)
+            {
+                failed = queue_source_range(conn, source, &ranges[i]) == -1;
+                queued += !failed;
+            }
+        }
+    }
+
+    // {ref}{LOGIC}{QUEUE_RANGE_RESPONSE}{6}
+    if (queued)
+    {
+        conn->out[conn->out_count - 1].owned = text;
+    }
+    else
+    {
+        free(text);
+    }
+    if (failed)
+    {
+        conn->keep_alive = 0;
+    }
+    if (source->file)
+    {
+        file_cache_release(source->file);
+    }
+    else
+    {
+        response_cache_release(source->cached);
+    }
+    return status;
+}
+
+/**
+ * @brief Queues what follows a pre-serialized head: the worker's Date line, the 'Connection' header this
+ *      request needs and the blank line.
+ * @details The Date line is copied into a block of the segment's own: output may wait in the queue for up to
+ *      WRITE_STALL_TIMEOUT_MS, while the worker's line is rewritten every second. A persistent HTTP/1.1
+ *      connection needs no 'Connection' header, so the Date line is copied with the CRLF kept after it.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int queue_head_end(Connection *conn, HttpRequest *request)
+{
+    static const char end_close[] = "Connection: close\r\n\r\n";
+    static const char end_keep_alive[] = "Connection: keep-alive\r\n\r\n";
+    const char *date = http_date_line(&date_cache);
+    char *text = malloc(HTTP_DATE_LINE_LEN + sizeof(end_keep_alive));
+    if (!text)
+    {
+        return -1;
+    }
+
+    char *p;
+    if (conn->keep_alive && request->version_minor != 0)
+    {
+        p = append_bytes(text, date, HTTP_DATE_LINE_LEN + 2);
+    }
+    else
+    {
+        p = append_bytes(text, date, HTTP_DATE_LINE_LEN);
+        p = append_string(p, conn->keep_alive ? end_keep_alive : end_close);
+    }
+    return queue_segment(conn, text, p - text, text);
+}
+
+/**
+ * @brief Whether the client's copy of a representation is current, so that 304 may be sent instead of it
+ * @details The one rule of the cached, the sendfile() and the embedded responses. If-None-Match is compared
+ *      with the ETag (`etag_list_matches`). Only a request without it has its If-Modified-Since looked at,
+ *      which matches when it repeats the Last-Modified: the date clients send back.
+ * @param last_modified The representation's Last-Modified, NULL if it has none.
+ */
+static int not_modified(HttpRequest *request, const char *etag, const char *last_modified)
+{
+    const char *if_none_match = request_header(request, HTTP_HEADER_IF_NONE_MATCH);
+    if (if_none_match)
+    {
+        return etag_list_matches(etag, if_none_match);
+    }
+    const char *if_modified_since = request_header(request, HTTP_HEADER_IF_MODIFIED_SINCE);
+    return if_modified_since && last_modified && strcmp(if_modified_since, last_modified) == 0;
+}
+
+/**
+ * @brief Queues a response straight from the response cache.
+ * @param conn The client connection the request arrived on.
+ * @param request The GET request being answered.
+ * @param cached The entry for the request's path; the caller's reference is handed to the queue.
+ * @details [LOGIC][QUEUE_CACHED_RESPONSE]
+ * 1. If the client's copy is current (`not_modified`), answer with the entry's 304 head instead.
+ *      A Range request is answered with the selected bytes of the cached body (`queue_range_response`).
+ * 2. The entry's head leaves out the lines that end it, so the Date line and the 'Connection' header can
+ *      follow for this request (`queue_head_end`).
+ * 3. Then queue the body. The segment queued last keeps the entry alive until all of them are written.
+ * @return The status code sent: 304, 206, 416 or 200.
+ */
+int queue_cached_response(Connection *conn, HttpRequest *request, CachedResponse *cached)
+{
+    // {ref}{LOGIC}{QUEUE_CACHED_RESPONSE}{1}
+    if (not_modified(request, cached->etag, cached->last_modified))
+    {
+        if (queue_cached_segment(conn, cached->data, cached->not_modified_len, cached) == -1 ||
+            queue_head_end(conn, request) == -1)
+        {
+            conn->keep_alive = 0;
+        }
+        return 304;
+    }
+
+    char *head = cached->data + cached->not_modified_len;
+    RangeSource source = {cached, NULL, head + cached->head_len + 2, cached->body_len,
+                          content_type_for_path(cached->path), cached->etag, cached->last_modified};
+    int status = queue_range_response(conn, request, &source);
+    if (status)
+    {
+        return status;
+    }
+    // {ref}{LOGIC}{QUEUE_CACHED_RESPONSE}{2}
+    if (queue_cached_segment(conn, head, cached->head_len, NULL) == -1 || queue_head_end(conn, request) == -1)
+    {
+        response_cache_release(cached);
+        conn->keep_alive = 0;
+        return 200;
+    }
+    // {ref}{LOGIC}{QUEUE_CACHED_RESPONSE}{3}
+    if (queue_cached_segment(conn, head + cached->head_len + 2, cached->body_len, cached) == -1)
+    {
+        conn->keep_alive = 0;
+    }
+    return 200;
+}
+
+/**
+ * @brief Adds a file response built by the GET handler to the response cache.
+ * @param request The GET request; the path part of its URI is the cache key.
+ * @param response The handler's response. On success its file reference is released, since the
+ *      response is served from the cache entry instead.
+ * @return The new entry with a reference for the caller, or NULL if the response is not cached:
+ *      it is not a 200 file response, or the file is too large.
+ */
+CachedResponse *cache_response(HttpRequest *request, HttpResponse *response)
+{
+    if (response->status_code != 200 || !response->file)
+    {
+        return NULL;
+    }
+    CachedFile *file = response->file;
+    CachedResponse *cached = response_cache_insert(&response_cache, request->uri, strcspn(request->uri, "?#"),
+                                                   file->path, file->fd, &file->st,
+                                                   content_type_for_path(file->path));
+    if (cached)
+    {
+        file_cache_release(file);
+        response->file = NULL;
+    }
+    return cached;
+}
+
+/**
+ * @brief Starts forwarding a request to an upstream group once its headers are complete.
+ * @param conn The connection the request arrived on.
+ * @param group The group the request was routed to.
+ * @details [LOGIC][START_PROXY]
+ * 1. A chunked request body would have to be decoded to learn where it ends; the server asks for a length (411).
+ * 2. Build the request head for the server: the request line, with the version lowered to HTTP/1.0 for an
+ *      HTTP/1.0 client, so the server does not answer with chunks the client cannot read; the client's headers
+ *      except the hop-by-hop ones and Expect, which was answered here; and X-Forwarded-For extended with the
+ *      client's address. Host is passed on as the client sent it. The framing is written anew: the client's
+ *      Content-Length lines are dropped for a single one with the length the body is spliced with, so the
+ *      server cannot read a different body from a pooled link than the one sent.
+ * 3. Append the body bytes that arrived together with the head and drop them from the receive buffer;
+ *      the rest of the body is spliced from the socket (`pump_proxy`).
+ * 4. Start the exchange's timeout and hand the connection to `pump_proxy`. Reading from the client stops
+ *      until the exchange ends, so requests pipelined behind this one wait in the socket. Nagle is turned off:
+ *      the response head and the spliced body are separate writes, and the body would otherwise wait for the
+ *      client's delayed ACK of the head.
+ */
+void start_proxy(Connection *conn, UpstreamGroup *group)
+{
+    HttpRequest *request = &conn->request;
+
+    // {ref}{LOGIC}{START_PROXY}{1}
+    if (request_header(request, HTTP_HEADER_TRANSFER_ENCODING))
+    {
+        conn->error_status = 411;
+        conn->state = PARSE_ERROR;
+        return;
+    }
+
+    // {ref}{LOGIC}{START_PROXY}{2}
+    uint64_t body_length = conn->body.remaining;
+    size_t buffered = conn->in_len - conn->body_start;
+    if (buffered > body_length)
+    {
+        buffered = body_length;
+    }
+    // Every header may gain the space after its colon; X-Forwarded-For gains the client's address, and
+    // Content-Length is written anew
+    size_t head_cap = conn->body_start + 2 * request->header_count + INET_ADDRSTRLEN + 64 +
+                      sizeof("Content-Length: \r\n") + HTTP_DECIMAL_SIZE + buffered;
+    ProxyExchange *proxy = arena_alloc(&conn->arena, sizeof(ProxyExchange));
+    char *head = malloc(head_cap);
+    if (!proxy || !head)
+    {
+        free(head);
+        conn->error_status = 500;
+        conn->state = PARSE_ERROR;
+        return;
+    }
+    memset(proxy, 0, sizeof(*proxy));
+    const char *connection = request_header(request, HTTP_HEADER_CONNECTION);
+    char *p = append_string(head, request->method);
+    *p++ = ' ';
+    p = append_string(p, request->uri);
+    p = append_string(p, request->version_minor == 0 ? " HTTP/1.0\r\n" : " HTTP/1.1\r\n");
+    for (int i = 0; i < request->header_count; i++)
+    {
+        const char *key = request->base + request->headers[i].key.offset;
+        HttpHeaderId id = http_header_lookup(key, request->headers[i].key.length);
+        if (id == HTTP_HEADER_CONNECTION || id == HTTP_HEADER_KEEP_ALIVE || id == HTTP_HEADER_TE ||
+            id == HTTP_HEADER_UPGRADE || id == HTTP_HEADER_EXPECT || id == HTTP_HEADER_X_FORWARDED_FOR ||
+            id == HTTP_HEADER_CONTENT_LENGTH || id == HTTP_HEADER_TRANSFER_ENCODING ||
+            strcasecmp(key, "Proxy-Connection") == 0 || header_has_token(connection, key))
+        {
+            continue;
+        }
+        p = append_bytes(p, key, request->headers[i].key.length);
+        p = append_bytes(p, ": ", 2);
+        p = append_bytes(p, request->base + request->headers[i].value.offset, request->headers[i].value.length);
+        p = append_bytes(p, "\r\n", 2);
+    }
+    char address[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &conn->peer_addr, address, sizeof(address));
+    const char *forwarded = request_header(request, HTTP_HEADER_X_FORWARDED_FOR);
+    p = append_string(p, "X-Forwarded-For: ");
+    if (forwarded)
+    {
+        p = append_bytes(append_string(p, forwarded), ", ", 2);
+    }
+    p = append_bytes(append_string(p, address), "\r\n", 2);
+    if (body_length > 0 || request_header(request, HTTP_HEADER_CONTENT_LENGTH))
+    {
+        p = append_string(p, "Content-Length: ");
+        p = append_bytes(http_format_decimal(p, body_length), "\r\n", 2);
+    }
+    if (request->version_minor == 0)
+    {
+        p = append_string(p, "Connection: keep-alive\r\n");
+    }
+    p = append_bytes(p, "\r\n", 2);
+
+    // {ref}{LOGIC}{START_PROXY}{3}
+    p = append_bytes(p, conn->in_buf + conn->body_start, buffered);
+    size_t n = p - head;
+    memmove(conn->in_buf + conn->body_start, conn->in_buf + conn->body_start + buffered,
+            conn->in_len - conn->body_start - buffered);
+    conn->in_len -= buffered;
+    conn->in_buf[conn->in_len] = '\0';
+
+    // {ref}{LOGIC}{START_PROXY}{4}
+    int one = 1;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    proxy->client = conn;
+    proxy->pool = &upstream_pools[group - upstream_groups];
+    proxy->head = head;
+    proxy->head_len = n;
+    proxy->body_length = body_length;
+    proxy->body_left = body_length - buffered;
+    proxy->started_ns = metrics_now_ns();
+    proxy->state = PROXY_CONNECT;
+    timer_init(&proxy->timer, on_proxy_timeout, proxy);
+    timer_wheel_schedule(&timers, &proxy->timer, PROXY_TIMEOUT_MS);
+    conn->proxy = proxy;
+}
+
+/**
+ * @brief Routes the request and lets its handler prepare for the body once the headers are complete.
+ * @param conn The connection the request arrived on.
+ * @details [LOGIC][PREPARE_REQUEST]
+ * 1. Look up the route by method and the path part of the URI; the outcome is kept for dispatch_request.
+ * 2. A client that sent 'Expect: 100-continue' waits for an interim response before sending the body:
+ *      queue "100 Continue" so the upload starts, unless the request has no route and will be refused anyway.
+ * 3. A reverse-proxy route hands the request to `start_proxy`. Otherwise the endpoint's prepare step, if any,
+ *      installs its body sink; without one the body is discarded.
+ */
+void prepare_request(Connection *conn)
+{
+    HttpRequest *request = &conn->request;
+
+    // {ref}{LOGIC}{PREPARE_REQUEST}{1}
+    size_t path_len = strcspn(request->uri, "?#");
+    request->route = router_lookup(&router, request->method_id, request->uri, path_len, &request->match);
+    const Endpoint *endpoint = request->match.value;
+
+    // {ref}{LOGIC}{PREPARE_REQUEST}{2}
+    if (endpoint && request->has_body && request->version_minor == 1 &&
+        header_has_token(request_header(request, HTTP_HEADER_EXPECT), "100-continue"))
+    {
+        static char continue_line[] = "HTTP/1.1 100 Continue\r\n\r\n";
+        queue_segment(conn, continue_line, sizeof(continue_line) - 1, NULL);
+    }
+
+    // {ref}{LOGIC}{PREPARE_REQUEST}{3}
+    if (endpoint && endpoint->upstreams)
+    {
+        start_proxy(conn, endpoint->upstreams);
+    }
+    else if (endpoint && endpoint->prepare)
+    {
+        endpoint->prepare(request, &conn->arena);
+    }
+}
+
+/**
+ * @brief Queues the response a handler filled in.
+ * @param conn The client connection the request arrived on.
+ * @param request The request, routed and complete.
+ * @param response The response, as the handler left it.
+ * @details [LOGIC][QUEUE_HANDLED]
+ * 1. A file the client already has current (`not_modified`), as a file too large for the cache or any
+ *      file with the cache disabled, is answered 304 with its ETag and no body. The file's reference is kept
+ *      until the head, which points to its validators, is queued. Otherwise a file answers a Range request
+ *      with just the selected bytes (`queue_range_response`).
+ * 2. A streamed body is sent chunked; HTTP/1.0 has no chunked coding, so there the body ends
+ *      when the connection closes. Tell the client whether the connection is kept open.
+ * 3. Queue the constructed HTTP response on the connection using `queue_response`.
+ * @return The status code of the response, for the request counters.
+ */
+int queue_handled_response(Connection *conn, HttpRequest *request, HttpResponse *response)
+{
+    // {ref}{LOGIC}{QUEUE_HANDLED}{1}
+    CachedFile *current = NULL;
+    if (response->file && response->status_code == 200 &&
+        not_modified(request, response->file->etag, response->file->last_modified))
+    {
+        current = response->file;
+        response->file = NULL;
+        response->status_code = 304;
+        response->status_text = "Not Modified";
+        response->header_count = 0;
+        add_response_header(response, "ETag", current->etag);
+    }
+    else if (response->file && response->status_code == 200 && request_header(request, HTTP_HEADER_RANGE))
+    {
+        RangeSource source = {NULL, response->file, NULL, response->file->st.st_size,
+                              content_type_for_path(response->file->path), response->file->etag,
+                              response->file->last_modified};
+        int status = queue_range_response(conn, request, &source);
+        if (status)
+        {
+            return status;
+        }
+    }
+
+    // {ref}{LOGIC}{QUEUE_HANDLED}{2}
+    if (response->producer)
+    {
+        conn->stream_chunked = request->version_minor != 0;
+        if (!conn->stream_chunked)
+        {
+            conn->keep_alive = 0;
+        }
+    }
+    if (!conn->keep_alive)
+    {
+        add_response_header(response, "Connection", "close");
+    }
+    else if (request->version_minor == 0)
+    {
+        add_response_header(response, "Connection", "keep-alive");
+    }
+    // {ref}{LOGIC}{QUEUE_HANDLED}{3}
+    queue_response(conn, response);
+    if (current)
+    {
+        file_cache_release(current);
+    }
+    return response->status_code;
+}
+
+/**
+ * @brief Queues the response of an asset compiled into the server.
+ * @param conn The client connection the request arrived on.
+ * @param request The GET request being answered.
+ * @param asset The asset the request was routed to.
+ * @details [LOGIC][QUEUE_EMBEDDED_RESPONSE]
+ * 1. If the request's If-None-Match lists the asset's ETag (`not_modified`; an asset has no Last-Modified),
+ *      answer with its 304 head.
+ * 2. Otherwise queue the 200 head and, after the lines that end it (`queue_head_end`), the body: a few
+ *      segments, still one writev. Head and body are static memory, owned by nobody; only the lines that
+ *      end the head are a copy of the segment's own.
+ * @return The status code sent: 304 or 200.
+ */
+int queue_embedded_response(Connection *conn, HttpRequest *request, const EmbeddedAsset *asset)
+{
+    char *data = (char *)asset->data;
+
+    // {ref}{LOGIC}{QUEUE_EMBEDDED_RESPONSE}{1}
+    if (not_modified(request, asset->etag, NULL))
+    {
+        if (queue_segment(conn, data, asset->not_modified_len, NULL) == -1 || queue_head_end(conn, request) == -1)
+        {
+            conn->keep_alive = 0;
+        }
+        return 304;
+    }
+
+    // {ref}{LOGIC}{QUEUE_EMBEDDED_RESPONSE}{2}
+    char *head = data + asset->not_modified_len;
+    if (queue_segment(conn, head, asset->head_len, NULL) == -1 || queue_head_end(conn, request) == -1 ||
+        queue_segment(conn, head + asset->head_len + 2, asset->body_len, NULL) == -1)
+    {
+        conn->keep_alive = 0;
+    }
+    return 200;
+}
+
+/**
+ * @brief Routes a fully parsed request to its handler and queues the response.
+ * @param conn The client connection the request arrived on.
+ * @param request The parsed request.
+ * @details [LOGIC][DISPATCH_REQUEST]
+ * 1. Decide from the request's version and 'Connection' header whether the connection persists.
+ * 2. Call the handler of the endpoint the request was routed to (see register_routes). A cacheable
+ *      endpoint's requests are first looked up in the response cache by the path part of their URI (the
+ *      query does not select a different file); a hit is queued without calling the handler. A small file
+ *      the handler served is added to the cache and answered from it, so even the first request can get a 304.
+ *      An offload endpoint only gets here when its request could not be queued for the handler pool
+ *      (`offload_request`): answer 503 (Service Unavailable) rather than run the slow handler on the loop.
+ *      An embedded asset is answered with its serialized responses (`queue_embedded_response`).
+ * 3. If no route matches the path, answer 404 (Not Found); if routes match it only for other methods,
+ *      answer 405 (Method Not Allowed).
+ * 4. Queue the response (`queue_handled_response`).
+ * @return The status code of the response, for the request counters.
+ */
+int dispatch_request(Connection *conn, HttpRequest *request)
+{
+    HttpResponse response = {0};
+    response.arena = &conn->arena;
+
+    // {ref}{LOGIC}{DISPATCH_REQUEST}{1}
+    conn->keep_alive = request_wants_keep_alive(request);
+
+    // {ref}{LOGIC}{DISPATCH_REQUEST}{2}
+    const Endpoint *endpoint = request->match.value;
+    if (request->route == ROUTE_FOUND && endpoint->asset)
+    {
+        return queue_embedded_response(conn, request, endpoint->asset);
+    }
+    if (request->route == ROUTE_FOUND && endpoint->cacheable)
+    {
+        size_t path_len = strcspn(request->uri, "?#");
+        CachedResponse *cached = response_cache_lookup(&response_cache, request->uri, path_len);
+        if (!cached)
+        {
+            endpoint->handle(request, &response);
+            cached = cache_response(request, &response);
+        }
+        if (cached)
+        {
+            return queue_cached_response(conn, request, cached);
+        }
+    }
+    else if (request->route == ROUTE_FOUND && endpoint->offload)
+    {
+        response.status_code = 503;
+        response.status_text = "Service Unavailable";
+        add_response_header(&response, "Content-Type", "text/plain");
+        add_response_header(&response, "Retry-After", "1");
+        response.body = "Service Unavailable";
+    }
+    else if (request->route == ROUTE_FOUND)
+    {
+        endpoint->handle(request, &response);
+    }
+    else if (request->route == ROUTE_NO_METHOD)
+    {
+        // {ref}{LOGIC}{DISPATCH_REQUEST}{3}
+        response.status_code = 405;
+        response.status_text = "Method Not Allowed";
+        add_response_header(&response, "Content-Type", "text/plain");
+        response.body = "Unsupported method";
+    }
+    else
+    {
+        response.status_code = 404;
+        response.status_text = "Not Found";
+        add_response_header(&response, "Content-Type", "text/plain");
+        response.body = "Not Found";
+    }
+
+    // {ref}{LOGIC}{DISPATCH_REQUEST}{4}
+    return queue_handled_response(conn, request, &response);
+}
+
+/**
+ * @brief Queues a minimal error response for a client whose input could not be parsed
+ *      and marks the connection for closing once it has been sent.
+ * @details Counted as a request with that status; anything but a 500 (a failure on our side) is also a parse error.
+ */
+void send_error_response(Connection *conn, int status_code, char *status_text)
+{
+    HttpResponse response = {0};
+    response.arena = &conn->arena;
+    response.status_code = status_code;
+    response.status_text = status_text;
+    add_response_header(&response, "Content-Type", "text/plain");
+    add_response_header(&response, "Connection", "close");
+    response.body = status_text;
+    conn->keep_alive = 0;
+    conn->closing = 1;
+    size_t queued = conn->out_bytes;
+    queue_response(conn, &response);
+
+    if (status_code != 500)
+    {
+        metrics_add(&metrics->parse_errors, 1);
+    }
+    metrics_count_request(metrics, request_metrics_method(&conn->request), status_code);
+    uint64_t now = metrics_now_ns();
+    if (!conn->send_started_ns)
+    {
+        conn->send_started_ns = now;
+    }
+    log_request(conn, status_code, conn->out_bytes - queued, now, now);
+}
+
+/**
+ * @brief Turns away a request at the worker's limit of requests in flight, or over its client's request rate:
+ *      queues the pre-serialized 503 or 429 and closes the connection once it has been sent, since the
+ *      request's body is never read.
+ * @param now When the request head was complete.
+ * @param status_code 503 at the limit of requests in flight, 429 from the rate limiter.
+ */
+void shed_request(Connection *conn, uint64_t now, int status_code)
+{
+    conn->keep_alive = 0;
+    conn->closing = 1;
+    size_t queued = conn->out_bytes;
+    if (status_code == 429)
+    {
+        queue_segment(conn, (char *)rate_limited_response, sizeof(rate_limited_response) - 1, NULL);
+        metrics_add(&metrics->requests_limited, 1);
+    }
+    else
+    {
+        queue_segment(conn, (char *)overload_response, sizeof(overload_response) - 1, NULL);
+        metrics_add(&metrics->requests_shed, 1);
+    }
+    metrics_count_request(metrics, request_metrics_method(&conn->request), status_code);
+    if (!conn->send_started_ns)
+    {
+        conn->send_started_ns = now;
+    }
+    log_request(conn, status_code, conn->out_bytes - queued, now, now);
+}
+
+/**
+ * @brief Accounts for a request whose response was queued, and gets the connection ready for the next one.
+ * @param status_code Status of the response.
+ * @param queued Output queued on the connection before the response.
+ * @param started When the request was complete.
+ * @details Counts the request by method and status, records its handle time, logs it and starts the send
+ *      clock if the queue was empty, gives back its admission, then resets the parser (`reset_request`).
+ * @return The time the response was queued.
+ */
+uint64_t complete_request(Connection *conn, int status_code, size_t queued, uint64_t started)
+{
+    uint64_t handled = metrics_now_ns();
+    metrics_count_request(metrics, request_metrics_method(&conn->request), status_code);
+    metrics_record(&metrics->histograms[METRICS_HANDLE], handled - started);
+    log_request(conn, status_code, conn->out_bytes - queued, started, handled);
+    if (!conn->send_started_ns)
+    {
+        conn->send_started_ns = handled;
+    }
+    end_admission(conn, handled);
+    reset_request(conn);
+    return handled;
+}
+
+/// @brief Pool thread: runs the handler of an offloaded request
+void run_handler_job(OffloadJob *job)
+{
+    HandlerJob *handler_job = (HandlerJob *)job;
+    HttpRequest *request = &handler_job->conn->request;
+    const Endpoint *endpoint = request->match.value;
+    endpoint->handle(request, &handler_job->response);
+}
+
+/**
+ * @brief Hands a complete request to the handler pool.
+ * @param conn The connection the request arrived on.
+ * @param started When the request was complete.
+ * @details [LOGIC][OFFLOAD_REQUEST]
+ * 1. Allocate the job in the connection's arena and decide on keep-alive up front, like `dispatch_request`.
+ * 2. The job takes over the receive buffer, which the request's strings point into; the bytes pipelined
+ *      behind the request move to a new one. The loop stops reading meanwhile, but on io_uring receives
+ *      already in flight still complete, and growing the old buffer would move the request under the handler.
+ * 3. Queue the job. From here until `finish_handler_jobs` the request and the arena belong to the pool thread.
+ * @return 0 if the job was queued, -1 if the pool already has OFFLOAD_QUEUE_SIZE jobs waiting or on
+ *      allocation failure; `dispatch_request` then answers 503.
+ */
+int offload_request(Connection *conn, uint64_t started)
+{
+    // {ref}{LOGIC}{OFFLOAD_REQUEST}{1}
+    HandlerJob *job = arena_alloc(&conn->arena, sizeof(HandlerJob));
+    if (!job)
+    {
+        return -1;
+    }
+    memset(job, 0, sizeof(*job));
+    job->job.run = run_handler_job;
+    job->job.completions = &handler_completions;
+    job->conn = conn;
+    job->response.arena = &conn->arena;
+    job->started_ns = started;
+    conn->keep_alive = request_wants_keep_alive(&conn->request);
+
+    // {ref}{LOGIC}{OFFLOAD_REQUEST}{2}
+    size_t rest = conn->in_len - conn->body_start;
+    size_t cap = READ_BUFFER_INITIAL;
+    while (cap < rest + 1)
+    {
+        cap *= 2;
+    }
+    char *in_buf = malloc(cap);
+    if (!in_buf)
+    {
+        return -1;
+    }
+    memcpy(in_buf, conn->in_buf + conn->body_start, rest);
+    in_buf[rest] = '\0';
+
+    // {ref}{LOGIC}{OFFLOAD_REQUEST}{3}
+    if (offload_submit(&handler_pool, &job->job) == -1)
+    {
+        free(in_buf);
+        return -1;
+    }
+    job->request_buf = conn->in_buf;
+    conn->in_buf = in_buf;
+    conn->in_len = rest;
+    conn->in_cap = cap;
+    conn->body_start = 0;
+    conn->job = job;
+    return 0;
+}
+
+/**
+ * @brief Parses and serves every complete request buffered on a connection.
+ * @param conn The connection whose input buffer was just extended.
+ * @details [LOGIC][PROCESS_INPUT]
+ * 1. Run the incremental parser over the newly arrived bytes. Time spent scanning a head is added up
+ *      over the reads it arrives in.
+ * 2. When a request's headers are complete, record the parse time and admit the request; over its client's
+ *      request rate (`rate_limit_request`) or at the worker's limit of requests in flight it is turned away
+ *      (`shed_request`) and nothing after it is read. Let an
+ *      admitted request's handler prepare for the body (`prepare_request`) and continue with the body.
+ * 3. For each complete request, dispatch it and drop its head from the front of the buffer (its body
+ *      was dropped while it was decoded). Pipelined requests that arrived in the same read are all answered
+ *      in order, until the queued output reaches OUTPUT_HIGH_WATERMARK or a response streams or is proxied; the rest
+ *      wait in the buffer. A request for an offload endpoint is handed to the handler pool instead
+ *      (`offload_request`), and the requests behind it wait until its response is queued (`finish_handler_jobs`).
+ *      Count the request by method and status, record the time from its head (or the read that completed its
+ *      body) to the queued response, log the request, and start the send clock if the queue was empty
+ *      (`complete_request`). One clock reading serves as the end of one interval and the start of the next,
+ *      so a request costs three readings here.
+ * 4. Reset the parser so any bytes left over are parsed as the start of the next request (`reset_request`);
+ *      a proxied request is reset the same way once its response is through (`end_proxy`).
+ * 5. Stop at the first request that closes the connection; anything pipelined after it is ignored.
+ * 6. A parse error queues an error response (400 unless the parser chose another status)
+ *      and closes the connection after it is sent.
+ */
+void process_input(Connection *conn)
+{
+    ParseState state = PARSE_HEADERS;
+    uint64_t now = metrics_now_ns();
+    while (!conn->closing && !conn->producer && !conn->proxy && !conn->job && conn->out_bytes < OUTPUT_HIGH_WATERMARK)
+    {
+        // {ref}{LOGIC}{PROCESS_INPUT}{1}
+        ParseState previous = conn->state;
+        state = parse_request(conn);
+        if (previous == PARSE_HEADERS)
+        {
+            uint64_t parsed = metrics_now_ns();
+            conn->parse_ns += parsed - now;
+            now = parsed;
+        }
+        if (state == PARSE_HEAD_DONE)
+        {
+            // {ref}{LOGIC}{PROCESS_INPUT}{2}
+            metrics_record(&metrics->histograms[METRICS_PARSE], conn->parse_ns);
+            conn->parse_ns = 0;
+            if (rate_limit_request(&rate_limiter, conn->peer_addr, now) == -1)
+            {
+                shed_request(conn, now, 429);
+                break;
+            }
+            if (admission_begin(&admission) == -1)
+            {
+                shed_request(conn, now, 503);
+                break;
+            }
+            conn->admitted_ns = now;
+            conn->state = PARSE_BODY;
+            prepare_request(conn);
+            continue;
+        }
+        if (state != PARSE_DONE)
+        {
+            break;
+        }
+
+        // {ref}{LOGIC}{PROCESS_INPUT}{3}
+        const Endpoint *endpoint = conn->request.match.value;
+        if (conn->request.route == ROUTE_FOUND && endpoint->offload && offload_request(conn, now) == 0)
+        {
+            break;
+        }
+        size_t queued = conn->out_bytes;
+        int status_code = dispatch_request(conn, &conn->request);
+
+        // {ref}{LOGIC}{PROCESS_INPUT}{4,5}
+        now = complete_request(conn, status_code, queued, now);
+    }
+
+    // {ref}{LOGIC}{PROCESS_INPUT}{6}
+    if (state == PARSE_ERROR)
+    {
+        if (conn->error_status == 501)
+        {
+            send_error_response(conn, 501, "Not Implemented");
+        }
+        else if (conn->error_status == 500)
+        {
+            send_error_response(conn, 500, "Internal Server Error");
+        }
+        else if (conn->error_status == 411)
+        {
+            send_error_response(conn, 411, "Length Required");
+        }
+        else
+        {
+            send_error_response(conn, 400, "Bad Request");
+        }
+    }
+}
+
+/**
+ * @brief Makes room for at least one more byte (plus the terminating NUL) in the receive buffer.
+ * @return 0 on success, -1 if the buffered request would exceed MAX_REQUEST_SIZE.
+ */
+int reserve_input(Connection *conn)
+{
+    if (conn->in_len + 1 < conn->in_cap)
+    {
+        return 0;
+    }
+    if (conn->in_cap >= MAX_REQUEST_SIZE)
+    {
+        return -1;
+    }
+    size_t new_cap = conn->in_cap * 2;
+    char *grown = realloc(conn->in_buf, new_cap);
+    if (!grown)
+    {
+        return -1;
+    }
+    conn->in_buf = grown;
+    conn->in_cap = new_cap;
+    return 0;
+}
+
+/**
+ * @brief Moves the TLS handshake of a connection along.
+ * @param epoll_fd The file descriptor for the epoll instance.
+ * @param conn A connection whose handshake is not done yet.
+ * @details [LOGIC][TLS_HANDSHAKE]
+ * 1. Run the handshake as far as the socket allows. Until it is done, the connection waits for whichever of
+ *      readability or writability it needs next (`update_connection`); the request timeout bounds it.
+ * 2. Once done, find out whether OpenSSL handed the transmit keys to the kernel (kTLS). Then responses are
+ *      written as on a plain connection, with `sendmsg` and `sendfile`, and the kernel encrypts them.
+ * 3. A failed handshake closes the connection.
+ * @return 0 once the handshake is done, 1 while it goes on, -1 if the connection was closed.
+ */
+int continue_tls_handshake(int epoll_fd, Connection *conn)
+{
+    // {ref}{LOGIC}{TLS_HANDSHAKE}{1}
+    conn->tls_state = tls_handshake(conn->tls);
+    if (conn->tls_state == TLS_HANDSHAKE_WANT_READ || conn->tls_state == TLS_HANDSHAKE_WANT_WRITE)
+    {
+        return update_connection(epoll_fd, conn) == -1 ? -1 : 1;
+    }
+    // {ref}{LOGIC}{TLS_HANDSHAKE}{3}
+    if (conn->tls_state == TLS_HANDSHAKE_FAILED)
+    {
+        log_connection(conn, ACCESS_LOG_CLOSE, "TLS handshake failed");
+        close_connection(epoll_fd, conn);
+        return -1;
+    }
+    // {ref}{LOGIC}{TLS_HANDSHAKE}{2}
+    conn->ktls_send = tls_kernel_send(conn->tls);
+    metrics_add(&metrics->tls_handshakes, 1);
+    if (conn->ktls_send)
+    {
+        metrics_add(&metrics->tls_kernel_send, 1);
+    }
+    return 0;
+}
+
+/**
+ * @brief Handles reading data from a client socket and processing the HTTP request.
+ * @param epoll_fd The file descriptor for the epoll instance to manage client connections.
+ * @param conn The connection that became readable.
+ * @details [LOGIC][HANDLE_READ_OPERATION]
+ * 1. A TLS connection first completes its handshake (`continue_tls_handshake`); requests are only read after it.
+ * 2. The socket is registered edge-triggered, so epoll will not report it again until new data arrives:
+ *      keep reading until `read` fails with EAGAIN, otherwise the tail of a burst would be lost. A TLS
+ *      connection reads with `SSL_read`, which also drains the records OpenSSL has buffered.
+ * 3. Serve the requests already buffered; `process_input` resumes parsing where the previous read stopped.
+ * 4. If the output queue reached OUTPUT_HIGH_WATERMARK, try to flush it. If it is still above the mark,
+ *      pause reading: the socket has not been drained, and `handle_write_operation` calls us again
+ *      once the client has caught up. Reading is paused as well while a response streams, a request is
+ *      proxied or its handler runs on the handler pool, until it ends.
+ * 5. Make sure the receive buffer has room; grow it, and reject the request with 431 once its head
+ *      reaches MAX_REQUEST_SIZE. Bodies never accumulate in the buffer, so they are not limited by it.
+ * 6. Append the received bytes to the connection's buffer, NUL-terminate it and count them.
+ * 7. If no bytes are read, the client has disconnected: close once any queued output is sent.
+ * 8. Flush the responses and update the epoll registration with `update_connection`.
+ */
+void handle_read_operation(int epoll_fd, Connection *conn)
+{
+    int drained = 0;
+    // {ref}{LOGIC}{HANDLE_READ_OPERATION}{1}
+    if (conn->tls_state != TLS_HANDSHAKE_DONE && continue_tls_handshake(epoll_fd, conn) != 0)
+    {
+        return;
+    }
+    // {ref}{LOGIC}{HANDLE_READ_OPERATION}{2}
+    while (!drained && !conn->closing)
+    {
+        // {ref}{LOGIC}{HANDLE_READ_OPERATION}{3}
+        process_input(conn);
+
+        // {ref}{LOGIC}{HANDLE_READ_OPERATION}{4}
+        if (conn->producer || conn->proxy || conn->job)
+        {
+            conn->read_paused = 1;
+            break;
+        }
+        if (conn->out_bytes >= OUTPUT_HIGH_WATERMARK)
+        {
+            if (flush_output(conn) == -1)
+            {
+                close_connection(epoll_fd, conn);
+                return;
+            }
+            if (conn->out_bytes >= OUTPUT_HIGH_WATERMARK)
+            {
+                conn->read_paused = 1;
+                break;
+            }
+            continue;
+        }
+
+        // {ref}{LOGIC}{HANDLE_READ_OPERATION}{5}
+        if (reserve_input(conn) == -1)
+        {
+            send_error_response(conn, 431, "Request Header Fields Too Large");
+            break;
+        }
+
+        ssize_t bytes_read = conn->tls ? tls_read(conn->tls, conn->in_buf + conn->in_len, conn->in_cap - conn->in_len - 1)
+                                       : read(conn->fd, conn->in_buf + conn->in_len, conn->in_cap - conn->in_len - 1);
+        if (bytes_read > 0)
+        {
+            // {ref}{LOGIC}{HANDLE_READ_OPERATION}{6}
+            metrics_add(&metrics->bytes_in, bytes_read);
+            conn->in_len += bytes_read;
+            conn->in_buf[conn->in_len] = '\0';
+        }
+        else if (bytes_read == 0)
+        {
+            // {ref}{LOGIC}{HANDLE_READ_OPERATION}{7}
+            log_connection(conn, ACCESS_LOG_CLOSE, "client disconnected");
+            conn->closing = 1;
+        }
+        else if (errno == EINTR)
+        {
+            continue;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            // Socket drained, wait for the next edge
+            drained = 1;
+        }
+        else
+        {
+            perror(conn->tls ? "SSL_read" : "read");
+            close_connection(epoll_fd, conn);
+            return;
+        }
+    }
+    // {ref}{LOGIC}{HANDLE_READ_OPERATION}{8}
+    update_connection(epoll_fd, conn);
+}
+
+/**
+ * @brief Handles a client socket that became writable while output was queued.
+ * @param epoll_fd The file descriptor for the epoll instance to manage client connections.
+ * @param conn The connection that reported EPOLLOUT.
+ * @details [LOGIC][HANDLE_WRITE_OPERATION]
+ * 1. Flush as much of the output queue as the kernel now accepts. A TLS handshake that waited for the socket to
+ *      become writable continues in `handle_read_operation` instead.
+ * 2. If reading was paused, no response is streaming, proxied or being handled on the handler pool and the
+ *      queue fell under OUTPUT_LOW_WATERMARK,
+ *      resume: serve the requests held back in the receive buffer and drain the socket again.
+ * 3. Otherwise `update_connection` drops EPOLLOUT once the queue is empty and closes a finished connection.
+ */
+void handle_write_operation(int epoll_fd, Connection *conn)
+{
+    // {ref}{LOGIC}{HANDLE_WRITE_OPERATION}{1}
+    if (conn->tls_state != TLS_HANDSHAKE_DONE)
+    {
+        handle_read_operation(epoll_fd, conn);
+        return;
+    }
+    if (flush_output(conn) == -1)
+    {
+        close_connection(epoll_fd, conn);
+        return;
+    }
+    // {ref}{LOGIC}{HANDLE_WRITE_OPERATION}{2}
+    if (conn->read_paused && !conn->producer && !conn->proxy && !conn->job && conn->out_bytes < OUTPUT_LOW_WATERMARK)
+    {
+        conn->read_paused = 0;
+        handle_read_operation(epoll_fd, conn);
+        return;
+    }
+    // {ref}{LOGIC}{HANDLE_WRITE_OPERATION}{3}
+    update_connection(epoll_fd, conn);
+}
+
+/**
+ * @brief io_uring counterpart of `handle_read_operation`: serves the requests in data a recv completed with.
+ * @param conn The connection the data arrived on.
+ * @param data The received bytes, NULL to only serve what is already buffered.
+ * @param len Number of received bytes.
+ * @details [LOGIC][RECEIVE_INPUT]
+ * 1. Append the data to the receive buffer, growing it as needed: the data has already left the socket.
+ * 2. Serve the buffered requests with `process_input`.
+ * 3. Pause reading while a response streams, a handler job runs or the queued output is at OUTPUT_HIGH_WATERMARK;
+ *      `update_connection` then cancels the recv.
+ * 4. Reject a request head that reached MAX_REQUEST_SIZE with 431.
+ */
+void receive_input(Connection *conn, const char *data, size_t len)
+{
+    if (conn->closing)
+    {
+        return;
+    }
+
+    // {ref}{LOGIC}{RECEIVE_INPUT}{1}
+    if (conn->in_len + len + 1 > conn->in_cap)
+    {
+        size_t new_cap = conn->in_cap * 2;
+        while (new_cap < conn->in_len + len + 1)
+        {
+            new_cap *= 2;
+        }
+        char *grown = realloc(conn->in_buf, new_cap);
+        if (!grown)
+        {
+            send_error_response(conn, 500, "Internal Server Error");
+            return;
+        }
+        conn->in_buf = grown;
+        conn->in_cap = new_cap;
+    }
+    if (len)
+    {
+        metrics_add(&metrics->bytes_in, len);
+        memcpy(conn->in_buf + conn->in_len, data, len);
+        conn->in_len += len;
+        conn->in_buf[conn->in_len] = '\0';
+    }
+
+    // {ref}{LOGIC}{RECEIVE_INPUT}{2}
+    process_input(conn);
+
+    // {ref}{LOGIC}{RECEIVE_INPUT}{3}
+    if (conn->producer || conn->job || conn->out_bytes >= OUTPUT_HIGH_WATERMARK)
+    {
+        conn->read_paused = 1;
+    }
+    // {ref}{LOGIC}{RECEIVE_INPUT}{4}
+    else if (!conn->closing && conn->state == PARSE_HEADERS && conn->in_len >= MAX_REQUEST_SIZE)
+    {
+        send_error_response(conn, 431, "Request Header Fields Too Large");
+    }
+}
+
+/**
+ * @brief io_uring counterpart of `handle_write_operation`, run when the connection's sends or its poll completed.
+ * @details [LOGIC][RESUME_CONNECTION]
+ * 1. If reading was paused, no response is streaming, no handler job runs and the queue fell under
+ *      OUTPUT_LOW_WATERMARK, serve the requests held back in the receive buffer.
+ * 2. `update_connection` continues with the rest of the queue and re-arms the recv.
+ */
+void resume_connection(Connection *conn)
+{
+    // {ref}{LOGIC}{RESUME_CONNECTION}{1}
+    if (conn->read_paused && !conn->producer && !conn->job && conn->out_bytes < OUTPUT_LOW_WATERMARK)
     {
-        len += snprintf(buffer + len, BUFFER_SIZE - len, "%s", response->body);
+        conn->read_paused = 0;
+        receive_input(conn, NULL, 0);
     }
+    // {ref}{LOGIC}{RESUME_CONNECTION}{2}
+    update_connection(-1, conn);
+}
+
+/**
+ * @brief Queues the responses of the handler jobs the pool finished; run when the completion eventfd is readable.
+ * @param epoll_fd The worker's epoll instance, -1 on io_uring.
+ * @details [LOGIC][FINISH_HANDLER_JOBS]
+ * 1. Take all finished jobs at once (`offload_queue_drain`). A job lives in its connection's arena, so
+ *      its successor is looked up before the arena can be reset.
+ * 2. If the connection was closed while the handler ran, release what `close_connection` left behind.
+ * 3. Otherwise queue the response like `dispatch_request` does, account for the request, and continue the
+ *      connection like after a write: send the response, then serve the requests that waited behind it.
+ */
+void finish_handler_jobs(int epoll_fd)
+{
+    // {ref}{LOGIC}{FINISH_HANDLER_JOBS}{1}
+    OffloadJob *next = offload_queue_drain(&handler_completions);
+    while (next)
+    {
+        HandlerJob *job = (HandlerJob *)next;
+        next = next->next;
+        Connection *conn = job->conn;
+        char *request_buf = job->request_buf;
+        conn->job = NULL;
+
+        // {ref}{LOGIC}{FINISH_HANDLER_JOBS}{2}
+        if (conn->closed)
+        {
+            arena_destroy(&conn->arena);
+            free(request_buf);
+            if (conn->uring_ops == 0)
+            {
+                release_connection(conn);
+            }
+            continue;
+        }
+
+        // {ref}{LOGIC}{FINISH_HANDLER_JOBS}{3}
+        size_t queued = conn->out_bytes;
+        int status_code = queue_handled_response(conn, &conn->request, &job->response);
+        complete_request(conn, status_code, queued, job->started_ns);
+        free(request_buf);
+        if (uring)
+        {
+            resume_connection(conn);
+        }
+        else
+        {
+            handle_write_operation(epoll_fd, conn);
+        }
+    }
+}
 
-    send(client_fd, buffer, len, 0);
+/**
+ * @brief Accepts a connection that the multishot accept completed with.
+ * @param client_fd The new, already non-blocking socket.
+ * @details Same as `handle_new_connection`, except that reading starts with a multishot recv.
+ */
+void accept_uring_connection(int client_fd)
+{
+    struct sockaddr_in client_addr = {0};
+    socklen_t client_addr_len = sizeof(client_addr);
+    getpeername(client_fd, (struct sockaddr *)&client_addr, &client_addr_len);
+    if (rate_limit_connection(&rate_limiter, client_addr.sin_addr.s_addr, metrics_now_ns()) == -1)
+    {
+        shed_connection(client_fd, 429);
+        return;
+    }
+    if (admission_open(&admission) == -1)
+    {
+        shed_connection(client_fd, 503);
+        return;
+    }
+    Connection *conn = create_connection(client_fd);
+    if (!conn)
+    {
+        perror("create_connection");
+        admission_close(&admission);
+        close(client_fd);
+        return;
+    }
+    timer_init(&conn->read_timer, on_connection_timeout, conn);
+    timer_init(&conn->write_timer, on_connection_timeout, conn);
+    conn->read_timeout = READ_TIMEOUT_REQUEST;
+    timer_wheel_schedule(&timers, &conn->read_timer, REQUEST_TIMEOUT_MS);
+    metrics_add(&metrics->connections_accepted, 1);
+    conn->peer_addr = client_addr.sin_addr.s_addr;
+    conn->peer_port = client_addr.sin_port;
+    log_connection(conn, ACCESS_LOG_ACCEPT, NULL);
+    update_connection(-1, conn);
 }
 
 /**
- * @brief Handles reading data from a client socket and processing the HTTP request.
- * @param epoll_fd The file descriptor for the epoll instance to manage client connections.
- * @param client_fd The file descriptor for the client socket connection.
- * @details [LOGIC][HANDLE_READ_OPERATION]
- * 1. Read incoming data from the client into a buffer using the `read` system call.
- * 2. If no bytes are read, assume the client has disconnected and remove the client from the epoll instance.
- * 3. If data is read, print the received request and ensure the buffer is null-terminated.
- * 4. Parse the HTTP request from the received data using `parse_request`.
- * 5. Determine the HTTP method and call the appropriate handler (`handle_get_request` for GET, `handle_post_request` for POST).
- * 6. If the method is unsupported, set the response to status 405 (Method Not Allowed).
- * 7. Send the constructed HTTP response back to the client using `send_response`.
+ * @brief Handles one io_uring completion of a connection.
+ * @param conn The connection the operation belongs to.
+ * @param op The kind of operation.
+ * @param res Its result: bytes transferred, or a negative errno.
+ * @param flags The completion flags (more completions to come, provided buffer id).
+ * @details [LOGIC][URING_COMPLETION]
+ * 1. Account for the operation; a multishot recv has ended once a completion comes without IORING_CQE_F_MORE.
+ * 2. Received data is served with `receive_input`, and its buffer goes straight back to the kernel.
+ * 3. A closed connection only waits for its last operation (and handler job), then is released.
+ * 4. A recv completing with 0 means the client disconnected; ENOBUFS (no free buffer) and ECANCELED
+ *      (reading paused) just end the recv, which `update_connection` re-arms when reading is allowed.
+ * 5. A send drops its bytes from the output queue and restarts the write-stall timer. Once the whole chain
+ *      completed, the connection continues; a failed send closes it. Operations after a short send are
+ *      cancelled by the kernel, and their segments are simply sent again.
+ * 6. A poll means a file segment can continue.
  */
-void handle_read_operation(int epoll_fd, int client_fd)
+void handle_uring_completion(Connection *conn, UringOp op, int res, unsigned flags)
 {
-    char buffer[BUFFER_SIZE] = {0};
-    int bytes_read = read(client_fd, buffer, BUFFER_SIZE);
-    if (bytes_read == 0)
+    // {ref}{LOGIC}{URING_COMPLETION}{1}
+    if (op == URING_OP_RECV && !(flags & IORING_CQE_F_MORE))
     {
-        // Client disconnected
-        printf("Client disconnected\n");
-        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_fd, NULL);
+        conn->recv_armed = 0;
+        conn->recv_cancelling = 0;
+        conn->uring_ops--;
     }
-    else if (bytes_read > 0)
+    else if (op == URING_OP_SEND)
     {
-        printf("Received from client: %s\n", buffer);
-        buffer[bytes_read] = '\0';
+        conn->sends--;
+        conn->uring_ops--;
+    }
+    else if (op == URING_OP_POLL)
+    {
+        conn->poll_armed = 0;
+        conn->uring_ops--;
+    }
 
-        HttpRequest request;
-        HttpResponse response = {0};
+    // {ref}{LOGIC}{URING_COMPLETION}{2}
+    if (op == URING_OP_RECV && (flags & IORING_CQE_F_BUFFER))
+    {
+        unsigned id = flags >> IORING_CQE_BUFFER_SHIFT;
+        if (res > 0 && !conn->closed)
+        {
+            receive_input(conn, uring_buffer(uring, id), res);
+        }
+        uring_recycle_buffer(uring, id);
+    }
 
-        parse_request(buffer, &request);
+    // {ref}{LOGIC}{URING_COMPLETION}{3}
+    if (conn->closed)
+    {
+        if (conn->uring_ops == 0 && !conn->job)
+        {
+            release_connection(conn);
+        }
+        return;
+    }
 
-        if (strcmp(request.method, "GET") == 0)
+    if (op == URING_OP_RECV)
+    {
+        // {ref}{LOGIC}{URING_COMPLETION}{4}
+        if (res == 0)
         {
-            handle_get_request(&request, &response);
+            log_connection(conn, ACCESS_LOG_CLOSE, "client disconnected");
+            conn->closing = 1;
         }
-        else if (strcmp(request.method, "POST") == 0)
+        else if (res < 0 && res != -ENOBUFS && res != -ECANCELED)
         {
-            handle_post_request(&request, &response);
+            fprintf(stderr, "recv: %s\n", strerror(-res));
+            close_connection(-1, conn);
+            return;
         }
-        else
+        update_connection(-1, conn);
+    }
+    else if (op == URING_OP_SEND)
+    {
+        // {ref}{LOGIC}{URING_COMPLETION}{5}
+        if (res > 0)
+        {
+            metrics_add(&metrics->bytes_out, res);
+            consume_output(conn, res);
+            timer_wheel_schedule(&timers, &conn->write_timer, WRITE_STALL_TIMEOUT_MS);
+        }
+        else if (res < 0 && res != -ECANCELED)
+        {
+            fprintf(stderr, "sendmsg: %s\n", strerror(-res));
+            conn->send_failed = 1;
+        }
+        if (conn->sends > 0)
+        {
+            return;
+        }
+        if (conn->send_failed)
         {
-            response.status_code = 405;
-            response.status_text = "Method Not Allowed";
-            add_response_header(&response, "Content-Type", "text/plain");
-            response.body = "Unsupported method";
+            close_connection(-1, conn);
+            return;
         }
-        send_response(client_fd, &response);
+        resume_connection(conn);
+    }
+    else if (op == URING_OP_POLL)
+    {
+        // {ref}{LOGIC}{URING_COMPLETION}{6}
+        resume_connection(conn);
     }
 }
 
 /**
- * @brief The entry point of the server application that sets up socket communication, initializes epoll, and handles client connections.
- * @details [LOGIC][MAIN]
+ * @brief Creates one listening socket of the SO_REUSEPORT group shared by the workers.
+ * @param cpu CPU the owning worker is pinned to, or -1.
+ * @details [LOGIC][LISTEN_SOCKET]
  * 1. Create a non-blocking server socket for handling incoming client connections.
- * 2. Configure the socket address (IPv4, any incoming address, and specified port) and bind it to the server socket.
- * 3. Start listening for incoming connections with a backlog defined by `SOMAXCONN`.
- * 4. Create and initialize an epoll instance to monitor events on the server socket and client connections.
- * 5. Enter an event loop that waits for events using `epoll_wait` with a 1000ms timeout.
- *    - If the event corresponds to the server socket, handle new incoming connections.
- *    - If the event corresponds to an existing client connection and it is ready for reading (`EPOLLIN`), handle the read operation.
- * 6. On server shutdown, close both the server and epoll file descriptors.
- * @return Returns 0 on normal termination, or exits with failure status if errors occur.
+ * 2. Set SO_REUSEPORT so every worker can bind its own socket to the same port; the kernel then
+ *      spreads incoming connections over the group instead of waking every worker for each one.
+ * 3. For a pinned worker, set SO_INCOMING_CPU so the socket is preferred for connections whose
+ *      packets are processed on that CPU.
+ * 4. Configure the socket address (IPv4, any incoming address, and specified port) and bind it to the server socket.
+ * 5. Start listening for incoming connections with a backlog defined by `SOMAXCONN`.
+ * @return The listening socket. Exits the program on failure.
  */
-int main()
+int create_listen_socket(int cpu)
 {
-    int server_fd, epoll_fd, event_count;
-    struct epoll_event ev, events[MAX_CLIENTS];
-    struct sockaddr_in server_addr;
-    // {ref}{LOGIC}{MAIN}{1}
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    struct sockaddr_in server_addr = {0};
+
+    // {ref}{LOGIC}{LISTEN_SOCKET}{1}
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd == -1)
     {
         perror("socket");
@@ -427,7 +4859,21 @@ int main()
         exit(EXIT_FAILURE);
     }
 
-    // {ref}{LOGIC}{MAIN}{2}
+    // {ref}{LOGIC}{LISTEN_SOCKET}{2}
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == -1 ||
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == -1)
+    {
+        perror("setsockopt: SO_REUSEPORT");
+        exit(EXIT_FAILURE);
+    }
+
+    // {ref}{LOGIC}{LISTEN_SOCKET}{3}
+    if (cpu >= 0 && setsockopt(server_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) == -1)
+    {
+        perror("setsockopt: SO_INCOMING_CPU");
+    }
+
+    // {ref}{LOGIC}{LISTEN_SOCKET}{4}
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = INADDR_ANY;
     server_addr.sin_port = htons(PORT);
@@ -437,48 +4883,574 @@ int main()
         exit(EXIT_FAILURE);
     }
 
-    // {ref}{LOGIC}{MAIN}{3}
+    // {ref}{LOGIC}{LISTEN_SOCKET}{5}
     if (listen(server_fd, SOMAXCONN) == -1)
     {
         perror("listen");
         exit(EXIT_FAILURE);
     }
+    return server_fd;
+}
 
-    // {ref}{LOGIC}{MAIN}{4}
-    create_epoll(&epoll_fd, server_fd, &ev);
+/**
+ * @brief Steers every connection of one client address to the same listening socket, so a single worker
+ *      sees all connections and requests of a client and its rate limits hold for the client as a whole.
+ * @details The classic BPF program loads the IPv4 source address from the network header, mixes it with a
+ *      multiplicative hash (the rate limiter's, so addresses that differ only in their low bits spread out)
+ *      and returns it modulo the group size, as the index into the group.
+ * @param socket_count Number of listening sockets in the group, one per worker.
+ * @return 0 on success, -1 if the kernel refused the program.
+ */
+int attach_address_steering(int server_fd, int socket_count)
+{
+    struct sock_filter code[] = {
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_NET_OFF + 12},
+        {BPF_ALU | BPF_MUL | BPF_K, 0, 0, 0x9E3779B1u},
+        {BPF_ALU | BPF_RSH | BPF_K, 0, 0, 16},
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)socket_count},
+        {BPF_RET | BPF_A, 0, 0, 0},
+    };
+    struct sock_fprog program = {.len = sizeof(code) / sizeof(code[0]), .filter = code};
+    if (setsockopt(server_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) == -1)
+    {
+        perror("setsockopt: SO_ATTACH_REUSEPORT_CBPF");
+        return -1;
+    }
+    return 0;
+}
 
-    // {ref}{LOGIC}{MAIN}{5}
+/**
+ * @brief Steers each new connection to the listening socket of the worker pinned to the CPU
+ *      that received it, so a connection is accepted and served on the core its packets arrive on.
+ * @attention Only valid when worker i is pinned to CPU i and the group has one socket per CPU:
+ *      the classic BPF program returns the current CPU number as the index into the group.
+ */
+void attach_cpu_steering(int server_fd)
+{
+    struct sock_filter code[] = {
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU},
+        {BPF_RET | BPF_A, 0, 0, 0},
+    };
+    struct sock_fprog program = {.len = sizeof(code) / sizeof(code[0]), .filter = code};
+    if (setsockopt(server_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) == -1)
+    {
+        perror("setsockopt: SO_ATTACH_REUSEPORT_CBPF");
+    }
+}
+
+/**
+ * @brief Event loop of a worker running on io_uring (-u); takes the place of the epoll loop in `worker_main`.
+ * @param worker The worker; its epoll_fd stays -1.
+ * @details [LOGIC][URING_LOOP]
+ * 1. Create the worker's ring and register its provided receive buffers.
+ * 2. Arm one multishot accept on the listening socket: it completes once for every new connection. Arm a
+ *      poll on the eventfd of the handler job completions; it is one-shot, and re-armed once it fired.
+ * 3. Submit everything the previous pass prepared and wait for completions with one io_uring_enter(),
+ *      sleeping at most until the next timer is due, then run the timers that expired.
+ * 4. Dispatch each completion by the operation kind in its user_data. The accept is re-armed if the kernel
+ *      ended it; a failed accept is logged and the loop goes on. Finished handler jobs get their responses
+ *      queued (`finish_handler_jobs`).
+ */
+void uring_event_loop(Worker *worker)
+{
+    Uring ring;
+
+    // {ref}{LOGIC}{URING_LOOP}{1}
+    if (uring_init(&ring, URING_ENTRIES) == -1)
+    {
+        perror("io_uring_setup");
+        exit(EXIT_FAILURE);
+    }
+    if (uring_setup_buffers(&ring, URING_BUFFER_COUNT, URING_BUFFER_SIZE) == -1)
+    {
+        perror("io_uring_register: IORING_REGISTER_PBUF_RING");
+        exit(EXIT_FAILURE);
+    }
+    uring = &ring;
+    worker->epoll_fd = -1;
+
+    int accept_armed = 0;
+    int offload_armed = 0;
+    while (1)
+    {
+        // {ref}{LOGIC}{URING_LOOP}{2}
+        struct io_uring_sqe *sqe = accept_armed ? NULL : uring_get_sqe(uring);
+        if (sqe)
+        {
+            uring_prep_accept_multishot(sqe, worker->server_fd);
+            sqe->user_data = URING_OP_ACCEPT;
+            accept_armed = 1;
+        }
+        sqe = offload_armed ? NULL : uring_get_sqe(uring);
+        if (sqe)
+        {
+            uring_prep_poll(sqe, handler_completions.event_fd, POLLIN);
+            sqe->user_data = URING_OP_OFFLOAD;
+            offload_armed = 1;
+        }
+
+        // {ref}{LOGIC}{URING_LOOP}{3}
+        if (uring_submit_and_wait(uring, timer_wheel_next_timeout(&timers)) == -1)
+        {
+            perror("io_uring_enter");
+            exit(EXIT_FAILURE);
+        }
+        timer_wheel_advance(&timers, timer_now_ms(), &worker->epoll_fd);
+
+        // {ref}{LOGIC}{URING_LOOP}{4}
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(uring)))
+        {
+            unsigned long long user_data = cqe->user_data;
+            int res = cqe->res;
+            unsigned flags = cqe->flags;
+            uring_cqe_seen(uring);
+
+            UringOp op = user_data & URING_OP_MASK;
+            if (op == URING_OP_ACCEPT)
+            {
+                accept_armed = (flags & IORING_CQE_F_MORE) != 0;
+                if (res >= 0)
+                {
+                    accept_uring_connection(res);
+                }
+                else
+                {
+                    fprintf(stderr, "accept: %s\n", strerror(-res));
+                }
+            }
+            else if (op == URING_OP_OFFLOAD)
+            {
+                offload_armed = 0;
+                finish_handler_jobs(-1);
+            }
+            else if (op != URING_OP_CANCEL)
+            {
+                handle_uring_completion((Connection *)(uintptr_t)(user_data & ~(unsigned long long)URING_OP_MASK),
+                                        op, res, flags);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Event loop of one worker thread.
+ * @param arg The Worker this thread runs.
+ * @details [LOGIC][WORKER]
+ * 1. Pin the thread to its CPU when CPU pinning was requested.
+ * 2. Set up the worker's own open-file cache, timer wheel, handler job completion queue and admission
+ *      control, and find its metrics block; the connection table grows on demand. With an adaptive request
+ *      limit, start its periodic adjustment. With upstream groups, set up the worker's pools and start their
+ *      periodic check.
+ * 3. Create and initialize an epoll instance to monitor events on the worker's server socket, its handler job
+ *      completions and client connections, or hand over to `uring_event_loop` when the workers run on io_uring.
+ * 4. Enter an event loop that waits for events using `epoll_wait`, sleeping at most until the next timer is due.
+ *    - Run the timers that expired, closing the connections that missed a deadline.
+ *    - If the event corresponds to the server socket, handle new incoming connections.
+ *    - If the event corresponds to the completion eventfd, queue the responses of the finished handler jobs.
+ *    - If the event corresponds to an upstream link in use, move the proxied request along (`update_connection`).
+ *      Pooled links stay registered; their events find no exchange and are ignored.
+ *    - If the event corresponds to an existing client connection, look up its Connection state;
+ *      flush queued output if it is writable (`EPOLLOUT`) and handle the read operation if it is readable (`EPOLLIN`).
+ * 5. On shutdown, drop the upstream pools and the file cache and close both the server and epoll file descriptors.
+ */
+void *worker_main(void *arg)
+{
+    Worker *worker = arg;
+    struct epoll_event ev, events[MAX_EVENTS];
+    int event_count;
+
+    // {ref}{LOGIC}{WORKER}{1}
+    if (worker->cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(worker->cpu, &cpus);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (err)
+        {
+            fprintf(stderr, "worker %d: pthread_setaffinity_np: %s\n", worker->id, strerror(err));
+        }
+    }
+
+    // {ref}{LOGIC}{WORKER}{2}
+    if (file_cache_init(&file_cache, FILE_CACHE_CAPACITY) == -1)
+    {
+        perror("file_cache_init");
+        exit(EXIT_FAILURE);
+    }
+    timer_wheel_init(&timers, TIMER_TICK_MS);
+    if (offload_queue_init(&handler_completions) == -1)
+    {
+        perror("eventfd");
+        exit(EXIT_FAILURE);
+    }
+    metrics = &worker_metrics[worker->id];
+    log_ring = &access_log.rings[worker->id];
+    admission_init(&admission, worker_max_connections, worker_max_in_flight, admission_target_ns);
+    if (rate_limiter_init(&rate_limiter, worker_connection_rate, worker_request_rate) == -1)
+    {
+        perror("rate_limiter_init");
+        exit(EXIT_FAILURE);
+    }
+    if (admission_target_ns)
+    {
+        timer_init(&admission_timer, on_admission_adapt, NULL);
+        timer_wheel_schedule(&timers, &admission_timer, ADMISSION_INTERVAL_MS);
+    }
+    if (upstream_group_count > 0)
+    {
+        upstream_pools = calloc(upstream_group_count, sizeof(UpstreamPool));
+        if (!upstream_pools)
+        {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < upstream_group_count; i++)
+        {
+            upstream_pool_init(&upstream_pools[i], &upstream_groups[i]);
+        }
+        timer_init(&upstream_check_timer, on_upstream_check, NULL);
+        timer_wheel_schedule(&timers, &upstream_check_timer, UPSTREAM_CHECK_INTERVAL_MS);
+    }
+
+    // {ref}{LOGIC}{WORKER}{3}
+    if (use_io_uring)
+    {
+        uring_event_loop(worker);
+    }
+    create_epoll(&worker->epoll_fd, worker->server_fd, &ev);
+    ev.events = EPOLLIN;
+    ev.data.fd = handler_completions.event_fd;
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, handler_completions.event_fd, &ev) == -1)
+    {
+        perror("epoll_ctl: eventfd");
+        exit(EXIT_FAILURE);
+    }
+
+    // {ref}{LOGIC}{WORKER}{4}
     while (1)
     {
-        // Wait for events on monitored file descriptors with a timeout of 1000ms
-        event_count = epoll_wait(epoll_fd, events, MAX_CLIENTS, 1000);
+        // Wait for events on monitored file descriptors until the next timer is due
+        event_count = epoll_wait(worker->epoll_fd, events, MAX_EVENTS, timer_wheel_next_timeout(&timers));
 
         if (event_count == -1)
         {
+            if (errno == EINTR)
+            {
+                continue;
+            }
             perror("epoll_wait");
             exit(EXIT_FAILURE);
         }
+        timer_wheel_advance(&timers, timer_now_ms(), &worker->epoll_fd);
 
         for (int i = 0; i < event_count; i++)
         {
-            if (events[i].data.fd == server_fd)
+            if (events[i].data.fd == worker->server_fd)
             {
                 // Handle new incoming client connection
-                handle_new_connection(epoll_fd, server_fd, &ev);
+                handle_new_connection(worker->epoll_fd, worker->server_fd, &ev);
             }
-            else
+            else if (events[i].data.fd == handler_completions.event_fd)
+            {
+                // Handler jobs finished on the pool: queue their responses
+                finish_handler_jobs(worker->epoll_fd);
+            }
+            else if (events[i].data.fd < proxies_size && proxies[events[i].data.fd])
+            {
+                // An upstream link became readable or writable: move its request along
+                update_connection(worker->epoll_fd, proxies[events[i].data.fd]->client);
+            }
+            else if (events[i].data.fd < connections_size)
             {
-                if (events[i].events & EPOLLIN)
+                int client_fd = events[i].data.fd;
+                if (connections[client_fd] && (events[i].events & EPOLLOUT))
+                {
+                    // Handle writable client socket (queued output)
+                    handle_write_operation(worker->epoll_fd, connections[client_fd]);
+                }
+                // The write handler may have closed the connection, so look it up again
+                if (connections[client_fd] && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
                 {
                     // Handle readable client socket (incoming data)
-                    handle_read_operation(epoll_fd, events[i].data.fd);
+                    handle_read_operation(worker->epoll_fd, connections[client_fd]);
                 }
             }
         }
     }
 
-    // {ref}{LOGIC}{MAIN}{6}
-    close(server_fd);
-    close(epoll_fd);
+    // {ref}{LOGIC}{WORKER}{5}
+    for (int i = 0; i < upstream_group_count; i++)
+    {
+        upstream_pool_destroy(&upstream_pools[i]);
+    }
+    free(upstream_pools);
+    file_cache_destroy(&file_cache);
+    offload_queue_destroy(&handler_completions);
+    rate_limiter_destroy(&rate_limiter);
+    close(worker->server_fd);
+    close(worker->epoll_fd);
+    return NULL;
+}
+
+/**
+ * @brief The entry point of the server application that parses the command line and starts the workers.
+ * @param argc Number of command-line arguments.
+ * @param argv Usage: http-server [-w workers] [-p] [-l] [-c cache_mb] [-u] [-a access_log] [-P prefix=host:port,...]
+ *      [-o handler_threads] [-m max_connections] [-q max_requests] [-A target_ms] [-R connection_rate]
+ *      [-r request_rate] [-C cert_file] [-K key_file] [document_root]
+ *      -w  number of worker threads (default: one per online CPU)
+ *      -p  pin worker i to CPU i; with one worker per CPU, connections are steered to the CPU receiving them,
+ *          unless -R or -r steer them by client address
+ *      -l  list directories that have no index.html
+ *      -c  size of the response cache in MiB (default RESPONSE_CACHE_SIZE_MB, 0 disables it)
+ *      -u  run the workers on io_uring instead of epoll
+ *      -a  append the access log to this file (default: standard output)
+ *      -P  forward requests below prefix to the listed servers (reverse proxy); may be given PROXY_MAX_GROUPS
+ *          times, not together with -u
+ *      -o  number of handler pool threads running slow handlers (default: one per online CPU)
+ *      -m  connections kept open at most; more are answered 503 and closed (default: no limit)
+ *      -q  requests in flight at most, from a complete head to the queued response; more are answered 503
+ *          (default: no limit)
+ *      -A  adapt the limit of requests in flight to keep their average latency under target_ms (AIMD),
+ *          starting at -q or ADMISSION_ADAPTIVE_MAX per worker
+ *      -R  connections one client address may open per second; more are answered 429 and closed (default: no limit)
+ *      -r  requests one client address may send per second; more are answered 429 (default: no limit)
+ *      -C  serve HTTPS with this PEM certificate chain; the kernel encrypts the records where it supports kTLS.
+ *          Not together with -u or -P
+ *      -K  PEM private key of the certificate (default: the -C file)
+ *      document_root overrides the directory served by GET (default "www").
+ * @details [LOGIC][MAIN]
+ * 1. Parse the options. The connection and request limits are split evenly among the workers, rounded up; a
+ *      worker's share is a fixed cap even when CPU steering (-p) sends it more than its share of clients.
+ *      The rates per client are not split: every worker applies them whole, to the clients steered to it.
+ * 2. Ignore SIGPIPE, so writing to a client that already closed its socket returns EPIPE instead of
+ *      killing the server, pick the widest SIMD instruction set for the request scanner and set up
+ *      the response cache and the routes the workers share, the handler pool, one metrics block per worker, and
+ *      the access log with one ring per worker. With -C, load the certificate and key into the TLS context.
+ * 3. Create every worker's listening socket up front, in worker order, so that a worker's index
+ *      matches its socket's position in the SO_REUSEPORT group.
+ * 4. With a rate per client (-R, -r), attach the address steering program to the group, so each client is
+ *      served by one worker and limited there as a whole; a group has one program, so it takes the place of
+ *      CPU steering. A kernel that refuses it leaves the hash of SO_REUSEPORT, which spreads a client's
+ *      connections, and the rates are split among the workers instead. Otherwise, when there is one pinned
+ *      worker per CPU, attach the CPU steering program.
+ * 5. Start one thread per worker and wait for them.
+ * @return Returns 0 on normal termination, or exits with failure status if errors occur.
+ */
+int main(int argc, char *argv[])
+{
+    int worker_count = get_nprocs();
+    int pin_workers = 0;
+    size_t cache_mb = RESPONSE_CACHE_SIZE_MB;
+    const char *access_log_path = NULL;
+    int handler_threads = get_nprocs();
+    int max_connections = 0;
+    int max_in_flight = 0;
+    unsigned connection_rate = 0;
+    unsigned request_rate = 0;
+    const char *cert_file = NULL;
+    const char *key_file = NULL;
+    int opt;
+
+    // {ref}{LOGIC}{MAIN}{1}
+    while ((opt = getopt(argc, argv, "w:plc:ua:P:o:m:q:A:R:r:C:K:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'w':
+            worker_count = atoi(optarg);
+            break;
+        case 'p':
+            pin_workers = 1;
+            break;
+        case 'l':
+            directory_listings = 1;
+            break;
+        case 'c':
+            cache_mb = strtoul(optarg, NULL, 10);
+            break;
+        case 'u':
+            use_io_uring = 1;
+            break;
+        case 'a':
+            access_log_path = optarg;
+            break;
+        case 'P':
+            if (upstream_group_count == PROXY_MAX_GROUPS)
+            {
+                fprintf(stderr, "at most %d upstream groups\n", PROXY_MAX_GROUPS);
+                exit(EXIT_FAILURE);
+            }
+            if (upstream_group_parse(&upstream_groups[upstream_group_count++], optarg) == -1)
+            {
+                fprintf(stderr, "invalid upstream group: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'o':
+            handler_threads = atoi(optarg);
+            break;
+        case 'm':
+            max_connections = atoi(optarg);
+            break;
+        case 'q':
+            max_in_flight = atoi(optarg);
+            break;
+        case 'A':
+            admission_target_ns = strtoull(optarg, NULL, 10) * 1000000;
+            break;
+        case 'R':
+            connection_rate = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            request_rate = strtoul(optarg, NULL, 10);
+            break;
+        case 'C':
+            cert_file = optarg;
+            break;
+        case 'K':
+            key_file = optarg;
+            break;
+        default:
+            fprintf(stderr,
+                    "Usage: %s [-w workers] [-p] [-l] [-c cache_mb] [-u] [-a access_log] [-P prefix=host:port,...] "
+                    "[-o handler_threads] [-m max_connections] [-q max_requests] [-A target_ms] [-R connection_rate] "
+                    "[-r request_rate] [-C cert_file] [-K key_file] [document_root]\n",
+                    argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (use_io_uring && upstream_group_count > 0)
+    {
+        fprintf(stderr, "-P is not supported with -u\n");
+        exit(EXIT_FAILURE);
+    }
+    if (cert_file && (use_io_uring || upstream_group_count > 0))
+    {
+        fprintf(stderr, "-C is not supported with -u or -P\n");
+        exit(EXIT_FAILURE);
+    }
+    if (optind < argc)
+    {
+        document_root = argv[optind];
+    }
+    if (worker_count < 1)
+    {
+        worker_count = 1;
+    }
+    if (handler_threads < 1)
+    {
+        handler_threads = 1;
+    }
+    if (max_connections > 0)
+    {
+        worker_max_connections = (max_connections + worker_count - 1) / worker_count;
+    }
+    if (max_in_flight > 0)
+    {
+        worker_max_in_flight = (max_in_flight + worker_count - 1) / worker_count;
+    }
+    worker_connection_rate = connection_rate;
+    worker_request_rate = request_rate;
+
+    // {ref}{LOGIC}{MAIN}{2}
+    signal(SIGPIPE, SIG_IGN);
+    http_scan_select_backend();
+    response_cache_init(&response_cache, cache_mb * 1024 * 1024);
+    if (cert_file)
+    {
+        tls_context = tls_context_create(cert_file, key_file ? key_file : cert_file);
+        if (!tls_context)
+        {
+            fprintf(stderr, "cannot load %s\n", cert_file);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (register_routes() == -1)
+    {
+        perror("register_routes");
+        exit(EXIT_FAILURE);
+    }
+    if (offload_pool_init(&handler_pool, handler_threads) == -1)
+    {
+        perror("offload_pool_init");
+        exit(EXIT_FAILURE);
+    }
+    worker_metrics = metrics_create(worker_count);
+    worker_metrics_count = worker_count;
+    if (!worker_metrics)
+    {
+        perror("metrics_create");
+        exit(EXIT_FAILURE);
+    }
+    int log_fd = STDOUT_FILENO;
+    if (access_log_path)
+    {
+        log_fd = open(access_log_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (log_fd == -1)
+        {
+            perror(access_log_path);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (access_log_init(&access_log, worker_count, log_fd) == -1)
+    {
+        perror("access_log_init");
+        exit(EXIT_FAILURE);
+    }
+
+    Worker *workers = calloc(worker_count, sizeof(Worker));
+    if (!workers)
+    {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    // {ref}{LOGIC}{MAIN}{3}
+    int cpu_count = get_nprocs();
+    for (int i = 0; i < worker_count; i++)
+    {
+        workers[i].id = i;
+        workers[i].cpu = pin_workers ? i % cpu_count : -1;
+        workers[i].server_fd = create_listen_socket(workers[i].cpu);
+    }
+
+    // {ref}{LOGIC}{MAIN}{4}
+    if ((connection_rate || request_rate) && worker_count > 1)
+    {
+        if (attach_address_steering(workers[0].server_fd, worker_count) == -1)
+        {
+            fprintf(stderr, "address steering unavailable: the rates per client are split among the workers\n");
+            worker_connection_rate = (connection_rate + worker_count - 1) / worker_count;
+            worker_request_rate = (request_rate + worker_count - 1) / worker_count;
+        }
+    }
+    else if (pin_workers && worker_count == cpu_count)
+    {
+        attach_cpu_steering(workers[0].server_fd);
+    }
+
+    // {ref}{LOGIC}{MAIN}{5}
+    for (int i = 0; i < worker_count; i++)
+    {
+        int err = pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+        if (err)
+        {
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            exit(EXIT_FAILURE);
+        }
+    }
+    printf("Serving %s on port %d with %d worker(s)%s, %s request scanner\n", document_root, PORT,
+           worker_count, pin_workers ? ", pinned to CPUs" : "", http_scan_backend_name());
+    fflush(stdout);
+    for (int i = 0; i < worker_count; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+    }
+    offload_pool_destroy(&handler_pool);
+    access_log_destroy(&access_log);
+    free(workers);
     return 0;
 }
@@ -0,0 +1,227 @@
+/**
+ * @file: metrics.c
+ *
+ * ℹ️ Request metrics of the server, recorded per worker and exposed in the Prometheus text format.
+ *
+ * 1. Every worker owns one cache-line aligned WorkerMetrics block and is the only thread writing it.
+ *      Recording is a plain load and store on memory no other core writes: no lock, no atomic
+ *      read-modify-write, no cache line bouncing between workers.
+ * 2. Requests are counted in an array indexed by method and status code, so counting is O(1).
+ * 3. Latencies go into log-linear histograms: the bucket of a duration is found from the position of its
+ *      highest bit and the bits below it, without a search.
+ * 4. Only a scrape pays: it sums the blocks of all workers with relaxed loads and renders the totals.
+ */
+#include "metrics.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *method_names[METRICS_METHOD_COUNT] = {"GET", "POST", "OTHER"};
+
+static const struct
+{
+    const char *name;
+    const char *help;
+} histogram_info[METRICS_HISTOGRAM_COUNT] = {
+    {"http_request_parse_seconds", "Time spent parsing request heads."},
+    {"http_request_handle_seconds", "Time from a complete request to its queued response, including decoding the last part of its body."},
+    {"http_response_send_seconds", "Time from a queued response until it has been written to the socket."},
+};
+
+/**
+ * @brief Allocate zeroed metrics for every worker
+ * @return An array of 'workers' blocks, each on cache lines of its own, or NULL on allocation failure.
+ */
+WorkerMetrics *metrics_create(int workers)
+{
+    WorkerMetrics *metrics = aligned_alloc(METRICS_CACHE_LINE, workers * sizeof(WorkerMetrics));
+    if (metrics)
+    {
+        memset(metrics, 0, workers * sizeof(WorkerMetrics));
+    }
+    return metrics;
+}
+
+/// @brief Monotonic clock in nanoseconds
+uint64_t metrics_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/// @brief Counts a completed request; status codes outside 100-599 are not counted
+void metrics_count_request(WorkerMetrics *metrics, MetricsMethod method, int status_code)
+{
+    if (status_code >= METRICS_STATUS_MIN && status_code < METRICS_STATUS_MIN + METRICS_STATUS_COUNT)
+    {
+        metrics_add(&metrics->requests[method][status_code - METRICS_STATUS_MIN], 1);
+    }
+}
+
+/// @brief Reads a counter another worker may be writing
+static uint64_t load(const uint64_t *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Sum the metrics of all workers
+ * @param workers : The workers' blocks, as returned by metrics_create()
+ * @param total : Receives the sums
+ */
+void metrics_aggregate(const WorkerMetrics *workers, int count, WorkerMetrics *total)
+{
+    memset(total, 0, sizeof(*total));
+    for (int w = 0; w < count; w++)
+    {
+        const WorkerMetrics *worker = &workers[w];
+        total->connections_accepted += load(&worker->connections_accepted);
+        total->connections_closed += load(&worker->connections_closed);
+        total->bytes_in += load(&worker->bytes_in);
+        total->bytes_out += load(&worker->bytes_out);
+        total->parse_errors += load(&worker->parse_errors);
+        total->connections_shed += load(&worker->connections_shed);
+        total->requests_shed += load(&worker->requests_shed);
+        total->connections_limited += load(&worker->connections_limited);
+        total->requests_limited += load(&worker->requests_limited);
+        total->tls_handshakes += load(&worker->tls_handshakes);
+        total->tls_kernel_send += load(&worker->tls_kernel_send);
+        for (int m = 0; m < METRICS_METHOD_COUNT; m++)
+        {
+            for (int s = 0; s < METRICS_STATUS_COUNT; s++)
+            {
+                total->requests[m][s] += load(&worker->requests[m][s]);
+            }
+        }
+        for (int h = 0; h < METRICS_HISTOGRAM_COUNT; h++)
+        {
+            for (int b = 0; b < METRICS_HISTOGRAM_BUCKETS; b++)
+            {
+                total->histograms[h].buckets[b] += load(&worker->histograms[h].buckets[b]);
+            }
+            total->histograms[h].count += load(&worker->histograms[h].count);
+            total->histograms[h].sum_ns += load(&worker->histograms[h].sum_ns);
+        }
+    }
+}
+
+/// @brief snprintf() that appends at 'len' and keeps counting past the end of the buffer
+static size_t append(char *buf, size_t size, size_t len, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(len < size ? buf + len : NULL, len < size ? size - len : 0, format, args);
+    va_end(args);
+    return len + (written > 0 ? written : 0);
+}
+
+/// @brief Exclusive upper bound of a histogram bucket in nanoseconds
+static uint64_t bucket_bound_ns(int bucket)
+{
+    if (bucket == 0)
+    {
+        return 1ULL << METRICS_HISTOGRAM_MIN_SHIFT;
+    }
+    int shift = METRICS_HISTOGRAM_MIN_SHIFT + ((bucket - 1) >> METRICS_HISTOGRAM_SUB_BITS);
+    int sub = (bucket - 1) & ((1 << METRICS_HISTOGRAM_SUB_BITS) - 1);
+    return (uint64_t)((1 << METRICS_HISTOGRAM_SUB_BITS) + sub + 1) << (shift - METRICS_HISTOGRAM_SUB_BITS);
+}
+
+/**
+ * @brief Render aggregated metrics in the Prometheus text exposition format
+ * @param total : Sums from metrics_aggregate()
+ * @details [LOGIC][METRICS_RENDER]
+ * 1. Connection, byte, error and shedding counters, and the active connections as a gauge.
+ * 2. One request counter per method and status code that has been seen.
+ * 3. Each histogram as cumulative 'le' buckets in seconds, ending with +Inf, plus its _sum and _count.
+ * @return Length of the complete text, like snprintf(): if it is not smaller than 'size', the text was
+ *      truncated and a buffer of the returned length plus one is needed.
+ */
+size_t metrics_render(const WorkerMetrics *total, char *buf, size_t size)
+{
+    size_t len = 0;
+
+    // {ref}{LOGIC}{METRICS_RENDER}{1}
+    len = append(buf, size, len,
+                 "# HELP http_connections_accepted_total Connections accepted.\n"
+                 "# TYPE http_connections_accepted_total counter\n"
+                 "http_connections_accepted_total %llu\n"
+                 "# HELP http_connections_active Connections currently open.\n"
+                 "# TYPE http_connections_active gauge\n"
+                 "http_connections_active %llu\n"
+                 "# HELP http_received_bytes_total Bytes received from clients.\n"
+                 "# TYPE http_received_bytes_total counter\n"
+                 "http_received_bytes_total %llu\n"
+                 "# HELP http_sent_bytes_total Bytes sent to clients.\n"
+                 "# TYPE http_sent_bytes_total counter\n"
+                 "http_sent_bytes_total %llu\n"
+                 "# HELP http_parse_errors_total Requests rejected before reaching a handler.\n"
+                 "# TYPE http_parse_errors_total counter\n"
+                 "http_parse_errors_total %llu\n"
+                 "# HELP http_connections_shed_total Connections turned away with 503 at the connection limit.\n"
+                 "# TYPE http_connections_shed_total counter\n"
+                 "http_connections_shed_total %llu\n"
+                 "# HELP http_requests_shed_total Requests turned away with 503 at the limit of requests in flight.\n"
+                 "# TYPE http_requests_shed_total counter\n"
+                 "http_requests_shed_total %llu\n"
+                 "# HELP http_connections_limited_total Connections turned away with 429 over their client's connection rate.\n"
+                 "# TYPE http_connections_limited_total counter\n"
+                 "http_connections_limited_total %llu\n"
+                 "# HELP http_requests_limited_total Requests turned away with 429 over their client's request rate.\n"
+                 "# TYPE http_requests_limited_total counter\n"
+                 "http_requests_limited_total %llu\n"
+                 "# HELP http_tls_handshakes_total TLS handshakes completed.\n"
+                 "# TYPE http_tls_handshakes_total counter\n"
+                 "http_tls_handshakes_total %llu\n"
+                 "# HELP http_tls_kernel_send_total TLS connections whose records the kernel encrypts (kTLS).\n"
+                 "# TYPE http_tls_kernel_send_total counter\n"
+                 "http_tls_kernel_send_total %llu\n",
+                 (unsigned long long)total->connections_accepted,
+                 (unsigned long long)(total->connections_accepted > total->connections_closed
+                                          ? total->connections_accepted - total->connections_closed : 0),
+                 (unsigned long long)total->bytes_in, (unsigned long long)total->bytes_out,
+                 (unsigned long long)total->parse_errors, (unsigned long long)total->connections_shed,
+                 (unsigned long long)total->requests_shed, (unsigned long long)total->connections_limited,
+                 (unsigned long long)total->requests_limited, (unsigned long long)total->tls_handshakes,
+                 (unsigned long long)total->tls_kernel_send);
+
+    // {ref}{LOGIC}{METRICS_RENDER}{2}
+    len = append(buf, size, len,
+                 "# HELP http_requests_total Requests answered, by method and status code.\n"
+                 "# TYPE http_requests_total counter\n");
+    for (int m = 0; m < METRICS_METHOD_COUNT; m++)
+    {
+        for (int s = 0; s < METRICS_STATUS_COUNT; s++)
+        {
+            if (total->requests[m][s])
+            {
+                len = append(buf, size, len, "http_requests_total{method=\"%s\",code=\"%d\"} %llu\n",
+                             method_names[m], s + METRICS_STATUS_MIN, (unsigned long long)total->requests[m][s]);
+            }
+        }
+    }
+
+    // {ref}{LOGIC}{METRICS_RENDER}{3}
+    for (int h = 0; h < METRICS_HISTOGRAM_COUNT; h++)
+    {
+        const MetricsHistogram *histogram = &total->histograms[h];
+        const char *name = histogram_info[h].name;
+        len = append(buf, size, len, "# HELP %s %s\n# TYPE %s histogram\n", name, histogram_info[h].help, name);
+        uint64_t cumulative = 0;
+        for (int b = 0; b < METRICS_HISTOGRAM_BUCKETS - 1; b++)
+        {
+            cumulative += histogram->buckets[b];
+            len = append(buf, size, len, "%s_bucket{le=\"%.9g\"} %llu\n", name, bucket_bound_ns(b) / 1e9,
+                         (unsigned long long)cumulative);
+        }
+        // The count is the sum of the buckets, so +Inf and _count agree even if a worker recorded meanwhile.
+        cumulative += histogram->buckets[METRICS_HISTOGRAM_BUCKETS - 1];
+        len = append(buf, size, len, "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.9f\n%s_count %llu\n", name,
+                     (unsigned long long)cumulative, name, histogram->sum_ns / 1e9, name,
+                     (unsigned long long)cumulative);
+    }
+    return len;
+}
@@ -0,0 +1,119 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define METRICS_CACHE_LINE 64       ///< Alignment of a worker's counters, so no two workers share a cache line.
+#define METRICS_STATUS_MIN 100      ///< Lowest status code counted; requests are counted per code, 100-599.
+#define METRICS_STATUS_COUNT 500
+#define METRICS_HISTOGRAM_MIN_SHIFT 8   ///< Durations below 2^8 ns (256 ns) share the first bucket.
+#define METRICS_HISTOGRAM_MAX_SHIFT 35  ///< Durations of 2^35 ns (~34 s) and more share the last bucket.
+#define METRICS_HISTOGRAM_SUB_BITS 2    ///< log2 of the linear buckets each power of two is split into.
+#define METRICS_HISTOGRAM_BUCKETS \
+    (((METRICS_HISTOGRAM_MAX_SHIFT - METRICS_HISTOGRAM_MIN_SHIFT) << METRICS_HISTOGRAM_SUB_BITS) + 2)
+
+/**
+ * @brief Request methods the request counters are split by
+ */
+typedef enum
+{
+    METRICS_METHOD_GET,
+    METRICS_METHOD_POST,
+    METRICS_METHOD_OTHER,
+    METRICS_METHOD_COUNT
+} MetricsMethod;
+
+/**
+ * @brief Latency histograms kept per worker
+ */
+typedef enum
+{
+    METRICS_PARSE,  ///< Time spent scanning a request head, over all the reads it arrived in
+    METRICS_HANDLE, ///< Time from the complete head, or the read that completed the body, to the queued response
+    METRICS_SEND,   ///< Time from a response being queued until the output queue has been written
+    METRICS_HISTOGRAM_COUNT
+} MetricsHistogramId;
+
+/**
+ * @brief Log-linear latency histogram: every power of two of nanoseconds is split into
+ *      2^METRICS_HISTOGRAM_SUB_BITS equal buckets, so the relative error stays below 25% at any scale
+ * @param buckets : Samples per bucket (not cumulative)
+ * @param count : Number of samples
+ * @param sum_ns : Sum of all samples in nanoseconds
+ */
+typedef struct
+{
+    uint64_t buckets[METRICS_HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t sum_ns;
+} MetricsHistogram;
+
+/**
+ * @brief Counters and histograms of one worker
+ * @attention Only the owning worker writes them, so recording needs neither a lock nor an atomic
+ *      read-modify-write; readers aggregating all workers see every value whole, if a little stale.
+ * @param connections_accepted, connections_closed : Connections opened and closed; their difference is the active count
+ * @param bytes_in, bytes_out : Bytes received from and sent to clients
+ * @param parse_errors : Requests rejected before reaching a handler (400, 431, 501)
+ * @param connections_shed, requests_shed : Connections and requests turned away with 503 by admission control
+ * @param connections_limited, requests_limited : Connections and requests turned away with 429 by the rate limiter
+ * @param tls_handshakes : TLS handshakes completed
+ * @param tls_kernel_send : TLS connections whose records the kernel encrypts (kTLS)
+ * @param requests : Completed requests by method and status code
+ */
+typedef struct __attribute__((aligned(METRICS_CACHE_LINE)))
+{
+    uint64_t connections_accepted;
+    uint64_t connections_closed;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t parse_errors;
+    uint64_t connections_shed;
+    uint64_t requests_shed;
+    uint64_t connections_limited;
+    uint64_t requests_limited;
+    uint64_t tls_handshakes;
+    uint64_t tls_kernel_send;
+    uint64_t requests[METRICS_METHOD_COUNT][METRICS_STATUS_COUNT];
+    MetricsHistogram histograms[METRICS_HISTOGRAM_COUNT];
+} WorkerMetrics;
+
+/// @brief Adds n to a counter owned by the calling worker: a plain load and store, never a locked instruction
+static inline void metrics_add(uint64_t *counter, uint64_t n)
+{
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+/// @brief Bucket of a duration: its power of two, then the next METRICS_HISTOGRAM_SUB_BITS bits below the top one
+static inline int metrics_bucket(uint64_t ns)
+{
+    if (ns < (1ULL << METRICS_HISTOGRAM_MIN_SHIFT))
+    {
+        return 0;
+    }
+    int shift = 63 - __builtin_clzll(ns);
+    if (shift >= METRICS_HISTOGRAM_MAX_SHIFT)
+    {
+        return METRICS_HISTOGRAM_BUCKETS - 1;
+    }
+    int sub = (ns >> (shift - METRICS_HISTOGRAM_SUB_BITS)) & ((1 << METRICS_HISTOGRAM_SUB_BITS) - 1);
+    return 1 + ((shift - METRICS_HISTOGRAM_MIN_SHIFT) << METRICS_HISTOGRAM_SUB_BITS) + sub;
+}
+
+/// @brief Records one duration in a histogram owned by the calling worker
+static inline void metrics_record(MetricsHistogram *histogram, uint64_t ns)
+{
+    metrics_add(&histogram->buckets[metrics_bucket(ns)], 1);
+    metrics_add(&histogram->count, 1);
+    metrics_add(&histogram->sum_ns, ns);
+}
+
+// Metrics functions
+WorkerMetrics *metrics_create(int workers);
+uint64_t metrics_now_ns(void);
+void metrics_count_request(WorkerMetrics *metrics, MetricsMethod method, int status_code);
+void metrics_aggregate(const WorkerMetrics *workers, int count, WorkerMetrics *total);
+size_t metrics_render(const WorkerMetrics *total, char *buf, size_t size);
+
+#endif // METRICS_H
@@ -0,0 +1,186 @@
+/**
+ * @file: offload.c
+ *
+ * ℹ️ A bounded thread pool for handlers too slow to run on an event loop, e.g. hashing or compressing
+ *      large data: while one of them runs on a worker, every other connection of that worker waits.
+ *
+ * 1. The pool is shared by all workers. Submitted jobs wait in one FIFO list under a mutex; the pool
+ *      threads sleep on a condition variable while it is empty. The list holds at most OFFLOAD_QUEUE_SIZE
+ *      jobs: past that the pool is overloaded, and the caller is told so instead of queueing without bound.
+ * 2. Every event loop owns a completion queue. A pool thread that finished a job pushes it there with one
+ *      compare-and-swap, and writes the loop's eventfd only if the queue was empty, so a burst of
+ *      completions wakes the loop once.
+ * 3. The loop reads the eventfd, then takes all finished jobs with one atomic exchange and puts them back
+ *      in completion order. Reading first means a job pushed after the exchange finds the queue empty
+ *      and writes the eventfd again, so no completion is ever left behind unsignalled.
+ */
+#include "offload.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+/// @brief Hands a finished job back to the loop that submitted it
+static void complete_job(OffloadJob *job)
+{
+    OffloadQueue *queue = job->completions;
+    OffloadJob *head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    do
+    {
+        job->next = head;
+    } while (!__atomic_compare_exchange_n(&queue->head, &head, job, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    if (!head)
+    {
+        uint64_t one = 1;
+        while (write(queue->event_fd, &one, sizeof(one)) == -1 && errno == EINTR)
+        {
+        }
+    }
+}
+
+/// @brief Pool thread: runs waiting jobs in submission order until the pool stops
+static void *pool_main(void *arg)
+{
+    OffloadPool *pool = arg;
+    pthread_mutex_lock(&pool->lock);
+    while (1)
+    {
+        while (!pool->first && !pool->stopping)
+        {
+            pthread_cond_wait(&pool->ready, &pool->lock);
+        }
+        OffloadJob *job = pool->first;
+        if (!job)
+        {
+            break;
+        }
+        pool->first = job->next;
+        if (!pool->first)
+        {
+            pool->last = NULL;
+        }
+        pool->queued--;
+        pthread_mutex_unlock(&pool->lock);
+
+        job->run(job);
+        complete_job(job);
+
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/**
+ * @brief Starts a pool of 'threads' threads
+ * @return 0 on success, -1 on failure.
+ */
+int offload_pool_init(OffloadPool *pool, int threads)
+{
+    memset(pool, 0, sizeof(*pool));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->ready, NULL);
+    pool->threads = calloc(threads, sizeof(pthread_t));
+    if (!pool->threads)
+    {
+        return -1;
+    }
+    for (; pool->thread_count < threads; pool->thread_count++)
+    {
+        int err = pthread_create(&pool->threads[pool->thread_count], NULL, pool_main, pool);
+        if (err)
+        {
+            offload_pool_destroy(pool);
+            errno = err;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/// @brief Lets the threads finish the waiting jobs, then joins them
+void offload_pool_destroy(OffloadPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->thread_count; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+    free(pool->threads);
+    pool->threads = NULL;
+    pool->thread_count = 0;
+}
+
+/**
+ * @brief Queues a job for the next free pool thread
+ * @param job : Its run and completions must be set; it belongs to the pool until the loop drains it again
+ * @return 0 on success, -1 if OFFLOAD_QUEUE_SIZE jobs are already waiting.
+ */
+int offload_submit(OffloadPool *pool, OffloadJob *job)
+{
+    job->next = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->queued == OFFLOAD_QUEUE_SIZE)
+    {
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+    if (pool->last)
+    {
+        pool->last->next = job;
+    }
+    else
+    {
+        pool->first = job;
+    }
+    pool->last = job;
+    pool->queued++;
+    pthread_cond_signal(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+/**
+ * @brief Sets up an empty completion queue and its non-blocking eventfd
+ * @return 0 on success, -1 on failure.
+ */
+int offload_queue_init(OffloadQueue *queue)
+{
+    queue->head = NULL;
+    queue->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return queue->event_fd == -1 ? -1 : 0;
+}
+
+/// @brief Closes the queue's eventfd; the queue must be empty and no job of its loop still running
+void offload_queue_destroy(OffloadQueue *queue)
+{
+    close(queue->event_fd);
+    queue->event_fd = -1;
+}
+
+/**
+ * @brief Takes every finished job off the queue; called by the owning loop when its eventfd is readable
+ * @return The jobs in the order they finished, linked through next, or NULL if there are none.
+ */
+OffloadJob *offload_queue_drain(OffloadQueue *queue)
+{
+    uint64_t count;
+    while (read(queue->event_fd, &count, sizeof(count)) == -1 && errno == EINTR)
+    {
+    }
+    OffloadJob *job = __atomic_exchange_n(&queue->head, NULL, __ATOMIC_ACQUIRE);
+    OffloadJob *ordered = NULL;
+    while (job)
+    {
+        OffloadJob *next = job->next;
+        job->next = ordered;
+        ordered = job;
+        job = next;
+    }
+    return ordered;
+}
@@ -0,0 +1,61 @@
+#ifndef OFFLOAD_H
+#define OFFLOAD_H
+
+#include <pthread.h>
+
+#define OFFLOAD_QUEUE_SIZE 1024 ///< Jobs waiting for a pool thread; a submission beyond this is refused.
+
+struct OffloadJob;
+
+/**
+ * @brief Lock-free multi-producer single-consumer queue of finished jobs, owned by one event loop
+ * @attention Pool threads push with a compare-and-swap; only the owning loop takes jobs off, all at once.
+ * @param head : Most recently finished job; jobs are linked through next, newest first
+ * @param event_fd : eventfd the loop waits on; written when a job lands on an empty queue
+ */
+typedef struct
+{
+    struct OffloadJob *head;
+    int event_fd;
+} OffloadQueue;
+
+/**
+ * @brief A piece of work run on a pool thread; embedded in the caller's own job structure
+ * @param run : Called on a pool thread; must only touch memory the submitting loop leaves alone meanwhile
+ * @param completions : Queue of the loop that submitted the job, which it is handed back to once run returned
+ * @param next : Link in the pool's waiting list, then in the completion queue
+ */
+typedef struct OffloadJob
+{
+    void (*run)(struct OffloadJob *job);
+    OffloadQueue *completions;
+    struct OffloadJob *next;
+} OffloadJob;
+
+/**
+ * @brief Threads running jobs for all event loops, fed from one bounded FIFO list
+ * @param first, last : Waiting jobs, oldest first
+ * @param queued : Number of waiting jobs, at most OFFLOAD_QUEUE_SIZE
+ * @param stopping : Set to let the threads exit once the list is empty
+ */
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    OffloadJob *first;
+    OffloadJob *last;
+    int queued;
+    int stopping;
+    pthread_t *threads;
+    int thread_count;
+} OffloadPool;
+
+// Offload functions
+int offload_pool_init(OffloadPool *pool, int threads);
+void offload_pool_destroy(OffloadPool *pool);
+int offload_submit(OffloadPool *pool, OffloadJob *job);
+int offload_queue_init(OffloadQueue *queue);
+void offload_queue_destroy(OffloadQueue *queue);
+OffloadJob *offload_queue_drain(OffloadQueue *queue);
+
+#endif // OFFLOAD_H
@@ -0,0 +1,145 @@
+/**
+ * @file: rate-limit.c
+ *
+ * ℹ️ Per-client rate limits: a client address that opens connections or sends requests faster than allowed
+ *      is answered 429 before its requests cost any more than a table lookup.
+ *
+ * 1. Every client address has two token buckets, one for connections and one for requests. A bucket is not
+ *      refilled by a timer: a check adds the time elapsed since the last one, so an idle client costs nothing.
+ *      Credit is kept in nanoseconds, where one token is worth the interval of its rate, so refilling is an
+ *      addition without rounding and a bucket holds at most RATE_LIMIT_BURST_MS worth of tokens.
+ * 2. The buckets live in a fixed open-addressing table per worker, allocated when the worker starts. A client
+ *      hashes to a window of RATE_LIMIT_PROBE slots; slots are never emptied, so the first empty slot in the
+ *      window ends a lookup. Both checks are O(1) and never allocate.
+ * 3. When a window is full, a clock picks the slot to reuse: a client checked since the clock last passed
+ *      gets a second chance, and a bucket that has refilled completely is taken right away, since forgetting
+ *      it changes nothing. A worker that sees more clients than it has slots forgets the ones least recently
+ *      seen.
+ * 4. The limits are checked per worker, but each client has a single worker: the listening sockets steer
+ *      connections by source address (attach_address_steering in http-server.c), so every worker applies the
+ *      whole rates to its clients, however many connections they open. Only where the kernel refuses the
+ *      steering program are the rates split among the workers.
+ */
+#include "rate-limit.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Sets up a worker's rate limits
+ * @param connections_per_second : Connections one client may open per second at this worker, 0 for no limit
+ * @param requests_per_second : Requests one client may send per second at this worker, 0 for no limit
+ * @return 0 on success, -1 if the table cannot be allocated.
+ */
+int rate_limiter_init(RateLimiter *limiter, unsigned connections_per_second, unsigned requests_per_second)
+{
+    memset(limiter, 0, sizeof(*limiter));
+    if (!connections_per_second && !requests_per_second)
+    {
+        return 0;
+    }
+    limiter->slots = calloc(RATE_LIMIT_SLOTS, sizeof(RateBucket));
+    if (!limiter->slots)
+    {
+        return -1;
+    }
+    uint64_t burst = (uint64_t)RATE_LIMIT_BURST_MS * 1000000;
+    if (connections_per_second)
+    {
+        limiter->connection_interval_ns = 1000000000ULL / connections_per_second;
+        limiter->connection_burst_ns = burst > limiter->connection_interval_ns ? burst : limiter->connection_interval_ns;
+    }
+    if (requests_per_second)
+    {
+        limiter->request_interval_ns = 1000000000ULL / requests_per_second;
+        limiter->request_burst_ns = burst > limiter->request_interval_ns ? burst : limiter->request_interval_ns;
+    }
+    return 0;
+}
+
+/// @brief Frees the table of a rate limiter
+void rate_limiter_destroy(RateLimiter *limiter)
+{
+    free(limiter->slots);
+    limiter->slots = NULL;
+}
+
+/// @brief Adds 'elapsed_ns' to a bucket's credit, up to 'burst_ns'
+static uint64_t refill(uint64_t credit_ns, uint64_t elapsed_ns, uint64_t burst_ns)
+{
+    return elapsed_ns >= burst_ns || credit_ns >= burst_ns - elapsed_ns ? burst_ns : credit_ns + elapsed_ns;
+}
+
+/// @brief Whether both buckets of a client would be full by 'now', so that it is as good as a new one
+static int bucket_full(const RateLimiter *limiter, const RateBucket *bucket, uint64_t now)
+{
+    uint64_t elapsed = now - bucket->updated_ns;
+    return refill(bucket->connection_credit_ns, elapsed, limiter->connection_burst_ns) == limiter->connection_burst_ns &&
+           refill(bucket->request_credit_ns, elapsed, limiter->request_burst_ns) == limiter->request_burst_ns;
+}
+
+/**
+ * @brief Picks the slot of a full probe window to reuse
+ * @details Starting at the clock's hand, the first slot not referenced since the hand last passed it, or
+ *      whose buckets are full, is taken; the referenced ones passed on the way lose their mark. Within
+ *      RATE_LIMIT_PROBE + 1 steps a slot is found.
+ */
+static RateBucket *evict(RateLimiter *limiter, uint32_t home, uint64_t now)
+{
+    for (uint32_t n = 0;; n++)
+    {
+        uint32_t offset = (limiter->hand + n) % RATE_LIMIT_PROBE;
+        RateBucket *slot = &limiter->slots[(home + offset) & (RATE_LIMIT_SLOTS - 1)];
+        if (!slot->referenced || bucket_full(limiter, slot, now))
+        {
+            limiter->hand = offset + 1;
+            return slot;
+        }
+        slot->referenced = 0;
+    }
+}
+
+/**
+ * @brief Finds the buckets of a client address, refilled up to 'now'
+ * @details [LOGIC][RATE_LIMITER_BUCKET]
+ * 1. Look through the address's probe window: its slot, or the first empty one where it would have been put.
+ * 2. An address that is not in the table takes the empty slot, or one the clock evicts from the full window.
+ * 3. A new client starts with full buckets; a known one has the time since its last check added.
+ */
+RateBucket *rate_limiter_bucket(RateLimiter *limiter, uint32_t addr, uint64_t now)
+{
+    // {ref}{LOGIC}{RATE_LIMITER_BUCKET}{1}
+    uint32_t home = (addr * 0x9E3779B1u) >> (32 - RATE_LIMIT_SLOT_BITS);
+    RateBucket *bucket = NULL;
+    for (int i = 0; i < RATE_LIMIT_PROBE; i++)
+    {
+        RateBucket *slot = &limiter->slots[(home + i) & (RATE_LIMIT_SLOTS - 1)];
+        if (!slot->used)
+        {
+            bucket = slot;
+            break;
+        }
+        if (slot->addr == addr)
+        {
+            // {ref}{LOGIC}{RATE_LIMITER_BUCKET}{3}
+            uint64_t elapsed = now - slot->updated_ns;
+            slot->connection_credit_ns = refill(slot->connection_credit_ns, elapsed, limiter->connection_burst_ns);
+            slot->request_credit_ns = refill(slot->request_credit_ns, elapsed, limiter->request_burst_ns);
+            slot->updated_ns = now;
+            slot->referenced = 1;
+            return slot;
+        }
+    }
+
+    // {ref}{LOGIC}{RATE_LIMITER_BUCKET}{2}
+    if (!bucket)
+    {
+        bucket = evict(limiter, home, now);
+    }
+    bucket->addr = addr;
+    bucket->used = 1;
+    bucket->referenced = 1;
+    bucket->connection_credit_ns = limiter->connection_burst_ns;
+    bucket->request_credit_ns = limiter->request_burst_ns;
+    bucket->updated_ns = now;
+    return bucket;
+}
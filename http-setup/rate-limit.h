@@ -0,0 +1,92 @@
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <stdint.h>
+
+#define RATE_LIMIT_SLOT_BITS 12                      ///< Log2 of the clients one worker tracks at the same time.
+#define RATE_LIMIT_SLOTS (1u << RATE_LIMIT_SLOT_BITS)  ///< Slots of a worker's table.
+#define RATE_LIMIT_PROBE 8                           ///< Slots a client's address may occupy, starting at its hash.
+#define RATE_LIMIT_BURST_MS 1000                     ///< A bucket holds the tokens of this long: the burst allowed.
+
+/**
+ * @brief The token buckets of one client address
+ * @param addr : IPv4 address in network byte order
+ * @param used : The slot holds a client; slots are reused, never emptied again
+ * @param referenced : Set by every check, cleared as the eviction clock passes: a second chance
+ * @param connection_credit_ns, request_credit_ns : Tokens of the two buckets, as the time it took to earn
+ *      them. One token is worth the interval of its rate, so refilling is adding the elapsed time.
+ * @param updated_ns : When the buckets were last refilled
+ */
+typedef struct
+{
+    uint32_t addr;
+    uint8_t used;
+    uint8_t referenced;
+    uint64_t connection_credit_ns;
+    uint64_t request_credit_ns;
+    uint64_t updated_ns;
+} RateBucket;
+
+/**
+ * @brief One worker's rate limits per client address
+ * @attention Owned by one worker. The table is allocated once, when the worker starts; checks never allocate.
+ * @param slots : Open-addressing table of RATE_LIMIT_SLOTS buckets, NULL if no limit is set
+ * @param connection_interval_ns, request_interval_ns : Time that earns one token, 0 for no limit
+ * @param connection_burst_ns, request_burst_ns : Most credit a bucket holds: the burst it allows
+ * @param hand : Eviction clock, the position in a full probe window to start looking for a victim
+ */
+typedef struct
+{
+    RateBucket *slots;
+    uint64_t connection_interval_ns;
+    uint64_t request_interval_ns;
+    uint64_t connection_burst_ns;
+    uint64_t request_burst_ns;
+    uint32_t hand;
+} RateLimiter;
+
+// Rate limiter functions
+int rate_limiter_init(RateLimiter *limiter, unsigned connections_per_second, unsigned requests_per_second);
+void rate_limiter_destroy(RateLimiter *limiter);
+RateBucket *rate_limiter_bucket(RateLimiter *limiter, uint32_t addr, uint64_t now);
+
+/// @brief Takes a token worth 'interval_ns' from a bucket holding 'credit_ns'; returns -1 if it has less
+static inline int rate_bucket_take(uint64_t *credit_ns, uint64_t interval_ns)
+{
+    if (*credit_ns < interval_ns)
+    {
+        return -1;
+    }
+    *credit_ns -= interval_ns;
+    return 0;
+}
+
+/**
+ * @brief Charges a new connection to its client's connection bucket
+ * @return 0 if the connection may be served, -1 if the client opens connections faster than allowed.
+ */
+static inline int rate_limit_connection(RateLimiter *limiter, uint32_t addr, uint64_t now)
+{
+    if (!limiter->connection_interval_ns)
+    {
+        return 0;
+    }
+    RateBucket *bucket = rate_limiter_bucket(limiter, addr, now);
+    return rate_bucket_take(&bucket->connection_credit_ns, limiter->connection_interval_ns);
+}
+
+/**
+ * @brief Charges a request to its client's request bucket
+ * @return 0 if the request may be served, -1 if the client sends requests faster than allowed.
+ */
+static inline int rate_limit_request(RateLimiter *limiter, uint32_t addr, uint64_t now)
+{
+    if (!limiter->request_interval_ns)
+    {
+        return 0;
+    }
+    RateBucket *bucket = rate_limiter_bucket(limiter, addr, now);
+    return rate_bucket_take(&bucket->request_credit_ns, limiter->request_interval_ns);
+}
+
+#endif // RATE_LIMIT_H
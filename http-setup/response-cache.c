@@ -0,0 +1,383 @@
+/**
+ * @file: response-cache.c
+ *
+ * ℹ️ A cache of complete GET responses for small static files, shared by all workers.
+ *
+ * 1. An entry holds the status line, headers and body of a 200 response serialized once, so a hit is
+ *      queued straight from the cached bytes: no handler, no path resolution, no formatting, no file I/O.
+ * 2. Every entry carries a strong ETag computed from its body. A request whose If-None-Match lists it
+ *      is answered with the pre-serialized 304 head stored in the same block.
+ * 3. The cache is split into RESPONSE_CACHE_SHARDS shards by key hash, each with its own lock, LRU
+ *      list and byte budget, so workers serving different URIs rarely contend for the same lock.
+ * 4. Entries are reference counted. A queued response keeps its entry's bytes alive even if another
+ *      worker evicts or replaces the entry before the response is written.
+ * 5. Like the file cache, an entry is re-validated against its file at most once every
+ *      RESPONSE_CACHE_REVALIDATE_SECONDS; a modified, replaced or removed file drops the entry.
+ */
+#include "response-cache.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/// @brief FNV-1a hash of 'len' bytes
+static uint64_t hash_bytes(const char *data, size_t len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/// @brief Bytes an entry is charged against its shard's budget
+static size_t entry_size(const CachedResponse *response)
+{
+    return sizeof(CachedResponse) + response->key_len + strlen(response->path) +
+           response->not_modified_len + response->head_len + 2 + response->body_len;
+}
+
+/// @brief Frees an entry's memory
+static void free_entry(CachedResponse *response)
+{
+    free(response->data);
+    free(response->path);
+    free(response->key);
+    free(response);
+}
+
+/// @brief Unlinks an entry from its shard's LRU list
+static void lru_unlink(ResponseCacheShard *shard, CachedResponse *response)
+{
+    if (response->lru_prev)
+    {
+        response->lru_prev->lru_next = response->lru_next;
+    }
+    else
+    {
+        shard->lru_head = response->lru_next;
+    }
+    if (response->lru_next)
+    {
+        response->lru_next->lru_prev = response->lru_prev;
+    }
+    else
+    {
+        shard->lru_tail = response->lru_prev;
+    }
+    response->lru_prev = response->lru_next = NULL;
+}
+
+/// @brief Inserts an entry at the most recently used end of its shard's LRU list
+static void lru_push_front(ResponseCacheShard *shard, CachedResponse *response)
+{
+    response->lru_prev = NULL;
+    response->lru_next = shard->lru_head;
+    if (shard->lru_head)
+    {
+        shard->lru_head->lru_prev = response;
+    }
+    shard->lru_head = response;
+    if (!shard->lru_tail)
+    {
+        shard->lru_tail = response;
+    }
+}
+
+/**
+ * @brief Removes an entry from its shard and drops the cache's reference; the shard lock is held
+ * @attention The bytes are only freed once no queued response still holds a reference.
+ */
+static void remove_entry(ResponseCacheShard *shard, CachedResponse *response)
+{
+    CachedResponse **link = &shard->buckets[response->hash % RESPONSE_CACHE_BUCKETS];
+    while (*link != response)
+    {
+        link = &(*link)->hash_next;
+    }
+    *link = response->hash_next;
+    lru_unlink(shard, response);
+    shard->bytes -= entry_size(response);
+    response_cache_release(response);
+}
+
+/// @brief Finds the entry for a key in its shard; the shard lock is held
+static CachedResponse *find_entry(ResponseCacheShard *shard, size_t hash, const char *key, size_t key_len)
+{
+    CachedResponse *response = shard->buckets[hash % RESPONSE_CACHE_BUCKETS];
+    while (response && (response->hash != hash || response->key_len != key_len ||
+                        memcmp(response->key, key, key_len) != 0))
+    {
+        response = response->hash_next;
+    }
+    return response;
+}
+
+/**
+ * @brief Initialize an empty cache
+ * @param capacity : Total bytes the cache may hold, split evenly over the shards; 0 disables it
+ */
+void response_cache_init(ResponseCache *cache, size_t capacity)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache->shard_capacity = capacity / RESPONSE_CACHE_SHARDS;
+    for (int i = 0; i < RESPONSE_CACHE_SHARDS; i++)
+    {
+        pthread_mutex_init(&cache->shards[i].lock, NULL);
+    }
+}
+
+/// @brief Drop every entry; responses still queued keep theirs until released
+void response_cache_destroy(ResponseCache *cache)
+{
+    for (int i = 0; i < RESPONSE_CACHE_SHARDS; i++)
+    {
+        ResponseCacheShard *shard = &cache->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        while (shard->lru_head)
+        {
+            remove_entry(shard, shard->lru_head);
+        }
+        pthread_mutex_unlock(&shard->lock);
+        pthread_mutex_destroy(&shard->lock);
+    }
+}
+
+/**
+ * @brief Look up the response for a request path
+ * @details [LOGIC][RESPONSE_CACHE_LOOKUP]
+ * 1. Pick the shard from the key's hash and find the entry under the shard's lock.
+ * 2. If the entry was last checked RESPONSE_CACHE_REVALIDATE_SECONDS ago or earlier, stat() its file
+ *      and drop the entry if the file was modified, replaced or removed.
+ * 3. On a hit, move the entry to the front of the LRU list and take a reference for the caller,
+ *      who must hand it back with response_cache_release().
+ * @return The entry, or NULL on a miss.
+ */
+CachedResponse *response_cache_lookup(ResponseCache *cache, const char *key, size_t key_len)
+{
+    if (cache->shard_capacity == 0)
+    {
+        return NULL;
+    }
+
+    // {ref}{LOGIC}{RESPONSE_CACHE_LOOKUP}{1}
+    size_t hash = hash_bytes(key, key_len);
+    ResponseCacheShard *shard = &cache->shards[hash % RESPONSE_CACHE_SHARDS];
+    pthread_mutex_lock(&shard->lock);
+    CachedResponse *response = find_entry(shard, hash, key, key_len);
+
+    // {ref}{LOGIC}{RESPONSE_CACHE_LOOKUP}{2}
+    time_t now = time(NULL);
+    if (response && now - response->checked_at >= RESPONSE_CACHE_REVALIDATE_SECONDS)
+    {
+        struct stat st;
+        if (stat(response->path, &st) == -1 || st.st_mtime != response->st.st_mtime ||
+            st.st_size != response->st.st_size || st.st_ino != response->st.st_ino ||
+            st.st_dev != response->st.st_dev)
+        {
+            remove_entry(shard, response);
+            response = NULL;
+        }
+        else
+        {
+            response->checked_at = now;
+        }
+    }
+
+    // {ref}{LOGIC}{RESPONSE_CACHE_LOOKUP}{3}
+    if (response)
+    {
+        lru_unlink(shard, response);
+        lru_push_front(shard, response);
+        __atomic_add_fetch(&response->refcount, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return response;
+}
+
+/**
+ * @brief Serialize the 200 response for a file and add it to the cache
+ * @param key Request path the response answers.
+ * @param path File the body comes from.
+ * @param fd Open descriptor of the file, read with pread() so a shared offset is not disturbed.
+ * @param st fstat() of fd.
+ * @param content_type Value of the Content-Type header.
+ * @details [LOGIC][RESPONSE_CACHE_INSERT]
+ * 1. Only bodies up to RESPONSE_CACHE_MAX_ENTRY that fit a shard's budget are cached.
+ * 2. Read the body and derive the strong ETag from its length and FNV-1a hash, so it changes
+ *      whenever the bytes do, independent of timestamps.
+ * 3. Lay out the 304 head, the 200 head, the blank line and the body in one block. The 200 head
+ *      announces byte ranges and carries Last-Modified, so clients can resume with If-Range.
+ * 4. Under the shard's lock, replace an entry another worker added for the same key meanwhile,
+ *      and evict least recently used entries until the new one fits the budget.
+ * 5. Keep one reference for the cache and return one to the caller.
+ * @return The new entry, or NULL if the response is not cacheable or memory ran out.
+ */
+CachedResponse *response_cache_insert(ResponseCache *cache, const char *key, size_t key_len, const char *path,
+                                      int fd, const struct stat *st, const char *content_type)
+{
+    // {ref}{LOGIC}{RESPONSE_CACHE_INSERT}{1}
+    size_t body_len = (size_t)st->st_size;
+    if (body_len > RESPONSE_CACHE_MAX_ENTRY || body_len + 1024 > cache->shard_capacity)
+    {
+        return NULL;
+    }
+
+    // {ref}{LOGIC}{RESPONSE_CACHE_INSERT}{2}
+    char *body = malloc(body_len ? body_len : 1);
+    if (!body)
+    {
+        return NULL;
+    }
+    size_t read_len = 0;
+    while (read_len < body_len)
+    {
+        ssize_t n = pread(fd, body + read_len, body_len - read_len, read_len);
+        if (n <= 0)
+        {
+            free(body); // Read error, or the file shrank underneath us
+            return NULL;
+        }
+        read_len += n;
+    }
+
+    CachedResponse *response = calloc(1, sizeof(CachedResponse));
+    if (!response)
+    {
+        free(body);
+        return NULL;
+    }
+    snprintf(response->etag, sizeof(response->etag), "\"%zx-%016llx\"", body_len,
+             (unsigned long long)hash_bytes(body, body_len));
+
+    // {ref}{LOGIC}{RESPONSE_CACHE_INSERT}{3}
+    char not_modified[128];
+    char head[512];
+    int not_modified_len = snprintf(not_modified, sizeof(not_modified),
+                                    "HTTP/1.1 304 Not Modified\r\nETag: %s\r\n", response->etag);
+    struct tm tm;
+    gmtime_r(&st->st_mtime, &tm);
+    strftime(response->last_modified, sizeof(response->last_modified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    int head_len = snprintf(head, sizeof(head),
+                            "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nETag: %s\r\nLast-Modified: %s\r\n"
+                            "Accept-Ranges: bytes\r\nContent-Length: %zu\r\n",
+                            content_type, response->etag, response->last_modified, body_len);
+    response->data = head_len < (int)sizeof(head) ? malloc(not_modified_len + head_len + 2 + body_len) : NULL;
+    response->key = malloc(key_len + 1);
+    response->path = strdup(path);
+    if (!response->data || !response->key || !response->path)
+    {
+        free(body);
+        free_entry(response);
+        return NULL;
+    }
+    memcpy(response->data, not_modified, not_modified_len);
+    memcpy(response->data + not_modified_len, head, head_len);
+    memcpy(response->data + not_modified_len + head_len, "\r\n", 2);
+    memcpy(response->data + not_modified_len + head_len + 2, body, body_len);
+    free(body);
+    response->not_modified_len = not_modified_len;
+    response->head_len = head_len;
+    response->body_len = body_len;
+    memcpy(response->key, key, key_len);
+    response->key[key_len] = '\0';
+    response->key_len = key_len;
+    response->hash = hash_bytes(key, key_len);
+    response->st = *st;
+    response->checked_at = time(NULL);
+
+    // {ref}{LOGIC}{RESPONSE_CACHE_INSERT}{4}
+    ResponseCacheShard *shard = &cache->shards[response->hash % RESPONSE_CACHE_SHARDS];
+    size_t size = entry_size(response);
+    pthread_mutex_lock(&shard->lock);
+    CachedResponse *existing = find_entry(shard, response->hash, key, key_len);
+    if (existing)
+    {
+        remove_entry(shard, existing);
+    }
+    while (shard->lru_tail && shard->bytes + size > cache->shard_capacity)
+    {
+        remove_entry(shard, shard->lru_tail);
+    }
+    CachedResponse **bucket = &shard->buckets[response->hash % RESPONSE_CACHE_BUCKETS];
+    response->hash_next = *bucket;
+    *bucket = response;
+    lru_push_front(shard, response);
+    shard->bytes += size;
+
+    // {ref}{LOGIC}{RESPONSE_CACHE_INSERT}{5}
+    response->refcount = 2;
+    pthread_mutex_unlock(&shard->lock);
+    return response;
+}
+
+/// @brief Take another reference to an entry the caller already holds one to
+void response_cache_retain(CachedResponse *response)
+{
+    __atomic_add_fetch(&response->refcount, 1, __ATOMIC_RELAXED);
+}
+
+/// @brief Give back a reference taken by response_cache_lookup(), response_cache_insert() or response_cache_retain()
+void response_cache_release(CachedResponse *response)
+{
+    if (__atomic_sub_fetch(&response->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        free_entry(response);
+    }
+}
+
+/**
+ * @brief Checks an If-None-Match header against an ETag (RFC 9110 section 13.1.2)
+ * @param etag The current entity tag, with its quotes.
+ * @param if_none_match The header value, or NULL if the request has none.
+ * @details [LOGIC][ETAG_MATCH]
+ * 1. "*" matches any current representation.
+ * 2. Otherwise the value is a comma-separated list of entity tags, compared weakly: a "W/" prefix
+ *      is ignored, as If-None-Match requires.
+ * @return Non-zero if the client's copy is current and 304 may be sent.
+ */
+int etag_list_matches(const char *etag, const char *if_none_match)
+{
+    size_t etag_len = strlen(etag);
+    const char *cursor = if_none_match;
+    while (cursor && *cursor)
+    {
+        if (*cursor == ' ' || *cursor == '\t' || *cursor == ',')
+        {
+            cursor++;
+            continue;
+        }
+        // {ref}{LOGIC}{ETAG_MATCH}{1}
+        if (*cursor == '*')
+        {
+            return 1;
+        }
+        // {ref}{LOGIC}{ETAG_MATCH}{2}
+        if (strncmp(cursor, "W/", 2) == 0)
+        {
+            cursor += 2;
+        }
+        const char *start = cursor;
+        if (*cursor == '"')
+        {
+            cursor = strchr(cursor + 1, '"');
+            if (!cursor)
+            {
+                return 0;
+            }
+            cursor++;
+        }
+        else
+        {
+            cursor += strcspn(cursor, ",");
+        }
+        if ((size_t)(cursor - start) == etag_len && memcmp(start, etag, etag_len) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define RESPONSE_CACHE_SHARDS 16              ///< Independently locked parts of the cache.
+#define RESPONSE_CACHE_BUCKETS 256            ///< Hash buckets per shard.
+#define RESPONSE_CACHE_MAX_ENTRY (256 * 1024) ///< Largest body kept in the cache; larger files are sent with sendfile().
+#define RESPONSE_CACHE_REVALIDATE_SECONDS 1   ///< How long an entry is trusted before its file is stat()ed again.
+
+/**
+ * @brief A complete 200 response, serialized once and shared by every request for the same URI
+ * @param key : Request path the entry answers (hash key)
+ * @param path : File the body was read from, re-checked for changes
+ * @param st : stat() of the file when the body was read
+ * @param checked_at : Last time the file was re-checked
+ * @param etag : Strong entity tag of the body, with its quotes
+ * @param last_modified : Modification time of the file as an HTTP date, for Last-Modified and If-Range
+ * @param data : "304 head | 200 head | CRLF | body" in one block
+ * @param not_modified_len : Length of the 304 status line and ETag header at the start of data
+ * @param head_len : Length of the 200 status line and headers that follow, without the final CRLF
+ * @param body_len : Length of the body after the final CRLF
+ * @param refcount : One for the cache while the entry is reachable, one per queued response using it
+ */
+typedef struct CachedResponse
+{
+    char *key;
+    size_t key_len;
+    size_t hash;
+    char *path;
+    struct stat st;
+    time_t checked_at;
+    char etag[40];
+    char last_modified[32];
+    char *data;
+    size_t not_modified_len;
+    size_t head_len;
+    size_t body_len;
+    int refcount;
+    struct CachedResponse *hash_next;
+    struct CachedResponse *lru_prev;
+    struct CachedResponse *lru_next;
+} CachedResponse;
+
+/**
+ * @brief One independently locked part of the cache, with its own LRU order and byte budget
+ */
+typedef struct
+{
+    pthread_mutex_t lock;
+    CachedResponse *buckets[RESPONSE_CACHE_BUCKETS];
+    CachedResponse *lru_head;
+    CachedResponse *lru_tail;
+    size_t bytes;
+} ResponseCacheShard;
+
+/**
+ * @brief Cache of serialized GET responses keyed by request path, shared by all workers
+ * @param shard_capacity : Byte budget of each shard; 0 disables the cache
+ */
+typedef struct
+{
+    ResponseCacheShard shards[RESPONSE_CACHE_SHARDS];
+    size_t shard_capacity;
+} ResponseCache;
+
+// Response cache functions
+void response_cache_init(ResponseCache *cache, size_t capacity);
+void response_cache_destroy(ResponseCache *cache);
+CachedResponse *response_cache_lookup(ResponseCache *cache, const char *key, size_t key_len);
+CachedResponse *response_cache_insert(ResponseCache *cache, const char *key, size_t key_len, const char *path,
+                                      int fd, const struct stat *st, const char *content_type);
+void response_cache_retain(CachedResponse *response);
+void response_cache_release(CachedResponse *response);
+int etag_list_matches(const char *etag, const char *if_none_match);
+
+#endif // RESPONSE_CACHE_H
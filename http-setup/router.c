@@ -0,0 +1,402 @@
+/**
+ * @file: router.c
+ *
+ * ℹ️ A radix-tree router from method and path pattern to a handler.
+ *
+ * 1. Patterns are literal text with two kinds of parameters: ':name' matches one non-empty path segment and
+ *      '*name' matches the rest of the path, including nothing. Both start a segment, and '*name' ends the pattern.
+ * 2. Literal text is stored in a radix tree: a node holds a run of text shared by all routes below it, and its
+ *      children are told apart by their first byte. Parameters hang off a node as two extra children.
+ * 3. A lookup walks the tree along the path, comparing each byte about once, so its cost grows with the length
+ *      of the path, not with the number of routes. Literal text is preferred over ':name', and ':name' over
+ *      '*name'; when a preferred branch dead-ends, the lookup backs up and tries the next.
+ * 4. Parameter values are captured as spans of the path: a lookup allocates nothing and copies nothing.
+ *      The tree is built before the workers start and only read afterwards, so they share it without locks.
+ */
+#include "router.h"
+#include <stdlib.h>
+#include <string.h>
+
+/// @brief Allocates a node matching 'len' bytes of literal text
+static RouteNode *new_node(const char *label, size_t len)
+{
+    RouteNode *node = calloc(1, sizeof(RouteNode));
+    if (node && len > 0)
+    {
+        node->label = strndup(label, len);
+        if (!node->label)
+        {
+            free(node);
+            return NULL;
+        }
+        node->label_len = len;
+    }
+    return node;
+}
+
+/// @brief Frees the subtree below a node and everything the node owns, but not the node itself
+static void free_children(RouteNode *node)
+{
+    for (int i = 0; i < node->child_count; i++)
+    {
+        free_children(node->children[i]);
+        free(node->children[i]);
+    }
+    if (node->param)
+    {
+        free_children(node->param);
+        free(node->param);
+    }
+    if (node->wildcard)
+    {
+        free_children(node->wildcard);
+        free(node->wildcard);
+    }
+    free(node->children);
+    free(node->indices);
+    free(node->label);
+    free(node->name);
+}
+
+/// @brief Literal child whose label starts with 'c', or NULL
+static RouteNode *find_child(const RouteNode *node, char c)
+{
+    for (int i = 0; i < node->child_count; i++)
+    {
+        if (node->indices[i] == c)
+        {
+            return node->children[i];
+        }
+    }
+    return NULL;
+}
+
+/// @brief Appends a literal child; returns -1 on allocation failure
+static int add_child(RouteNode *node, RouteNode *child)
+{
+    RouteNode **children = realloc(node->children, (node->child_count + 1) * sizeof(RouteNode *));
+    if (!children)
+    {
+        return -1;
+    }
+    node->children = children;
+    char *indices = realloc(node->indices, node->child_count + 1);
+    if (!indices)
+    {
+        return -1;
+    }
+    node->indices = indices;
+    node->children[node->child_count] = child;
+    node->indices[node->child_count] = child->label[0];
+    node->child_count++;
+    return 0;
+}
+
+/**
+ * @brief Splits a node after the first 'at' bytes of its label
+ * @details The node keeps the first part, so its parent's pointer stays valid; a new child takes the rest of
+ *      the label together with everything the node had below it.
+ * @return 0 on success, -1 on allocation failure.
+ */
+static int split_node(RouteNode *node, size_t at)
+{
+    RouteNode *rest = new_node(node->label + at, node->label_len - at);
+    if (!rest)
+    {
+        return -1;
+    }
+    rest->indices = node->indices;
+    rest->children = node->children;
+    rest->child_count = node->child_count;
+    rest->param = node->param;
+    rest->wildcard = node->wildcard;
+    memcpy(rest->values, node->values, sizeof(node->values));
+
+    node->label_len = at;
+    node->indices = NULL;
+    node->children = NULL;
+    node->child_count = 0;
+    node->param = NULL;
+    node->wildcard = NULL;
+    memset(node->values, 0, sizeof(node->values));
+    if (add_child(node, rest) == -1)
+    {
+        free_children(rest);
+        free(rest);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Adds literal text below a node
+ * @details [LOGIC][INSERT_LITERAL]
+ * 1. Follow the child starting with the next byte, if any, for as long as its label matches the text.
+ * 2. Where the text leaves a label part-way through, split that node at the point where they differ.
+ * 3. Text left over after the last matching child becomes a new child of its own.
+ * @return The node whose label ends where the text ends, or NULL on allocation failure.
+ */
+static RouteNode *insert_literal(RouteNode *node, const char *text, size_t len)
+{
+    while (len > 0)
+    {
+        // {ref}{LOGIC}{INSERT_LITERAL}{1}
+        RouteNode *child = find_child(node, text[0]);
+        if (!child)
+        {
+            // {ref}{LOGIC}{INSERT_LITERAL}{3}
+            child = new_node(text, len);
+            if (!child || add_child(node, child) == -1)
+            {
+                free(child ? child->label : NULL);
+                free(child);
+                return NULL;
+            }
+            return child;
+        }
+        size_t common = 0;
+        while (common < child->label_len && common < len && child->label[common] == text[common])
+        {
+            common++;
+        }
+
+        // {ref}{LOGIC}{INSERT_LITERAL}{2}
+        if (common < child->label_len && split_node(child, common) == -1)
+        {
+            return NULL;
+        }
+        node = child;
+        text += common;
+        len -= common;
+    }
+    return node;
+}
+
+/// @brief Returns the ':name' or '*name' child of a node, creating it; NULL if it exists under another name
+static RouteNode *insert_param(RouteNode **slot, const char *name, size_t len)
+{
+    if (!*slot)
+    {
+        *slot = new_node(NULL, 0);
+        if (!*slot)
+        {
+            return NULL;
+        }
+        (*slot)->name = strndup(name, len);
+        if (!(*slot)->name)
+        {
+            free(*slot);
+            *slot = NULL;
+            return NULL;
+        }
+        return *slot;
+    }
+    if (strlen((*slot)->name) != len || strncmp((*slot)->name, name, len) != 0)
+    {
+        return NULL;
+    }
+    return *slot;
+}
+
+/// @brief Sets up an empty router
+void router_init(Router *router)
+{
+    memset(router, 0, sizeof(*router));
+}
+
+/// @brief Frees every route
+void router_destroy(Router *router)
+{
+    free_children(&router->root);
+    memset(router, 0, sizeof(*router));
+}
+
+/**
+ * @brief Registers a route
+ * @param pattern : Path pattern starting with '/', e.g. "/users/:id/posts", or "/static/" followed by "*path"
+ * @param value : Returned by router_lookup() for matching requests; must not be NULL
+ * @details [LOGIC][ROUTER_ADD]
+ * 1. Check the pattern: parameters start a segment, have a non-empty name, are at most ROUTER_MAX_PARAMS,
+ *      and '*name' comes last.
+ * 2. Insert literal text into the radix tree, and descend into the parameter child for ':name' and '*name'.
+ *      Two patterns may only share a parameter position if they name the parameter the same way.
+ * 3. Store the value for the method at the node where the pattern ends.
+ * @return 0 on success, -1 if the pattern is invalid, conflicts with an existing one or is already
+ *      registered for the method, or on allocation failure.
+ */
+int router_add(Router *router, HttpMethod method, const char *pattern, void *value)
+{
+    // {ref}{LOGIC}{ROUTER_ADD}{1}
+    if (method == HTTP_METHOD_UNKNOWN || !value || pattern[0] != '/')
+    {
+        return -1;
+    }
+    RouteNode *node = &router->root;
+    const char *p = pattern;
+    int params = 0;
+    while (*p && node)
+    {
+        if (*p == ':' || *p == '*')
+        {
+            size_t len = *p == ':' ? strcspn(p + 1, "/") : strlen(p + 1);
+            if (p[-1] != '/' || len == 0 || strcspn(p + 1, ":*/") < len || ++params > ROUTER_MAX_PARAMS)
+            {
+                return -1;
+            }
+            // {ref}{LOGIC}{ROUTER_ADD}{2}
+            node = insert_param(*p == ':' ? &node->param : &node->wildcard, p + 1, len);
+            p += 1 + len;
+        }
+        else
+        {
+            size_t len = strcspn(p, ":*");
+            node = insert_literal(node, p, len);
+            p += len;
+        }
+    }
+
+    // {ref}{LOGIC}{ROUTER_ADD}{3}
+    if (!node || node->values[method])
+    {
+        return -1;
+    }
+    node->values[method] = value;
+    return 0;
+}
+
+/**
+ * @brief Tells whether a route for the method ends at this node
+ * @param other : Set to the node if only routes for other methods end here, so a failed lookup can tell
+ *      "405 Method Not Allowed" from "404 Not Found"
+ */
+static int ends_route(const RouteNode *node, HttpMethod method, const RouteNode **other)
+{
+    if (node->values[method])
+    {
+        return 1;
+    }
+    for (int i = 0; i < HTTP_METHOD_COUNT && !*other; i++)
+    {
+        if (node->values[i])
+        {
+            *other = node;
+        }
+    }
+    return 0;
+}
+
+/// @brief Records a parameter value; returns 0 if the match already holds ROUTER_MAX_PARAMS
+static int capture(RouteMatch *match, const RouteNode *node, size_t offset, size_t length)
+{
+    if (match->param_count == ROUTER_MAX_PARAMS)
+    {
+        return 0;
+    }
+    RouteParam *param = &match->params[match->param_count++];
+    param->name = node->name;
+    param->value.offset = offset;
+    param->value.length = length;
+    return 1;
+}
+
+/**
+ * @brief Matches the rest of a path, from 'pos', against the subtree below a node
+ * @param other : Receives the first node where the path matched a route for another method only
+ * @details [LOGIC][MATCH_NODE]
+ * 1. At the end of the path, the node matches if a route for the method ends there; otherwise a '*name'
+ *      child may match the empty rest.
+ * 2. Try the literal child starting with the next byte, if its whole label follows in the path.
+ * 3. Then a ':name' child, which takes the path up to the next '/'.
+ * 4. Then a '*name' child, which takes all of the rest.
+ * Parameters captured on a branch that fails are dropped again before the next is tried.
+ * @return The node where a route for the method ends, or NULL.
+ */
+static const RouteNode *match_node(const RouteNode *node, HttpMethod method, const char *path, size_t pos,
+                                   size_t len, RouteMatch *match, const RouteNode **other)
+{
+    // {ref}{LOGIC}{MATCH_NODE}{1}
+    if (pos == len && ends_route(node, method, other))
+    {
+        return node;
+    }
+    if (pos == len)
+    {
+        if (node->wildcard && ends_route(node->wildcard, method, other) && capture(match, node->wildcard, pos, 0))
+        {
+            return node->wildcard;
+        }
+        return NULL;
+    }
+
+    // {ref}{LOGIC}{MATCH_NODE}{2}
+    const RouteNode *child = find_child(node, path[pos]);
+    if (child && len - pos >= child->label_len && memcmp(path + pos, child->label, child->label_len) == 0)
+    {
+        const RouteNode *found = match_node(child, method, path, pos + child->label_len, len, match, other);
+        if (found)
+        {
+            return found;
+        }
+    }
+
+    // {ref}{LOGIC}{MATCH_NODE}{3}
+    int captured = match->param_count;
+    if (node->param && path[pos] != '/')
+    {
+        size_t end = pos;
+        while (end < len && path[end] != '/')
+        {
+            end++;
+        }
+        if (capture(match, node->param, pos, end - pos))
+        {
+            const RouteNode *found = match_node(node->param, method, path, end, len, match, other);
+            if (found)
+            {
+                return found;
+            }
+            match->param_count = captured;
+        }
+    }
+
+    // {ref}{LOGIC}{MATCH_NODE}{4}
+    if (node->wildcard && ends_route(node->wildcard, method, other) && capture(match, node->wildcard, pos, len - pos))
+    {
+        return node->wildcard;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Finds the route of a request
+ * @param path, len : The path part of the request target, without query or fragment
+ * @param match : Receives the value and the captured parameters; spans are offsets into 'path'
+ * @return ROUTE_FOUND, ROUTE_NO_METHOD if routes match the path only for other methods, or ROUTE_NOT_FOUND.
+ */
+RouteResult router_lookup(const Router *router, HttpMethod method, const char *path, size_t len, RouteMatch *match)
+{
+    const RouteNode *other = NULL;
+    match->value = NULL;
+    match->param_count = 0;
+    const RouteNode *node = match_node(&router->root, method, path, 0, len, match, &other);
+    if (!node)
+    {
+        match->param_count = 0;
+        return other ? ROUTE_NO_METHOD : ROUTE_NOT_FOUND;
+    }
+    match->value = node->values[method];
+    return ROUTE_FOUND;
+}
+
+/// @brief Value of a captured parameter, as a span of the path, or NULL if the route has no such parameter
+const Span *router_param(const RouteMatch *match, const char *name)
+{
+    for (int i = 0; i < match->param_count; i++)
+    {
+        if (strcmp(match->params[i].name, name) == 0)
+        {
+            return &match->params[i].value;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,82 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <stddef.h>
+#include "http-names.h"
+#include "http-scan.h"
+
+#define ROUTER_MAX_PARAMS 8 ///< Most parameters a route can capture.
+
+/**
+ * @brief A node of the radix tree: a run of literal path text, or one parameter
+ * @param label, label_len : Literal text this node matches; empty for parameter and wildcard nodes
+ * @param name : Parameter name of a ':name' or '*name' node
+ * @param indices : First byte of the label of each child, in the order of children
+ * @param children : Literal children; no two share a first byte
+ * @param param : Child matching one non-empty ':name' segment
+ * @param wildcard : Child matching the rest of the path, '*name'
+ * @param values : What the route ending here serves, per method; NULL if it has none
+ */
+typedef struct RouteNode
+{
+    char *label;
+    size_t label_len;
+    char *name;
+    char *indices;
+    struct RouteNode **children;
+    int child_count;
+    struct RouteNode *param;
+    struct RouteNode *wildcard;
+    void *values[HTTP_METHOD_COUNT];
+} RouteNode;
+
+/**
+ * @brief A captured parameter
+ * @param name : Parameter name from the pattern, without ':' or '*'
+ * @param value : Span of the value, as an offset into the path passed to router_lookup()
+ */
+typedef struct
+{
+    const char *name;
+    Span value;
+} RouteParam;
+
+/**
+ * @brief Outcome of router_lookup()
+ */
+typedef enum
+{
+    ROUTE_NOT_FOUND, ///< No route matches the path.
+    ROUTE_NO_METHOD, ///< A route matches the path, but not for this method.
+    ROUTE_FOUND
+} RouteResult;
+
+/**
+ * @brief The route a request matched
+ * @param value : What router_add() registered for the path and method (ROUTE_FOUND only)
+ * @param params, param_count : Parameters captured along the path, in pattern order
+ */
+typedef struct
+{
+    void *value;
+    RouteParam params[ROUTER_MAX_PARAMS];
+    int param_count;
+} RouteMatch;
+
+/**
+ * @brief Routes from method and path pattern to a value
+ * @param root : Node matching the empty path; every pattern starts with '/'
+ */
+typedef struct
+{
+    RouteNode root;
+} Router;
+
+// Router functions
+void router_init(Router *router);
+void router_destroy(Router *router);
+int router_add(Router *router, HttpMethod method, const char *pattern, void *value);
+RouteResult router_lookup(const Router *router, HttpMethod method, const char *path, size_t len, RouteMatch *match);
+const Span *router_param(const RouteMatch *match, const char *name);
+
+#endif // ROUTER_H
@@ -0,0 +1,280 @@
+/**
+ * @file: timer-wheel.c
+ *
+ * ℹ️ A hierarchical timer wheel for connection timeouts.
+ *
+ * 1. Time advances in ticks. The lowest wheel has one slot per tick for the next 64 ticks; each wheel
+ *      above it has slots 64 times as wide, so four wheels cover 2^24 ticks (19 days at 100 ms).
+ * 2. Scheduling and cancelling a timer link or unlink it in one slot list: O(1), independent of how
+ *      many connections are open. The timer is embedded in the connection, so nothing is allocated.
+ * 3. Each tick only looks at the one lowest-wheel slot that is due. Every 64 ticks the next slot of
+ *      the wheel above is "cascaded": its timers are re-inserted, now landing in a lower wheel.
+ *      Connections whose timeouts are far away are never touched on a tick.
+ * 4. A bitmap of non-empty slots tells the event loop how long it may sleep in epoll_wait().
+ */
+#define _GNU_SOURCE // CLOCK_MONOTONIC_COARSE
+#include "timer-wheel.h"
+#include <stddef.h>
+#include <time.h>
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define MAX_TICKS ((1ULL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOT_BITS)) - 1)
+
+/// @brief Milliseconds on the monotonic clock; the coarse clock avoids a precise read on every loop pass
+uint64_t timer_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/// @brief Prepare a timer that is not scheduled yet
+void timer_init(TimerNode *timer, TimerCallback callback, void *data)
+{
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->callback = callback;
+    timer->data = data;
+}
+
+/// @brief Non-zero while the timer is scheduled
+int timer_pending(const TimerNode *timer)
+{
+    return timer->next != NULL;
+}
+
+/**
+ * @brief Initialize an empty wheel
+ * @param tick_ms Resolution of the wheel; timers fire at most one tick late.
+ */
+void timer_wheel_init(TimerWheel *wheel, uint64_t tick_ms)
+{
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+        {
+            TimerNode *head = &wheel->slots[level][slot];
+            head->next = head;
+            head->prev = head;
+        }
+        wheel->occupied[level] = 0;
+    }
+    wheel->tick_ms = tick_ms;
+    wheel->now_ms = timer_now_ms();
+    wheel->current = wheel->now_ms / tick_ms + 1;
+    wheel->count = 0;
+}
+
+/**
+ * @brief Links a timer into the slot matching its expiry tick
+ * @details [LOGIC][TIMER_INSERT]
+ * 1. A timer due within 64 ticks goes to the lowest wheel, in the slot of its own tick. A timer that
+ *      is already due goes to the slot of the next tick to process.
+ * 2. Otherwise pick the lowest wheel whose range covers the distance and the slot of the expiry tick
+ *      at that wheel's granularity. Distances beyond the top wheel are clamped to its range.
+ */
+static void insert_timer(TimerWheel *wheel, TimerNode *timer)
+{
+    int level = 0;
+    uint64_t slot;
+
+    // {ref}{LOGIC}{TIMER_INSERT}{1}
+    if (timer->expires < wheel->current)
+    {
+        slot = wheel->current & SLOT_MASK;
+    }
+    else
+    {
+        // {ref}{LOGIC}{TIMER_INSERT}{2}
+        uint64_t delta = timer->expires - wheel->current;
+        if (delta > MAX_TICKS)
+        {
+            delta = MAX_TICKS;
+            timer->expires = wheel->current + delta;
+        }
+        while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ULL << ((level + 1) * TIMER_WHEEL_SLOT_BITS)))
+        {
+            level++;
+        }
+        slot = (timer->expires >> (level * TIMER_WHEEL_SLOT_BITS)) & SLOT_MASK;
+    }
+
+    TimerNode *head = &wheel->slots[level][slot];
+    timer->level = level;
+    timer->slot = (int)slot;
+    timer->next = head;
+    timer->prev = head->prev;
+    head->prev->next = timer;
+    head->prev = timer;
+    wheel->occupied[level] |= 1ULL << slot;
+}
+
+/// @brief Unlinks a timer from whatever list it is on, clearing its slot's bit if that slot emptied
+static void unlink_timer(TimerWheel *wheel, TimerNode *timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = NULL;
+    timer->prev = NULL;
+    TimerNode *head = &wheel->slots[timer->level][timer->slot];
+    if (head->next == head)
+    {
+        wheel->occupied[timer->level] &= ~(1ULL << timer->slot);
+    }
+}
+
+/**
+ * @brief (Re)schedule a timer to fire 'timeout_ms' after the wheel's current time
+ * @attention A pending timer is moved, so this also pushes an existing deadline back.
+ */
+void timer_wheel_schedule(TimerWheel *wheel, TimerNode *timer, uint64_t timeout_ms)
+{
+    if (timer_pending(timer))
+    {
+        unlink_timer(wheel, timer);
+        wheel->count--;
+    }
+    timer->expires = (wheel->now_ms + timeout_ms + wheel->tick_ms - 1) / wheel->tick_ms;
+    insert_timer(wheel, timer);
+    wheel->count++;
+}
+
+/// @brief Stop a timer; does nothing if it is not scheduled
+void timer_wheel_cancel(TimerWheel *wheel, TimerNode *timer)
+{
+    if (timer_pending(timer))
+    {
+        unlink_timer(wheel, timer);
+        wheel->count--;
+    }
+}
+
+/**
+ * @brief Moves every timer of one slot of a higher wheel down to the wheels below it
+ * @return The slot index, so the caller knows whether the wheel above has to cascade as well.
+ */
+static int cascade(TimerWheel *wheel, int level)
+{
+    int slot = (wheel->current >> (level * TIMER_WHEEL_SLOT_BITS)) & SLOT_MASK;
+    TimerNode *head = &wheel->slots[level][slot];
+    TimerNode *timer = head->next;
+
+    head->next = head;
+    head->prev = head;
+    wheel->occupied[level] &= ~(1ULL << slot);
+    while (timer != head)
+    {
+        TimerNode *next = timer->next;
+        insert_timer(wheel, timer);
+        timer = next;
+    }
+    return slot;
+}
+
+/**
+ * @brief Run the timers that expired up to 'now_ms'
+ * @param now_ms Current time from timer_now_ms().
+ * @param arg Passed to every callback.
+ * @details [LOGIC][TIMER_ADVANCE]
+ * 1. With no timers scheduled, just move the wheel to the current tick.
+ * 2. For every tick that passed: when the lowest wheel wraps around, cascade the next slot of the
+ *      wheel above (and of the one above that, whenever that wraps too).
+ * 3. Move the due slot's timers to a private list before running them, and advance 'current' first:
+ *      a callback may then cancel other timers of the list or schedule new ones, which land in a later tick.
+ */
+void timer_wheel_advance(TimerWheel *wheel, uint64_t now_ms, void *arg)
+{
+    uint64_t target = now_ms / wheel->tick_ms;
+    wheel->now_ms = now_ms;
+
+    // {ref}{LOGIC}{TIMER_ADVANCE}{1}
+    if (wheel->count == 0)
+    {
+        if (wheel->current <= target)
+        {
+            wheel->current = target + 1;
+        }
+        return;
+    }
+
+    while (wheel->current <= target)
+    {
+        // {ref}{LOGIC}{TIMER_ADVANCE}{2}
+        int index = wheel->current & SLOT_MASK;
+        if (index == 0)
+        {
+            for (int level = 1; level < TIMER_WHEEL_LEVELS && cascade(wheel, level) == 0; level++)
+            {
+            }
+        }
+
+        // {ref}{LOGIC}{TIMER_ADVANCE}{3}
+        TimerNode expired;
+        TimerNode *head = &wheel->slots[0][index];
+        if (head->next == head)
+        {
+            wheel->current++;
+            continue;
+        }
+        expired.next = head->next;
+        expired.prev = head->prev;
+        expired.next->prev = &expired;
+        expired.prev->next = &expired;
+        head->next = head;
+        head->prev = head;
+        wheel->occupied[0] &= ~(1ULL << index);
+        wheel->current++;
+
+        while (expired.next != &expired)
+        {
+            TimerNode *timer = expired.next;
+            unlink_timer(wheel, timer);
+            wheel->count--;
+            timer->callback(timer, arg);
+        }
+    }
+}
+
+/**
+ * @brief How long the event loop may sleep before the wheel needs to be advanced
+ * @details [LOGIC][TIMER_NEXT_TIMEOUT]
+ * 1. No timers: sleep until an event arrives (-1).
+ * 2. Otherwise find the next non-empty slot of the lowest wheel from its bitmap.
+ * 3. If the higher wheels hold timers, also wake up for the next cascade, when they move down.
+ * @return Milliseconds for epoll_wait(), or -1 for no timeout.
+ */
+int timer_wheel_next_timeout(const TimerWheel *wheel)
+{
+    // {ref}{LOGIC}{TIMER_NEXT_TIMEOUT}{1}
+    if (wheel->count == 0)
+    {
+        return -1;
+    }
+
+    // {ref}{LOGIC}{TIMER_NEXT_TIMEOUT}{2}
+    int index = wheel->current & SLOT_MASK;
+    uint64_t ticks = TIMER_WHEEL_SLOTS;
+    uint64_t bits = wheel->occupied[0];
+    if (bits)
+    {
+        uint64_t rotated = index ? (bits >> index) | (bits << (TIMER_WHEEL_SLOTS - index)) : bits;
+        ticks = __builtin_ctzll(rotated);
+    }
+
+    // {ref}{LOGIC}{TIMER_NEXT_TIMEOUT}{3}
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        if (wheel->occupied[level])
+        {
+            uint64_t to_cascade = (TIMER_WHEEL_SLOTS - index) & SLOT_MASK;
+            if (to_cascade < ticks)
+            {
+                ticks = to_cascade;
+            }
+            break;
+        }
+    }
+
+    uint64_t deadline = (wheel->current + ticks) * wheel->tick_ms;
+    return deadline > wheel->now_ms ? (int)(deadline - wheel->now_ms) : 0;
+}
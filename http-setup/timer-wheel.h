@@ -0,0 +1,63 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+
+#define TIMER_WHEEL_LEVELS 4      ///< Number of wheels; each covers 64 times the span of the one below.
+#define TIMER_WHEEL_SLOT_BITS 6   ///< log2 of the number of slots per wheel.
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+
+struct TimerNode;
+
+/// @brief Called when a timer expires; 'arg' is the value passed to timer_wheel_advance()
+typedef void (*TimerCallback)(struct TimerNode *timer, void *arg);
+
+/**
+ * @brief A timer, embedded in the object it belongs to
+ * @param next, prev : Links in the slot list; next is NULL while the timer is not scheduled
+ * @param expires : Tick at which the timer fires
+ * @param level, slot : Wheel slot the timer is linked into
+ * @param callback : Function run on expiry
+ * @param data : Owner of the timer, for the callback
+ */
+typedef struct TimerNode
+{
+    struct TimerNode *next;
+    struct TimerNode *prev;
+    uint64_t expires;
+    int level;
+    int slot;
+    TimerCallback callback;
+    void *data;
+} TimerNode;
+
+/**
+ * @brief Hierarchical timer wheel
+ * @param slots : Circular list heads, one per slot and level
+ * @param occupied : Per level, a bit for every slot whose list is not empty
+ * @param current : Next tick to process
+ * @param tick_ms : Length of a tick in milliseconds
+ * @param now_ms : Time of the last timer_wheel_advance(); timeouts are measured from it
+ * @param count : Number of scheduled timers
+ */
+typedef struct
+{
+    TimerNode slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t occupied[TIMER_WHEEL_LEVELS];
+    uint64_t current;
+    uint64_t tick_ms;
+    uint64_t now_ms;
+    int count;
+} TimerWheel;
+
+// Timer wheel functions
+uint64_t timer_now_ms(void);
+void timer_init(TimerNode *timer, TimerCallback callback, void *data);
+int timer_pending(const TimerNode *timer);
+void timer_wheel_init(TimerWheel *wheel, uint64_t tick_ms);
+void timer_wheel_schedule(TimerWheel *wheel, TimerNode *timer, uint64_t timeout_ms);
+void timer_wheel_cancel(TimerWheel *wheel, TimerNode *timer);
+void timer_wheel_advance(TimerWheel *wheel, uint64_t now_ms, void *arg);
+int timer_wheel_next_timeout(const TimerWheel *wheel);
+
+#endif // TIMER_WHEEL_H
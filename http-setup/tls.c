@@ -0,0 +1,194 @@
+/**
+ * @file: tls.c
+ *
+ * ℹ️ TLS termination with OpenSSL, handing the record encryption to the kernel (kTLS) where it can.
+ *
+ * 1. OpenSSL runs the handshake on the non-blocking socket. The context enables SSL_OP_ENABLE_KTLS and only
+ *      offers AEAD ciphers the kernel implements (AES-GCM, ChaCha20-Poly1305), so once the keys are agreed
+ *      OpenSSL attaches the "tls" upper layer protocol to the socket (setsockopt TCP_ULP) and passes the
+ *      session keys down with TLS_TX and, where supported, TLS_RX.
+ * 2. With the transmit keys in the kernel, the socket takes plain bytes: the server keeps writing responses
+ *      with sendmsg() and sendfile(), the kernel frames and encrypts them, and static files stay zero-copy.
+ * 3. Input is always read with SSL_read(). With TLS_RX offloaded that returns what the kernel already
+ *      decrypted; OpenSSL still sees the alerts and handshake messages a plain read() would fail on.
+ * 4. A kernel without kTLS (no "tls" module) still gets a working server: then output goes through
+ *      SSL_write() in records of up to TLS_RECORD_SIZE, file bytes included, at the cost of copying them.
+ */
+#include "tls.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <openssl/err.h>
+
+/**
+ * @brief Creates the server context shared by all workers
+ * @param cert_file : PEM file with the certificate chain, leaf first
+ * @param key_file : PEM file with the private key; may be the same file
+ * @details [LOGIC][TLS_CONTEXT]
+ * 1. TLS 1.2 and 1.3 only, without renegotiation: it would change keys the kernel holds.
+ * 2. Ask OpenSSL to offload the records to the kernel, and restrict TLS 1.2 to the ciphers kTLS handles.
+ *      TLS 1.3 suites are all AEADs the kernel knows.
+ * 3. Partial writes and moving write buffers, so output written through OpenSSL can be retried from the
+ *      output queue. A peer that closes without close_notify reads as a plain end of stream; HTTP framing
+ *      already tells a truncated message.
+ * 4. Load the certificate chain and the key and check they belong together.
+ * @return The context, or NULL with OpenSSL's errors printed.
+ */
+SSL_CTX *tls_context_create(const char *cert_file, const char *key_file)
+{
+    SSL_CTX *context = SSL_CTX_new(TLS_server_method());
+    if (!context)
+    {
+        ERR_print_errors_fp(stderr);
+        return NULL;
+    }
+    // {ref}{LOGIC}{TLS_CONTEXT}{1,2,3}
+    SSL_CTX_set_min_proto_version(context, TLS1_2_VERSION);
+    SSL_CTX_set_options(context, SSL_OP_ENABLE_KTLS | SSL_OP_NO_RENEGOTIATION | SSL_OP_IGNORE_UNEXPECTED_EOF);
+    SSL_CTX_set_mode(context, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    // {ref}{LOGIC}{TLS_CONTEXT}{4}
+    if (SSL_CTX_set_cipher_list(context, "ECDHE+AESGCM:ECDHE+CHACHA20") != 1 ||
+        SSL_CTX_use_certificate_chain_file(context, cert_file) != 1 ||
+        SSL_CTX_use_PrivateKey_file(context, key_file, SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(context) != 1)
+    {
+        ERR_print_errors_fp(stderr);
+        SSL_CTX_free(context);
+        return NULL;
+    }
+    return context;
+}
+
+/**
+ * @brief Starts the server side of a TLS session on an accepted socket
+ * @return The session, or NULL on allocation failure.
+ */
+SSL *tls_session_create(SSL_CTX *context, int fd)
+{
+    SSL *ssl = SSL_new(context);
+    if (!ssl)
+    {
+        ERR_clear_error();
+        return NULL;
+    }
+    if (SSL_set_fd(ssl, fd) != 1)
+    {
+        ERR_clear_error();
+        SSL_free(ssl);
+        return NULL;
+    }
+    SSL_set_accept_state(ssl);
+    return ssl;
+}
+
+/**
+ * @brief Runs the handshake as far as the socket allows without blocking
+ * @return Whether it is done, what it waits for, or that it failed.
+ */
+TlsHandshake tls_handshake(SSL *ssl)
+{
+    int result = SSL_do_handshake(ssl);
+    if (result == 1)
+    {
+        return TLS_HANDSHAKE_DONE;
+    }
+    switch (SSL_get_error(ssl, result))
+    {
+    case SSL_ERROR_WANT_READ:
+        return TLS_HANDSHAKE_WANT_READ;
+    case SSL_ERROR_WANT_WRITE:
+        return TLS_HANDSHAKE_WANT_WRITE;
+    default:
+        ERR_clear_error();
+        return TLS_HANDSHAKE_FAILED;
+    }
+}
+
+/// @brief Whether the kernel encrypts what is written to the socket, after a completed handshake
+int tls_kernel_send(SSL *ssl)
+{
+    return BIO_get_ktls_send(SSL_get_wbio(ssl)) > 0;
+}
+
+/**
+ * @brief Reads decrypted application data
+ * @return Like read(): the bytes read, 0 at the end of the stream, or -1 with errno EAGAIN while no
+ *      record is complete, EIO on a protocol error.
+ */
+ssize_t tls_read(SSL *ssl, void *buf, size_t len)
+{
+    errno = 0;
+    int result = SSL_read(ssl, buf, len > INT_MAX ? INT_MAX : (int)len);
+    if (result > 0)
+    {
+        return result;
+    }
+    switch (SSL_get_error(ssl, result))
+    {
+    case SSL_ERROR_ZERO_RETURN:
+        return 0;
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        errno = EAGAIN;
+        return -1;
+    case SSL_ERROR_SYSCALL:
+        ERR_clear_error();
+        if (errno == 0)
+        {
+            return 0;
+        }
+        return -1;
+    default:
+        ERR_clear_error();
+        errno = EIO;
+        return -1;
+    }
+}
+
+/**
+ * @brief Encrypts and sends application data in user space, when the kernel does not
+ * @attention After a -1 with EAGAIN the same bytes must be written again, at least as many of them.
+ * @return Like write(): the bytes of the records sent, or -1 with errno EAGAIN while the socket is full,
+ *      EPIPE or EIO once the session is unusable.
+ */
+ssize_t tls_write(SSL *ssl, const void *buf, size_t len)
+{
+    errno = 0;
+    int result = SSL_write(ssl, buf, len > INT_MAX ? INT_MAX : (int)len);
+    if (result > 0)
+    {
+        return result;
+    }
+    switch (SSL_get_error(ssl, result))
+    {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        errno = EAGAIN;
+        return -1;
+    case SSL_ERROR_SYSCALL:
+        ERR_clear_error();
+        if (errno == 0)
+        {
+            errno = EPIPE;
+        }
+        return -1;
+    default:
+        ERR_clear_error();
+        errno = EIO;
+        return -1;
+    }
+}
+
+/**
+ * @brief Ends a session: sends close_notify if the handshake completed, without waiting for the peer's, and
+ *      frees it. The socket itself is left to the caller.
+ */
+void tls_session_close(SSL *ssl)
+{
+    if (SSL_is_init_finished(ssl))
+    {
+        SSL_shutdown(ssl);
+    }
+    ERR_clear_error();
+    SSL_free(ssl);
+}
@@ -0,0 +1,32 @@
+#ifndef TLS_H
+#define TLS_H
+
+#include <sys/types.h>
+#include <openssl/ssl.h>
+
+#define TLS_RECORD_SIZE 16384  ///< Largest record payload; output written through OpenSSL is gathered up to this.
+
+/**
+ * @brief Where the handshake of a connection stands
+ * @param TLS_HANDSHAKE_DONE : Application data may flow
+ * @param TLS_HANDSHAKE_WANT_READ, TLS_HANDSHAKE_WANT_WRITE : Waiting for the socket to become readable or writable
+ * @param TLS_HANDSHAKE_FAILED : The peer is not a TLS client, or no common parameters were found
+ */
+typedef enum
+{
+    TLS_HANDSHAKE_DONE,
+    TLS_HANDSHAKE_WANT_READ,
+    TLS_HANDSHAKE_WANT_WRITE,
+    TLS_HANDSHAKE_FAILED,
+} TlsHandshake;
+
+// TLS functions
+SSL_CTX *tls_context_create(const char *cert_file, const char *key_file);
+SSL *tls_session_create(SSL_CTX *context, int fd);
+TlsHandshake tls_handshake(SSL *ssl);
+int tls_kernel_send(SSL *ssl);
+ssize_t tls_read(SSL *ssl, void *buf, size_t len);
+ssize_t tls_write(SSL *ssl, const void *buf, size_t len);
+void tls_session_close(SSL *ssl);
+
+#endif // TLS_H
@@ -0,0 +1,325 @@
+/**
+ * @file: upstream.c
+ *
+ * ℹ️ Backend servers of the reverse proxy: per-worker pools of keep-alive connections, least-outstanding-requests
+ *      balancing and health checks.
+ *
+ * 1. An upstream group maps a path prefix to a list of servers, given on the command line as
+ *      "prefix=host:port,host:port". Groups are parsed once and shared; every worker keeps its own
+ *      state per server (UpstreamPool), so the workers share nothing and need no locks.
+ * 2. A worker keeps up to UPSTREAM_POOL_SIZE idle connections per server, each with the pipe its bodies
+ *      are spliced through. The most recently used one is reused first; a one-byte non-blocking
+ *      MSG_PEEK shows whether the server closed it meanwhile. Links idle for UPSTREAM_IDLE_TIMEOUT_MS are closed.
+ * 3. A request goes to the healthy server with the fewest requests of this worker in flight; ties rotate.
+ * 4. A server is taken out of rotation after UPSTREAM_MAX_FAILS consecutive failures, counting both failed
+ *      requests and failed probes. Every UPSTREAM_CHECK_INTERVAL_MS each server gets a probe,
+ *      'GET UPSTREAM_CHECK_PATH', answered by the next check: any status below 500 brings it back.
+ *      The probe runs off the worker's timer without an epoll registration: it is written as soon as the
+ *      connection is up and its answer is read without blocking one interval later.
+ */
+#define _GNU_SOURCE // pipe2()
+#include "upstream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+/// @brief Closes a link's socket and pipe
+static void close_link(UpstreamLink *link)
+{
+    close(link->fd);
+    close(link->pipe[0]);
+    close(link->pipe[1]);
+}
+
+/**
+ * @brief Parses an upstream group from "prefix=host:port,host:port"
+ * @details [LOGIC][UPSTREAM_PARSE]
+ * 1. The prefix must start with '/'; a trailing '/' is dropped, so "/" forwards every path.
+ * 2. Every server is resolved once, to its first IPv4 address, and named "address:port".
+ * @return 0 on success, -1 if the specification is invalid or a host does not resolve.
+ */
+int upstream_group_parse(UpstreamGroup *group, const char *spec)
+{
+    memset(group, 0, sizeof(*group));
+    // {ref}{LOGIC}{UPSTREAM_PARSE}{1}
+    const char *servers = strchr(spec, '=');
+    if (spec[0] != '/' || !servers)
+    {
+        return -1;
+    }
+    size_t prefix_len = servers - spec;
+    while (prefix_len > 0 && spec[prefix_len - 1] == '/')
+    {
+        prefix_len--;
+    }
+    group->prefix = strndup(spec, prefix_len);
+    if (!group->prefix)
+    {
+        return -1;
+    }
+
+    // {ref}{LOGIC}{UPSTREAM_PARSE}{2}
+    const char *p = servers + 1;
+    while (*p)
+    {
+        size_t len = strcspn(p, ",");
+        char host[256];
+        const char *colon = memchr(p, ':', len);
+        if (!colon || colon == p || (size_t)(colon - p) >= sizeof(host) || group->server_count == UPSTREAM_MAX_SERVERS)
+        {
+            return -1;
+        }
+        memcpy(host, p, colon - p);
+        host[colon - p] = '\0';
+        char port[8];
+        size_t port_len = len - (colon - p) - 1;
+        if (port_len == 0 || port_len >= sizeof(port))
+        {
+            return -1;
+        }
+        memcpy(port, colon + 1, port_len);
+        port[port_len] = '\0';
+
+        struct addrinfo hints = {0}, *result;
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host, port, &hints, &result) != 0)
+        {
+            return -1;
+        }
+        UpstreamServer *server = &group->servers[group->server_count++];
+        memcpy(&server->addr, result->ai_addr, sizeof(server->addr));
+        freeaddrinfo(result);
+        char address[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &server->addr.sin_addr, address, sizeof(address));
+        snprintf(server->name, sizeof(server->name), "%s:%u", address, ntohs(server->addr.sin_port));
+
+        p += len;
+        if (*p == ',')
+        {
+            p++;
+        }
+    }
+    return group->server_count > 0 ? 0 : -1;
+}
+
+/// @brief Sets up a worker's state for the servers of a group; every server starts out healthy
+void upstream_pool_init(UpstreamPool *pool, const UpstreamGroup *group)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->group = group;
+    for (int i = 0; i < group->server_count; i++)
+    {
+        pool->upstreams[i].server = &group->servers[i];
+        pool->upstreams[i].healthy = 1;
+        pool->upstreams[i].probe_fd = -1;
+    }
+}
+
+/// @brief Closes a worker's idle links and probes
+void upstream_pool_destroy(UpstreamPool *pool)
+{
+    for (int i = 0; i < pool->group->server_count; i++)
+    {
+        Upstream *upstream = &pool->upstreams[i];
+        while (upstream->idle_count > 0)
+        {
+            close_link(&upstream->idle[--upstream->idle_count]);
+        }
+        if (upstream->probe_fd != -1)
+        {
+            close(upstream->probe_fd);
+        }
+    }
+}
+
+/**
+ * @brief Picks the healthy server with the fewest outstanding requests
+ * @param excluded : Bit i set to skip server i, e.g. one a retried request already failed on
+ * @return The server, or NULL if none is healthy.
+ */
+Upstream *upstream_pick(UpstreamPool *pool, unsigned excluded)
+{
+    Upstream *best = NULL;
+    int count = pool->group->server_count;
+    for (int n = 0; n < count; n++)
+    {
+        int i = (pool->next + n) % count;
+        Upstream *upstream = &pool->upstreams[i];
+        if (!upstream->healthy || (excluded & (1u << i)))
+        {
+            continue;
+        }
+        if (!best || upstream->outstanding < best->outstanding)
+        {
+            best = upstream;
+        }
+    }
+    pool->next = (pool->next + 1) % count;
+    return best;
+}
+
+/**
+ * @brief Takes a link to a server: a pooled one if one is still open, otherwise a new one
+ * @details [LOGIC][UPSTREAM_ACQUIRE]
+ * 1. Pop pooled links, most recent first. A link whose server closed it reads as end of file (or has
+ *      unexpected data) instead of EAGAIN, and is dropped.
+ * 2. Otherwise open a non-blocking socket with Nagle off, since request heads are small writes, and a
+ *      non-blocking pipe, and start connecting. The connection may still be in progress on return;
+ *      the first write reports EAGAIN until it is up, or the connect error.
+ * @return 1 if a pooled link was reused, 0 if a new one was opened, -1 on failure.
+ */
+int upstream_acquire(Upstream *upstream, UpstreamLink *link)
+{
+    // {ref}{LOGIC}{UPSTREAM_ACQUIRE}{1}
+    while (upstream->idle_count > 0)
+    {
+        *link = upstream->idle[--upstream->idle_count];
+        char byte;
+        if (recv(link->fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return 1;
+        }
+        close_link(link);
+    }
+
+    // {ref}{LOGIC}{UPSTREAM_ACQUIRE}{2}
+    link->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (link->fd == -1)
+    {
+        return -1;
+    }
+    if (pipe2(link->pipe, O_NONBLOCK | O_CLOEXEC) == -1)
+    {
+        close(link->fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(link->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(link->fd, (const struct sockaddr *)&upstream->server->addr, sizeof(upstream->server->addr)) == -1 &&
+        errno != EINPROGRESS)
+    {
+        close_link(link);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Gives a link back after a request
+ * @param reusable : Non-zero if the response ended cleanly, the server keeps the connection open and the
+ *      pipe is empty; such a link is pooled unless the pool is full. Other links are closed.
+ */
+void upstream_release(Upstream *upstream, UpstreamLink *link, int reusable, uint64_t now_ms)
+{
+    if (reusable && upstream->idle_count < UPSTREAM_POOL_SIZE)
+    {
+        link->idle_since = now_ms;
+        upstream->idle[upstream->idle_count++] = *link;
+        return;
+    }
+    close_link(link);
+}
+
+/// @brief Records the outcome of a request or probe; a success puts the server back into rotation
+void upstream_report(Upstream *upstream, int ok)
+{
+    if (ok)
+    {
+        upstream->failures = 0;
+        upstream->healthy = 1;
+    }
+    else if (++upstream->failures >= UPSTREAM_MAX_FAILS)
+    {
+        upstream->healthy = 0;
+    }
+}
+
+/**
+ * @brief Writes the probe request; returns -1 if the connection is not up (yet)
+ */
+static int send_probe(Upstream *upstream)
+{
+    char request[128];
+    int len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n",
+                       UPSTREAM_CHECK_PATH, upstream->server->name);
+    if (send(upstream->probe_fd, request, len, MSG_NOSIGNAL | MSG_DONTWAIT) != len)
+    {
+        return -1;
+    }
+    upstream->probe_sent = 1;
+    return 0;
+}
+
+/**
+ * @brief Runs the periodic maintenance of a worker's pool; called every UPSTREAM_CHECK_INTERVAL_MS
+ * @details [LOGIC][UPSTREAM_CHECK]
+ * 1. Close the links that stayed idle for UPSTREAM_IDLE_TIMEOUT_MS; they sit at the bottom of the pool.
+ * 2. Finish the probe started at the previous check. If its request went out, it must have been answered
+ *      with a status below 500 by now. If the connection was not up yet, write the request now and read the
+ *      answer at the next check; a probe that cannot even be written then has failed.
+ * 3. Start the next probe, and write its request right away if the connection is already up (loopback).
+ */
+void upstream_check(UpstreamPool *pool, uint64_t now_ms)
+{
+    for (int i = 0; i < pool->group->server_count; i++)
+    {
+        Upstream *upstream = &pool->upstreams[i];
+
+        // {ref}{LOGIC}{UPSTREAM_CHECK}{1}
+        int expired = 0;
+        while (expired < upstream->idle_count && now_ms - upstream->idle[expired].idle_since >= UPSTREAM_IDLE_TIMEOUT_MS)
+        {
+            close_link(&upstream->idle[expired++]);
+        }
+        upstream->idle_count -= expired;
+        memmove(upstream->idle, upstream->idle + expired, upstream->idle_count * sizeof(UpstreamLink));
+
+        // {ref}{LOGIC}{UPSTREAM_CHECK}{2}
+        if (upstream->probe_fd != -1)
+        {
+            if (!upstream->probe_sent)
+            {
+                if (send_probe(upstream) == 0)
+                {
+                    continue;
+                }
+                upstream_report(upstream, 0);
+            }
+            else
+            {
+                char status[12];
+                ssize_t len = recv(upstream->probe_fd, status, sizeof(status), MSG_DONTWAIT);
+                upstream_report(upstream, len == sizeof(status) && memcmp(status, "HTTP/1.", 7) == 0 &&
+                                              status[9] >= '1' && status[9] <= '4');
+            }
+            close(upstream->probe_fd);
+            upstream->probe_fd = -1;
+        }
+
+        // {ref}{LOGIC}{UPSTREAM_CHECK}{3}
+        upstream->probe_sent = 0;
+        upstream->probe_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (upstream->probe_fd == -1)
+        {
+            continue;
+        }
+        if (connect(upstream->probe_fd, (const struct sockaddr *)&upstream->server->addr,
+                    sizeof(upstream->server->addr)) == -1 &&
+            errno != EINPROGRESS)
+        {
+            upstream_report(upstream, 0);
+            close(upstream->probe_fd);
+            upstream->probe_fd = -1;
+            continue;
+        }
+        send_probe(upstream);
+    }
+}
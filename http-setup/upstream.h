@@ -0,0 +1,94 @@
+#ifndef UPSTREAM_H
+#define UPSTREAM_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#define UPSTREAM_MAX_SERVERS 16          ///< Servers one upstream group may list.
+#define UPSTREAM_NAME_SIZE 24            ///< Room for "255.255.255.255:65535".
+#define UPSTREAM_POOL_SIZE 32            ///< Idle keep-alive connections a worker keeps per server.
+#define UPSTREAM_IDLE_TIMEOUT_MS 4000    ///< Idle connections are closed before typical backends (5 s) do it.
+#define UPSTREAM_MAX_FAILS 2             ///< Consecutive failures that take a server out of rotation.
+#define UPSTREAM_CHECK_INTERVAL_MS 2000  ///< Time between two health probes of a server.
+#define UPSTREAM_CHECK_PATH "/health"    ///< Target of the health probe; any status below 500 counts as alive.
+
+/**
+ * @brief A backend server of an upstream group
+ * @param addr : IPv4 address and port to connect to
+ * @param name : "address:port", sent as Host by the health probe
+ */
+typedef struct
+{
+    struct sockaddr_in addr;
+    char name[UPSTREAM_NAME_SIZE];
+} UpstreamServer;
+
+/**
+ * @brief A path prefix forwarded to a set of backend servers; parsed before the workers start, then only read
+ * @param prefix : Path prefix without a trailing '/'; empty to forward every path
+ * @param servers, server_count : Servers requests are balanced over
+ */
+typedef struct
+{
+    char *prefix;
+    UpstreamServer servers[UPSTREAM_MAX_SERVERS];
+    int server_count;
+} UpstreamGroup;
+
+/**
+ * @brief A connection to a server together with the pipe bodies are spliced through
+ * @param fd : Non-blocking socket, registered with the worker's epoll instance for as long as it is open
+ * @param pipe : Read and write end of the pipe; empty whenever the link is idle
+ * @param idle_since : When the link was returned to the pool, on the timer clock
+ */
+typedef struct
+{
+    int fd;
+    int pipe[2];
+    uint64_t idle_since;
+} UpstreamLink;
+
+/**
+ * @brief One worker's state of a server
+ * @param server : The server, in the shared group
+ * @param idle, idle_count : Pooled keep-alive links, the most recently used last
+ * @param outstanding : Requests of this worker the server is handling now
+ * @param healthy : Zero once UPSTREAM_MAX_FAILS requests or probes failed in a row, until a probe succeeds
+ * @param failures : Consecutive failures
+ * @param probe_fd : Socket of the health probe in progress, -1 if none
+ * @param probe_sent : Set once the probe request has been written
+ */
+typedef struct
+{
+    const UpstreamServer *server;
+    UpstreamLink idle[UPSTREAM_POOL_SIZE];
+    int idle_count;
+    int outstanding;
+    int healthy;
+    int failures;
+    int probe_fd;
+    int probe_sent;
+} Upstream;
+
+/**
+ * @brief One worker's servers of an upstream group
+ * @param next : Server the next pick starts looking at, so ties rotate over the servers
+ */
+typedef struct
+{
+    const UpstreamGroup *group;
+    Upstream upstreams[UPSTREAM_MAX_SERVERS];
+    int next;
+} UpstreamPool;
+
+// Upstream functions
+int upstream_group_parse(UpstreamGroup *group, const char *spec);
+void upstream_pool_init(UpstreamPool *pool, const UpstreamGroup *group);
+void upstream_pool_destroy(UpstreamPool *pool);
+Upstream *upstream_pick(UpstreamPool *pool, unsigned excluded);
+int upstream_acquire(Upstream *upstream, UpstreamLink *link);
+void upstream_release(Upstream *upstream, UpstreamLink *link, int reusable, uint64_t now_ms);
+void upstream_report(Upstream *upstream, int ok);
+void upstream_check(UpstreamPool *pool, uint64_t now_ms);
+
+#endif // UPSTREAM_H
@@ -0,0 +1,348 @@
+/**
+ * @file: uring.c
+ *
+ * ℹ️ A minimal io_uring binding on the raw system calls, for the http-server event loop.
+ *
+ * 1. io_uring_setup() creates a submission and a completion ring shared with the kernel. Operations are
+ *      described in submission queue entries (SQEs); results come back as completion queue entries (CQEs).
+ * 2. Preparing an SQE is a plain memory write. Everything prepared during one pass of the event loop is
+ *      handed to the kernel with a single io_uring_enter(), which also waits for the next completions.
+ * 3. Received data lands in "provided buffers": a ring of buffers registered up front, from which the
+ *      kernel picks one per completion. A socket needs no buffer of its own while it waits for data.
+ * 4. The ring is created for a single thread (SINGLE_ISSUER) and completion work is only done when that
+ *      thread asks for events (DEFER_TASKRUN), so the kernel never interrupts the worker to post them.
+ *      Kernels without those flags get a plain ring.
+ */
+#define _GNU_SOURCE
+#include "uring.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg,
+                              size_t arg_size)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * @brief Create a ring and map its queues
+ * @param entries Size of the submission queue; the completion queue gets twice as many entries.
+ * @details [LOGIC][URING_INIT]
+ * 1. Ask for a single-issuer ring with deferred task work; fall back to a plain ring on older kernels.
+ * 2. Map the submission ring, the completion ring (one mapping when the kernel supports it) and the SQEs.
+ * 3. The submission ring indexes SQEs through an array; it is filled with the identity once, so the
+ *      SQE at position i of the ring is entry i.
+ * @return 0 on success, -1 with errno set.
+ */
+int uring_init(Uring *ring, unsigned entries)
+{
+    struct io_uring_params params;
+    memset(ring, 0, sizeof(*ring));
+
+    // {ref}{LOGIC}{URING_INIT}{1}
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    ring->fd = sys_io_uring_setup(entries, &params);
+    if (ring->fd == -1 && errno == EINVAL)
+    {
+        memset(&params, 0, sizeof(params));
+        ring->fd = sys_io_uring_setup(entries, &params);
+    }
+    if (ring->fd == -1)
+    {
+        return -1;
+    }
+
+    // {ref}{LOGIC}{URING_INIT}{2}
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cq_map_size > ring->sq_map_size)
+        {
+            ring->sq_map_size = ring->cq_map_size;
+        }
+        ring->cq_map_size = 0;
+    }
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                        IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED)
+    {
+        ring->sq_map = NULL;
+        uring_destroy(ring);
+        return -1;
+    }
+    ring->cq_map = ring->sq_map;
+    if (ring->cq_map_size)
+    {
+        ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                            IORING_OFF_CQ_RING);
+        if (ring->cq_map == MAP_FAILED)
+        {
+            ring->cq_map = NULL;
+            uring_destroy(ring);
+            return -1;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                      IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = NULL;
+        uring_destroy(ring);
+        return -1;
+    }
+
+    char *sq = ring->sq_map;
+    char *cq = ring->cq_map;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->sq_entries = params.sq_entries;
+    ring->sqe_tail = *ring->sq_tail;
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    // {ref}{LOGIC}{URING_INIT}{3}
+    for (unsigned i = 0; i < ring->sq_entries; i++)
+    {
+        ring->sq_array[i] = i;
+    }
+    return 0;
+}
+
+/// @brief Unmap the queues and buffers and close the ring
+void uring_destroy(Uring *ring)
+{
+    if (ring->buf_ring)
+    {
+        munmap(ring->buf_ring, ring->buf_ring_size);
+    }
+    free(ring->buffers);
+    if (ring->sqes)
+    {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_map && ring->cq_map != ring->sq_map)
+    {
+        munmap(ring->cq_map, ring->cq_map_size);
+    }
+    if (ring->sq_map)
+    {
+        munmap(ring->sq_map, ring->sq_map_size);
+    }
+    if (ring->fd >= 0)
+    {
+        close(ring->fd);
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+/**
+ * @brief Register a ring of provided receive buffers as buffer group URING_BUFFER_GROUP
+ * @param count Number of buffers, a power of two.
+ * @param size Size of each buffer; a receive completes with at most this many bytes.
+ * @return 0 on success, -1 with errno set.
+ */
+int uring_setup_buffers(Uring *ring, unsigned count, size_t size)
+{
+    ring->buf_ring_size = count * sizeof(struct io_uring_buf);
+    ring->buf_ring = mmap(NULL, ring->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->buf_ring == MAP_FAILED)
+    {
+        ring->buf_ring = NULL;
+        return -1;
+    }
+    ring->buffers = malloc(count * size);
+    if (!ring->buffers)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    ring->buf_count = count;
+    ring->buf_size = size;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)ring->buf_ring;
+    reg.ring_entries = count;
+    reg.bgid = URING_BUFFER_GROUP;
+    if (sys_io_uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1)
+    {
+        return -1;
+    }
+    for (unsigned id = 0; id < count; id++)
+    {
+        uring_recycle_buffer(ring, id);
+    }
+    return 0;
+}
+
+/// @brief Memory of a provided buffer, by the id a completion reported
+char *uring_buffer(Uring *ring, unsigned id)
+{
+    return ring->buffers + (size_t)id * ring->buf_size;
+}
+
+/// @brief Hand a provided buffer back to the kernel once its data has been consumed
+void uring_recycle_buffer(Uring *ring, unsigned id)
+{
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[ring->buf_tail & (ring->buf_count - 1)];
+    buf->addr = (unsigned long)uring_buffer(ring, id);
+    buf->len = ring->buf_size;
+    buf->bid = id;
+    ring->buf_tail++;
+    __atomic_store_n(&ring->buf_ring->tail, ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+/// @brief Publish the prepared SQEs and tell the kernel about them, optionally waiting for completions
+static int enter(Uring *ring, unsigned min_complete, void *arg, size_t arg_size, unsigned flags)
+{
+    unsigned to_submit = ring->sqe_tail - *ring->sq_tail;
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+    return sys_io_uring_enter(ring->fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+/// @brief Number of SQEs that can be prepared before the submission queue is full
+unsigned uring_sq_space(Uring *ring)
+{
+    return ring->sq_entries - (ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE));
+}
+
+/// @brief Submit the prepared SQEs without waiting
+int uring_submit(Uring *ring)
+{
+    return enter(ring, 0, NULL, 0, 0);
+}
+
+/**
+ * @brief Get a zeroed SQE to prepare
+ * @attention When the submission queue is full, the prepared entries are submitted first.
+ * @return The entry, or NULL if the queue is still full.
+ */
+struct io_uring_sqe *uring_get_sqe(Uring *ring)
+{
+    if (uring_sq_space(ring) == 0)
+    {
+        uring_submit(ring);
+        if (uring_sq_space(ring) == 0)
+        {
+            return NULL;
+        }
+    }
+    struct io_uring_sqe *sqe = &ring->sqes[ring->sqe_tail & *ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sqe_tail++;
+    return sqe;
+}
+
+/**
+ * @brief Submit everything prepared and wait for at least one completion
+ * @param timeout_ms Longest wait, -1 for none. The wait is skipped while completions are pending.
+ * @return 0 on success (also when the timeout expired), -1 with errno set.
+ */
+int uring_submit_and_wait(Uring *ring, int timeout_ms)
+{
+    struct __kernel_timespec ts = {.tv_sec = timeout_ms / 1000, .tv_nsec = (timeout_ms % 1000) * 1000000L};
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = timeout_ms >= 0 ? (unsigned long)&ts : 0;
+
+    unsigned ready = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) - *ring->cq_head;
+    unsigned wait = ready || timeout_ms == 0 ? 0 : 1;
+    if (enter(ring, wait, &arg, sizeof(arg), IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG) == -1 &&
+        errno != ETIME && errno != EINTR)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/// @brief The oldest unconsumed completion, or NULL
+struct io_uring_cqe *uring_peek_cqe(Uring *ring)
+{
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        return NULL;
+    }
+    return &ring->cqes[head & *ring->cq_mask];
+}
+
+/// @brief Mark the completion returned by uring_peek_cqe() as consumed
+void uring_cqe_seen(Uring *ring)
+{
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/// @brief One accept that keeps completing with a new non-blocking connection until it is cancelled
+void uring_prep_accept_multishot(struct io_uring_sqe *sqe, int fd)
+{
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+}
+
+/// @brief One recv that completes with each arrival of data, placed in a provided buffer
+void uring_prep_recv_multishot(struct io_uring_sqe *sqe, int fd)
+{
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+}
+
+/// @brief A sendmsg; 'msg' and its iovecs must stay valid until the operation completes
+void uring_prep_sendmsg(struct io_uring_sqe *sqe, int fd, const struct msghdr *msg, unsigned flags)
+{
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)msg;
+    sqe->len = 1;
+    sqe->msg_flags = flags;
+}
+
+/// @brief A one-shot poll for 'events' (POLLIN, POLLOUT, ...)
+void uring_prep_poll(struct io_uring_sqe *sqe, int fd, unsigned events)
+{
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+}
+
+/// @brief Cancel the operation submitted with 'user_data'
+void uring_prep_cancel(struct io_uring_sqe *sqe, unsigned long long user_data)
+{
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+}
+
+/// @brief Cancel every operation in flight on a file descriptor
+void uring_prep_cancel_fd(struct io_uring_sqe *sqe, int fd)
+{
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+}
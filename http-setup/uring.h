@@ -0,0 +1,67 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+
+#define URING_BUFFER_GROUP 0 ///< Buffer group id of the provided receive buffers.
+
+/**
+ * @brief An io_uring instance driven through the raw system calls
+ * @param fd : The ring's file descriptor
+ * @param sq_head, sq_tail, sq_mask, sq_array : Submission queue ring, shared with the kernel
+ * @param sqes : Submission queue entries
+ * @param sq_entries : Number of submission queue entries
+ * @param sqe_tail : Tail including entries prepared but not yet published to the kernel
+ * @param cq_head, cq_tail, cq_mask, cqes : Completion queue ring, shared with the kernel
+ * @param buf_ring : Ring of provided receive buffers the kernel picks from
+ * @param buffers : Memory of the provided buffers, buf_count buffers of buf_size bytes
+ */
+typedef struct
+{
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sq_entries;
+    unsigned sqe_tail;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map;
+    size_t cq_map_size;
+    size_t sqes_size;
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    char *buffers;
+    unsigned buf_count;
+    size_t buf_size;
+    unsigned short buf_tail;
+} Uring;
+
+// io_uring functions
+int uring_init(Uring *ring, unsigned entries);
+void uring_destroy(Uring *ring);
+int uring_setup_buffers(Uring *ring, unsigned count, size_t size);
+char *uring_buffer(Uring *ring, unsigned id);
+void uring_recycle_buffer(Uring *ring, unsigned id);
+unsigned uring_sq_space(Uring *ring);
+int uring_submit(Uring *ring);
+struct io_uring_sqe *uring_get_sqe(Uring *ring);
+int uring_submit_and_wait(Uring *ring, int timeout_ms);
+struct io_uring_cqe *uring_peek_cqe(Uring *ring);
+void uring_cqe_seen(Uring *ring);
+void uring_prep_accept_multishot(struct io_uring_sqe *sqe, int fd);
+void uring_prep_recv_multishot(struct io_uring_sqe *sqe, int fd);
+void uring_prep_sendmsg(struct io_uring_sqe *sqe, int fd, const struct msghdr *msg, unsigned flags);
+void uring_prep_poll(struct io_uring_sqe *sqe, int fd, unsigned events);
+void uring_prep_cancel(struct io_uring_sqe *sqe, unsigned long long user_data);
+void uring_prep_cancel_fd(struct io_uring_sqe *sqe, int fd);
+
+#endif // URING_H
@@ -22,6 +22,9 @@
  *      about read events coming from the client.
  * 7. The program keeps track of time using time() and collects and sends
  *      system information to all connected clients every 5 seconds.
+ * 8. Disconnected clients are removed, and a client that stops reading is closed once its message
+ *      has been stuck for WRITE_STALL_TIMEOUT_MS, using the timer wheel of http-setup, so dead
+ *      clients cannot hold the MAX_CLIENTS slots forever.
  * 
  */
 #include <stdio.h>
@@ -36,11 +39,14 @@
 #include <time.h>
 #include <sys/sysinfo.h>
 #include <sys/utsname.h>
+#include "../http-setup/timer-wheel.h"
 
 #define MAX_CLIENTS 10 ///< Maximum number of clients allowed.
 #define PORT 8080 ///< port 8080 will be sued to run the server.
 #define MESSAGE_INTERVAL 5 ///< 5 Seconds is the message interval.
 #define BUFFER_SIZE 1024 ///< Buffer limit for data to be sent.
+#define TIMER_TICK_MS 100 ///< Resolution of the client timeouts.
+#define WRITE_STALL_TIMEOUT_MS 30000 ///< Time a message may wait without the client accepting any of it.
 
 
 /**
@@ -48,16 +54,22 @@
  * @param socket_fd : File Descriptor associated with the client
  * @param outgoing_data : The data being sent to the client
  * @param data_ready : state to track changes to data
+ * @param sent : bytes of outgoing_data already sent; non-zero while a message is partly sent
+ * @param stall_timer : closes the client if a partly sent message does not move on
  */
 typedef struct
 {
     int socket_fd;
     char outgoing_data[BUFFER_SIZE];
     int data_ready;
+    size_t sent;
+    TimerNode stall_timer;
 } ClientInfo;
 
 /// @brief Array of clients with ClientInfo structure, allowing a maximum of MAX_CLIENTS = 10 clients.
 ClientInfo clients[MAX_CLIENTS];
+/// @brief Timer wheel for the client timeouts.
+TimerWheel timers;
 
 /**
  * @brief Function to initialize the clients array
@@ -96,6 +108,7 @@ int add_client(int new_socket_fd)
         {
             clients[i].socket_fd = new_socket_fd;
             clients[i].data_ready = 0;
+            clients[i].sent = 0;
             return i;
         }
     }
@@ -103,6 +116,55 @@ int add_client(int new_socket_fd)
     return -1;
 }
 
+/**
+ * @brief Function to remove a client and free its slot
+ * @param epoll_fd: File descriptor corresponding to epoll instance
+ * @param client: The client to remove
+ * @details [LOGIC][CLIENT_REMOVAL]
+ * 1. Remove the socket from the epoll instance and close it.
+ * 2. Stop the client's stall timer.
+ * 3. Mark the slot as available again with socket_fd = -1.
+ */
+void remove_client(int epoll_fd, ClientInfo *client)
+{
+    // @ref {LOGIC}{CLIENT_REMOVAL}{1}
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->socket_fd, NULL);
+    close(client->socket_fd);
+    // @ref {LOGIC}{CLIENT_REMOVAL}{2,3}
+    timer_wheel_cancel(&timers, &client->stall_timer);
+    client->socket_fd = -1;
+    client->data_ready = 0;
+    client->sent = 0;
+}
+
+/**
+ * @brief Function to find the client that owns a File Descriptor
+ * @return The client, or NULL if no client uses socket_fd.
+ */
+ClientInfo *find_client(int socket_fd)
+{
+    for (int i = 0; i < MAX_CLIENTS; i++)
+    {
+        if (clients[i].socket_fd == socket_fd)
+        {
+            return &clients[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Timer wheel callback for a client that has not accepted any data for WRITE_STALL_TIMEOUT_MS
+ * @param timer: The client's stall timer
+ * @param arg: Pointer to the epoll File Descriptor
+ */
+void on_client_stall(TimerNode *timer, void *arg)
+{
+    ClientInfo *client = timer->data;
+    printf("Client FD %d stopped reading, closing\n", client->socket_fd);
+    remove_client(*(int *)arg, client);
+}
+
 /**
  * @brief Helper function to to set a socket to non-blocking mode. 
  * @param socket_fd: File Descriptor of corresponding socket
@@ -188,7 +250,7 @@ void get_top_cpu_processes(char *log_data, size_t buffer_size) {
  * 2. Information is extracted via pointers uts_info and sys_info.
  * 3. CPU usgae information is extracted and logged via get_top_cpu_processes().
  * 4. For each client item in clients array, having valid File Descriptor:
- *      i. attach logged data.
+ *      i. attach logged data, unless the client is still in the middle of sending the previous message.
  *      ii. mark the item with data_ready state as true.
  */
 char log_system_info(struct utsname *uts_info, struct sysinfo *sys_info)
@@ -221,7 +283,7 @@ char log_system_info(struct utsname *uts_info, struct sysinfo *sys_info)
     // @ref {LOGIC}{LOG_PREPARE_DATA}{4}
     for (int i = 0; i < MAX_CLIENTS; i++)
     {
-        if (clients[i].socket_fd != -1)
+        if (clients[i].socket_fd != -1 && clients[i].sent == 0)
         {
             strncpy(clients[i].outgoing_data, log_data, BUFFER_SIZE);
             clients[i].data_ready = 1;
@@ -235,8 +297,11 @@ char log_system_info(struct utsname *uts_info, struct sysinfo *sys_info)
  * 
  * @details [LOGIC][SEND_DATA]
  * 1. Check whether the client is in a data ready state
- * 2. use send() sys call by providing client's socket File Descriptor and attached data.
- * 3. reset the data_ready flag
+ * 2. use send() sys call by providing client's socket File Descriptor and the part of the attached data
+ *      not sent yet. MSG_NOSIGNAL turns a send to a closed client into an error instead of SIGPIPE.
+ * 3. reset the data_ready flag and stop the stall timer once the whole message is sent
+ * 4. If the socket buffer is full, the rest goes out on EPOLLOUT. Arm the stall timer, restarting it
+ *      whenever the client accepted some bytes.
  */
 
 void send_data_to_client(ClientInfo *client)
@@ -245,13 +310,25 @@ void send_data_to_client(ClientInfo *client)
     if (client->data_ready)
     {
         // @ref {LOGIC}{SEND_DATA}{2}
-        int sent_bytes = send(client->socket_fd, client->outgoing_data, strlen(client->outgoing_data), 0);
+        size_t length = strlen(client->outgoing_data);
+        int sent_bytes = send(client->socket_fd, client->outgoing_data + client->sent, length - client->sent, MSG_NOSIGNAL);
         if (sent_bytes > 0)
+        {
+            client->sent += sent_bytes;
+        }
+        if (client->sent == length)
         {
             // @ref {LOGIC}{SEND_DATA}{3}
             client->data_ready = 0; // Reset once the data is sent
+            client->sent = 0;
+            timer_wheel_cancel(&timers, &client->stall_timer);
+        }
+        else if (sent_bytes > 0 || (errno == EAGAIN && !timer_pending(&client->stall_timer)))
+        {
+            // @ref {LOGIC}{SEND_DATA}{4}
+            timer_wheel_schedule(&timers, &client->stall_timer, WRITE_STALL_TIMEOUT_MS);
         }
-        else if (sent_bytes == -1 && errno != EAGAIN)
+        else if (errno != EAGAIN)
         {
             perror("Failed to send data to client");
         }
@@ -298,8 +375,9 @@ void create_epoll(int *epoll_fd, int server_fd, struct epoll_event *ev)
  * @details [LOGIC][HANDLE_CONNECTION] 
  * 1. Use accept() system call to accept client connection
  * 2. Make the socket corresponding to new connection as non-blocking
- * 3. Add the client socket to epoll instance' to get notified about events
- * 4. Add the client in the clients array
+ * 3. Add the client in the clients array; if all MAX_CLIENTS slots are taken, close the connection
+ * 4. Add the client socket to epoll instance' to get notified about events: EPOLLIN reports a
+ *      disconnect, EPOLLOUT that a partly sent message can continue
  */
 void handle_new_connection(int epoll_fd, int server_fd, struct epoll_event *ev)
 {
@@ -331,22 +409,78 @@ void handle_new_connection(int epoll_fd, int server_fd, struct epoll_event *ev)
             continue;
         }
 
+        int client_idx = add_client(client_fd);
+        if (client_idx == -1)
+        {
+            printf("No free client slot, closing FD %d\n", client_fd);
+            close(client_fd);
+            continue;
+        }
+        timer_init(&clients[client_idx].stall_timer, on_client_stall, &clients[client_idx]);
+
         // Add the new client socket to epoll
-        ev->events = EPOLLIN | EPOLLET; // Edge-triggered mode
+        ev->events = EPOLLIN | EPOLLOUT | EPOLLET; // Edge-triggered mode
         ev->data.fd = client_fd;
 
         if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, ev) == -1)
         {
             perror("epoll_ctl: client_fd");
-            close(client_fd);
+            remove_client(epoll_fd, &clients[client_idx]);
             continue;
         }
-
-        int client_idx = add_client(client_fd);
         printf("Accepted new connection: FD %d\n", client_fd);
     }
 }
 
+/**
+ * @brief This function handles events on a connected client
+ * @param epoll_fd File descriptor corresponding to epoll instance
+ * @param client The client the event belongs to
+ * @param events The epoll events reported for it
+ * @details [LOGIC][HANDLE_CLIENT_EVENT]
+ * 1. The clients only receive, so anything they send is read and discarded until EAGAIN.
+ *      A read of 0 bytes, a read error or EPOLLHUP/EPOLLERR means the client is gone: free its slot.
+ * 2. On EPOLLOUT, continue a message that did not fit into the socket buffer.
+ */
+void handle_client_event(int epoll_fd, ClientInfo *client, uint32_t events)
+{
+    // @ref {LOGIC}{HANDLE_CLIENT_EVENT}{1}
+    if (events & (EPOLLHUP | EPOLLERR))
+    {
+        printf("Client disconnected: FD %d\n", client->socket_fd);
+        remove_client(epoll_fd, client);
+        return;
+    }
+    if (events & EPOLLIN)
+    {
+        char discard[BUFFER_SIZE];
+        while (1)
+        {
+            ssize_t bytes_read = recv(client->socket_fd, discard, sizeof(discard), 0);
+            if (bytes_read > 0)
+            {
+                continue;
+            }
+            if (bytes_read == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            if (bytes_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                break;
+            }
+            printf("Client disconnected: FD %d\n", client->socket_fd);
+            remove_client(epoll_fd, client);
+            return;
+        }
+    }
+    // @ref {LOGIC}{HANDLE_CLIENT_EVENT}{2}
+    if ((events & EPOLLOUT) && client->sent > 0)
+    {
+        send_data_to_client(client);
+    }
+}
+
 /// @brief The main function of the program
 /// @return 0 if everything runs successfully.
 int main()
@@ -390,6 +524,7 @@ int main()
     }
 
     create_epoll(&epoll_fd, server_fd, &ev);
+    timer_wheel_init(&timers, TIMER_TICK_MS);
 
     time_t last_message_time = time(NULL);
 
@@ -410,13 +545,20 @@ int main()
             ;
         }
         log_system_info(&sys_info, &info);
-        event_count = epoll_wait(epoll_fd, events, MAX_CLIENTS, 1000); // Timeout of 1000 ms
+        // Timeout of 1000 ms, or less if a client timer is due earlier
+        int timeout = timer_wheel_next_timeout(&timers);
+        if (timeout == -1 || timeout > 1000)
+        {
+            timeout = 1000;
+        }
+        event_count = epoll_wait(epoll_fd, events, MAX_CLIENTS, timeout);
 
         if (event_count == -1)
         {
             perror("epoll_wait");
             exit(EXIT_FAILURE);
         }
+        timer_wheel_advance(&timers, timer_now_ms(), &epoll_fd);
         printf("Event Count : %d\n", event_count);
         for (int i = 0; i < event_count; i++)
         {
@@ -425,6 +567,14 @@ int main()
                 // Handle new incoming connection
                 handle_new_connection(epoll_fd, server_fd, &ev);
             }
+            else
+            {
+                ClientInfo *client = find_client(events[i].data.fd);
+                if (client)
+                {
+                    handle_client_event(epoll_fd, client, events[i].events);
+                }
+            }
         }
         time_t current_time = time(NULL);
         if (difftime(current_time, last_message_time) >= MESSAGE_INTERVAL)